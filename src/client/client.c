@@ -10,9 +10,11 @@
 #include <signal.h>
 #include <termios.h>
 #include <errno.h>
+#include <sys/stat.h>
 #include "../common/structures.h"
 #include "../common/constants.h"
 #include "ui.h"
+#include "net.h"
 
 // Global variables
 int client_socket = -1;
@@ -25,6 +27,10 @@ int authenticate_user();
 void handle_admin_operations();
 void handle_student_operations();
 void handle_faculty_operations();
+void handle_admin_diagnostics();
+void handle_admin_data_transfer();
+int import_csv_file(const char *table, const char *path, char *response, size_t size);
+int export_table_file(const char *table, const char *format, const char *path, char *response, size_t size);
 void send_request(const char *request);
 int receive_response(char *buffer, size_t size);
 void cleanup();
@@ -33,12 +39,12 @@ void disable_echo();
 void enable_echo();
 
 int main(int argc, char *argv[]) {
-    char server_ip[16] = DEFAULT_SERVER_IP;
+    char server_ip[108] = DEFAULT_SERVER_IP;   // an IPv4 address or a local socket path
     int port = DEFAULT_PORT;
     
     // Parse command line arguments
     if (argc > 1) {
-        strncpy(server_ip, argv[1], 15);
+        strncpy(server_ip, argv[1], sizeof(server_ip) - 1);
     }
     if (argc > 2) {
         port = atoi(argv[2]);
@@ -78,31 +84,9 @@ int main(int argc, char *argv[]) {
 }
 
 int connect_to_server(const char *server_ip, int port) {
-    struct sockaddr_in server_addr;
-    
-    // Create socket using system call
-    client_socket = socket(AF_INET, SOCK_STREAM, 0);
+    client_socket = net_connect(server_ip, port);
     if (client_socket < 0) {
-        perror("Socket creation failed");
-        return -1;
-    }
-    
-    // Set up server address
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(port);
-    
-    // Convert IP address
-    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
-        perror("Invalid address");
-        close(client_socket);
-        return -1;
-    }
-    
-    // Connect to server
-    if (connect(client_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        perror("Connection failed");
-        close(client_socket);
+        perror(errno == EINVAL ? "Invalid address" : "Connection failed");
         return -1;
     }
     
@@ -435,7 +419,17 @@ void handle_admin_operations() {
                 break;
         case 5:
 {
-    char request[64] = "VIEW_STUDENTS:all"; // Add "all" as a parameter
+    char request[128] = "VIEW_STUDENTS:all"; // Add "all" as a parameter
+    ssize_t n;
+    
+    // Search text matches usernames, names and emails; ":2" asks for the second page
+    printf("Search text[:page] (Enter for all students): ");
+    fflush(stdout);
+    n = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
+    if (n > 1) {
+        buffer[n - 1] = '\0'; // Remove newline
+        snprintf(request, sizeof(request), "SEARCH_STUDENTS:%.100s", buffer);
+    }
     send_request(request);
     
     receive_response(buffer, sizeof(buffer));
@@ -454,7 +448,25 @@ break;
 // Also fix the VIEW_FACULTY case
 case 6:
 {
-    char request[64] = "VIEW_FACULTY:all"; // Add "all" as a parameter
+    char request[128] = "VIEW_FACULTY:all"; // Add "all" as a parameter
+    ssize_t n;
+    
+    printf("Search text[:page] (Enter to list by department): ");
+    fflush(stdout);
+    n = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
+    if (n > 1) {
+        buffer[n - 1] = '\0'; // Remove newline
+        snprintf(request, sizeof(request), "SEARCH_FACULTY:%.100s", buffer);
+    } else {
+        // A department narrows the list to its faculty and their courses
+        printf("Department (Enter for all faculty, 'all' for the department list): ");
+        fflush(stdout);
+        n = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
+        if (n > 1) {
+            buffer[n - 1] = '\0'; // Remove newline
+            snprintf(request, sizeof(request), "VIEW_DEPARTMENT:%.100s", buffer);
+        }
+    }
     send_request(request);
     
     receive_response(buffer, sizeof(buffer));
@@ -469,7 +481,15 @@ case 6:
     }
 }
 break;
-            case 7: // Exit
+            case 7: // System diagnostics
+                handle_admin_diagnostics();
+                break;
+
+            case 8: // Bulk data transfer
+                handle_admin_data_transfer();
+                break;
+
+            case 9: // Exit
                 printf("Logging out...\n");
                 send_request("LOGOUT");
                 return;
@@ -483,6 +503,303 @@ break;
         read(STDIN_FILENO, buffer, sizeof(buffer));
     }
 }
+
+void handle_admin_diagnostics() {
+    int choice = 0;
+    char buffer[1024];
+    char request[256];
+
+    printf("\nSystem Diagnostics:\n");
+    printf("1. Lock contention report\n");
+    printf("2. Reset lock statistics\n");
+    printf("3. Dump request trace\n");
+    printf("4. Set slow request threshold\n");
+    printf("5. Enrollment queue report\n");
+    printf("6. Replication status\n");
+    printf("7. Request memory report\n");
+    printf("8. Connection pool report\n");
+    printf("9. Duplicate-check filter report\n");
+    printf("Choice: ");
+    fflush(stdout);
+    if (read(STDIN_FILENO, buffer, sizeof(buffer)) > 0) {
+        choice = atoi(buffer);
+    }
+
+    switch (choice) {
+        case 1: // Lock contention report
+            {
+                int top_n = 10;
+                printf("Number of sites to show [10]: ");
+                fflush(stdout);
+                if (read(STDIN_FILENO, buffer, sizeof(buffer)) > 0 && atoi(buffer) > 0) {
+                    top_n = atoi(buffer);
+                }
+                snprintf(request, sizeof(request), "LOCK_STATS:%d", top_n);
+            }
+            break;
+
+        case 2: // Reset lock statistics
+            snprintf(request, sizeof(request), "LOCK_STATS:reset");
+            break;
+
+        case 3: // Dump request trace
+            snprintf(request, sizeof(request), "TRACE_DUMP:now");
+            break;
+
+        case 4: // Slow request threshold
+            printf("Threshold in ms (or 'off'): ");
+            fflush(stdout);
+            {
+                int n = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
+                if (n <= 0) {
+                    return;
+                }
+                buffer[n] = '\0';
+                buffer[strcspn(buffer, "\n")] = '\0';
+            }
+            snprintf(request, sizeof(request), "SLOW_LOG:%.32s", buffer);
+            break;
+
+        case 5: // Enrollment queue report
+            snprintf(request, sizeof(request), "ADMISSION_STATS:10");
+            break;
+
+        case 6: // Replication role, position and lag
+            snprintf(request, sizeof(request), "REPLICATION_STATUS:all");
+            break;
+
+        case 7: // Per-request arena high-water marks
+            snprintf(request, sizeof(request), "ARENA_STATS:show");
+            break;
+
+        case 8: // Pooled connection state
+            snprintf(request, sizeof(request), "CONNECTION_STATS:show");
+            break;
+
+        case 9: // Bloom filters over unique names
+            snprintf(request, sizeof(request), "FILTER_STATS:show");
+            break;
+
+        default:
+            printf("Invalid choice.\n");
+            return;
+    }
+
+    send_request(request);
+    receive_response(buffer, sizeof(buffer));
+    if (strncmp(buffer, "SUCCESS:", 8) == 0) {
+        printf("\n%s\n", buffer + 8);
+    } else {
+        printf("Error: %s\n", buffer);
+    }
+}
+
+// Stream a local CSV file to the server's IMPORT command
+int import_csv_file(const char *table, const char *path, char *response, size_t size) {
+    char request[256];
+    char chunk[65536];
+    struct stat st;
+    ssize_t n;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        snprintf(response, size, "ERROR:Cannot open %s: %s", path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    // The server answers READY before it reads the body
+    snprintf(request, sizeof(request), "IMPORT:%s:%ld", table, (long)st.st_size);
+    send_request(request);
+    if (receive_response(response, size) < 0 || strcmp(response, "READY") != 0) {
+        close(fd);
+        return -1;
+    }
+
+    while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+        ssize_t sent = 0;
+        while (sent < n) {
+            ssize_t w = write(client_socket, chunk + sent, n - sent);
+            if (w < 0) {
+                if (errno == EINTR) continue;
+                snprintf(response, size, "ERROR:Send failed: %s", strerror(errno));
+                close(fd);
+                return -1;
+            }
+            sent += w;
+        }
+    }
+    close(fd);
+
+    return receive_response(response, size);
+}
+
+static int read_exact(int sock, char *buffer, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(sock, buffer, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        buffer += n;
+        length -= n;
+    }
+    return 0;
+}
+
+int export_table_file(const char *table, const char *format, const char *path, char *response, size_t size) {
+    char request[256];
+    char header[9];
+    char chunk[65536];
+    int fd;
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        snprintf(response, size, "ERROR:Cannot create %s: %s", path, strerror(errno));
+        return -1;
+    }
+
+    // The body arrives as frames: 8 hex digits of length, then the payload; length 0 ends it
+    snprintf(request, sizeof(request), "EXPORT:%s:%s", table, format);
+    send_request(request);
+    while (1) {
+        long length;
+
+        if (read_exact(client_socket, header, 8) < 0) {
+            strcpy(response, "ERROR: Server closed connection");
+            close(fd);
+            return -1;
+        }
+        header[8] = '\0';
+        if (strncmp(header, "ERROR:", 6) == 0) {
+            // Rejected before any frame was sent
+            snprintf(response, size, "%s", header);
+            receive_response(response + 8, size - 8);
+            close(fd);
+            return -1;
+        }
+
+        length = strtol(header, NULL, 16);
+        if (length == 0) {
+            break;
+        }
+        while (length > 0) {
+            size_t want = length < (long)sizeof(chunk) ? (size_t)length : sizeof(chunk);
+            if (read_exact(client_socket, chunk, want) < 0 || write(fd, chunk, want) != (ssize_t)want) {
+                snprintf(response, size, "ERROR:Export to %s failed", path);
+                close(fd);
+                return -1;
+            }
+            length -= want;
+        }
+    }
+    close(fd);
+
+    return receive_response(response, size);
+}
+
+void handle_admin_data_transfer() {
+    int choice = 0;
+    char buffer[1024];
+    char table[16];
+    char format[8];
+    char path[256];
+    int n;
+
+    printf("\nData Import/Export:\n");
+    printf("1. Import CSV (students, faculty or courses)\n");
+    printf("2. Export table (CSV, JSON or raw records)\n");
+    printf("3. Snapshot all data files on the server\n");
+    printf("Choice: ");
+    fflush(stdout);
+    if (read(STDIN_FILENO, buffer, sizeof(buffer)) > 0) {
+        choice = atoi(buffer);
+    }
+
+    switch (choice) {
+        case 1: // Import CSV
+            printf("Table (students/faculty/courses): ");
+            fflush(stdout);
+            n = read(STDIN_FILENO, table, sizeof(table) - 1);
+            if (n <= 0) {
+                return;
+            }
+            table[n] = '\0';
+            table[strcspn(table, "\n")] = '\0';
+
+            printf("CSV file path: ");
+            fflush(stdout);
+            n = read(STDIN_FILENO, path, sizeof(path) - 1);
+            if (n <= 0) {
+                return;
+            }
+            path[n] = '\0';
+            path[strcspn(path, "\n")] = '\0';
+
+            import_csv_file(table, path, buffer, sizeof(buffer));
+            break;
+
+        case 2: // Export table
+            printf("Table (students/faculty/courses/enrollments/waitlists): ");
+            fflush(stdout);
+            n = read(STDIN_FILENO, table, sizeof(table) - 1);
+            if (n <= 0) {
+                return;
+            }
+            table[n] = '\0';
+            table[strcspn(table, "\n")] = '\0';
+
+            printf("Format (csv/json/raw): ");
+            fflush(stdout);
+            n = read(STDIN_FILENO, format, sizeof(format) - 1);
+            if (n <= 0) {
+                return;
+            }
+            format[n] = '\0';
+            format[strcspn(format, "\n")] = '\0';
+
+            printf("Output file path: ");
+            fflush(stdout);
+            n = read(STDIN_FILENO, path, sizeof(path) - 1);
+            if (n <= 0) {
+                return;
+            }
+            path[n] = '\0';
+            path[strcspn(path, "\n")] = '\0';
+
+            export_table_file(table, format, path, buffer, sizeof(buffer));
+            break;
+
+        case 3: // Point-in-time snapshot
+            printf("Snapshot name [now]: ");
+            fflush(stdout);
+            n = read(STDIN_FILENO, path, sizeof(path) - 1);
+            if (n <= 0) {
+                return;
+            }
+            path[n] = '\0';
+            path[strcspn(path, "\n")] = '\0';
+
+            snprintf(buffer, sizeof(buffer), "SNAPSHOT:%.64s", path[0] ? path : "now");
+            send_request(buffer);
+            receive_response(buffer, sizeof(buffer));
+            break;
+
+        default:
+            printf("Invalid choice.\n");
+            return;
+    }
+
+    if (strncmp(buffer, "SUCCESS:", 8) == 0) {
+        printf("\n%s\n", buffer + 8);
+    } else {
+        printf("Error: %s\n", buffer);
+    }
+}
+
 void handle_student_operations() {
     int choice;
     char buffer[1024];
@@ -499,14 +816,25 @@ void handle_student_operations() {
             case 1: // Enroll to new courses
                 {
                     int course_id=0;
-                    printf("Enter course ID to enroll: ");
+                    int n;
+                    printf("Enter course ID(s) to enroll (comma-separated for several): ");
                     fflush(stdout);
-                    if (read(STDIN_FILENO, buffer, sizeof(buffer)) > 0) {
+                    n = read(STDIN_FILENO, buffer, sizeof(buffer) - 1);
+                    if (n > 0) {
+                        buffer[n] = '\0';
+                        buffer[strcspn(buffer, "\n")] = '\0';
                         course_id = atoi(buffer);
+                    } else {
+                        buffer[0] = '\0';
                     }
                     
+                    // Several courses are enrolled together, all or none
                     char request[256];
-                    snprintf(request, sizeof(request), "ENROLL_COURSE:%d", course_id);
+                    if (strchr(buffer, ',')) {
+                        snprintf(request, sizeof(request), "ENROLL_COURSES:%.200s", buffer);
+                    } else {
+                        snprintf(request, sizeof(request), "ENROLL_COURSE:%d", course_id);
+                    }
                     send_request(request);
                     receive_response(buffer, sizeof(buffer));
                     printf("Server response: %s\n", buffer);
@@ -536,7 +864,24 @@ void handle_student_operations() {
                 printf("Enrolled courses:\n%s\n", buffer);
                 break;
                 
-            case 4: // Password change
+            case 4: // Join a full course's waitlist
+                {
+                    int course_id=0;
+                    printf("Enter course ID to waitlist: ");
+                    fflush(stdout);
+                    if (read(STDIN_FILENO, buffer, sizeof(buffer)) > 0) {
+                        course_id = atoi(buffer);
+                    }
+                    
+                    char request[256];
+                    snprintf(request, sizeof(request), "JOIN_WAITLIST:%d", course_id);
+                    send_request(request);
+                    receive_response(buffer, sizeof(buffer));
+                    printf("Server response: %s\n", buffer);
+                }
+                break;
+                
+            case 5: // Password change
                 {
                     char new_password[50];
                     printf("Enter new password: ");
@@ -557,7 +902,7 @@ void handle_student_operations() {
                 }
                 break;
                 
-            case 5: // Exit
+            case 6: // Exit
                 printf("Logging out...\n");
                 send_request("LOGOUT");
                 return;
@@ -680,21 +1025,17 @@ void handle_faculty_operations() {
 
 // Updated send_request function
 void send_request(const char *request) {
-    // Use write system call
-    ssize_t bytes_written = write(client_socket, request, strlen(request));
-    if (bytes_written < 0) {
+    if (net_send(client_socket, request) < 0) {
         perror("Failed to send request");
         printf("Error code: %d, Error message: %s\n", errno, strerror(errno));
     } else {
-        printf("Request sent successfully. Bytes written: %zd\n", bytes_written);
+        printf("Request sent successfully. Bytes written: %zu\n", strlen(request));
     }
 }
 
 // Updated receive_response function
 int receive_response(char *buffer, size_t size) {
-    memset(buffer, 0, size);
-    // Use read system call
-    ssize_t bytes_read = read(client_socket, buffer, size - 1);
+    int bytes_read = net_receive(client_socket, buffer, size);
     if (bytes_read < 0) {
         perror("Failed to receive response");
         printf("Error code: %d, Error message: %s\n", errno, strerror(errno));
@@ -705,8 +1046,7 @@ int receive_response(char *buffer, size_t size) {
         strcpy(buffer, "ERROR: Server closed connection");
         return -1;
     } else {
-        buffer[bytes_read] = '\0';
-        printf("Response received. Bytes read: %zd\n", bytes_read);
+        printf("Response received. Bytes read: %d\n", bytes_read);
         return 0;
     }
 }
@@ -0,0 +1,641 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include "../common/constants.h"
+#include "net.h"
+
+// Load generator for the Academia Portal server.
+// Sessions arrive open-loop (Poisson arrivals at a fixed rate) and are served by a pool
+// of worker threads, each playing one student, faculty or admin user at a time.
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB_BUCKETS)
+#define ARRIVAL_QUEUE_SIZE 65536
+#define WORKER_STACK_SIZE (256 * 1024)
+
+enum Command { CMD_LOGIN, CMD_ENROLL, CMD_UNENROLL, CMD_VIEW, CMD_LOGOUT, CMD_COUNT };
+enum Role { ROLE_STUDENT, ROLE_FACULTY, ROLE_ADMIN, ROLE_COUNT };
+
+static const char *command_names[CMD_COUNT] = { "login", "enroll", "unenroll", "view", "logout" };
+static const char *role_names[ROLE_COUNT] = { "student", "faculty", "admin" };
+
+// Latency histogram with 16 linear sub-buckets per power of two (microseconds)
+struct Histogram {
+    unsigned long counts[HIST_BUCKETS];
+    unsigned long total;
+    unsigned long errors;
+    unsigned long failures;
+    unsigned long long sum_us;
+    unsigned long long max_us;
+};
+
+struct Options {
+    char host[108];                 // IPv4 address or local socket path
+    int port;
+    int concurrency;
+    double rate;
+    int duration;
+    int ops_per_session;
+    double think_ms;
+    int mix[CMD_LOGOUT];
+    int role_weights[ROLE_COUNT];
+    char student_prefix[32];
+    int student_count;
+    char faculty_prefix[32];
+    int faculty_count;
+    int course_count;
+    char admin_user[50];
+    char admin_password[50];
+    char user_password[50];
+    int setup;
+};
+
+static struct Options options = {
+    .host = DEFAULT_SERVER_IP,
+    .port = DEFAULT_PORT,
+    .concurrency = 100,
+    .rate = 50.0,
+    .duration = 30,
+    .ops_per_session = 5,
+    .think_ms = 500.0,
+    .mix = { 5, 40, 20, 35 },
+    .role_weights = { 90, 8, 2 },
+    .student_prefix = "student",
+    .student_count = 1000,
+    .faculty_prefix = "faculty",
+    .faculty_count = 20,
+    .course_count = 50,
+    .admin_user = "admin",
+    .admin_password = "admin123",
+    .user_password = "default",
+    .setup = 0,
+};
+
+static struct Histogram histograms[ROLE_COUNT][CMD_COUNT];
+static struct Histogram start_delay;
+
+static double arrival_queue[ARRIVAL_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static int arrivals_done = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+
+static unsigned long sessions_started = 0;
+static unsigned long sessions_completed = 0;
+static unsigned long arrivals_dropped = 0;
+static volatile sig_atomic_t stop_now = 0;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_until(double when) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)when;
+    ts.tv_nsec = (long)((when - ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !stop_now) {
+    }
+}
+
+static double uniform(unsigned int *seed) {
+    return rand_r(seed) / ((double)RAND_MAX + 1.0);
+}
+
+static double exponential(unsigned int *seed, double mean) {
+    return -log(1.0 - uniform(seed)) * mean;
+}
+
+static int pick_weighted(unsigned int *seed, const int *weights, int count) {
+    int total = 0;
+    int choice;
+
+    for (int i = 0; i < count; i++) {
+        total += weights[i];
+    }
+    if (total <= 0) {
+        return 0;
+    }
+
+    choice = rand_r(seed) % total;
+    for (int i = 0; i < count; i++) {
+        if (choice < weights[i]) {
+            return i;
+        }
+        choice -= weights[i];
+    }
+    return count - 1;
+}
+
+static int bucket_of(unsigned long long value) {
+    int exponent;
+
+    if (value < HIST_SUB_BUCKETS) {
+        return (int)value;
+    }
+    exponent = 63 - __builtin_clzll(value);
+    return (exponent - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+           (int)((value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+}
+
+static unsigned long long value_of(int bucket) {
+    int exponent;
+
+    if (bucket < HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+    exponent = bucket / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+    return (unsigned long long)(HIST_SUB_BUCKETS + bucket % HIST_SUB_BUCKETS) << (exponent - HIST_SUB_BITS);
+}
+
+static void record_latency(struct Histogram *histogram, double seconds, int error, int failure) {
+    unsigned long long micros = (unsigned long long)(seconds * 1e6);
+    int bucket = bucket_of(micros);
+
+    if (bucket >= HIST_BUCKETS) {
+        bucket = HIST_BUCKETS - 1;
+    }
+    __sync_fetch_and_add(&histogram->counts[bucket], 1);
+    __sync_fetch_and_add(&histogram->total, 1);
+    __sync_fetch_and_add(&histogram->sum_us, micros);
+    if (error) {
+        __sync_fetch_and_add(&histogram->errors, 1);
+    }
+    if (failure) {
+        __sync_fetch_and_add(&histogram->failures, 1);
+    }
+
+    unsigned long long seen = histogram->max_us;
+    while (micros > seen && !__sync_bool_compare_and_swap(&histogram->max_us, seen, micros)) {
+        seen = histogram->max_us;
+    }
+}
+
+static double percentile_ms(struct Histogram *histogram, double fraction) {
+    unsigned long target = (unsigned long)ceil(histogram->total * fraction);
+    unsigned long seen = 0;
+
+    if (target == 0) {
+        target = 1;
+    }
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            return value_of(i) / 1000.0;
+        }
+    }
+    return histogram->max_us / 1000.0;
+}
+
+// Send one request and wait for its response, recording the round trip
+static int timed_request(int sock, const char *request, char *response, size_t size,
+                         struct Histogram *histogram) {
+    double start = now_seconds();
+    int result;
+
+    if (net_send(sock, request) < 0 || (result = net_receive(sock, response, size)) <= 0) {
+        record_latency(histogram, now_seconds() - start, 0, 1);
+        return -1;
+    }
+
+    record_latency(histogram, now_seconds() - start, strncmp(response, "ERROR", 5) == 0, 0);
+    return 0;
+}
+
+static int login(int role, const char *username, const char *password, struct Histogram *histogram) {
+    char request[256];
+    char response[BUFFER_SIZE];
+    double start = now_seconds();
+    int sock;
+
+    sock = net_connect(options.host, options.port);
+    if (sock < 0) {
+        record_latency(histogram, now_seconds() - start, 0, 1);
+        return -1;
+    }
+
+    snprintf(request, sizeof(request), "AUTH:%s:%s", username, password);
+    if (net_send(sock, request) < 0 || net_receive(sock, response, sizeof(response)) <= 0) {
+        record_latency(histogram, now_seconds() - start, 0, 1);
+        close(sock);
+        return -1;
+    }
+
+    if (strncmp(response, "SUCCESS", 7) != 0) {
+        record_latency(histogram, now_seconds() - start, 1, 0);
+        close(sock);
+        return -1;
+    }
+
+    record_latency(histogram, now_seconds() - start, 0, 0);
+    return sock;
+}
+
+static void logout(int sock, struct Histogram *histogram) {
+    char response[BUFFER_SIZE];
+
+    timed_request(sock, "LOGOUT", response, sizeof(response), histogram);
+    close(sock);
+}
+
+// Build the request a user of this role sends for a mix command.
+// Faculty and admins cannot enroll, so their non-login commands are all views.
+static int build_request(int role, int command, unsigned int *seed, char *request, size_t size) {
+    int course_id = 1 + rand_r(seed) % (options.course_count > 0 ? options.course_count : 1);
+
+    switch (role) {
+        case ROLE_STUDENT:
+            if (command == CMD_ENROLL) {
+                snprintf(request, size, "ENROLL_COURSE:%d", course_id);
+            } else if (command == CMD_UNENROLL) {
+                snprintf(request, size, "UNENROLL_COURSE:%d", course_id);
+            } else {
+                snprintf(request, size, "VIEW_ENROLLED_COURSES");
+            }
+            break;
+        case ROLE_FACULTY:
+            if (command == CMD_VIEW) {
+                snprintf(request, size, "VIEW_MY_COURSES");
+            } else {
+                snprintf(request, size, "VIEW_ENROLLMENTS:%d", course_id);
+            }
+            break;
+        default:
+            if (command == CMD_VIEW) {
+                snprintf(request, size, "VIEW_STUDENTS:all");
+            } else {
+                snprintf(request, size, "VIEW_FACULTY:all");
+            }
+            break;
+    }
+
+    return role == ROLE_STUDENT ? command : CMD_VIEW;
+}
+
+static void run_session(unsigned int *seed) {
+    char username[64];
+    char request[256];
+    char response[BUFFER_SIZE];
+    const char *password = options.user_password;
+    int role = pick_weighted(seed, options.role_weights, ROLE_COUNT);
+    struct Histogram *role_histograms = histograms[role];
+    int sock;
+
+    if (role == ROLE_STUDENT) {
+        snprintf(username, sizeof(username), "%s%d", options.student_prefix,
+                 1 + rand_r(seed) % options.student_count);
+    } else if (role == ROLE_FACULTY) {
+        snprintf(username, sizeof(username), "%s%d", options.faculty_prefix,
+                 1 + rand_r(seed) % options.faculty_count);
+    } else {
+        snprintf(username, sizeof(username), "%s", options.admin_user);
+        password = options.admin_password;
+    }
+
+    sock = login(role, username, password, &role_histograms[CMD_LOGIN]);
+    if (sock < 0) {
+        return;
+    }
+
+    for (int i = 0; i < options.ops_per_session && !stop_now; i++) {
+        int command;
+
+        if (options.think_ms > 0) {
+            sleep_until(now_seconds() + exponential(seed, options.think_ms) / 1000.0);
+        }
+
+        command = pick_weighted(seed, options.mix, CMD_LOGOUT);
+        if (command == CMD_LOGIN) {
+            // Re-login: drop the connection and authenticate again
+            logout(sock, &role_histograms[CMD_LOGOUT]);
+            sock = login(role, username, password, &role_histograms[CMD_LOGIN]);
+            if (sock < 0) {
+                return;
+            }
+            continue;
+        }
+
+        command = build_request(role, command, seed, request, sizeof(request));
+        if (timed_request(sock, request, response, sizeof(response), &role_histograms[command]) < 0) {
+            close(sock);
+            return;
+        }
+    }
+
+    logout(sock, &role_histograms[CMD_LOGOUT]);
+}
+
+static void *worker_thread(void *arg) {
+    unsigned int seed = (unsigned int)(size_t)arg * 2654435761u ^ (unsigned int)time(NULL);
+    double scheduled;
+
+    while (1) {
+        pthread_mutex_lock(&queue_mutex);
+        while (queue_count == 0 && !arrivals_done && !stop_now) {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+        }
+        if (queue_count == 0 || stop_now) {
+            pthread_mutex_unlock(&queue_mutex);
+            break;
+        }
+        scheduled = arrival_queue[queue_head];
+        queue_head = (queue_head + 1) % ARRIVAL_QUEUE_SIZE;
+        queue_count--;
+        sessions_started++;
+        pthread_mutex_unlock(&queue_mutex);
+
+        // Time spent waiting for a free worker shows the generator or server saturating
+        record_latency(&start_delay, now_seconds() - scheduled, 0, 0);
+        run_session(&seed);
+        __sync_fetch_and_add(&sessions_completed, 1);
+    }
+
+    return NULL;
+}
+
+static int parse_weights(const char *spec, const char **names, int count, int *weights) {
+    char copy[256];
+    char *saveptr;
+
+    strncpy(copy, spec, sizeof(copy) - 1);
+    copy[sizeof(copy) - 1] = '\0';
+    for (int i = 0; i < count; i++) {
+        weights[i] = 0;
+    }
+
+    for (char *item = strtok_r(copy, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        char *equals = strchr(item, '=');
+        int found = 0;
+
+        if (!equals) {
+            return -1;
+        }
+        *equals = '\0';
+        for (int i = 0; i < count; i++) {
+            if (strcmp(item, names[i]) == 0) {
+                weights[i] = atoi(equals + 1);
+                found = 1;
+            }
+        }
+        if (!found) {
+            fprintf(stderr, "Unknown mix entry '%s'\n", item);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Create the users and courses the run refers to, ignoring ones that already exist
+static int setup_fixtures() {
+    char request[256];
+    char response[BUFFER_SIZE];
+    struct Histogram scratch;
+    int sock;
+
+    memset(&scratch, 0, sizeof(scratch));
+    sock = login(ROLE_ADMIN, options.admin_user, options.admin_password, &scratch);
+    if (sock < 0) {
+        fprintf(stderr, "Setup: admin login failed\n");
+        return -1;
+    }
+
+    printf("Setup: creating %d students and %d faculty...\n", options.student_count, options.faculty_count);
+    for (int i = 1; i <= options.student_count; i++) {
+        snprintf(request, sizeof(request), "ADD_STUDENT:%s%d:Load Student %d:%s%d@load.test",
+                 options.student_prefix, i, i, options.student_prefix, i);
+        timed_request(sock, request, response, sizeof(response), &scratch);
+    }
+    for (int i = 1; i <= options.faculty_count; i++) {
+        snprintf(request, sizeof(request), "ADD_FACULTY:%s%d:Load Faculty %d:%s%d@load.test:LOAD",
+                 options.faculty_prefix, i, i, options.faculty_prefix, i);
+        timed_request(sock, request, response, sizeof(response), &scratch);
+    }
+    logout(sock, &scratch);
+
+    snprintf(request, sizeof(request), "%s1", options.faculty_prefix);
+    sock = login(ROLE_FACULTY, request, options.user_password, &scratch);
+    if (sock < 0) {
+        fprintf(stderr, "Setup: faculty login failed\n");
+        return -1;
+    }
+    printf("Setup: creating %d courses...\n", options.course_count);
+    for (int i = 1; i <= options.course_count; i++) {
+        snprintf(request, sizeof(request), "ADD_COURSE:LG%04d:Load Course %d:%d",
+                 i, i, options.student_count);
+        timed_request(sock, request, response, sizeof(response), &scratch);
+    }
+    logout(sock, &scratch);
+    return 0;
+}
+
+static void print_row(const char *label, struct Histogram *histogram, double elapsed) {
+    printf("%-18s %9lu %8lu %8lu %9.1f %8.2f %8.2f %8.2f %8.2f %8.2f %9.2f\n",
+           label, histogram->total, histogram->errors, histogram->failures,
+           histogram->total / elapsed,
+           histogram->total ? histogram->sum_us / 1000.0 / histogram->total : 0.0,
+           percentile_ms(histogram, 0.50), percentile_ms(histogram, 0.90),
+           percentile_ms(histogram, 0.99), percentile_ms(histogram, 0.999),
+           histogram->max_us / 1000.0);
+}
+
+static void print_report(double elapsed) {
+    unsigned long total = 0;
+    char label[32];
+
+    printf("\nLoad test against %s:%d - %.1f s, arrival rate %.1f sessions/s, %d workers\n",
+           options.host, options.port, elapsed, options.rate, options.concurrency);
+    printf("Sessions: %lu started, %lu completed, %lu arrivals dropped\n\n",
+           sessions_started, sessions_completed, arrivals_dropped);
+    printf("%-18s %9s %8s %8s %9s %8s %8s %8s %8s %8s %9s\n", "role/command", "count", "errors",
+           "failed", "req/s", "mean", "p50", "p90", "p99", "p99.9", "max (ms)");
+
+    for (int role = 0; role < ROLE_COUNT; role++) {
+        for (int command = 0; command < CMD_COUNT; command++) {
+            struct Histogram *histogram = &histograms[role][command];
+            if (histogram->total == 0) {
+                continue;
+            }
+            snprintf(label, sizeof(label), "%s/%s", role_names[role], command_names[command]);
+            print_row(label, histogram, elapsed);
+            total += histogram->total;
+        }
+    }
+
+    printf("\n");
+    print_row("session start", &start_delay, elapsed);
+    printf("\nTotal: %lu requests, %.1f req/s\n", total, total / elapsed);
+}
+
+static void handle_stop(int sig) {
+    stop_now = 1;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -h host          server address or local socket path (default %s)\n"
+            "  -p port          server port (default %d)\n"
+            "  -c workers       concurrent sessions (default %d)\n"
+            "  -r rate          session arrivals per second (default %.1f)\n"
+            "  -d seconds       arrival window (default %d)\n"
+            "  -n ops           requests per session after login (default %d)\n"
+            "  -t ms            mean think time between requests (default %.0f)\n"
+            "  -m mix           command weights, e.g. login=5,enroll=40,unenroll=20,view=35\n"
+            "  -R roles         role weights, e.g. student=90,faculty=8,admin=2\n"
+            "  -S prefix:count  student usernames prefix1..prefixN (default %s:%d)\n"
+            "  -F prefix:count  faculty usernames (default %s:%d)\n"
+            "  -C courses       course ids 1..N to enroll in (default %d)\n"
+            "  -A user:pass     admin credentials (default %s:%s)\n"
+            "  -P password      student/faculty password (default %s)\n"
+            "  -s               create the users and courses before the run\n",
+            program, options.host, options.port, options.concurrency, options.rate,
+            options.duration, options.ops_per_session, options.think_ms,
+            options.student_prefix, options.student_count, options.faculty_prefix,
+            options.faculty_count, options.course_count, options.admin_user,
+            options.admin_password, options.user_password);
+}
+
+static int parse_prefix_count(const char *spec, char *prefix, size_t prefix_size, int *count) {
+    const char *colon = strrchr(spec, ':');
+
+    if (!colon || colon == spec || atoi(colon + 1) <= 0) {
+        return -1;
+    }
+    snprintf(prefix, prefix_size, "%.*s", (int)(colon - spec), spec);
+    *count = atoi(colon + 1);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    pthread_attr_t attr;
+    pthread_t *workers;
+    unsigned int seed = (unsigned int)time(NULL);
+    double start, next, elapsed;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "h:p:c:r:d:n:t:m:R:S:F:C:A:P:s")) != -1) {
+        switch (opt) {
+            case 'h': snprintf(options.host, sizeof(options.host), "%s", optarg); break;
+            case 'p': options.port = atoi(optarg); break;
+            case 'c': options.concurrency = atoi(optarg); break;
+            case 'r': options.rate = atof(optarg); break;
+            case 'd': options.duration = atoi(optarg); break;
+            case 'n': options.ops_per_session = atoi(optarg); break;
+            case 't': options.think_ms = atof(optarg); break;
+            case 'm':
+                if (parse_weights(optarg, command_names, CMD_LOGOUT, options.mix) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'R':
+                if (parse_weights(optarg, role_names, ROLE_COUNT, options.role_weights) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'S':
+                if (parse_prefix_count(optarg, options.student_prefix, sizeof(options.student_prefix),
+                                       &options.student_count) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'F':
+                if (parse_prefix_count(optarg, options.faculty_prefix, sizeof(options.faculty_prefix),
+                                       &options.faculty_count) < 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'C': options.course_count = atoi(optarg); break;
+            case 'A':
+                if (sscanf(optarg, "%49[^:]:%49s", options.admin_user, options.admin_password) != 2) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                break;
+            case 'P': snprintf(options.user_password, sizeof(options.user_password), "%s", optarg); break;
+            case 's': options.setup = 1; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (options.concurrency <= 0 || options.rate <= 0 || options.duration <= 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, handle_stop);
+
+    if (options.setup && setup_fixtures() < 0) {
+        return 1;
+    }
+
+    workers = calloc(options.concurrency, sizeof(pthread_t));
+    if (!workers) {
+        perror("calloc");
+        return 1;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, WORKER_STACK_SIZE);
+    for (int i = 0; i < options.concurrency; i++) {
+        if (pthread_create(&workers[i], &attr, worker_thread, (void *)(size_t)(i + 1)) != 0) {
+            fprintf(stderr, "Could only start %d workers\n", i);
+            options.concurrency = i;
+            break;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    printf("Running for %d s at %.1f sessions/s with %d workers...\n",
+           options.duration, options.rate, options.concurrency);
+
+    // Open-loop arrivals: the schedule does not wait for the server to keep up
+    start = now_seconds();
+    next = start;
+    while (!stop_now) {
+        next += exponential(&seed, 1.0 / options.rate);
+        if (next - start >= options.duration) {
+            break;
+        }
+        sleep_until(next);
+
+        pthread_mutex_lock(&queue_mutex);
+        if (queue_count == ARRIVAL_QUEUE_SIZE) {
+            arrivals_dropped++;
+        } else {
+            arrival_queue[(queue_head + queue_count) % ARRIVAL_QUEUE_SIZE] = next;
+            queue_count++;
+            pthread_cond_signal(&queue_cond);
+        }
+        pthread_mutex_unlock(&queue_mutex);
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    arrivals_done = 1;
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    for (int i = 0; i < options.concurrency; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    elapsed = now_seconds() - start;
+    free(workers);
+
+    print_report(elapsed);
+    return 0;
+}
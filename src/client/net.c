@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+#include "net.h"
+
+// Connect to a server's AF_UNIX socket on this host
+static int net_connect_local(const char *path) {
+    struct sockaddr_un server_addr;
+    int sock;
+    
+    if (strlen(path) >= sizeof(server_addr.sun_path)) {
+        errno = EINVAL;
+        return -1;
+    }
+    
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sun_family = AF_UNIX;
+    strcpy(server_addr.sun_path, path);
+    
+    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        int saved_errno = errno;
+        close(sock);
+        errno = saved_errno;
+        return -1;
+    }
+    
+    return sock;
+}
+
+int net_connect(const char *server_ip, int port) {
+    struct sockaddr_in server_addr;
+    int sock;
+    
+    if (server_ip[0] == '/') {
+        return net_connect_local(server_ip);
+    }
+    
+    // Create socket using system call
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    
+    // Set up server address
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(port);
+    
+    // Convert IP address
+    if (inet_pton(AF_INET, server_ip, &server_addr.sin_addr) <= 0) {
+        close(sock);
+        errno = EINVAL;
+        return -1;
+    }
+    
+    // Connect to server
+    if (connect(sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        int saved_errno = errno;
+        close(sock);
+        errno = saved_errno;
+        return -1;
+    }
+    
+    return sock;
+}
+
+int net_send(int sock, const char *request) {
+    size_t length = strlen(request);
+    size_t sent = 0;
+    
+    // Use write system call, retrying short writes
+    while (sent < length) {
+        ssize_t bytes_written = write(sock, request + sent, length - sent);
+        if (bytes_written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        sent += bytes_written;
+    }
+    
+    return 0;
+}
+
+int net_receive(int sock, char *buffer, size_t size) {
+    ssize_t bytes_read;
+    
+    memset(buffer, 0, size);
+    do {
+        bytes_read = read(sock, buffer, size - 1);
+    } while (bytes_read < 0 && errno == EINTR);
+    
+    if (bytes_read < 0) {
+        return -1;
+    }
+    
+    buffer[bytes_read] = '\0';
+    return (int)bytes_read;
+}
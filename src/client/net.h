@@ -0,0 +1,19 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stddef.h>
+
+// Connection helpers shared by the interactive client and the load generator.
+// They report failures through the return value and errno and print nothing.
+
+// Open a TCP connection, or a local one when server_ip is a socket path (starts with '/');
+// returns the socket descriptor or -1
+int net_connect(const char *server_ip, int port);
+
+// Send one request; returns 0 on success or -1
+int net_send(int sock, const char *request);
+
+// Receive one response into a NUL-terminated buffer; returns bytes read, 0 if closed, -1 on error
+int net_receive(int sock, char *buffer, size_t size);
+
+#endif // NET_H
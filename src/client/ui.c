@@ -21,7 +21,9 @@ void display_admin_menu() {
     printf("4. Update Student/Faculty Details\n");
     printf("5. View Students\n");
     printf("6. View Faculty\n");
-    printf("7. Exit\n");
+    printf("7. System Diagnostics\n");
+    printf("8. Data Import/Export\n");
+    printf("9. Exit\n");
     printf("=================================\n");
     printf("Enter your choice: ");
     fflush(stdout);
@@ -35,8 +37,9 @@ void display_student_menu() {
     printf("1. Enroll to New Courses\n");
     printf("2. Unenroll from Courses\n");
     printf("3. View Enrolled Courses\n");
-    printf("4. Change Password\n");
-    printf("5. Exit\n");
+    printf("4. Join Course Waitlist\n");
+    printf("5. Change Password\n");
+    printf("6. Exit\n");
     printf("=================================\n");
     printf("Enter your choice: ");
     fflush(stdout);
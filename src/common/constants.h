@@ -15,6 +15,7 @@
 #define FACULTY_FILE "data/faculty.dat"
 #define COURSE_FILE "data/courses.dat"
 #define ENROLLMENT_FILE "data/enrollments.dat"
+#define WAITLIST_FILE "data/waitlists.dat"
 #define CREDENTIALS_FILE "data/credentials.dat"
 
 // Limits
@@ -35,6 +35,12 @@ struct Enrollment {
     time_t enrollment_date;
 };
 
+struct WaitlistEntry {
+    int student_id;
+    int course_id;
+    time_t joined_at;
+};
+
 struct Credentials {
     char username[50];
     char password_hash[65];
@@ -434,4 +434,26 @@ int calculate_age(const char *birth_date) {
     }
     
     return age;
-}
\ No newline at end of file
+}
+
+// Shard that owns a course (and its enrollments and waitlist) in a sharded deployment
+int shard_for_course(int course_id, int shard_count) {
+    if (shard_count <= 1 || course_id < 0) {
+        return 0;
+    }
+    return course_id % shard_count;
+}
+
+// Shard a new course is created on, chosen by its code so duplicate codes meet on one shard
+int shard_for_course_code(const char *course_code, int shard_count) {
+    // FNV-1a spreads similar codes (CS101, CS102, ...) evenly over the shards
+    unsigned int hash = 2166136261u;
+
+    if (shard_count <= 1) {
+        return 0;
+    }
+    while (*course_code) {
+        hash = (hash ^ (unsigned char)*course_code++) * 16777619u;
+    }
+    return (int)(hash % shard_count);
+}
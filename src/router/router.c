@@ -0,0 +1,773 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include "constants.h"
+#include "../client/net.h"
+
+// Routes the client protocol across course shards. Course-scoped commands go to the shard
+// owning the course; student and faculty views are gathered from every shard; changes to
+// students, faculty and credentials are applied on every shard in one global order.
+
+#define ROUTER_MAX_SHARDS 16
+#define ROUTER_CHUNK_SIZE 65536
+#define ROUTER_IMPORT_MAX_BYTES (256L * 1024 * 1024)
+#define EXPORT_FRAME_HEADER 8
+
+// From utils.c
+int shard_for_course(int course_id, int shard_count);
+int shard_for_course_code(const char *course_code, int shard_count);
+
+struct Shard {
+    char host[64];
+    int port;
+};
+
+// One client connection and its authenticated connection to every shard
+struct RouterSession {
+    int client;
+    int backends[ROUTER_MAX_SHARDS];
+    int authenticated;
+};
+
+static struct Shard shards[ROUTER_MAX_SHARDS];
+static int shard_count = 0;
+static int router_socket = -1;
+
+// Serialises changes to the replicated tables so every shard assigns the same ids
+static pthread_mutex_t replicated_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *course_commands[] = {
+    "ENROLL_COURSE", "UNENROLL_COURSE", "JOIN_WAITLIST", "REMOVE_COURSE", "VIEW_ENROLLMENTS"
+};
+static const char *replicated_writes[] = {
+    "ADD_STUDENT", "ADD_FACULTY", "UPDATE_STUDENT_STATUS", "UPDATE_STUDENT_NAME",
+    "UPDATE_STUDENT_EMAIL", "UPDATE_FACULTY_NAME", "UPDATE_FACULTY_EMAIL",
+    "UPDATE_FACULTY_DEPT", "CHANGE_PASSWORD"
+};
+static const char *diagnostic_commands[] = {
+    "LOCK_STATS", "TRACE_DUMP", "SLOW_LOG", "ADMISSION_STATS", "REPLICATION_STATUS", "SNAPSHOT",
+    "ARENA_STATS", "CONNECTION_STATS", "FILTER_STATS"
+};
+
+static int in_list(const char *command, const char **list, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(command, list[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int write_all(int sock, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(sock, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int read_exact(int sock, char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = read(sock, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// Send one request to a shard and read its single response
+static int forward(struct RouterSession *session, int shard, const char *request, char *response) {
+    if (net_send(session->backends[shard], request) < 0 ||
+        net_receive(session->backends[shard], response, BUFFER_SIZE) <= 0) {
+        snprintf(response, BUFFER_SIZE, "ERROR:Shard %d unavailable", shard);
+        return -1;
+    }
+    return 0;
+}
+
+// Append to a response, never past what a client reads in one go
+static void append_response(char *response, const char *text) {
+    size_t used = strlen(response);
+    snprintf(response + used, BUFFER_SIZE - used, "%s", text);
+}
+
+static void close_backends(struct RouterSession *session) {
+    for (int i = 0; i < shard_count; i++) {
+        if (session->backends[i] >= 0) {
+            close(session->backends[i]);
+            session->backends[i] = -1;
+        }
+    }
+}
+
+// Log in to every shard with the client's credentials; all must accept
+static void route_auth(struct RouterSession *session, const char *request, char *response) {
+    char shard_response[BUFFER_SIZE];
+
+    for (int i = 0; i < shard_count; i++) {
+        session->backends[i] = net_connect(shards[i].host, shards[i].port);
+        if (session->backends[i] < 0) {
+            snprintf(response, BUFFER_SIZE, "ERROR:Shard %d unavailable", i);
+            close_backends(session);
+            return;
+        }
+        if (forward(session, i, request, shard_response) < 0 ||
+            strncmp(shard_response, "SUCCESS:", 8) != 0) {
+            strcpy(response, shard_response);
+            close_backends(session);
+            return;
+        }
+        if (i == 0) {
+            strcpy(response, shard_response);
+        }
+    }
+    session->authenticated = 1;
+}
+
+// Validation pass of a replicated write: every shard must accept CHECK:<request> with the
+// same answer as shard 0 before the change is sent to any of them
+static int check_replicated_write(struct RouterSession *session, const char *request, char *response) {
+    char check[BUFFER_SIZE + 8];
+    char shard_response[BUFFER_SIZE];
+
+    snprintf(check, sizeof(check), "CHECK:%s", request);
+    for (int i = 0; i < shard_count; i++) {
+        if (forward(session, i, check, i == 0 ? response : shard_response) < 0) {
+            if (i > 0) {
+                strcpy(response, shard_response);
+            }
+            return -1;
+        }
+        if (i == 0 && strncmp(response, "SUCCESS:", 8) != 0) {
+            return -1;
+        }
+        if (i > 0 && strcmp(shard_response, response) != 0) {
+            snprintf(response, BUFFER_SIZE, "ERROR:Shards disagree, nothing changed (shard %d: %.400s)",
+                     i, shard_response);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Apply a change to students, faculty or credentials on every shard. The shards are only
+// kept identical if this router is the only one sending them such changes.
+static void route_replicated_write(struct RouterSession *session, const char *request, char *response) {
+    char shard_response[BUFFER_SIZE];
+
+    pthread_mutex_lock(&replicated_write_mutex);
+    if (check_replicated_write(session, request, response) == 0) {
+        forward(session, 0, request, response);
+        for (int i = 1; i < shard_count; i++) {
+            forward(session, i, request, shard_response);
+            if (strcmp(shard_response, response) != 0) {
+                // Validated everywhere, so only a failing shard gets here; it needs repair
+                snprintf(response, BUFFER_SIZE, "ERROR:Shard %d failed after shards 0-%d applied the "
+                         "change (shard %d: %.400s)", i, i - 1, i, shard_response);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&replicated_write_mutex);
+}
+
+// Collect the rows starting with row_prefix from every shard's answer to the same view
+static int gather_rows(struct RouterSession *session, const char *request, const char *row_prefix,
+                       char *rows, size_t rows_size, char *error) {
+    char shard_response[BUFFER_SIZE];
+    int count = 0;
+
+    rows[0] = '\0';
+    for (int i = 0; i < shard_count; i++) {
+        char *line;
+        char *saveptr;
+
+        if (forward(session, i, request, shard_response) < 0 ||
+            strncmp(shard_response, "ERROR", 5) == 0) {
+            strcpy(error, shard_response);
+            return -1;
+        }
+        for (line = strtok_r(shard_response, "\n", &saveptr); line; line = strtok_r(NULL, "\n", &saveptr)) {
+            if (strncmp(line, row_prefix, strlen(row_prefix)) == 0 &&
+                strlen(rows) + strlen(line) + 2 < rows_size) {
+                strcat(rows, line);
+                strcat(rows, "\n");
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// Same layout as get_enrolled_courses() on a single server
+static void route_enrolled_courses(struct RouterSession *session, const char *request, char *response) {
+    char rows[BUFFER_SIZE];
+    int count = gather_rows(session, request, "Course ID:", rows, sizeof(rows) - 96, response);
+
+    if (count == 0) {
+        strcpy(response, "No courses enrolled");
+    } else if (count > 0) {
+        snprintf(response, BUFFER_SIZE, "Enrolled Courses:\n=================\n%.*s\nTotal courses enrolled: %d\n",
+                 (int)sizeof(rows) - 96, rows, count);
+    }
+}
+
+// Same layout as handle_view_my_courses() on a single server
+static void route_my_courses(struct RouterSession *session, const char *request, char *response) {
+    char rows[BUFFER_SIZE];
+    int count = gather_rows(session, request, "ID:", rows, sizeof(rows) - 64, response);
+
+    if (count == 0) {
+        strcpy(response, "You haven't offered any courses yet");
+    } else if (count > 0) {
+        snprintf(response, BUFFER_SIZE, "Your courses (%d):\n%.*s", count, (int)sizeof(rows) - 64, rows);
+    }
+}
+
+// Faculty are the same on every shard but their courses are spread out: the department's
+// faculty come from shard 0, and the courses and their count from every shard
+static void route_department(struct RouterSession *session, const char *request, const char *params,
+                             char *response) {
+    char shard_response[BUFFER_SIZE];
+    char rows[BUFFER_SIZE] = "";
+    char *section;
+    int total = 0;
+
+    if (forward(session, 0, request, response) < 0 || strcmp(params, "all") == 0 ||
+        !(section = strstr(response, "Courses ("))) {
+        return;
+    }
+    for (int i = 0; i < shard_count; i++) {
+        const char *courses;
+        int count;
+
+        if (i > 0 && forward(session, i, request, shard_response) < 0) {
+            strcpy(response, shard_response);
+            return;
+        }
+        courses = strstr(i == 0 ? response : shard_response, "Courses (");
+        if (!courses || sscanf(courses, "Courses (%d):", &count) != 1) {
+            snprintf(response, BUFFER_SIZE, "ERROR:Shard %d answered unexpectedly", i);
+            return;
+        }
+        total += count;
+        courses = strchr(courses, '\n');
+        if (courses) {
+            snprintf(rows + strlen(rows), sizeof(rows) - strlen(rows), "%s", courses + 1);
+        }
+    }
+    snprintf(section, BUFFER_SIZE - (section - response), "Courses (%d):\n%s", total, rows);
+}
+
+// Diagnostics and snapshots are per server: show each shard's report in turn
+static void route_diagnostic(struct RouterSession *session, const char *request, char *response) {
+    char shard_response[BUFFER_SIZE];
+    char heading[32];
+
+    strcpy(response, "SUCCESS:");
+    for (int i = 0; i < shard_count; i++) {
+        forward(session, i, request, shard_response);
+        snprintf(heading, sizeof(heading), "[shard %d] ", i);
+        append_response(response, heading);
+        append_response(response, strncmp(shard_response, "SUCCESS:", 8) == 0 ? shard_response + 8 : shard_response);
+        append_response(response, "\n");
+    }
+}
+
+static void route_enroll_courses(struct RouterSession *session, const char *request, const char *params,
+                                 char *response) {
+    char list[BUFFER_SIZE];
+    char *token;
+    char *saveptr;
+    int shard = -1;
+
+    // All-or-none enrollment is only atomic within one shard's admission queues
+    strncpy(list, params, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+    for (token = strtok_r(list, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        int owner = shard_for_course(atoi(token), shard_count);
+        if (shard >= 0 && owner != shard) {
+            strcpy(response, "ERROR:These courses live on different shards; enroll in them separately");
+            return;
+        }
+        shard = owner;
+    }
+    forward(session, shard < 0 ? 0 : shard, request, response);
+}
+
+// Send an IMPORT body to one shard: header, READY handshake, body, summary. With check set
+// the shard only validates the rows and reports what it would import.
+static int import_to_shard(struct RouterSession *session, int shard, const char *table,
+                           const char *body, size_t length, int check, char *response) {
+    char request[128];
+
+    snprintf(request, sizeof(request), "%sIMPORT:%s:%zu", check ? "CHECK:" : "", table, length);
+    if (forward(session, shard, request, response) < 0 || strcmp(response, "READY") != 0) {
+        return -1;
+    }
+    if (write_all(session->backends[shard], body, length) < 0 ||
+        net_receive(session->backends[shard], response, BUFFER_SIZE) <= 0) {
+        snprintf(response, BUFFER_SIZE, "ERROR:Shard %d unavailable", shard);
+        return -1;
+    }
+    return 0;
+}
+
+// Users go to every shard; course rows go to the shard their code hashes to
+static void route_import(struct RouterSession *session, const char *params, char *response) {
+    char table[16];
+    char shard_response[BUFFER_SIZE];
+    long bytes;
+    char *body;
+    long received = 0;
+    int courses;
+
+    if (sscanf(params, "%15[^:]:%ld", table, &bytes) != 2 || bytes < 0 || bytes > ROUTER_IMPORT_MAX_BYTES) {
+        strcpy(response, "ERROR:Invalid parameters for IMPORT (IMPORT:<students|faculty|courses>:<bytes>)");
+        return;
+    }
+    courses = strcmp(table, "courses") == 0;
+
+    // The body is held in full: course rows are split by shard before anything is sent
+    body = malloc(bytes + 1);
+    if (!body) {
+        strcpy(response, "ERROR:Out of memory");
+        return;
+    }
+    write_all(session->client, "READY", 5);
+    while (received < bytes) {
+        ssize_t n = read(session->client, body + received, bytes - received);
+        if (n <= 0) {
+            strcpy(response, "ERROR:Import aborted (connection lost)");
+            free(body);
+            return;
+        }
+        received += n;
+    }
+    body[bytes] = '\0';
+
+    if (!courses) {
+        int failed = 0;
+
+        // Users are checked on every shard first, so an import one shard would not take
+        // exactly like shard 0 is sent to none of them
+        pthread_mutex_lock(&replicated_write_mutex);
+        for (int pass = 0; pass < 2 && !failed; pass++) {
+            import_to_shard(session, 0, table, body, bytes, pass == 0, response);
+            failed = strncmp(response, "SUCCESS:", 8) != 0;
+            for (int i = 1; i < shard_count && !failed; i++) {
+                import_to_shard(session, i, table, body, bytes, pass == 0, shard_response);
+                if (strcmp(shard_response, response) == 0) {
+                    continue;
+                }
+                failed = 1;
+                if (pass == 0) {
+                    snprintf(response, BUFFER_SIZE, "ERROR:Shards disagree on import, nothing imported "
+                             "(shard %d: %.400s)", i, shard_response);
+                } else {
+                    snprintf(response, BUFFER_SIZE, "ERROR:Import failed on shard %d after shards 0-%d "
+                             "imported it (shard %d: %.400s)", i, i - 1, i, shard_response);
+                }
+            }
+        }
+        pthread_mutex_unlock(&replicated_write_mutex);
+    } else {
+        char *parts[ROUTER_MAX_SHARDS];
+        size_t lengths[ROUTER_MAX_SHARDS] = {0};
+        char *line = body;
+
+        for (int i = 0; i < shard_count; i++) {
+            parts[i] = malloc(bytes + 1);
+        }
+        while (*line) {
+            char *end = strchr(line, '\n');
+            size_t length = end ? (size_t)(end - line + 1) : strlen(line);
+            char code[MAX_COURSE_CODE_LENGTH];
+            int shard;
+
+            // The first column is the course code; a header row goes to every shard
+            if (*line == '"') {
+                snprintf(code, sizeof(code), "%.*s", (int)strcspn(line + 1, "\"\n"), line + 1);
+            } else {
+                snprintf(code, sizeof(code), "%.*s", (int)strcspn(line, ",\r\n"), line);
+            }
+            if (line == body && strcmp(code, "course_code") == 0) {
+                for (int i = 0; i < shard_count; i++) {
+                    if (parts[i]) {
+                        memcpy(parts[i], line, length);
+                        lengths[i] = length;
+                    }
+                }
+            } else {
+                shard = shard_for_course_code(code, shard_count);
+                if (parts[shard]) {
+                    memcpy(parts[shard] + lengths[shard], line, length);
+                    lengths[shard] += length;
+                }
+            }
+            line += length;
+        }
+
+        strcpy(response, "SUCCESS:");
+        for (int i = 0; i < shard_count; i++) {
+            char heading[32];
+            if (!parts[i]) {
+                snprintf(shard_response, sizeof(shard_response), "ERROR:Out of memory");
+            } else {
+                import_to_shard(session, i, table, parts[i], lengths[i], 0, shard_response);
+            }
+            snprintf(heading, sizeof(heading), "[shard %d] ", i);
+            append_response(response, heading);
+            append_response(response, strncmp(shard_response, "SUCCESS:", 8) == 0 ? shard_response + 8
+                                                                                  : shard_response);
+            append_response(response, "\n");
+            free(parts[i]);
+        }
+    }
+    free(body);
+}
+
+// Relay one shard's EXPORT frames to the client, holding back the end-of-stream frame.
+// Returns the number of records the shard reported, or -1 (response then holds the error).
+static long relay_export(struct RouterSession *session, int shard, const char *request,
+                         int skip_header, long long *bytes, char *response) {
+    char *frame = malloc(ROUTER_CHUNK_SIZE + EXPORT_FRAME_HEADER);
+    char header[EXPORT_FRAME_HEADER + 1];
+    long records = 0;
+    int first = 1;
+
+    if (!frame || net_send(session->backends[shard], request) < 0) {
+        free(frame);
+        snprintf(response, BUFFER_SIZE, "ERROR:Shard %d unavailable", shard);
+        return -1;
+    }
+
+    while (1) {
+        size_t length;
+        size_t start = 0;
+
+        if (read_exact(session->backends[shard], header, EXPORT_FRAME_HEADER) < 0) {
+            snprintf(response, BUFFER_SIZE, "ERROR:Shard %d unavailable", shard);
+            free(frame);
+            return -1;
+        }
+        header[EXPORT_FRAME_HEADER] = '\0';
+        if (strncmp(header, "ERROR:", 6) == 0) {
+            strcpy(response, header);
+            net_receive(session->backends[shard], response + EXPORT_FRAME_HEADER,
+                        BUFFER_SIZE - EXPORT_FRAME_HEADER);
+            free(frame);
+            return -1;
+        }
+
+        length = strtoul(header, NULL, 16);
+        if (length == 0) {
+            break;
+        }
+        while (length > 0) {
+            size_t part = length < ROUTER_CHUNK_SIZE ? length : ROUTER_CHUNK_SIZE;
+            char *payload = frame + EXPORT_FRAME_HEADER;
+
+            if (read_exact(session->backends[shard], payload, part) < 0) {
+                snprintf(response, BUFFER_SIZE, "ERROR:Shard %d unavailable", shard);
+                free(frame);
+                return -1;
+            }
+            length -= part;
+
+            // Later shards' CSV header rows are dropped so the output has one
+            if (first && skip_header) {
+                char *newline = memchr(payload, '\n', part);
+                start = newline ? (size_t)(newline - payload + 1) : part;
+            }
+            first = 0;
+
+            if (part > start) {
+                char digits[EXPORT_FRAME_HEADER + 1];
+                snprintf(digits, sizeof(digits), "%08zx", part - start);
+                memcpy(payload + start - EXPORT_FRAME_HEADER, digits, EXPORT_FRAME_HEADER);
+                if (write_all(session->client, payload + start - EXPORT_FRAME_HEADER,
+                              EXPORT_FRAME_HEADER + part - start) < 0) {
+                    strcpy(response, "ERROR:Client connection lost");
+                    free(frame);
+                    return -1;
+                }
+                *bytes += part - start;
+            }
+            start = 0;
+        }
+    }
+    free(frame);
+
+    // The shard's summary follows its end-of-stream frame
+    if (net_receive(session->backends[shard], response, BUFFER_SIZE) <= 0 ||
+        sscanf(response, "SUCCESS:Exported %ld", &records) != 1) {
+        return -1;
+    }
+    return records;
+}
+
+static void route_export(struct RouterSession *session, const char *request, const char *params,
+                         char *response) {
+    char table[16];
+    char format[8];
+    long long bytes = 0;
+    long total = 0;
+    int sharded;
+    int last;
+
+    if (sscanf(params, "%15[^:]:%7s", table, format) != 2) {
+        forward(session, 0, request, response);
+        return;
+    }
+    sharded = strcmp(table, "courses") == 0 || strcmp(table, "enrollments") == 0 ||
+              strcmp(table, "waitlists") == 0;
+    if (sharded && strcmp(format, "json") == 0) {
+        strcpy(response, "ERROR:JSON export of sharded tables is not supported through the router; use csv or raw");
+        return;
+    }
+
+    // Users are whole on every shard; sharded tables are concatenated shard by shard
+    last = sharded ? shard_count - 1 : 0;
+    for (int i = 0; i <= last; i++) {
+        long records = relay_export(session, i, request, i > 0 && strcmp(format, "csv") == 0, &bytes, response);
+        if (records < 0) {
+            if (i == 0 && bytes == 0) {
+                return;                  // rejected before any frame; response holds the error
+            }
+            write_all(session->client, "00000000", EXPORT_FRAME_HEADER);
+            return;
+        }
+        total += records;
+    }
+
+    write_all(session->client, "00000000", EXPORT_FRAME_HEADER);
+    snprintf(response, BUFFER_SIZE, "SUCCESS:Exported %ld %s as %s (%lld bytes) from %d shard%s",
+             total, table, format, bytes, last + 1, last ? "s" : "");
+}
+
+static void route_request(struct RouterSession *session, char *request, char *response) {
+    char command[256];
+    const char *params = "";
+    size_t length = strcspn(request, ":");
+
+    snprintf(command, sizeof(command), "%.*s", (int)length, request);
+    if (request[length] == ':') {
+        params = request + length + 1;
+    }
+
+    if (in_list(command, course_commands, sizeof(course_commands) / sizeof(course_commands[0]))) {
+        forward(session, shard_for_course(atoi(params), shard_count), request, response);
+    } else if (strcmp(command, "ADD_COURSE") == 0) {
+        char code[MAX_COURSE_CODE_LENGTH];
+        snprintf(code, sizeof(code), "%.*s", (int)strcspn(params, ":"), params);
+        forward(session, shard_for_course_code(code, shard_count), request, response);
+    } else if (strcmp(command, "ENROLL_COURSES") == 0) {
+        route_enroll_courses(session, request, params, response);
+    } else if (strcmp(command, "VIEW_ENROLLED_COURSES") == 0) {
+        route_enrolled_courses(session, request, response);
+    } else if (strcmp(command, "VIEW_MY_COURSES") == 0) {
+        route_my_courses(session, request, response);
+    } else if (strcmp(command, "VIEW_DEPARTMENT") == 0) {
+        route_department(session, request, params, response);
+    } else if (in_list(command, replicated_writes, sizeof(replicated_writes) / sizeof(replicated_writes[0]))) {
+        route_replicated_write(session, request, response);
+    } else if (in_list(command, diagnostic_commands, sizeof(diagnostic_commands) / sizeof(diagnostic_commands[0]))) {
+        route_diagnostic(session, request, response);
+    } else if (strcmp(command, "IMPORT") == 0) {
+        route_import(session, params, response);
+    } else if (strcmp(command, "EXPORT") == 0) {
+        route_export(session, request, params, response);
+    } else if (strcmp(command, "REPLICATE") == 0) {
+        strcpy(response, "ERROR:Replicas connect to a shard directly, not through the router");
+    } else {
+        // Student and faculty lookups are the same on every shard
+        forward(session, 0, request, response);
+    }
+}
+
+static void *session_thread(void *arg) {
+    struct RouterSession session;
+    char request[BUFFER_SIZE];
+    char response[BUFFER_SIZE];
+    ssize_t bytes_read;
+
+    memset(&session, 0, sizeof(session));
+    session.client = *(int *)arg;
+    free(arg);
+    for (int i = 0; i < ROUTER_MAX_SHARDS; i++) {
+        session.backends[i] = -1;
+    }
+
+    while ((bytes_read = read(session.client, request, sizeof(request) - 1)) > 0) {
+        request[bytes_read] = '\0';
+        request[strcspn(request, "\n")] = '\0';
+        response[0] = '\0';
+
+        if (!session.authenticated) {
+            if (strncmp(request, "AUTH:", 5) == 0) {
+                route_auth(&session, request, response);
+            } else {
+                strcpy(response, "ERROR: Not authenticated");
+            }
+        } else if (strcmp(request, "LOGOUT") == 0) {
+            for (int i = 0; i < shard_count; i++) {
+                net_send(session.backends[i], "LOGOUT");
+            }
+            strcpy(response, "SUCCESS: Logged out");
+            write_all(session.client, response, strlen(response));
+            break;
+        } else {
+            route_request(&session, request, response);
+        }
+
+        if (response[0] != '\0') {
+            write_all(session.client, response, strlen(response));
+        }
+    }
+
+    close_backends(&session);
+    close(session.client);
+    return NULL;
+}
+
+static int parse_shard(const char *spec, struct Shard *shard) {
+    const char *colon = strrchr(spec, ':');
+
+    if (!colon || colon == spec || (size_t)(colon - spec) >= sizeof(shard->host)) {
+        return -1;
+    }
+    struct addrinfo hints;
+    struct addrinfo *result;
+    char name[64];
+
+    snprintf(name, sizeof(name), "%.*s", (int)(colon - spec), spec);
+    shard->port = atoi(colon + 1);
+    if (shard->port <= 0) {
+        return -1;
+    }
+
+    // Resolved once here; net_connect() takes a dotted address
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(name, NULL, &hints, &result) != 0) {
+        return -1;
+    }
+    inet_ntop(AF_INET, &((struct sockaddr_in *)result->ai_addr)->sin_addr, shard->host, sizeof(shard->host));
+    freeaddrinfo(result);
+    return 0;
+}
+
+static int create_router_socket(int port) {
+    struct sockaddr_in address;
+    int sock;
+    int opt = 1;
+
+    sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(sock, MAX_CLIENTS) < 0) {
+        perror("Bind/listen failed");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [-p port] shard_host:port [shard_host:port ...]\n"
+            "  Shard i must be a server started with -S i/<number of shards>\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    int port = DEFAULT_PORT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    for (int i = optind; i < argc; i++) {
+        if (shard_count == ROUTER_MAX_SHARDS || parse_shard(argv[i], &shards[shard_count]) < 0) {
+            fprintf(stderr, "Invalid or too many shards at '%s'\n", argv[i]);
+            return 1;
+        }
+        shard_count++;
+    }
+    if (shard_count == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    router_socket = create_router_socket(port);
+    if (router_socket < 0) {
+        return 1;
+    }
+    printf("Academia Portal Router on port %d routing %d shard%s\n", port, shard_count,
+           shard_count > 1 ? "s" : "");
+    for (int i = 0; i < shard_count; i++) {
+        printf("  shard %d: %s:%d\n", i, shards[i].host, shards[i].port);
+    }
+
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        pthread_t tid;
+        int *client = malloc(sizeof(int));
+
+        *client = accept(router_socket, (struct sockaddr *)&client_addr, &client_addr_len);
+        if (*client < 0) {
+            free(client);
+            if (errno != EINTR) {
+                perror("Accept failed");
+            }
+            continue;
+        }
+        if (pthread_create(&tid, NULL, session_thread, client) != 0) {
+            perror("Failed to create session thread");
+            close(*client);
+            free(client);
+        } else {
+            pthread_detach(tid);
+        }
+    }
+    return 0;
+}
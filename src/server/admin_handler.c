@@ -10,14 +10,37 @@
 #include <time.h>
 #include "../common/structures.h"
 #include "../common/constants.h"
+#include "lock_stats.h"
+#include "trace.h"
+#include "slow_log.h"
+#include "admission.h"
+#include "bulk_import.h"
+#include "bulk_export.h"
 #include "auth.h"
 #include "file_ops.h"
+#include "replication.h"
+#include "snapshot.h"
+#include "record_index.h"
+#include "string_heap.h"
+#include "department.h"
+#include "arena.h"
+#include "connection_pool.h"
+#include "key_filter.h"
+#include "search_index.h"
+#include "shard.h"
 
 // File paths
 #define STUDENT_FILE "data/students.dat"
 #define FACULTY_FILE "data/faculty.dat"
 #define CREDENTIALS_FILE "data/credentials.dat"
 
+// Listings are built here before being cut down to the response
+#define VIEW_BUFFER_SIZE 2048
+
+// Matches per page of SEARCH_STUDENTS / SEARCH_FACULTY; a full page still fits the response
+#define SEARCH_PAGE_SIZE 8
+#define SEARCH_MAX_PAGE 10000
+
 // Function declarations
 int handle_add_student(char *request, char *response);
 int handle_add_faculty(char *request, char *response);
@@ -32,19 +55,36 @@ int get_next_faculty_id();
 int create_user_credentials(const char *username, const char *role);
 int handle_view_students(char *params, char *response);
 int handle_view_faculty(char *params, char *response);
+int handle_view_department(char *params, char *response);
+int handle_lock_stats(char *params, char *response);
+int handle_trace_dump(char *params, char *response);
+int handle_slow_log(char *params, char *response);
+int handle_admission_stats(char *params, char *response);
+int handle_replication_status(char *params, char *response);
+int handle_arena_stats(char *params, char *response);
+int handle_connection_stats(char *params, char *response);
+int handle_filter_stats(char *params, char *response);
+int handle_search_students(char *params, char *response);
+int handle_search_faculty(char *params, char *response);
 // int handle_view_student_by_username(char *params, char *response);
 // int handle_view_faculty_by_username(char *params, char *response);
 
 
 // Main admin handler function
 int handle_admin_request(int client_socket, char *request) {
-    char response[1024];
-    char command[256];
-    char params[768];
+    char *response = arena_alloc(ARENA_RESPONSE_SIZE);
+    char *command = arena_alloc(ARENA_COMMAND_SIZE);
+    char *params = arena_alloc(ARENA_PARAMS_SIZE);
     int result = 0;
+    TRACE_SCOPE(__func__);
     
+    if (!response || !command || !params) {
+        write(client_socket, "ERROR:Out of memory", 19);
+        return -1;
+    }
+
     // Parse the request
-    if (sscanf(request, "%[^:]:%[^\n]", command, params) != 2) {
+    if (sscanf(request, "%255[^:]:%767[^\n]", command, params) != 2) {
         strcpy(response, "ERROR:Invalid request format");
         write(client_socket, response, strlen(response));
         return -1;
@@ -71,6 +111,34 @@ int handle_admin_request(int client_socket, char *request) {
         result = handle_view_students(params, response);
     } else if (strcmp(command, "VIEW_FACULTY") == 0) {
         result = handle_view_faculty(params, response);
+    } else if (strcmp(command, "VIEW_DEPARTMENT") == 0) {
+        result = handle_view_department(params, response);
+    } else if (strcmp(command, "LOCK_STATS") == 0) {
+        result = handle_lock_stats(params, response);
+    } else if (strcmp(command, "TRACE_DUMP") == 0) {
+        result = handle_trace_dump(params, response);
+    } else if (strcmp(command, "SLOW_LOG") == 0) {
+        result = handle_slow_log(params, response);
+    } else if (strcmp(command, "IMPORT") == 0) {
+        result = handle_import(client_socket, params, response);
+    } else if (strcmp(command, "EXPORT") == 0) {
+        result = handle_export(client_socket, params, response);
+    } else if (strcmp(command, "ADMISSION_STATS") == 0) {
+        result = handle_admission_stats(params, response);
+    } else if (strcmp(command, "REPLICATION_STATUS") == 0) {
+        result = handle_replication_status(params, response);
+    } else if (strcmp(command, "ARENA_STATS") == 0) {
+        result = handle_arena_stats(params, response);
+    } else if (strcmp(command, "CONNECTION_STATS") == 0) {
+        result = handle_connection_stats(params, response);
+    } else if (strcmp(command, "FILTER_STATS") == 0) {
+        result = handle_filter_stats(params, response);
+    } else if (strcmp(command, "SEARCH_STUDENTS") == 0) {
+        result = handle_search_students(params, response);
+    } else if (strcmp(command, "SEARCH_FACULTY") == 0) {
+        result = handle_search_faculty(params, response);
+    } else if (strcmp(command, "SNAPSHOT") == 0) {
+        result = handle_snapshot(params, response);
     // } else if (strcmp(command, "VIEW_STUDENT") == 0) {
     //     result = handle_view_student_by_username(params, response);
     // } else if (strcmp(command, "VIEW_FACULTY_MEMBER") == 0) {
@@ -87,10 +155,16 @@ int handle_admin_request(int client_socket, char *request) {
 // Helper function to find a student by username
 int handle_view_students(char *params, char *response) {
     struct Student student;
-    int fd;
-    char temp_buffer[2048] = ""; // Temporary buffer to hold all student data
+    int fd, heap_fd;
+    char *temp_buffer = arena_alloc(VIEW_BUFFER_SIZE); // Temporary buffer to hold all student data
     char student_info[256];
     
+    if (!temp_buffer) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+    temp_buffer[0] = '\0';
+
     // Open file with read lock
     fd = open(STUDENT_FILE, O_RDONLY);
     if (fd < 0) {
@@ -99,7 +173,7 @@ int handle_view_students(char *params, char *response) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, STUDENT_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock student file: %s", strerror(errno));
         return -1;
@@ -110,7 +184,10 @@ int handle_view_students(char *params, char *response) {
     strcat(temp_buffer, "ID | Username | Name | Email | Status\n");
     strcat(temp_buffer, "----------------------------------------\n");
     
-    while (read(fd, &student, sizeof(struct Student)) == sizeof(struct Student)) {
+    // Rows are decoded one at a time; the listing stops long before that matters
+    heap_fd = heap_open(&student_heap);
+    while (heap_read_records(&student_heap, fd, heap_fd, &student, 1) == 1) {
+        slow_log_note_scan(STUDENT_FILE, 1);
         snprintf(student_info, sizeof(student_info), "%d | %s | %s | %s | %s\n", 
                 student.id, 
                 student.username, 
@@ -119,7 +196,7 @@ int handle_view_students(char *params, char *response) {
                 student.active ? "Active" : "Inactive");
         
         // Check if we have enough space in the buffer
-        if (strlen(temp_buffer) + strlen(student_info) < sizeof(temp_buffer) - 1) {
+        if (strlen(temp_buffer) + strlen(student_info) < VIEW_BUFFER_SIZE - 1) {
             strcat(temp_buffer, student_info);
             count++;
         } else {
@@ -128,7 +205,10 @@ int handle_view_students(char *params, char *response) {
         }
     }
     
-    flock(fd, LOCK_UN);
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     
     if (count == 0) {
@@ -143,10 +223,16 @@ int handle_view_students(char *params, char *response) {
 // Function to view all faculty members
 int handle_view_faculty(char *params, char *response) {
     struct Faculty faculty;
-    int fd;
-    char temp_buffer[2048] = ""; // Temporary buffer to hold all faculty data
+    int fd, heap_fd;
+    char *temp_buffer = arena_alloc(VIEW_BUFFER_SIZE); // Temporary buffer to hold all faculty data
     char faculty_info[256];
     
+    if (!temp_buffer) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+    temp_buffer[0] = '\0';
+
     // Open file with read lock
     fd = open(FACULTY_FILE, O_RDONLY);
     if (fd < 0) {
@@ -155,7 +241,7 @@ int handle_view_faculty(char *params, char *response) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, FACULTY_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock faculty file: %s", strerror(errno));
         return -1;
@@ -166,7 +252,10 @@ int handle_view_faculty(char *params, char *response) {
     strcat(temp_buffer, "ID | Username | Name | Email | Department\n");
     strcat(temp_buffer, "----------------------------------------\n");
     
-    while (read(fd, &faculty, sizeof(struct Faculty)) == sizeof(struct Faculty)) {
+    // Rows are decoded one at a time; the listing stops long before that matters
+    heap_fd = heap_open(&faculty_heap);
+    while (heap_read_records(&faculty_heap, fd, heap_fd, &faculty, 1) == 1) {
+        slow_log_note_scan(FACULTY_FILE, 1);
         snprintf(faculty_info, sizeof(faculty_info), "%d | %s | %s | %s | %s\n", 
                 faculty.id, 
                 faculty.username, 
@@ -175,7 +264,7 @@ int handle_view_faculty(char *params, char *response) {
                 faculty.department);
         
         // Check if we have enough space in the buffer
-        if (strlen(temp_buffer) + strlen(faculty_info) < sizeof(temp_buffer) - 1) {
+        if (strlen(temp_buffer) + strlen(faculty_info) < VIEW_BUFFER_SIZE - 1) {
             strcat(temp_buffer, faculty_info);
             count++;
         } else {
@@ -184,7 +273,10 @@ int handle_view_faculty(char *params, char *response) {
         }
     }
     
-    flock(fd, LOCK_UN);
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     
     if (count == 0) {
@@ -196,6 +288,445 @@ int handle_view_faculty(char *params, char *response) {
     return 0;
 }
 
+// Scans that only need the fixed fields read the faculty and course files a block at a time
+#define DEPARTMENT_SCAN_BYTES (24 * 1024)
+
+static int compare_ids(const void *a, const void *b) {
+    int x = *(const int *)a, y = *(const int *)b;
+    return (x > y) - (x < y);
+}
+
+// Every department with its number of faculty (VIEW_DEPARTMENT:all)
+static int list_departments(char *response) {
+    struct Department *departments;
+    struct FacultyRow *rows = arena_alloc(DEPARTMENT_SCAN_BYTES);
+    int *counts = arena_calloc(MAX_DEPARTMENTS + 1, sizeof(int));
+    char *temp_buffer = arena_alloc(VIEW_BUFFER_SIZE);
+    char line[128];
+    int count;
+    ssize_t n;
+    int fd;
+
+    if (!rows || !counts || !temp_buffer) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+    strcpy(temp_buffer, "Code | Department | Faculty\n----------------------------------------\n");
+
+    fd = open(FACULTY_FILE, O_RDONLY);
+    if (fd >= 0) {
+        FLOCK(fd, LOCK_SH, FACULTY_FILE);
+        while ((n = read(fd, rows, DEPARTMENT_SCAN_BYTES)) > 0) {
+            slow_log_note_scan(FACULTY_FILE, n / sizeof(rows[0]));
+            for (size_t i = 0; i < n / sizeof(rows[0]); i++) {
+                if (rows[i].department > 0 && rows[i].department <= MAX_DEPARTMENTS) {
+                    counts[rows[i].department]++;
+                }
+            }
+        }
+        FLOCK(fd, LOCK_UN, FACULTY_FILE);
+        close(fd);
+    }
+
+    // The list is read after the scan, so it covers every code the rows used
+    count = department_count();
+    departments = arena_alloc((count > 0 ? count : 1) * sizeof(struct Department));
+    if (!departments) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+    count = department_list(departments, count);
+    if (count == 0) {
+        strcpy(response, "INFO:No departments found");
+        return 0;
+    }
+    for (int i = 0; i < count; i++) {
+        snprintf(line, sizeof(line), "%d | %s | %d\n", departments[i].code, departments[i].name,
+                 counts[departments[i].code]);
+        if (strlen(temp_buffer) + strlen(line) >= VIEW_BUFFER_SIZE - 1) {
+            break;
+        }
+        strcat(temp_buffer, line);
+    }
+    snprintf(response, 1024, "SUCCESS:%s", temp_buffer);
+    return 0;
+}
+
+// Faculty of one department and the courses they teach (VIEW_DEPARTMENT:<name>), or every
+// department (VIEW_DEPARTMENT:all). Faculty rows are matched on their department code, so
+// only the matching ones are decoded.
+int handle_view_department(char *params, char *response) {
+    char *scan;                      // faculty rows, then courses
+    struct FacultyRow *rows;
+    struct Course *courses;
+    struct FacultyRow *matched = NULL;
+    struct Faculty faculty;
+    char faculty_lines[600];         // leaves room in the response for the courses
+    char *course_lines;
+    char line[384];
+    int *ids = NULL;
+    int matches = 0, capacity = 0, course_count = 0;
+    int used;
+    int failed = 0, full = 0;
+    int code, fd, heap_fd;
+    ssize_t n;
+
+    if (strcmp(params, "all") == 0) {
+        return list_departments(response);
+    }
+    scan = arena_alloc(DEPARTMENT_SCAN_BYTES);
+    course_lines = arena_alloc(1024);
+    if (!scan || !course_lines) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+    rows = (struct FacultyRow *)scan;
+    courses = (struct Course *)scan;
+    course_lines[0] = '\0';
+    code = department_code(params);
+    if (code <= 0) {
+        sprintf(response, "ERROR:Unknown department '%.100s'", params);
+        return -1;
+    }
+
+    fd = open(FACULTY_FILE, O_RDONLY);
+    if (fd < 0) {
+        sprintf(response, "ERROR:Cannot open faculty file: %s", strerror(errno));
+        return -1;
+    }
+    if (FLOCK(fd, LOCK_SH, FACULTY_FILE) < 0) {
+        close(fd);
+        sprintf(response, "ERROR:Cannot lock faculty file: %s", strerror(errno));
+        return -1;
+    }
+
+    // Collect the matching rows; nothing else is decoded. The array is the arena's latest
+    // allocation, so it grows in place.
+    while (!failed && (n = read(fd, rows, DEPARTMENT_SCAN_BYTES)) > 0) {
+        slow_log_note_scan(FACULTY_FILE, n / sizeof(rows[0]));
+        for (size_t i = 0; i < n / sizeof(rows[0]); i++) {
+            if (rows[i].department != code) {
+                continue;
+            }
+            if (matches == capacity) {
+                int grown_capacity = capacity ? capacity * 2 : 64;
+                struct FacultyRow *grown = arena_grow(matched, capacity * sizeof(*grown),
+                                                      grown_capacity * sizeof(*grown));
+                if (!grown) {
+                    failed = 1;
+                    break;
+                }
+                matched = grown;
+                capacity = grown_capacity;
+            }
+            matched[matches++] = rows[i];
+        }
+    }
+    ids = matches > 0 ? arena_alloc(matches * sizeof(int)) : NULL;
+    if (matches > 0 && !ids) {
+        failed = 1;
+    }
+
+    snprintf(faculty_lines, sizeof(faculty_lines), "Department %.100s (code %d)\nFaculty (%d):\n",
+             params, code, matches);
+    heap_fd = heap_open(&faculty_heap);
+    for (int i = 0; i < matches && !failed; i++) {
+        ids[i] = matched[i].id;
+        // Rows past what fits in the response are only counted
+        if (full) {
+            continue;
+        }
+        if (heap_decode(&faculty_heap, heap_fd, &matched[i], 1, &faculty) < 0) {
+            failed = 1;
+            break;
+        }
+        snprintf(line, sizeof(line), "%d | %s | %s | %s\n", faculty.id, faculty.username, faculty.name,
+                 faculty.email);
+        if (strlen(faculty_lines) + strlen(line) < sizeof(faculty_lines) - 1) {
+            strcat(faculty_lines, line);
+        } else {
+            full = 1;
+        }
+    }
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
+    close(fd);
+
+    if (failed) {
+        strcpy(response, "ERROR:Failed to read faculty records");
+        return -1;
+    }
+    qsort(ids, matches, sizeof(int), compare_ids);
+
+    // Courses taught by any of them
+    fd = matches > 0 ? open(COURSE_FILE, O_RDONLY) : -1;
+    if (fd >= 0) {
+        FLOCK(fd, LOCK_SH, COURSE_FILE);
+        while ((n = read(fd, courses, DEPARTMENT_SCAN_BYTES / sizeof(courses[0]) * sizeof(courses[0]))) > 0) {
+            slow_log_note_scan(COURSE_FILE, n / sizeof(courses[0]));
+            for (size_t i = 0; i < n / sizeof(courses[0]); i++) {
+                if (!bsearch(&courses[i].faculty_id, ids, matches, sizeof(int), compare_ids)) {
+                    continue;
+                }
+                course_count++;
+                snprintf(line, sizeof(line), "Course %d | %s | %s | faculty %d | %d/%d\n",
+                         courses[i].course_id, courses[i].course_code, courses[i].course_name,
+                         courses[i].faculty_id, courses[i].enrolled_count, courses[i].max_seats);
+                // Whole lines only, within what is left of the response after the faculty
+                if (strlen(faculty_lines) + strlen(course_lines) + strlen(line) < 1024 - 32) {
+                    strcat(course_lines, line);
+                }
+            }
+        }
+        FLOCK(fd, LOCK_UN, COURSE_FILE);
+        close(fd);
+    }
+
+    // The course lines were cut to what is left after the faculty
+    used = snprintf(response, 1024, "SUCCESS:%sCourses (%d):\n", faculty_lines, course_count);
+    snprintf(response + used, 1024 - used, "%s", course_lines);
+    return 0;
+}
+
+// Report the most contended data file lock sites (LOCK_STATS:<top_n> or LOCK_STATS:reset)
+int handle_lock_stats(char *params, char *response) {
+    char report[ARENA_RESPONSE_SIZE - sizeof("SUCCESS:") + 1];
+    int top_n = 10;
+
+    if (strcmp(params, "reset") == 0) {
+        lock_stats_reset();
+        strcpy(response, "SUCCESS:Lock statistics reset");
+        return 0;
+    }
+
+    if (sscanf(params, "%d", &top_n) != 1 || top_n <= 0) {
+        top_n = 10;
+    }
+
+    if (lock_stats_report(top_n, report, sizeof(report)) < 0) {
+        strcpy(response, "ERROR:Failed to build lock report");
+        return -1;
+    }
+
+    snprintf(response, ARENA_RESPONSE_SIZE, "SUCCESS:%s", report);
+    return 0;
+}
+
+// Write buffered request traces as Chrome trace-event JSON (TRACE_DUMP:now)
+int handle_trace_dump(char *params, char *response) {
+    int events = trace_dump(trace_dump_file);
+
+    if (events < 0) {
+        sprintf(response, "ERROR:Failed to write trace file: %s", strerror(errno));
+        return -1;
+    }
+
+    sprintf(response, "SUCCESS:Wrote %d trace events to %s", events, trace_dump_file);
+    return 0;
+}
+
+// Show or change the slow-request threshold (SLOW_LOG:status, SLOW_LOG:<ms>, SLOW_LOG:off)
+int handle_slow_log(char *params, char *response) {
+    int threshold;
+
+    if (strcmp(params, "status") == 0) {
+        threshold = slow_log_get_threshold();
+        if (threshold < 0) {
+            strcpy(response, "SUCCESS:Slow request log is off");
+        } else {
+            sprintf(response, "SUCCESS:Logging requests slower than %d ms to %s", threshold, SLOW_LOG_FILE);
+        }
+        return 0;
+    }
+
+    if (strcmp(params, "off") == 0) {
+        threshold = -1;
+    } else if (sscanf(params, "%d", &threshold) != 1 || threshold < 0) {
+        strcpy(response, "ERROR:Invalid parameters for SLOW_LOG");
+        return -1;
+    }
+
+    slow_log_set_threshold(threshold);
+    if (threshold < 0) {
+        strcpy(response, "SUCCESS:Slow request log turned off");
+    } else {
+        sprintf(response, "SUCCESS:Slow request threshold set to %d ms", threshold);
+    }
+    return 0;
+}
+
+// Report the busiest per-course enrollment queues (ADMISSION_STATS:<top_n>)
+int handle_admission_stats(char *params, char *response) {
+    char report[ARENA_RESPONSE_SIZE - sizeof("SUCCESS:") + 1];
+    int top_n = 10;
+
+    if (sscanf(params, "%d", &top_n) != 1 || top_n <= 0) {
+        top_n = 10;
+    }
+
+    if (admission_report(top_n, report, sizeof(report)) < 0) {
+        strcpy(response, "ERROR:Failed to build admission report");
+        return -1;
+    }
+
+    snprintf(response, ARENA_RESPONSE_SIZE, "SUCCESS:%s", report);
+    return 0;
+}
+
+int handle_replication_status(char *params, char *response) {
+    char report[ARENA_RESPONSE_SIZE - sizeof("SUCCESS:") + 1];
+
+    replication_report(report, sizeof(report));
+    snprintf(response, ARENA_RESPONSE_SIZE, "SUCCESS:%s", report);
+    return 0;
+}
+
+// Per-request scratch memory high-water marks (ARENA_STATS:show or ARENA_STATS:reset)
+int handle_arena_stats(char *params, char *response) {
+    char report[ARENA_RESPONSE_SIZE - sizeof("SUCCESS:") + 1];
+
+    if (strcmp(params, "reset") == 0) {
+        arena_stats_reset();
+        strcpy(response, "SUCCESS:Arena statistics reset");
+        return 0;
+    }
+
+    if (arena_report(report, sizeof(report)) < 0) {
+        strcpy(response, "ERROR:Failed to build arena report");
+        return -1;
+    }
+
+    snprintf(response, ARENA_RESPONSE_SIZE, "SUCCESS:%s", report);
+    return 0;
+}
+
+// Occupancy of the pooled per-connection state (CONNECTION_STATS:show)
+int handle_connection_stats(char *params, char *response) {
+    char report[ARENA_RESPONSE_SIZE - sizeof("SUCCESS:") + 1];
+
+    if (connection_pool_report(report, sizeof(report)) < 0) {
+        strcpy(response, "ERROR:Failed to build connection report");
+        return -1;
+    }
+
+    snprintf(response, ARENA_RESPONSE_SIZE, "SUCCESS:%s", report);
+    return 0;
+}
+
+// Fill and hit rates of the duplicate-check filters (FILTER_STATS:show)
+int handle_filter_stats(char *params, char *response) {
+    char report[ARENA_RESPONSE_SIZE - sizeof("SUCCESS:") + 1];
+
+    if (key_filter_report(report, sizeof(report)) < 0) {
+        strcpy(response, "ERROR:Failed to build filter report");
+        return -1;
+    }
+
+    snprintf(response, ARENA_RESPONSE_SIZE, "SUCCESS:%s", report);
+    return 0;
+}
+
+// One page of the students or faculty whose username, name or email contains the text
+static int handle_search(const struct HeapTable *table, const char *label, char *params, char *response) {
+    union {
+        struct Student students[SEARCH_PAGE_SIZE];
+        struct Faculty faculty[SEARCH_PAGE_SIZE];
+    } *results = arena_alloc(sizeof(*results));
+    char *temp_buffer = arena_alloc(VIEW_BUFFER_SIZE);
+    char *page_separator = strrchr(params, ':');
+    char line[320];
+    long candidates;
+    size_t length;
+    int page = 1;
+    int found, fd;
+
+    if (!results || !temp_buffer) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+
+    // Parameters: text[:page]
+    if (page_separator && page_separator[1] != '\0' &&
+        strspn(page_separator + 1, "0123456789") == strlen(page_separator + 1)) {
+        page = atoi(page_separator + 1);
+        *page_separator = '\0';
+    }
+    length = strlen(params);
+    if (length < SEARCH_MIN_TEXT || length > SEARCH_MAX_TEXT) {
+        sprintf(response, "ERROR:Search text must be %d to %d characters", SEARCH_MIN_TEXT, SEARCH_MAX_TEXT);
+        return -1;
+    }
+    if (page < 1 || page > SEARCH_MAX_PAGE) {
+        sprintf(response, "ERROR:Page must be between 1 and %d", SEARCH_MAX_PAGE);
+        return -1;
+    }
+
+    fd = open(table->path, O_RDONLY);
+    if (fd < 0) {
+        sprintf(response, "INFO:No %s found", label);
+        return 0;
+    }
+    if (FLOCK(fd, LOCK_SH, table->path) < 0) {
+        close(fd);
+        sprintf(response, "ERROR:Cannot lock %s file: %s", label, strerror(errno));
+        return -1;
+    }
+    found = search_index_find(table, fd, params, (page - 1) * SEARCH_PAGE_SIZE, SEARCH_PAGE_SIZE, results,
+                              &candidates);
+    FLOCK(fd, LOCK_UN, table->path);
+    close(fd);
+
+    if (found < 0) {
+        strcpy(response, "ERROR:Search failed");
+        return -1;
+    }
+    if (found == 0) {
+        snprintf(response, 1024, "INFO:No %s match '%s'%s", label, params, page > 1 ? " on this page" : "");
+        return 0;
+    }
+
+    snprintf(temp_buffer, VIEW_BUFFER_SIZE, "Matches %d-%d for '%s' (at most %ld)\n%s\n"
+             "----------------------------------------\n",
+             (page - 1) * SEARCH_PAGE_SIZE + 1, (page - 1) * SEARCH_PAGE_SIZE + found, params, candidates,
+             table == &student_heap ? "ID | Username | Name | Email | Status" :
+                                      "ID | Username | Name | Email | Department");
+    for (int i = 0; i < found; i++) {
+        if (table == &student_heap) {
+            const struct Student *student = &results->students[i];
+
+            snprintf(line, sizeof(line), "%d | %s | %s | %s | %s\n", student->id, student->username,
+                     student->name, student->email, student->active ? "Active" : "Inactive");
+        } else {
+            const struct Faculty *faculty = &results->faculty[i];
+
+            snprintf(line, sizeof(line), "%d | %s | %s | %s | %s\n", faculty->id, faculty->username,
+                     faculty->name, faculty->email, faculty->department);
+        }
+        // Leave room for the prefix and the page hint within the response
+        if (strlen(temp_buffer) + strlen(line) >= ARENA_RESPONSE_SIZE - 48) {
+            break;
+        }
+        strcat(temp_buffer, line);
+    }
+    if (found == SEARCH_PAGE_SIZE) {
+        snprintf(line, sizeof(line), "More may follow on page %d\n", page + 1);
+        strcat(temp_buffer, line);
+    }
+
+    snprintf(response, 1024, "SUCCESS:%s", temp_buffer);
+    return 0;
+}
+
+int handle_search_students(char *params, char *response) {
+    return handle_search(&student_heap, "students", params, response);
+}
+
+int handle_search_faculty(char *params, char *response) {
+    return handle_search(&faculty_heap, "faculty", params, response);
+}
+
 // Function to view a specific student by username
 // int handle_view_student_by_username(char *params, char *response) {
 //     char username[50];
@@ -328,23 +859,16 @@ int find_student_by_username(const char *username, struct Student *student, off_
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, STUDENT_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    while (read(fd, student, sizeof(struct Student)) == sizeof(struct Student)) {
-        if (strcmp(student->username, username) == 0) {
-            flock(fd, LOCK_UN);
-            close(fd);
-            return 0; // Found
-        }
-        *offset += sizeof(struct Student);
-    }
+    *offset = record_index_find_name(INDEX_STUDENT_USERNAME, fd, username, student);
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
-    return -1; // Not found
+    return *offset >= 0 ? 0 : -1;
 }
 
 // Helper function to find a faculty by username
@@ -358,31 +882,28 @@ int find_faculty_by_username(const char *username, struct Faculty *faculty, off_
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, FACULTY_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    while (read(fd, faculty, sizeof(struct Faculty)) == sizeof(struct Faculty)) {
-        if (strcmp(faculty->username, username) == 0) {
-            flock(fd, LOCK_UN);
-            close(fd);
-            return 0; // Found
-        }
-        *offset += sizeof(struct Faculty);
-    }
+    *offset = record_index_find_name(INDEX_FACULTY_USERNAME, fd, username, faculty);
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
-    return -1; // Not found
+    return *offset >= 0 ? 0 : -1;
 }
 
 // Check if student username already exists in the students file
 int student_username_exists(const char *username) {
-    struct Student student;
     int fd;
     int exists = 0;
     
+    // A username the filter has never seen is new, without opening the file
+    if (!key_filter_may_contain(FILTER_STUDENT_USERNAME, username)) {
+        return 0;
+    }
+    
     // Open student file
     fd = open(STUDENT_FILE, O_RDONLY);
     if (fd < 0) {
@@ -394,22 +915,17 @@ int student_username_exists(const char *username) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, STUDENT_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for the username
-    while (read(fd, &student, sizeof(struct Student)) == sizeof(struct Student)) {
-        if (strcmp(student.username, username) == 0) {
-            // Username already exists
-            exists = 1;
-            break;
-        }
-    }
+    // Look up the username
+    exists = record_index_find_name(INDEX_STUDENT_USERNAME, fd, username, NULL) >= 0;
+    key_filter_note_lookup(FILTER_STUDENT_USERNAME, exists);
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     
     return exists;
@@ -452,6 +968,12 @@ int handle_add_student(char *params, char *response) {
     
     student.active = 1;
     
+    // The router's validation pass stops here, before anything is written
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Student can be added with ID %d", student.id);
+        return 0;
+    }
+    
     // Open file with write lock
     fd = open(STUDENT_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
     if (fd < 0) {
@@ -460,22 +982,22 @@ int handle_add_student(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, STUDENT_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock student file: %s", strerror(errno));
         return -1;
     }
     
-    // Write student record
-    if (write(fd, &student, sizeof(struct Student)) != sizeof(struct Student)) {
-        flock(fd, LOCK_UN);
+    // Write student record: strings to the heap, then the row
+    if (append_heap_records(&student_heap, fd, &student, 1) < 0) {
+        FLOCK(fd, LOCK_UN, STUDENT_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to write student record: %s", strerror(errno));
         return -1;
     }
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     
     // Create user credentials
@@ -490,10 +1012,14 @@ int handle_add_student(char *params, char *response) {
 
 // Check if faculty username already exists in the faculty file
 int faculty_username_exists(const char *username) {
-    struct Faculty faculty;
     int fd;
     int exists = 0;
     
+    // A username the filter has never seen is new, without opening the file
+    if (!key_filter_may_contain(FILTER_FACULTY_USERNAME, username)) {
+        return 0;
+    }
+    
     // Open faculty file
     fd = open(FACULTY_FILE, O_RDONLY);
     if (fd < 0) {
@@ -505,22 +1031,17 @@ int faculty_username_exists(const char *username) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, FACULTY_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for the username
-    while (read(fd, &faculty, sizeof(struct Faculty)) == sizeof(struct Faculty)) {
-        if (strcmp(faculty.username, username) == 0) {
-            // Username already exists
-            exists = 1;
-            break;
-        }
-    }
+    // Look up the username
+    exists = record_index_find_name(INDEX_FACULTY_USERNAME, fd, username, NULL) >= 0;
+    key_filter_note_lookup(FILTER_FACULTY_USERNAME, exists);
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     
     return exists;
@@ -555,6 +1076,12 @@ int handle_add_faculty(char *params, char *response) {
     strncpy(faculty.email, email, sizeof(faculty.email) - 1);
     strncpy(faculty.department, department, sizeof(faculty.department) - 1);
     
+    // The router's validation pass stops here, before anything is written
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Faculty can be added with ID %d", faculty.id);
+        return 0;
+    }
+    
     // Open file with write lock
     fd = open(FACULTY_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
     if (fd < 0) {
@@ -563,22 +1090,22 @@ int handle_add_faculty(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, FACULTY_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock faculty file: %s", strerror(errno));
         return -1;
     }
     
-    // Write faculty record
-    if (write(fd, &faculty, sizeof(struct Faculty)) != sizeof(struct Faculty)) {
-        flock(fd, LOCK_UN);
+    // Write faculty record: strings to the heap, then the row
+    if (append_heap_records(&faculty_heap, fd, &faculty, 1) < 0) {
+        FLOCK(fd, LOCK_UN, FACULTY_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to write faculty record: %s", strerror(errno));
         return -1;
     }
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     
     // Create user credentials
@@ -610,6 +1137,11 @@ int handle_update_student_status(char *params, char *response) {
         return -1;
     }
     
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Student %s can be updated", username);
+        return 0;
+    }
+    
     // Open file with read/write access
     fd = open(STUDENT_FILE, O_RDWR);
     if (fd < 0) {
@@ -618,27 +1150,24 @@ int handle_update_student_status(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, STUDENT_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock student file: %s", strerror(errno));
         return -1;
     }
     
-    // Seek to the record position
-    lseek(fd, offset, SEEK_SET);
-    
     // Update status
     student.active = status;
     
     // Write updated record
-    if (write(fd, &student, sizeof(struct Student)) != sizeof(struct Student)) {
-        flock(fd, LOCK_UN);
+    if (update_heap_record(&student_heap, fd, offset, &student) < 0) {
+        FLOCK(fd, LOCK_UN, STUDENT_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to update student status: %s", strerror(errno));
         return -1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     sprintf(response, "SUCCESS:Student status updated for %s", username);
     return 0;
@@ -662,6 +1191,11 @@ int handle_update_student_name(char *params, char *response) {
         return -1;
     }
     
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Student %s can be updated", username);
+        return 0;
+    }
+    
     // Open file with read/write access
     fd = open(STUDENT_FILE, O_RDWR);
     if (fd < 0) {
@@ -670,7 +1204,7 @@ int handle_update_student_name(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, STUDENT_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock student file: %s", strerror(errno));
         return -1;
@@ -679,18 +1213,15 @@ int handle_update_student_name(char *params, char *response) {
     // Update student name
     strncpy(student.name, name, sizeof(student.name) - 1);
     
-    // Seek to the record position
-    lseek(fd, offset, SEEK_SET);
-    
     // Write updated record
-    if (write(fd, &student, sizeof(struct Student)) != sizeof(struct Student)) {
-        flock(fd, LOCK_UN);
+    if (update_heap_record(&student_heap, fd, offset, &student) < 0) {
+        FLOCK(fd, LOCK_UN, STUDENT_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to update student name: %s", strerror(errno));
         return -1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     sprintf(response, "SUCCESS:Student name updated for %s", username);
     return 0;
@@ -714,6 +1245,11 @@ int handle_update_student_email(char *params, char *response) {
         return -1;
     }
     
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Student %s can be updated", username);
+        return 0;
+    }
+    
     // Open file with read/write access
     fd = open(STUDENT_FILE, O_RDWR);
     if (fd < 0) {
@@ -722,7 +1258,7 @@ int handle_update_student_email(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, STUDENT_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock student file: %s", strerror(errno));
         return -1;
@@ -731,18 +1267,15 @@ int handle_update_student_email(char *params, char *response) {
     // Update student email
     strncpy(student.email, email, sizeof(student.email) - 1);
     
-    // Seek to the record position
-    lseek(fd, offset, SEEK_SET);
-    
     // Write updated record
-    if (write(fd, &student, sizeof(struct Student)) != sizeof(struct Student)) {
-        flock(fd, LOCK_UN);
+    if (update_heap_record(&student_heap, fd, offset, &student) < 0) {
+        FLOCK(fd, LOCK_UN, STUDENT_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to update student email: %s", strerror(errno));
         return -1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     sprintf(response, "SUCCESS:Student email updated for %s", username);
     return 0;
@@ -766,6 +1299,11 @@ int handle_update_faculty_name(char *params, char *response) {
         return -1;
     }
     
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Faculty %s can be updated", username);
+        return 0;
+    }
+    
     // Open file with read/write access
     fd = open(FACULTY_FILE, O_RDWR);
     if (fd < 0) {
@@ -774,7 +1312,7 @@ int handle_update_faculty_name(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, FACULTY_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock faculty file: %s", strerror(errno));
         return -1;
@@ -783,18 +1321,15 @@ int handle_update_faculty_name(char *params, char *response) {
     // Update faculty name
     strncpy(faculty.name, name, sizeof(faculty.name) - 1);
     
-    // Seek to the record position
-    lseek(fd, offset, SEEK_SET);
-    
     // Write updated record
-    if (write(fd, &faculty, sizeof(struct Faculty)) != sizeof(struct Faculty)) {
-        flock(fd, LOCK_UN);
+    if (update_heap_record(&faculty_heap, fd, offset, &faculty) < 0) {
+        FLOCK(fd, LOCK_UN, FACULTY_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to update faculty name: %s", strerror(errno));
         return -1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     sprintf(response, "SUCCESS:Faculty name updated for %s", username);
     return 0;
@@ -818,6 +1353,11 @@ int handle_update_faculty_email(char *params, char *response) {
         return -1;
     }
     
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Faculty %s can be updated", username);
+        return 0;
+    }
+    
     // Open file with read/write access
     fd = open(FACULTY_FILE, O_RDWR);
     if (fd < 0) {
@@ -826,7 +1366,7 @@ int handle_update_faculty_email(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, FACULTY_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock faculty file: %s", strerror(errno));
         return -1;
@@ -835,18 +1375,15 @@ int handle_update_faculty_email(char *params, char *response) {
     // Update faculty email
     strncpy(faculty.email, email, sizeof(faculty.email) - 1);
     
-    // Seek to the record position
-    lseek(fd, offset, SEEK_SET);
-    
     // Write updated record
-    if (write(fd, &faculty, sizeof(struct Faculty)) != sizeof(struct Faculty)) {
-        flock(fd, LOCK_UN);
+    if (update_heap_record(&faculty_heap, fd, offset, &faculty) < 0) {
+        FLOCK(fd, LOCK_UN, FACULTY_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to update faculty email: %s", strerror(errno));
         return -1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     sprintf(response, "SUCCESS:Faculty email updated for %s", username);
     return 0;
@@ -859,10 +1396,14 @@ int handle_update_faculty_dept(char *params, char *response) {
     int fd;
     
     // Parse parameters
-    if (sscanf(params, "%[^:]:%[^\n]", username, department) != 2) {
+    if (sscanf(params, "%49[^:]:%99[^\n]", username, department) != 2) {
         strcpy(response, "ERROR:Invalid parameters for UPDATE_FACULTY_DEPT");
         return -1;
     }
+    if (strlen(department) >= MAX_DEPARTMENT_LENGTH) {
+        sprintf(response, "ERROR:Department name longer than %d characters", MAX_DEPARTMENT_LENGTH - 1);
+        return -1;
+    }
     
     // Find faculty by username
     if (find_faculty_by_username(username, &faculty, &offset) < 0) {
@@ -870,6 +1411,11 @@ int handle_update_faculty_dept(char *params, char *response) {
         return -1;
     }
     
+    if (shard_check_only()) {
+        sprintf(response, "SUCCESS:Faculty %s can be updated", username);
+        return 0;
+    }
+    
     // Open file with read/write access
     fd = open(FACULTY_FILE, O_RDWR);
     if (fd < 0) {
@@ -878,7 +1424,7 @@ int handle_update_faculty_dept(char *params, char *response) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, FACULTY_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock faculty file: %s", strerror(errno));
         return -1;
@@ -887,26 +1433,22 @@ int handle_update_faculty_dept(char *params, char *response) {
     // Update faculty department
     strncpy(faculty.department, department, sizeof(faculty.department) - 1);
     
-    // Seek to the record position
-    lseek(fd, offset, SEEK_SET);
-    
-    // Write updated record
-    if (write(fd, &faculty, sizeof(struct Faculty)) != sizeof(struct Faculty)) {
-        flock(fd, LOCK_UN);
+    // Write updated record; a new department name is interned on the way
+    if (update_heap_record(&faculty_heap, fd, offset, &faculty) < 0) {
+        FLOCK(fd, LOCK_UN, FACULTY_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to update faculty department: %s", strerror(errno));
         return -1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     sprintf(response, "SUCCESS:Faculty department updated for %s", username);
     return 0;
 }
 
 int get_next_student_id() {
-    struct Student student;
-    int fd, max_id = 0;
+    int fd, max_id;
     
     fd = open(STUDENT_FILE, O_RDONLY);
     if (fd < 0) {
@@ -914,23 +1456,18 @@ int get_next_student_id() {
     }
     
     // Apply read lock
-    flock(fd, LOCK_SH);
+    FLOCK(fd, LOCK_SH, STUDENT_FILE);
     
-    while (read(fd, &student, sizeof(struct Student)) == sizeof(struct Student)) {
-        if (student.id > max_id) {
-            max_id = student.id;
-        }
-    }
+    max_id = record_index_max_id(INDEX_STUDENT_ID, fd);
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     
-    return max_id + 1;
+    return max_id > 0 ? max_id + 1 : 1;
 }
 
 int get_next_faculty_id() {
-    struct Faculty faculty;
-    int fd, max_id = 0;
+    int fd, max_id;
     
     fd = open(FACULTY_FILE, O_RDONLY);
     if (fd < 0) {
@@ -938,18 +1475,14 @@ int get_next_faculty_id() {
     }
     
     // Apply read lock
-    flock(fd, LOCK_SH);
+    FLOCK(fd, LOCK_SH, FACULTY_FILE);
     
-    while (read(fd, &faculty, sizeof(struct Faculty)) == sizeof(struct Faculty)) {
-        if (faculty.id > max_id) {
-            max_id = faculty.id;
-        }
-    }
+    max_id = record_index_max_id(INDEX_FACULTY_ID, fd);
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     
-    return max_id + 1;
+    return max_id > 0 ? max_id + 1 : 1;
 }
 
 int create_user_credentials(const char *username, const char *role) {
@@ -968,19 +1501,20 @@ int create_user_credentials(const char *username, const char *role) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, CREDENTIALS_FILE) < 0) {
         close(fd);
         return -1;
     }
     
     // Write credentials
     if (write(fd, &cred, sizeof(struct Credentials)) != sizeof(struct Credentials)) {
-        flock(fd, LOCK_UN);
+        FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
         close(fd);
         return -1;
     }
+    replication_log_write(fd, CREDENTIALS_FILE, &cred, sizeof(struct Credentials));
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
     close(fd);
     
     return 0;
@@ -10,6 +10,12 @@ int handle_add_faculty(char *request, char *response);
 int handle_update_student_status(char *request, char *response);
 int handle_update_student_details(char *request, char *response);
 int handle_update_faculty_details(char *request, char *response);
+int handle_view_students(char *params, char *response);
+int handle_view_faculty(char *params, char *response);
+int handle_lock_stats(char *params, char *response);
+int handle_trace_dump(char *params, char *response);
+int handle_slow_log(char *params, char *response);
+int handle_admission_stats(char *params, char *response);
 
 // Helper functions
 int get_next_student_id();
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "admission.h"
+#include "trace.h"
+#include "slow_log.h"
+
+#define ADMISSION_BUCKETS 256
+
+// FIFO queue and sequencer state for one course
+struct CourseQueue {
+    int course_id;
+    pthread_mutex_t mutex;
+    pthread_cond_t applied;
+    struct AdmissionTicket *head;
+    struct AdmissionTicket *tail;
+    int sequencing;                   // a thread is currently draining this queue
+    unsigned long issued;
+    unsigned long served;
+    unsigned long batches;
+    int max_depth;
+    struct CourseQueue *next_bucket;
+};
+
+// Queues are created on first use and live for the life of the server
+static struct CourseQueue *queue_table[ADMISSION_BUCKETS];
+static pthread_mutex_t table_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// One descriptor per process for the course locks: closing any descriptor of a file drops
+// every fcntl lock the process holds on it, so this one is never closed
+static int course_lock_fd = -1;
+static pthread_once_t course_lock_once = PTHREAD_ONCE_INIT;
+
+static void open_course_lock_file() {
+    course_lock_fd = open(ADMISSION_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+}
+
+// Lock or unlock byte course_id of the lock file. fcntl locks belong to the process, so
+// they only order sequencers of different processes; within one process the queue's
+// sequencing flag already makes the sequencer exclusive.
+static int set_course_lock(int course_id, short type) {
+    struct flock lock;
+
+    pthread_once(&course_lock_once, open_course_lock_file);
+    if (course_lock_fd < 0) {
+        return -1;
+    }
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = course_id;
+    lock.l_len = 1;
+    while (fcntl(course_lock_fd, F_SETLKW, &lock) < 0) {
+        // The kernel's deadlock check sees processes, not threads, so a multi-course
+        // holder waiting on one worker whose other thread waits on it looks like a cycle
+        if (errno == EDEADLK) {
+            usleep(1000);
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void fail_batch(struct AdmissionTicket **batch, int count) {
+    for (int i = 0; i < count; i++) {
+        strcpy(batch[i]->response, "ERROR:Course is busy, try again");
+        batch[i]->result = -1;
+    }
+}
+
+// Apply a batch holding the course's lock, so workers never interleave their
+// read-check-update sequences on the same course
+static void apply_locked(int course_id, admission_apply_fn apply, struct AdmissionTicket **batch,
+                         int count) {
+    if (set_course_lock(course_id, F_WRLCK) < 0) {
+        fail_batch(batch, count);
+        return;
+    }
+    apply(course_id, batch, count);
+    set_course_lock(course_id, F_UNLCK);
+}
+
+static struct CourseQueue *get_course_queue(int course_id) {
+    unsigned int bucket = (unsigned int)course_id % ADMISSION_BUCKETS;
+    struct CourseQueue *queue;
+
+    pthread_mutex_lock(&table_mutex);
+    for (queue = queue_table[bucket]; queue; queue = queue->next_bucket) {
+        if (queue->course_id == course_id) {
+            break;
+        }
+    }
+    if (!queue) {
+        queue = calloc(1, sizeof(struct CourseQueue));
+        if (queue) {
+            queue->course_id = course_id;
+            pthread_mutex_init(&queue->mutex, NULL);
+            pthread_cond_init(&queue->applied, NULL);
+            queue->next_bucket = queue_table[bucket];
+            queue_table[bucket] = queue;
+        }
+    }
+    pthread_mutex_unlock(&table_mutex);
+    return queue;
+}
+
+// Apply queued tickets in order until the caller's own ticket is done
+// (caller holds queue->mutex and is the sequencer)
+static void run_sequencer(struct CourseQueue *queue, struct AdmissionTicket *own) {
+    struct AdmissionTicket *batch[ADMISSION_MAX_BATCH];
+    struct RequestContext *requests[ADMISSION_MAX_BATCH];
+    TRACE_SCOPE("admission_sequencer");
+
+    while (queue->head && !own->done) {
+        int count = 0;
+        admission_apply_fn apply = queue->head->apply;
+
+        // Take the longest run at the head that shares an apply function
+        while (queue->head && queue->head->apply == apply && count < ADMISSION_MAX_BATCH) {
+            batch[count++] = queue->head;
+            queue->head = queue->head->next;
+        }
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+        queue->batches++;
+
+        for (int i = 0; i < count; i++) {
+            requests[i] = batch[i]->request;
+        }
+
+        // New arrivals keep queueing behind us while the batch is applied. Its lock waits
+        // and scans serve every ticket in it, not just the sequencer's own request.
+        pthread_mutex_unlock(&queue->mutex);
+        slow_log_charge_begin();
+        apply_locked(queue->course_id, apply, batch, count);
+        slow_log_charge_end(requests, count);
+        pthread_mutex_lock(&queue->mutex);
+
+        for (int i = 0; i < count; i++) {
+            batch[i]->done = 1;
+        }
+        queue->served += count;
+        pthread_cond_broadcast(&queue->applied);
+    }
+}
+
+int admission_submit(int course_id, struct AdmissionTicket *ticket) {
+    struct CourseQueue *queue = get_course_queue(course_id);
+    int depth;
+
+    if (!queue) {
+        // No memory for a queue: apply directly, unsequenced
+        ticket->position = 1;
+        apply_locked(course_id, ticket->apply, &ticket, 1);
+        return ticket->result;
+    }
+
+    ticket->done = 0;
+    ticket->request = slow_log_current();
+    ticket->next = NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->tail) {
+        queue->tail->next = ticket;
+    } else {
+        queue->head = ticket;
+    }
+    queue->tail = ticket;
+    queue->issued++;
+    depth = queue->issued - queue->served;
+    ticket->position = depth;
+    if (depth > queue->max_depth) {
+        queue->max_depth = depth;
+    }
+
+    // Whoever finds the course idle becomes its sequencer until its own ticket is applied,
+    // then hands the role to a waiter (or an admission_acquire caller) so no client is
+    // stuck serving everyone else
+    int traced = -1;
+    while (!ticket->done) {
+        if (!queue->sequencing) {
+            queue->sequencing = 1;
+            run_sequencer(queue, ticket);
+            queue->sequencing = 0;
+            pthread_cond_broadcast(&queue->applied);
+        } else {
+            if (traced < 0) {
+                traced = trace_begin("admission_wait");
+            }
+            pthread_cond_wait(&queue->applied, &queue->mutex);
+        }
+    }
+    if (traced >= 0) {
+        trace_end_to(traced);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return ticket->result;
+}
+
+int admission_acquire(const int *course_ids, int count) {
+    TRACE_SCOPE("admission_acquire");
+
+    for (int i = 0; i < count; i++) {
+        struct CourseQueue *queue = get_course_queue(course_ids[i]);
+
+        if (!queue) {
+            admission_release(course_ids, i);
+            return -1;
+        }
+
+        pthread_mutex_lock(&queue->mutex);
+        while (queue->sequencing) {
+            pthread_cond_wait(&queue->applied, &queue->mutex);
+        }
+        queue->sequencing = 1;
+        pthread_mutex_unlock(&queue->mutex);
+
+        // Ascending order across processes too
+        if (set_course_lock(course_ids[i], F_WRLCK) < 0) {
+            pthread_mutex_lock(&queue->mutex);
+            queue->sequencing = 0;
+            pthread_cond_broadcast(&queue->applied);
+            pthread_mutex_unlock(&queue->mutex);
+            admission_release(course_ids, i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void admission_release(const int *course_ids, int count) {
+    for (int i = count - 1; i >= 0; i--) {
+        struct CourseQueue *queue = get_course_queue(course_ids[i]);
+
+        set_course_lock(course_ids[i], F_UNLCK);
+        if (!queue) {
+            continue;
+        }
+
+        // Wake queued tickets so one of them takes over the role
+        pthread_mutex_lock(&queue->mutex);
+        queue->sequencing = 0;
+        pthread_cond_broadcast(&queue->applied);
+        pthread_mutex_unlock(&queue->mutex);
+    }
+}
+
+static int compare_by_issued(const void *a, const void *b) {
+    const struct CourseQueue *qa = *(struct CourseQueue * const *)a;
+    const struct CourseQueue *qb = *(struct CourseQueue * const *)b;
+
+    if (qa->issued == qb->issued) {
+        return 0;
+    }
+    return qa->issued < qb->issued ? 1 : -1;
+}
+
+int admission_report(int top_n, char *buffer, size_t buffer_size) {
+    struct CourseQueue **queues;
+    int count = 0;
+    size_t used;
+
+    pthread_mutex_lock(&table_mutex);
+    for (int b = 0; b < ADMISSION_BUCKETS; b++) {
+        for (struct CourseQueue *queue = queue_table[b]; queue; queue = queue->next_bucket) {
+            count++;
+        }
+    }
+    queues = malloc(sizeof(struct CourseQueue *) * (count > 0 ? count : 1));
+    if (!queues) {
+        pthread_mutex_unlock(&table_mutex);
+        return -1;
+    }
+    count = 0;
+    for (int b = 0; b < ADMISSION_BUCKETS; b++) {
+        for (struct CourseQueue *queue = queue_table[b]; queue; queue = queue->next_bucket) {
+            queues[count++] = queue;
+        }
+    }
+    pthread_mutex_unlock(&table_mutex);
+
+    qsort(queues, count, sizeof(struct CourseQueue *), compare_by_issued);
+    if (top_n <= 0 || top_n > count) {
+        top_n = count;
+    }
+
+    used = snprintf(buffer, buffer_size, "Top %d of %d course queues by requests\n"
+                    "Course | Requests | Batches | Waiting | Max depth\n", top_n, count);
+    for (int i = 0; i < top_n && used < buffer_size; i++) {
+        struct CourseQueue *queue = queues[i];
+        int written;
+
+        pthread_mutex_lock(&queue->mutex);
+        written = snprintf(buffer + used, buffer_size - used, "%d | %lu | %lu | %lu | %d\n",
+                           queue->course_id, queue->issued, queue->batches,
+                           queue->issued - queue->served, queue->max_depth);
+        pthread_mutex_unlock(&queue->mutex);
+        if (written < 0 || (size_t)written >= buffer_size - used) {
+            buffer[used] = '\0';
+            break;
+        }
+        used += written;
+    }
+
+    free(queues);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stddef.h>
+
+// Byte course_id of this file is locked while a process applies changes to the course
+#define ADMISSION_LOCK_FILE "data/admission.lock"
+
+// Largest run of tickets a sequencer hands to one apply call
+#define ADMISSION_MAX_BATCH 64
+
+struct AdmissionTicket;
+struct RequestContext;
+
+/**
+ * Applies a run of queued tickets for one course, in queue order
+ * @param course_id Course the tickets were queued on
+ * @param batch Tickets to apply; set result and response on each
+ * @param count Number of tickets in batch
+ */
+typedef void (*admission_apply_fn)(int course_id, struct AdmissionTicket **batch, int count);
+
+// One queued request; lives on the submitting thread's stack until it is applied
+struct AdmissionTicket {
+    int student_id;
+    admission_apply_fn apply;
+    char *response;
+    int result;
+    int position;                     // queue position when the ticket was admitted
+    int done;
+    struct RequestContext *request;   // slow-log context the ticket's work is charged to
+    struct AdmissionTicket *next;
+};
+
+/**
+ * Queue a ticket on a course and wait until it has been applied. Tickets are applied
+ * strictly FIFO by a single sequencer per course: the first submitter finding the course
+ * idle drains the queue, batching consecutive tickets with the same apply function. Each
+ * batch is applied under the course's lock in ADMISSION_LOCK_FILE, which serializes it
+ * against other processes (pre-forked workers) sequencing the same course.
+ * @return The ticket's result
+ */
+int admission_submit(int course_id, struct AdmissionTicket *ticket);
+
+/**
+ * Take the sequencer role for several courses at once, for operations that must change
+ * them together, with each course's lock taken as in admission_submit(). Queued tickets
+ * for these courses wait until admission_release().
+ * @param course_ids Course ids in strictly ascending order, so holders never deadlock
+ * @param count Number of courses
+ * @return 0 on success, -1 if a queue could not be created
+ */
+int admission_acquire(const int *course_ids, int count);
+void admission_release(const int *course_ids, int count);
+
+// Per-course queue statistics for the busiest courses
+int admission_report(int top_n, char *buffer, size_t buffer_size);
+
+#endif // ADMISSION_H
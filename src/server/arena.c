@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_COMMAND_LENGTH 32
+
+// Per-request peaks are bucketed by these limits for the report
+static const size_t peak_limits[] = { 1024, 4096, 16384, ARENA_BLOCK_SIZE };
+#define PEAK_BUCKETS (sizeof(peak_limits) / sizeof(peak_limits[0]) + 1)
+
+struct ArenaBlock {
+    struct ArenaBlock *previous;
+    size_t size;
+    size_t base;                // bytes handed out in earlier blocks when this one was added
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[];
+};
+
+// One arena: the first block lives as long as its owner, extra blocks until the reset
+struct Arena {
+    struct ArenaBlock *current;
+    size_t peak;                // high-water mark of the current request
+    int overflowed;
+};
+
+// Counters over all threads, updated once per request
+struct ArenaStats {
+    unsigned long requests;
+    unsigned long overflowed;
+    unsigned long long peak_total;
+    size_t peak_max;
+    unsigned long buckets[PEAK_BUCKETS];
+    unsigned long arenas;
+};
+
+static struct ArenaStats stats;
+static char peak_command[ARENA_COMMAND_LENGTH] = "";
+static pthread_mutex_t peak_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t arena_key;
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+static __thread struct Arena *thread_arena = NULL;
+
+static size_t round_up(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static struct ArenaBlock *new_block(size_t size, struct ArenaBlock *previous) {
+    struct ArenaBlock *block = malloc(sizeof(struct ArenaBlock) + size);
+
+    if (!block) {
+        return NULL;
+    }
+    block->previous = previous;
+    block->size = size;
+    block->base = previous ? previous->base + previous->used : 0;
+    block->used = 0;
+    return block;
+}
+
+// Thread exit: give every block back
+static void free_arena(void *arg) {
+    struct Arena *arena = arg;
+
+    while (arena->current) {
+        struct ArenaBlock *previous = arena->current->previous;
+        free(arena->current);
+        arena->current = previous;
+    }
+    free(arena);
+    __sync_fetch_and_sub(&stats.arenas, 1);
+}
+
+static void create_arena_key() {
+    pthread_key_create(&arena_key, free_arena);
+}
+
+struct Arena *arena_create() {
+    struct Arena *arena = calloc(1, sizeof(struct Arena));
+
+    if (!arena) {
+        return NULL;
+    }
+    arena->current = new_block(ARENA_BLOCK_SIZE, NULL);
+    if (!arena->current) {
+        free(arena);
+        return NULL;
+    }
+    __sync_fetch_and_add(&stats.arenas, 1);
+    return arena;
+}
+
+void arena_use(struct Arena *arena) {
+    thread_arena = arena;
+}
+
+// Threads that never called arena_use() get an arena of their own, freed when they exit
+static struct Arena *get_arena() {
+    struct Arena *arena;
+
+    if (thread_arena) {
+        return thread_arena;
+    }
+    pthread_once(&arena_key_once, create_arena_key);
+    arena = pthread_getspecific(arena_key);
+    if (!arena) {
+        arena = arena_create();
+        if (!arena) {
+            return NULL;
+        }
+        pthread_setspecific(arena_key, arena);
+    }
+    thread_arena = arena;
+    return arena;
+}
+
+void *arena_alloc(size_t size) {
+    struct Arena *arena = get_arena();
+    struct ArenaBlock *block;
+    size_t used;
+    void *ptr;
+
+    if (!arena) {
+        return NULL;
+    }
+    size = round_up(size > 0 ? size : 1);
+    block = arena->current;
+    if (block->size - block->used < size) {
+        block = new_block(size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE, block);
+        if (!block) {
+            return NULL;
+        }
+        arena->current = block;
+        arena->overflowed = 1;
+    }
+    ptr = block->data + block->used;
+    block->used += size;
+
+    used = block->base + block->used;
+    if (used > arena->peak) {
+        arena->peak = used;
+    }
+    return ptr;
+}
+
+void *arena_calloc(size_t count, size_t size) {
+    void *ptr;
+
+    if (size > 0 && count > (size_t)-1 / size) {
+        return NULL;
+    }
+    ptr = arena_alloc(count * size);
+    if (ptr) {
+        memset(ptr, 0, count * size);
+    }
+    return ptr;
+}
+
+void *arena_grow(void *ptr, size_t old_size, size_t new_size) {
+    struct Arena *arena = thread_arena;
+    void *moved;
+
+    if (!ptr) {
+        return arena_alloc(new_size);
+    }
+    if (new_size <= old_size) {
+        return ptr;
+    }
+
+    // The latest allocation ends at the block's used mark and can simply be extended
+    if (arena) {
+        struct ArenaBlock *block = arena->current;
+        size_t start = (char *)ptr - block->data;
+
+        if ((char *)ptr >= block->data && start + round_up(old_size) == block->used &&
+            block->size - start >= round_up(new_size)) {
+            block->used = start + round_up(new_size);
+            if (block->base + block->used > arena->peak) {
+                arena->peak = block->base + block->used;
+            }
+            return ptr;
+        }
+    }
+
+    moved = arena_alloc(new_size);
+    if (moved) {
+        memcpy(moved, ptr, old_size);
+    }
+    return moved;
+}
+
+size_t arena_mark() {
+    struct Arena *arena = get_arena();
+
+    return arena ? arena->current->base + arena->current->used : 0;
+}
+
+void arena_rewind(size_t mark) {
+    struct Arena *arena = thread_arena;
+
+    if (!arena) {
+        return;
+    }
+    // Extra blocks that start at or after the mark hold nothing older than it
+    while (arena->current->previous && arena->current->base >= mark) {
+        struct ArenaBlock *previous = arena->current->previous;
+        free(arena->current);
+        arena->current = previous;
+    }
+    if (mark < arena->current->base + arena->current->used) {
+        arena->current->used = mark - arena->current->base;
+    }
+}
+
+void arena_reset(const char *command) {
+    struct Arena *arena = thread_arena;
+    size_t peak = arena ? arena->peak : 0;
+    size_t bucket = 0;
+    size_t seen;
+
+    if (arena) {
+        arena_rewind(0);
+        arena->peak = 0;
+        if (arena->overflowed) {
+            __sync_fetch_and_add(&stats.overflowed, 1);
+            arena->overflowed = 0;
+        }
+    }
+
+    while (bucket < PEAK_BUCKETS - 1 && peak > peak_limits[bucket]) {
+        bucket++;
+    }
+    __sync_fetch_and_add(&stats.requests, 1);
+    __sync_fetch_and_add(&stats.peak_total, peak);
+    __sync_fetch_and_add(&stats.buckets[bucket], 1);
+
+    seen = stats.peak_max;
+    while (peak > seen) {
+        if (__sync_bool_compare_and_swap(&stats.peak_max, seen, peak)) {
+            pthread_mutex_lock(&peak_mutex);
+            snprintf(peak_command, sizeof(peak_command), "%.*s", (int)strcspn(command, ":"), command);
+            pthread_mutex_unlock(&peak_mutex);
+            break;
+        }
+        seen = stats.peak_max;
+    }
+}
+
+int arena_report(char *buffer, size_t size) {
+    struct ArenaStats copy = stats;
+    char command[ARENA_COMMAND_LENGTH];
+    size_t used;
+    int written;
+
+    pthread_mutex_lock(&peak_mutex);
+    strcpy(command, peak_command);
+    pthread_mutex_unlock(&peak_mutex);
+
+    used = snprintf(buffer, size,
+                    "Requests: %lu, arenas: %lu of %d KB\n"
+                    "Peak per request: mean %llu bytes, max %zu bytes (%s)\n"
+                    "Requests past the first block: %lu\n"
+                    "Peak bytes | Requests\n",
+                    copy.requests, copy.arenas, ARENA_BLOCK_SIZE / 1024,
+                    copy.requests > 0 ? copy.peak_total / copy.requests : 0ULL, copy.peak_max,
+                    command[0] ? command : "-", copy.overflowed);
+    for (size_t i = 0; i < PEAK_BUCKETS && used < size; i++) {
+        if (i < PEAK_BUCKETS - 1) {
+            written = snprintf(buffer + used, size - used, "<= %zu | %lu\n", peak_limits[i], copy.buckets[i]);
+        } else {
+            written = snprintf(buffer + used, size - used, "> %zu | %lu\n", peak_limits[i - 1], copy.buckets[i]);
+        }
+        if (written < 0 || (size_t)written >= size - used) {
+            return -1;
+        }
+        used += written;
+    }
+    return used < size ? 0 : -1;
+}
+
+void arena_stats_reset() {
+    // The arena count describes live arenas and is kept
+    pthread_mutex_lock(&peak_mutex);
+    stats.requests = 0;
+    stats.overflowed = 0;
+    stats.peak_total = 0;
+    stats.peak_max = 0;
+    memset(stats.buckets, 0, sizeof(stats.buckets));
+    peak_command[0] = '\0';
+    pthread_mutex_unlock(&peak_mutex);
+}
@@ -0,0 +1,59 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Per-request scratch memory. Each connection owns a bump allocator that handle_client()
+// installs for its thread and resets after each request, so request code never frees what
+// it takes from it. Any other thread gets one of its own on first use.
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Buffer sizes the role handlers take from the arena
+#define ARENA_RESPONSE_SIZE 1024
+#define ARENA_COMMAND_SIZE 256
+#define ARENA_PARAMS_SIZE 768
+
+struct Arena;
+
+/**
+ * A new arena with its first block, for an owner that keeps it across threads
+ * @return NULL when out of memory
+ */
+struct Arena *arena_create();
+
+// Make arena the one this thread allocates from; NULL goes back to the thread's own
+void arena_use(struct Arena *arena);
+
+/**
+ * Take size bytes, aligned for any type, that stay valid until the next arena_reset() or
+ * arena_rewind() past them. Requests larger than the arena's block get an extra block,
+ * which is given back at the reset.
+ * @return NULL when out of memory
+ */
+void *arena_alloc(size_t size);
+
+// arena_alloc() of count * size zeroed bytes
+void *arena_calloc(size_t count, size_t size);
+
+/**
+ * Resize an allocation: the most recent one grows in place, anything else is copied
+ * @return The (possibly moved) allocation, or NULL with ptr left untouched
+ */
+void *arena_grow(void *ptr, size_t old_size, size_t new_size);
+
+// Position to hand back to arena_rewind(), for code that frees scratch before the request ends
+size_t arena_mark();
+void arena_rewind(size_t mark);
+
+/**
+ * End of a request: record its high-water mark and make the whole arena reusable
+ * @param command The request, whose command name is kept if it sets a new maximum
+ */
+void arena_reset(const char *command);
+
+// Per-request high-water marks since startup or the last arena_stats_reset(); -1 if the
+// report does not fit in buffer
+int arena_report(char *buffer, size_t size);
+void arena_stats_reset();
+
+#endif // ARENA_H
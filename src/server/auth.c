@@ -10,6 +10,10 @@
 #include <time.h>
 #include "../common/structures.h"
 #include "../common/constants.h"
+#include "lock_stats.h"
+#include "replication.h"
+#include "record_index.h"
+#include "shard.h"
 // Function declarations
 int authenticate_user(const char *username, const char *password, char *role);
 int verify_credentials(const char *username, const char *password, struct Credentials *cred);
@@ -33,22 +37,19 @@ int check_student_active_status(const char *username) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, STUDENT_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for the student record
-    while (read(fd, &student, sizeof(struct Student)) == sizeof(struct Student)) {
-        if (strcmp(student.username, username) == 0) {
-            // Found student - check active status
-            is_active = student.active;
-            break;
-        }
+    // Look up the student record
+    if (record_index_find_name(INDEX_STUDENT_USERNAME, fd, username, &student) >= 0) {
+        // Found student - check active status
+        is_active = student.active;
     }
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     
     return is_active;
@@ -96,44 +97,41 @@ int authenticate_user(const char *username, const char *password, char *role) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, CREDENTIALS_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for user credentials
-    while (read(fd, &cred, sizeof(struct Credentials)) == sizeof(struct Credentials)) {
-        if (strcmp(cred.username, username) == 0) {
-            // Found user - verify password
-            if (verify_credentials(username, password, &cred) == 0) {
-                // Check if user is a student and if yes, verify active status
-                if (strcmp(cred.role, "student") == 0) {
-                    int active_status = check_student_active_status(username);
-                    
-                    if (active_status == 0) {
-                        // Student exists but is inactive
-                        flock(fd, LOCK_UN);
-                        close(fd);
-                        return -2; // Special error code for inactive student
-                    } else if (active_status == -1) {
-                        // Student credentials exist but no student record found (unusual case)
-                        flock(fd, LOCK_UN);
-                        close(fd);
-                        return -3; // Special error code for missing student record
-                    }
-                }
+    // Look up user credentials
+    if (record_index_find_name(INDEX_CREDENTIALS_USERNAME, fd, username, &cred) >= 0) {
+        // Found user - verify password
+        if (verify_credentials(username, password, &cred) == 0) {
+            // Check if user is a student and if yes, verify active status
+            if (strcmp(cred.role, "student") == 0) {
+                int active_status = check_student_active_status(username);
                 
-                // If we get here, either user is not a student or is an active student
-                strcpy(role, cred.role);
-                flock(fd, LOCK_UN);
-                close(fd);
-                return 0; // Success
+                if (active_status == 0) {
+                    // Student exists but is inactive
+                    FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
+                    close(fd);
+                    return -2; // Special error code for inactive student
+                } else if (active_status == -1) {
+                    // Student credentials exist but no student record found (unusual case)
+                    FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
+                    close(fd);
+                    return -3; // Special error code for missing student record
+                }
             }
-            break;
+            
+            // If we get here, either user is not a student or is an active student
+            strcpy(role, cred.role);
+            FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
+            close(fd);
+            return 0; // Success
         }
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
     close(fd);
     return -1; // General authentication failure
 }
@@ -151,7 +149,7 @@ int verify_credentials(const char *username, const char *password, struct Creden
 int change_password(const char *username, const char *new_password) {
     struct Credentials cred;
     int fd;
-    off_t offset = 0;
+    off_t offset;
     int found = 0;
     
     // Open credentials file for read/write
@@ -161,30 +159,25 @@ int change_password(const char *username, const char *new_password) {
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, CREDENTIALS_FILE) < 0) {
         close(fd);
         return -1;
     }
     
     // Find and update user credentials
-    while (read(fd, &cred, sizeof(struct Credentials)) == sizeof(struct Credentials)) {
-        if (strcmp(cred.username, username) == 0) {
-            // Update password
-            strncpy(cred.password_hash, new_password, sizeof(cred.password_hash) - 1);
-            
-            // Seek back to the record position
-            lseek(fd, offset, SEEK_SET);
-            
-            // Write updated record
-            if (write(fd, &cred, sizeof(struct Credentials)) == sizeof(struct Credentials)) {
-                found = 1;
-            }
-            break;
+    offset = record_index_find_name(INDEX_CREDENTIALS_USERNAME, fd, username, &cred);
+    if (offset >= 0) {
+        // Update password
+        strncpy(cred.password_hash, new_password, sizeof(cred.password_hash) - 1);
+        
+        // Write updated record in place
+        if (pwrite(fd, &cred, sizeof(struct Credentials), offset) == sizeof(struct Credentials)) {
+            replication_log_write_at(CREDENTIALS_FILE, &cred, sizeof(struct Credentials), offset);
+            found = 1;
         }
-        offset += sizeof(struct Credentials);
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
     close(fd);
     
     return found ? 0 : -1;
@@ -221,7 +214,7 @@ int handle_password_change(int client_socket, char *request, const char *usernam
 int update_user_password(const char *username, const char *new_password) {
     struct Credentials cred;
     int fd;
-    off_t offset = 0;
+    off_t offset;
     int found = 0;
     
     fd = open("data/credentials.dat", O_RDWR);
@@ -230,30 +223,27 @@ int update_user_password(const char *username, const char *new_password) {
     }
     
     // Apply write lock
-    flock(fd, LOCK_EX);
+    FLOCK(fd, LOCK_EX, "data/credentials.dat");
     
     // Find and update user password
-    while (read(fd, &cred, sizeof(struct Credentials)) == sizeof(struct Credentials)) {
-        if (strcmp(cred.username, username) == 0) {
-            // Update password (using simple storage for academic project)
-            strncpy(cred.password_hash, new_password, sizeof(cred.password_hash) - 1);
-            
-            // Seek back to the record position
-            lseek(fd, offset, SEEK_SET);
-            
-            // Write updated record
-            if (write(fd, &cred, sizeof(struct Credentials)) != sizeof(struct Credentials)) {
-                flock(fd, LOCK_UN);
-                close(fd);
-                return -1;
-            }
-            found = 1;
-            break;
+    offset = record_index_find_name(INDEX_CREDENTIALS_USERNAME, fd, username, &cred);
+    if (offset >= 0 && shard_check_only()) {
+        found = 1;                    // the router's validation pass only needs the account
+    } else if (offset >= 0) {
+        // Update password (using simple storage for academic project)
+        strncpy(cred.password_hash, new_password, sizeof(cred.password_hash) - 1);
+        
+        // Write updated record in place
+        if (pwrite(fd, &cred, sizeof(struct Credentials), offset) != sizeof(struct Credentials)) {
+            FLOCK(fd, LOCK_UN, "data/credentials.dat");
+            close(fd);
+            return -1;
         }
-        offset += sizeof(struct Credentials);
+        replication_log_write_at(CREDENTIALS_FILE, &cred, sizeof(struct Credentials), offset);
+        found = 1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, "data/credentials.dat");
     close(fd);
     
     return found ? 0 : -1;
@@ -274,14 +264,14 @@ int create_initial_admin() {
     // Check if admin already exists
     fd = open(CREDENTIALS_FILE, O_RDONLY);
     if (fd >= 0) {
-        flock(fd, LOCK_SH);
+        FLOCK(fd, LOCK_SH, CREDENTIALS_FILE);
         while (read(fd, &admin_cred, sizeof(struct Credentials)) == sizeof(struct Credentials)) {
             if (strcmp(admin_cred.username, "admin") == 0) {
                 admin_exists = 1;
                 break;
             }
         }
-        flock(fd, LOCK_UN);
+        FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
         close(fd);
     }
     
@@ -293,9 +283,9 @@ int create_initial_admin() {
         
         fd = open(CREDENTIALS_FILE, O_WRONLY | O_APPEND | O_CREAT, 0600);
         if (fd >= 0) {
-            flock(fd, LOCK_EX);
+            FLOCK(fd, LOCK_EX, CREDENTIALS_FILE);
             write(fd, &admin_cred, sizeof(struct Credentials));
-            flock(fd, LOCK_UN);
+            FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
             close(fd);
             printf("Initial admin account created (username: admin, password: admin123)\n");
         }
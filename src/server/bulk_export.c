@@ -0,0 +1,785 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/sendfile.h>
+#include "../common/structures.h"
+#include "../common/constants.h"
+#include "bulk_export.h"
+#include "lock_stats.h"
+#include "slow_log.h"
+#include "trace.h"
+#include "enrollment_store.h"
+#include "string_heap.h"
+#include "file_ops.h"
+
+// Room left in a chunk before another row is started; covers the widest row fully escaped
+#define EXPORT_MAX_ROW 4096
+#define EXPORT_SEND_TIMEOUT_SEC 10
+
+enum ExportFormat {
+    EXPORT_CSV,
+    EXPORT_JSON,
+    EXPORT_RAW
+};
+
+// One formatted row under construction, appended to the current chunk
+struct RowBuffer {
+    char *data;
+    size_t used;
+    size_t size;
+    int json;
+    int fields;
+};
+
+typedef void (*export_format_fn)(struct RowBuffer *row, const void *record);
+
+struct ExportJob;
+
+// Decode the job's next block as malloc'd records, taking the table's lock itself; 0 at
+// the end, -1 on failure
+typedef long (*export_rows_fn)(struct ExportJob *job, void **records);
+
+struct ExportTable {
+    const char *name;
+    const char *path;
+    size_t record_size;
+    const char *csv_header;
+    export_format_fn format;
+    export_rows_fn read_rows;         // rows not kept as plain records in the table file alone
+    const struct HeapTable *heap;     // the file holds rows whose strings are in a heap
+};
+
+// A frame: header space followed by up to EXPORT_CHUNK_SIZE bytes of rows
+struct ExportChunk {
+    char data[EXPORT_FRAME_HEADER + EXPORT_CHUNK_SIZE];
+    size_t length;
+};
+
+// Fixed ring between the formatter thread (producer) and the connection thread (consumer)
+struct ExportJob {
+    const struct ExportTable *table;
+    int json;
+    int fd;
+    struct ExportChunk *chunks;
+    int head;
+    int count;
+    int finished;                     // formatter has published its last chunk
+    int cancelled;                    // connection failed; formatter should stop
+    int read_failed;
+    long records;
+    struct RequestContext *request;   // the EXPORT request, charged with the formatter's reads
+    // Enrollments: rows up to last_id have been sent (see read_enrollment_block())
+    int last_id;
+    int in_tail;
+    off_t sealed_offset;
+    off_t tail_offset;
+    dev_t segment_dev;
+    ino_t segment_ino;
+    off_t segment_size;
+    dev_t tail_dev;
+    ino_t tail_ino;
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+};
+
+static void append_text(struct RowBuffer *row, const char *text) {
+    size_t length = strlen(text);
+
+    if (row->used + length < row->size) {
+        memcpy(row->data + row->used, text, length);
+        row->used += length;
+    }
+}
+
+static void append_char(struct RowBuffer *row, char c) {
+    if (row->used + 1 < row->size) {
+        row->data[row->used++] = c;
+    }
+}
+
+// Start the next field: a separator, and the key in JSON
+static void begin_field(struct RowBuffer *row, const char *key) {
+    if (row->fields++ > 0) {
+        append_char(row, ',');
+    }
+    if (row->json) {
+        append_char(row, '"');
+        append_text(row, key);
+        append_text(row, "\":");
+    }
+}
+
+static void put_int(struct RowBuffer *row, const char *key, long value) {
+    char number[24];
+
+    begin_field(row, key);
+    snprintf(number, sizeof(number), "%ld", value);
+    append_text(row, number);
+}
+
+// Fixed-size record fields are not guaranteed to be NUL terminated
+static void put_string(struct RowBuffer *row, const char *key, const char *value, size_t max_length) {
+    size_t length = strnlen(value, max_length);
+
+    begin_field(row, key);
+    if (row->json) {
+        append_char(row, '"');
+        for (size_t i = 0; i < length; i++) {
+            unsigned char c = value[i];
+            if (c == '"' || c == '\\') {
+                append_char(row, '\\');
+                append_char(row, c);
+            } else if (c < 0x20) {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                append_text(row, escaped);
+            } else {
+                append_char(row, c);
+            }
+        }
+        append_char(row, '"');
+    } else if (memchr(value, ',', length) || memchr(value, '"', length) ||
+               memchr(value, '\n', length) || memchr(value, '\r', length)) {
+        // Same quoting the IMPORT parser accepts
+        append_char(row, '"');
+        for (size_t i = 0; i < length; i++) {
+            if (value[i] == '"') {
+                append_char(row, '"');
+            }
+            append_char(row, value[i]);
+        }
+        append_char(row, '"');
+    } else {
+        for (size_t i = 0; i < length; i++) {
+            append_char(row, value[i]);
+        }
+    }
+}
+
+static void put_time(struct RowBuffer *row, const char *key, time_t value) {
+    char timestamp[32];
+    struct tm tm_info;
+
+    gmtime_r(&value, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &tm_info);
+    put_string(row, key, timestamp, sizeof(timestamp));
+}
+
+static void format_student(struct RowBuffer *row, const void *record) {
+    const struct Student *student = record;
+
+    put_int(row, "id", student->id);
+    put_string(row, "username", student->username, sizeof(student->username));
+    put_string(row, "name", student->name, sizeof(student->name));
+    put_string(row, "email", student->email, sizeof(student->email));
+    put_int(row, "active", student->active);
+}
+
+static void format_faculty(struct RowBuffer *row, const void *record) {
+    const struct Faculty *faculty = record;
+
+    put_int(row, "id", faculty->id);
+    put_string(row, "username", faculty->username, sizeof(faculty->username));
+    put_string(row, "name", faculty->name, sizeof(faculty->name));
+    put_string(row, "email", faculty->email, sizeof(faculty->email));
+    put_string(row, "department", faculty->department, sizeof(faculty->department));
+}
+
+static void format_course(struct RowBuffer *row, const void *record) {
+    const struct Course *course = record;
+
+    put_int(row, "course_id", course->course_id);
+    put_string(row, "course_code", course->course_code, sizeof(course->course_code));
+    put_string(row, "course_name", course->course_name, sizeof(course->course_name));
+    put_int(row, "faculty_id", course->faculty_id);
+    put_int(row, "max_seats", course->max_seats);
+    put_int(row, "enrolled_count", course->enrolled_count);
+}
+
+static void format_enrollment(struct RowBuffer *row, const void *record) {
+    const struct Enrollment *enrollment = record;
+
+    put_int(row, "enrollment_id", enrollment->enrollment_id);
+    put_int(row, "student_id", enrollment->student_id);
+    put_int(row, "course_id", enrollment->course_id);
+    put_time(row, "enrollment_date", enrollment->enrollment_date);
+}
+
+static void format_waitlist(struct RowBuffer *row, const void *record) {
+    const struct WaitlistEntry *entry = record;
+
+    put_int(row, "student_id", entry->student_id);
+    put_int(row, "course_id", entry->course_id);
+    put_time(row, "joined_at", entry->joined_at);
+}
+
+// Next block of enrollments, oldest first: the sealed segments, then the tail. Ids grow
+// along that order, so the export resumes after the last id it sent rather than at a file
+// offset. Between blocks a seal can move the unsent tail into a new segment and a removal
+// can rewrite either file; the segments are then read on from where they changed and the
+// tail again from its start, skipping the rows already sent. The switch from the segments
+// to the tail happens under one shared lock, so no seal falls between them.
+static long read_enrollment_block(struct ExportJob *job, void **records) {
+    size_t max = EXPORT_CHUNK_SIZE / sizeof(struct Enrollment);
+    struct Enrollment *rows = NULL;
+    struct stat st;
+    long count = 0;
+    long kept = 0;
+    int segment_fd;
+    int fd;
+
+    *records = NULL;
+    fd = OPEN_LOCKED(ENROLLMENT_FILE, O_RDONLY | O_CREAT, 0644, LOCK_SH);
+    if (fd < 0) {
+        return -1;
+    }
+    segment_fd = open(ENROLLMENT_SEGMENT_FILE, O_RDONLY);
+    if (segment_fd >= 0 && fstat(segment_fd, &st) == 0 &&
+        (st.st_dev != job->segment_dev || st.st_ino != job->segment_ino || st.st_size != job->segment_size)) {
+        if (st.st_dev != job->segment_dev || st.st_ino != job->segment_ino) {
+            job->sealed_offset = 0;
+        }
+        job->segment_dev = st.st_dev;
+        job->segment_ino = st.st_ino;
+        job->segment_size = st.st_size;
+        job->in_tail = 0;
+    }
+    if (fstat(fd, &st) == 0 && (st.st_dev != job->tail_dev || st.st_ino != job->tail_ino)) {
+        job->tail_dev = st.st_dev;
+        job->tail_ino = st.st_ino;
+        job->tail_offset = 0;
+    }
+
+    while (kept == 0) {
+        free(rows);
+        rows = NULL;
+        if (!job->in_tail) {
+            count = segment_fd >= 0 ? enrollment_segment_read(segment_fd, &job->sealed_offset, &rows) : 0;
+            if (count == 0) {
+                job->in_tail = 1;
+                job->tail_offset = 0;
+                continue;
+            }
+        } else {
+            ssize_t n;
+
+            rows = malloc(max * sizeof(struct Enrollment));
+            trace_begin("scan");
+            n = rows ? pread(fd, rows, max * sizeof(struct Enrollment), job->tail_offset) : -1;
+            trace_end();
+            count = n < 0 ? -1 : (long)(n / sizeof(struct Enrollment));
+            slow_log_note_scan(ENROLLMENT_FILE, count);
+            job->tail_offset += count > 0 ? count * sizeof(struct Enrollment) : 0;
+        }
+        if (count <= 0) {
+            break;
+        }
+        for (long i = 0; i < count; i++) {
+            if (rows[i].enrollment_id > job->last_id) {
+                rows[kept++] = rows[i];
+            }
+        }
+        if (kept > 0) {
+            job->last_id = rows[kept - 1].enrollment_id;
+        }
+    }
+
+    if (segment_fd >= 0) {
+        close(segment_fd);
+    }
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
+    close(fd);
+
+    if (kept > 0) {
+        *records = rows;
+        return kept;
+    }
+    free(rows);
+    return count < 0 ? -1 : 0;
+}
+
+// Decode the block of rows at *cursor in a heap table (caller holds the shared lock);
+// 0 at the end, -1 on failure
+static long read_heap_rows(struct ExportJob *job, off_t *cursor, void **records) {
+    const struct HeapTable *heap = job->table->heap;
+    size_t max = EXPORT_CHUNK_SIZE / heap->record_size;
+    char *rows = malloc(max * heap->row_size);
+    long count = -1;
+    ssize_t n;
+
+    *records = malloc(max * heap->record_size);
+    if (rows && *records) {
+        trace_begin("scan");
+        n = pread(job->fd, rows, max * heap->row_size, *cursor);
+        trace_end();
+        count = n < 0 ? -1 : (long)(n / heap->row_size);
+        slow_log_note_scan(heap->path, count);
+    }
+    if (count > 0) {
+        int heap_fd = heap_open(heap);
+
+        if (heap_decode(heap, heap_fd, rows, count, *records) < 0) {
+            count = -1;
+        }
+        if (heap_fd >= 0) {
+            close(heap_fd);
+        }
+    }
+
+    free(rows);
+    if (count > 0) {
+        *cursor += count * heap->row_size;
+    } else {
+        free(*records);
+        *records = NULL;
+    }
+    return count;
+}
+
+// Next block of a table exported through records: read_rows, or a heap block under the lock
+static long read_record_block(struct ExportJob *job, off_t *cursor, void **records) {
+    long count;
+
+    if (job->table->read_rows) {
+        return job->table->read_rows(job, records);
+    }
+    FLOCK(job->fd, LOCK_SH, job->table->path);
+    count = read_heap_rows(job, cursor, records);
+    FLOCK(job->fd, LOCK_UN, job->table->path);
+    return count;
+}
+
+// Credentials are deliberately not exportable
+static const struct ExportTable export_tables[] = {
+    { "students", STUDENT_FILE, sizeof(struct Student),
+      "id,username,name,email,active", format_student, NULL, &student_heap },
+    { "faculty", FACULTY_FILE, sizeof(struct Faculty),
+      "id,username,name,email,department", format_faculty, NULL, &faculty_heap },
+    { "courses", COURSE_FILE, sizeof(struct Course),
+      "course_id,course_code,course_name,faculty_id,max_seats,enrolled_count", format_course },
+    { "enrollments", ENROLLMENT_FILE, sizeof(struct Enrollment),
+      "enrollment_id,student_id,course_id,enrollment_date", format_enrollment, read_enrollment_block },
+    { "waitlists", WAITLIST_FILE, sizeof(struct WaitlistEntry),
+      "student_id,course_id,joined_at", format_waitlist },
+};
+
+static int write_all(int sock, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(sock, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static void set_frame_header(char *header, size_t length) {
+    char digits[EXPORT_FRAME_HEADER + 1];
+
+    snprintf(digits, sizeof(digits), "%08zx", length);
+    memcpy(header, digits, EXPORT_FRAME_HEADER);
+}
+
+// Producer side: wait for a free slot; NULL once the connection has gone away
+static struct ExportChunk *ring_claim(struct ExportJob *job) {
+    struct ExportChunk *chunk = NULL;
+
+    pthread_mutex_lock(&job->mutex);
+    while (job->count == EXPORT_RING_SLOTS && !job->cancelled) {
+        pthread_cond_wait(&job->not_full, &job->mutex);
+    }
+    if (!job->cancelled) {
+        chunk = &job->chunks[(job->head + job->count) % EXPORT_RING_SLOTS];
+        chunk->length = 0;
+    }
+    pthread_mutex_unlock(&job->mutex);
+    return chunk;
+}
+
+static void ring_publish(struct ExportJob *job) {
+    pthread_mutex_lock(&job->mutex);
+    job->count++;
+    pthread_cond_signal(&job->not_empty);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+// Consumer side: the oldest filled slot, or NULL when the formatter is done
+static struct ExportChunk *ring_take(struct ExportJob *job) {
+    struct ExportChunk *chunk = NULL;
+
+    pthread_mutex_lock(&job->mutex);
+    while (job->count == 0 && !job->finished) {
+        pthread_cond_wait(&job->not_empty, &job->mutex);
+    }
+    if (job->count > 0) {
+        chunk = &job->chunks[job->head];
+    }
+    pthread_mutex_unlock(&job->mutex);
+    return chunk;
+}
+
+static void ring_release(struct ExportJob *job) {
+    pthread_mutex_lock(&job->mutex);
+    job->head = (job->head + 1) % EXPORT_RING_SLOTS;
+    job->count--;
+    pthread_cond_signal(&job->not_full);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+// Publish the current chunk if another row might not fit, and claim the next one
+static struct ExportChunk *ensure_room(struct ExportJob *job, struct ExportChunk *chunk) {
+    if (chunk && EXPORT_CHUNK_SIZE - chunk->length < EXPORT_MAX_ROW) {
+        ring_publish(job);
+        chunk = ring_claim(job);
+    }
+    return chunk;
+}
+
+static void append_to_chunk(struct ExportChunk *chunk, const char *text) {
+    size_t length = strlen(text);
+
+    memcpy(chunk->data + EXPORT_FRAME_HEADER + chunk->length, text, length);
+    chunk->length += length;
+}
+
+// Format n bytes of whole records into the ring; returns the current chunk, NULL once cancelled
+static struct ExportChunk *format_records(struct ExportJob *job, struct ExportChunk *chunk,
+                                          const char *records, size_t n) {
+    const struct ExportTable *table = job->table;
+
+    for (size_t i = 0; i < n && chunk; i += table->record_size) {
+        struct RowBuffer row;
+
+        chunk = ensure_room(job, chunk);
+        if (!chunk) {
+            break;
+        }
+        row.data = chunk->data + EXPORT_FRAME_HEADER + chunk->length;
+        row.used = 0;
+        row.size = EXPORT_CHUNK_SIZE - chunk->length;
+        row.json = job->json;
+        row.fields = 0;
+
+        if (job->json) {
+            append_text(&row, job->records > 0 ? ",\n{" : "{");
+        }
+        table->format(&row, records + i);
+        append_text(&row, job->json ? "}" : "\n");
+
+        chunk->length += row.used;
+        job->records++;
+    }
+    return chunk;
+}
+
+// Formatter thread: read the table a block at a time and format rows into ring chunks.
+// Each block is read under its own shared lock, so a slow client never holds off writers.
+static void *format_table(void *arg) {
+    struct ExportJob *job = arg;
+    const struct ExportTable *table = job->table;
+    size_t block_records = EXPORT_CHUNK_SIZE / table->record_size;
+    char *block = malloc(block_records * table->record_size);
+    struct ExportChunk *chunk = ring_claim(job);
+    off_t offset = 0;
+    TRACE_SCOPE("export_format");
+
+    slow_log_charge_begin();
+
+    if (!block) {
+        job->read_failed = 1;
+    }
+
+    if (chunk) {
+        if (job->json) {
+            append_to_chunk(chunk, "[\n");
+        } else {
+            append_to_chunk(chunk, table->csv_header);
+            append_to_chunk(chunk, "\n");
+        }
+    }
+
+    // Enrollments (segments, then the tail) and heap tables are decoded a block per lock
+    while (chunk && block && (table->read_rows || table->heap)) {
+        void *records;
+        long count = read_record_block(job, &offset, &records);
+
+        if (count < 0) {
+            job->read_failed = 1;
+        }
+        if (count <= 0) {
+            break;
+        }
+        chunk = format_records(job, chunk, records, count * table->record_size);
+        free(records);
+    }
+
+    while (chunk && block && !table->read_rows && !table->heap) {
+        ssize_t n;
+
+        FLOCK(job->fd, LOCK_SH, table->path);
+        trace_begin("scan");
+        n = pread(job->fd, block, block_records * table->record_size, offset);
+        trace_end();
+        FLOCK(job->fd, LOCK_UN, table->path);
+
+        if (n < 0) {
+            job->read_failed = 1;
+            break;
+        }
+        // A partially written trailing record is left for a later export
+        n -= n % table->record_size;
+        slow_log_note_scan(table->path, n / table->record_size);
+        if (n == 0) {
+            break;
+        }
+        offset += n;
+        chunk = format_records(job, chunk, block, n);
+    }
+
+    if (chunk && job->json) {
+        append_to_chunk(chunk, job->records > 0 ? "\n]\n" : "]\n");
+    }
+    if (chunk) {
+        ring_publish(job);
+    }
+    // The connection thread only writes to the socket until it joins this one
+    slow_log_charge_end(&job->request, 1);
+
+    pthread_mutex_lock(&job->mutex);
+    job->finished = 1;
+    pthread_cond_signal(&job->not_empty);
+    pthread_mutex_unlock(&job->mutex);
+
+    free(block);
+    return NULL;
+}
+
+// Connection thread: write formatted chunks as frames until the formatter is done
+static int send_formatted(struct ExportJob *job, int client_socket, long long *bytes) {
+    pthread_t formatter;
+    struct ExportChunk *chunk;
+    int failed = 0;
+
+    job->chunks = malloc(sizeof(struct ExportChunk) * EXPORT_RING_SLOTS);
+    if (!job->chunks) {
+        return -1;
+    }
+    pthread_mutex_init(&job->mutex, NULL);
+    pthread_cond_init(&job->not_empty, NULL);
+    pthread_cond_init(&job->not_full, NULL);
+
+    if (pthread_create(&formatter, NULL, format_table, job) != 0) {
+        pthread_mutex_destroy(&job->mutex);
+        pthread_cond_destroy(&job->not_empty);
+        pthread_cond_destroy(&job->not_full);
+        free(job->chunks);
+        return -1;
+    }
+
+    while ((chunk = ring_take(job)) != NULL) {
+        if (!failed && chunk->length > 0) {
+            set_frame_header(chunk->data, chunk->length);
+            if (write_all(client_socket, chunk->data, EXPORT_FRAME_HEADER + chunk->length) < 0) {
+                // Stop the formatter; it may be waiting for a slot
+                failed = 1;
+                pthread_mutex_lock(&job->mutex);
+                job->cancelled = 1;
+                pthread_cond_signal(&job->not_full);
+                pthread_mutex_unlock(&job->mutex);
+            } else {
+                *bytes += chunk->length;
+            }
+        }
+        ring_release(job);
+    }
+
+    pthread_join(formatter, NULL);
+    pthread_mutex_destroy(&job->mutex);
+    pthread_cond_destroy(&job->not_empty);
+    pthread_cond_destroy(&job->not_full);
+    free(job->chunks);
+    return failed ? -1 : 0;
+}
+
+// Raw mode for rows that are not stored in the table's record layout: decoded back to it,
+// a block per lock
+static int send_decoded_raw(struct ExportJob *job, int client_socket, long long *bytes) {
+    size_t record_size = job->table->record_size;
+    size_t frame_limit = EXPORT_RAW_FRAME - EXPORT_RAW_FRAME % record_size;
+    off_t cursor = 0;
+    char header[EXPORT_FRAME_HEADER];
+
+    while (1) {
+        void *records;
+        long count;
+        size_t length;
+        int failed = 0;
+
+        count = read_record_block(job, &cursor, &records);
+        if (count <= 0) {
+            job->read_failed = count < 0;
+            return 0;
+        }
+
+        length = count * record_size;
+        for (size_t sent = 0; sent < length && !failed; ) {
+            size_t frame = length - sent < frame_limit ? length - sent : frame_limit;
+
+            set_frame_header(header, frame);
+            failed = write_all(client_socket, header, sizeof(header)) ||
+                     write_all(client_socket, (const char *)records + sent, frame);
+            sent += frame;
+            *bytes += frame;
+        }
+        free(records);
+        if (failed) {
+            return -1;
+        }
+    }
+}
+
+// Raw mode: whole records straight from the page cache, one shared lock per frame
+static int send_raw(struct ExportJob *job, int client_socket, long long *bytes) {
+    size_t record_size = job->table->record_size;
+    size_t frame_limit = EXPORT_RAW_FRAME - EXPORT_RAW_FRAME % record_size;
+    off_t offset = 0;
+    char header[EXPORT_FRAME_HEADER];
+
+    // Clients always receive the record layout, so segments and heap tables cannot use sendfile
+    if (job->table->read_rows || job->table->heap) {
+        if (send_decoded_raw(job, client_socket, bytes) < 0) {
+            return -1;
+        }
+        job->records = *bytes / record_size;
+        return 0;
+    }
+
+    while (1) {
+        off_t size;
+        size_t length;
+        int failed = 0;
+
+        FLOCK(job->fd, LOCK_SH, job->table->path);
+        size = lseek(job->fd, 0, SEEK_END);
+        length = size > offset ? (size_t)(size - offset) : 0;
+        if (length > frame_limit) {
+            length = frame_limit;
+        }
+        length -= length % record_size;
+
+        if (length > 0) {
+            slow_log_note_scan(job->table->path, length / record_size);
+            set_frame_header(header, length);
+            failed = write_all(client_socket, header, sizeof(header));
+            while (!failed && length > 0) {
+                ssize_t n = sendfile(client_socket, job->fd, &offset, length);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    failed = 1;
+                    break;
+                }
+                length -= n;
+                *bytes += n;
+            }
+        }
+        FLOCK(job->fd, LOCK_UN, job->table->path);
+
+        if (failed) {
+            return -1;
+        }
+        if (size <= offset || size - offset < (off_t)record_size) {
+            break;
+        }
+    }
+
+    job->records = *bytes / record_size;
+    return 0;
+}
+
+int handle_export(int client_socket, char *params, char *response) {
+    struct timeval timeout = { EXPORT_SEND_TIMEOUT_SEC, 0 };
+    struct timeval no_timeout = { 0, 0 };
+    struct ExportJob job;
+    char table_name[16];
+    char format_name[8];
+    enum ExportFormat format;
+    long long bytes = 0;
+    int result;
+    TRACE_SCOPE(__func__);
+
+    if (sscanf(params, "%15[^:]:%7s", table_name, format_name) != 2) {
+        strcpy(response, "ERROR:Invalid parameters for EXPORT "
+               "(EXPORT:<students|faculty|courses|enrollments|waitlists>:<csv|json|raw>)");
+        return -1;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.request = slow_log_current();
+    for (size_t i = 0; i < sizeof(export_tables) / sizeof(export_tables[0]); i++) {
+        if (strcmp(table_name, export_tables[i].name) == 0) {
+            job.table = &export_tables[i];
+        }
+    }
+    if (!job.table) {
+        strcpy(response, "ERROR:Unknown table for EXPORT");
+        return -1;
+    }
+
+    if (strcmp(format_name, "csv") == 0) {
+        format = EXPORT_CSV;
+    } else if (strcmp(format_name, "json") == 0) {
+        format = EXPORT_JSON;
+    } else if (strcmp(format_name, "raw") == 0) {
+        format = EXPORT_RAW;
+    } else {
+        strcpy(response, "ERROR:Unknown format for EXPORT (csv, json or raw)");
+        return -1;
+    }
+    job.json = format == EXPORT_JSON;
+
+    // A table that was never written exports as empty
+    job.fd = trace_open(job.table->path, O_RDONLY | O_CREAT, 0644);
+    if (job.fd < 0) {
+        sprintf(response, "ERROR:Cannot open %s: %s", job.table->path, strerror(errno));
+        return -1;
+    }
+
+    // A stalled client must not keep a raw frame's shared lock indefinitely
+    setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    if (format == EXPORT_RAW) {
+        result = send_raw(&job, client_socket, &bytes);
+    } else {
+        result = send_formatted(&job, client_socket, &bytes);
+    }
+
+    // End of stream; the summary follows as a normal response
+    write_all(client_socket, "00000000", EXPORT_FRAME_HEADER);
+    setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, &no_timeout, sizeof(no_timeout));
+    close(job.fd);
+
+    if (result < 0 || job.read_failed) {
+        snprintf(response, 1024, "ERROR:Export of %s aborted after %ld records (%s)",
+                 table_name, job.records, job.read_failed ? "read failed" : "connection lost");
+        return -1;
+    }
+    snprintf(response, 1024, "SUCCESS:Exported %ld %s as %s (%lld bytes)",
+             job.records, table_name, format_name, bytes);
+    return 0;
+}
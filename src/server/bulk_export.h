@@ -0,0 +1,26 @@
+#ifndef BULK_EXPORT_H
+#define BULK_EXPORT_H
+
+// Payload bytes per CSV/JSON frame, and the number of frames buffered ahead of the socket
+#define EXPORT_CHUNK_SIZE 65536
+#define EXPORT_RING_SLOTS 4
+
+// Bytes per frame in raw mode, sent with sendfile() straight from the data file
+#define EXPORT_RAW_FRAME (1024 * 1024)
+
+// Every frame starts with its payload length as 8 lowercase hex digits; length 0 ends the stream
+#define EXPORT_FRAME_HEADER 8
+
+/**
+ * Bulk export (EXPORT:<students|faculty|courses|enrollments|waitlists>:<csv|json|raw>).
+ * Streams every record of the table as frames, followed by the usual response. Rows are
+ * formatted on a helper thread into a fixed ring of chunks, so memory stays bounded and
+ * the connection thread only writes.
+ * @param client_socket Connection the frames are written to
+ * @param params "<table>:<format>"
+ * @param response Final summary, written by the caller after the end-of-stream frame
+ * @return 0 on success, -1 on failure
+ */
+int handle_export(int client_socket, char *params, char *response);
+
+#endif // BULK_EXPORT_H
@@ -0,0 +1,788 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "../common/structures.h"
+#include "../common/constants.h"
+#include "bulk_import.h"
+#include "lock_stats.h"
+#include "slow_log.h"
+#include "trace.h"
+#include "replication.h"
+#include "shard.h"
+#include "file_ops.h"
+#include "string_heap.h"
+#include "key_filter.h"
+
+// From utils.c
+int validate_email(const char *email);
+int validate_username(const char *username);
+
+#define IMPORT_CHUNK_SIZE 65536
+#define IMPORT_BATCH_RECORDS 1024
+#define IMPORT_MAX_FIELDS 4
+#define IMPORT_LINE_LENGTH 512
+#define IMPORT_ERROR_SAMPLES 3
+#define IMPORT_RECV_TIMEOUT_SEC 10
+
+enum ImportTable {
+    IMPORT_STUDENTS,
+    IMPORT_FACULTY,
+    IMPORT_COURSES
+};
+
+// Open-addressing set of names (usernames or course codes), optionally mapped to an id
+struct NameEntry {
+    char name[MAX_USERNAME_LENGTH];
+    int value;
+    int used;
+};
+
+struct NameSet {
+    struct NameEntry *entries;
+    size_t capacity;
+    size_t count;
+};
+
+// Everything one import carries between batches
+struct ImportState {
+    enum ImportTable table;
+    const char *path;
+    const struct HeapTable *heap;  // students and faculty: rows plus a string heap
+    int data_fd;                   // both open and locked only while a batch is written
+    int cred_fd;
+    dev_t data_dev;                // the table file the names were read from
+    ino_t data_ino;
+    off_t data_loaded;             // bytes of it (and of credentials.dat) read into names
+    off_t cred_loaded;
+    size_t record_size;
+    struct NameSet names;          // names already taken, including rows accepted so far
+    struct NameSet faculty;        // courses only: faculty username -> faculty id
+    int first_id;
+    int next_id;
+    int last_id;
+    char *batch;
+    struct Credentials *creds;
+    long *lines;                   // CSV line of each batched row
+    int batch_count;
+    long line;
+    long imported;
+    long rejected;
+    int failed;
+    char errors[IMPORT_ERROR_SAMPLES * 96];
+};
+
+static unsigned long hash_name(const char *name) {
+    unsigned long hash = 1469598103934665603UL;
+
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 1099511628211UL;
+    }
+    return hash;
+}
+
+static int name_set_init(struct NameSet *set, size_t expected) {
+    set->capacity = 1024;
+    while (set->capacity < expected * 2) {
+        set->capacity *= 2;
+    }
+    set->count = 0;
+    set->entries = calloc(set->capacity, sizeof(struct NameEntry));
+    return set->entries ? 0 : -1;
+}
+
+static struct NameEntry *name_set_find(struct NameSet *set, const char *name) {
+    size_t slot = hash_name(name) & (set->capacity - 1);
+
+    while (set->entries[slot].used) {
+        if (strcmp(set->entries[slot].name, name) == 0) {
+            return &set->entries[slot];
+        }
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    return NULL;
+}
+
+static int name_set_add(struct NameSet *set, const char *name, int value) {
+    size_t slot;
+
+    if ((set->count + 1) * 2 > set->capacity) {
+        struct NameSet grown;
+        if (name_set_init(&grown, set->capacity) < 0) {
+            return -1;
+        }
+        for (size_t i = 0; i < set->capacity; i++) {
+            if (set->entries[i].used) {
+                name_set_add(&grown, set->entries[i].name, set->entries[i].value);
+            }
+        }
+        free(set->entries);
+        *set = grown;
+    }
+
+    slot = hash_name(name) & (set->capacity - 1);
+    while (set->entries[slot].used) {
+        slot = (slot + 1) & (set->capacity - 1);
+    }
+    strncpy(set->entries[slot].name, name, sizeof(set->entries[slot].name) - 1);
+    set->entries[slot].value = value;
+    set->entries[slot].used = 1;
+    set->count++;
+    return 0;
+}
+
+// Load every key of a locked file from the current offset on into the set, raising *max_id
+// to the highest id
+static int load_existing(int fd, enum ImportTable table, struct NameSet *set, int *max_id) {
+    char buffer[IMPORT_CHUNK_SIZE];
+    const struct HeapTable *heap = NULL;
+    const char *path = COURSE_FILE;
+    size_t record_size = sizeof(struct Course);
+    char *names = NULL;
+    int heap_fd = -1;
+    ssize_t n;
+
+    if (table != IMPORT_COURSES) {
+        heap = table == IMPORT_STUDENTS ? &student_heap : &faculty_heap;
+        path = heap->path;
+        record_size = heap->row_size;
+        names = malloc(sizeof(buffer) / record_size * MAX_USERNAME_LENGTH);
+        heap_fd = heap_open(heap);
+        if (!names) {
+            return -1;
+        }
+    }
+
+    trace_begin("scan");
+    // Read whole multiples of the record size so records never straddle chunks
+    while ((n = read(fd, buffer, sizeof(buffer) - sizeof(buffer) % record_size)) > 0) {
+        size_t count = n / record_size;
+
+        slow_log_note_scan(path, count);
+        // Usernames live in the heap; fetch the chunk's in one go
+        if (heap && heap_read_column(heap, heap_fd, buffer, count, HEAP_USERNAME, names, MAX_USERNAME_LENGTH) < 0) {
+            n = -1;
+            break;
+        }
+        for (size_t i = 0; i < count && n > 0; i++) {
+            const char *record = buffer + i * record_size;
+            const char *name;
+            int id;
+
+            if (table == IMPORT_STUDENTS) {
+                name = names + i * MAX_USERNAME_LENGTH;
+                id = ((const struct StudentRow *)record)->id;
+            } else if (table == IMPORT_FACULTY) {
+                name = names + i * MAX_USERNAME_LENGTH;
+                id = ((const struct FacultyRow *)record)->id;
+            } else {
+                const struct Course *course = (const struct Course *)record;
+                name = course->course_code;
+                id = course->course_id;
+            }
+
+            if (id > *max_id) {
+                *max_id = id;
+            }
+            if (!name_set_find(set, name) && name_set_add(set, name, id) < 0) {
+                n = -1;
+            }
+        }
+        if (n < 0) {
+            break;
+        }
+    }
+    trace_end();
+
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    free(names);
+    return n < 0 ? -1 : 0;
+}
+
+static int load_credentials(int fd, struct NameSet *set) {
+    struct Credentials creds[IMPORT_CHUNK_SIZE / sizeof(struct Credentials)];
+    ssize_t n;
+
+    trace_begin("scan");
+    while ((n = read(fd, creds, sizeof(creds))) > 0) {
+        slow_log_note_scan(CREDENTIALS_FILE, n / sizeof(struct Credentials));
+        for (size_t i = 0; i < n / sizeof(struct Credentials); i++) {
+            if (!name_set_find(set, creds[i].username) && name_set_add(set, creds[i].username, 0) < 0) {
+                trace_end();
+                return -1;
+            }
+        }
+    }
+    trace_end();
+    return n < 0 ? -1 : 0;
+}
+
+static int take_id(struct ImportState *state) {
+    state->last_id = state->next_id;
+    state->next_id = state->table == IMPORT_COURSES ? shard_next_course_id(state->last_id)
+                                                    : state->last_id + 1;
+    return state->last_id;
+}
+
+static void note_rejection_at(struct ImportState *state, long line, const char *reason) {
+    size_t used = strlen(state->errors);
+
+    if (state->rejected++ < IMPORT_ERROR_SAMPLES) {
+        snprintf(state->errors + used, sizeof(state->errors) - used, "%sline %ld: %s",
+                 used ? "; " : "", line, reason);
+    }
+}
+
+static void note_rejection(struct ImportState *state, const char *reason) {
+    note_rejection_at(state, state->line, reason);
+}
+
+// The username or course code of a batched row
+static char *batch_name(struct ImportState *state, int i) {
+    char *record = state->batch + i * state->record_size;
+
+    if (state->table == IMPORT_STUDENTS) {
+        return ((struct Student *)record)->username;
+    }
+    if (state->table == IMPORT_FACULTY) {
+        return ((struct Faculty *)record)->username;
+    }
+    return ((struct Course *)record)->course_code;
+}
+
+// Take the file locks, credentials first as authentication does. The table is opened
+// through OPEN_LOCKED since a course removal may have renamed a new copy in.
+static int lock_files(struct ImportState *state) {
+    if (state->table != IMPORT_COURSES) {
+        state->cred_fd = trace_open(CREDENTIALS_FILE, O_RDWR | O_APPEND | O_CREAT, 0600);
+        if (state->cred_fd < 0) {
+            return -1;
+        }
+        if (FLOCK(state->cred_fd, LOCK_EX, CREDENTIALS_FILE) < 0) {
+            close(state->cred_fd);
+            state->cred_fd = -1;
+            return -1;
+        }
+    }
+    state->data_fd = OPEN_LOCKED(state->path, O_RDWR | O_APPEND | O_CREAT, 0644, LOCK_EX);
+    return state->data_fd < 0 ? -1 : 0;
+}
+
+static void unlock_files(struct ImportState *state) {
+    if (state->data_fd >= 0) {
+        FLOCK(state->data_fd, LOCK_UN, state->path);
+        close(state->data_fd);
+        state->data_fd = -1;
+    }
+    if (state->cred_fd >= 0) {
+        FLOCK(state->cred_fd, LOCK_UN, CREDENTIALS_FILE);
+        close(state->cred_fd);
+        state->cred_fd = -1;
+    }
+}
+
+/**
+ * With the locks held, read the names other writers added since the last batch (all of
+ * them if the table file was replaced), drop the batched rows they now clash with, and
+ * give the rest their ids
+ * @return 0 on success, -1 on a read error
+ */
+static int sync_names(struct ImportState *state) {
+    size_t row_size = state->heap ? state->heap->row_size : state->record_size;
+    struct NameSet added;
+    struct stat st, cred_st;
+    int max_id = 0;
+    int reloaded;
+    int kept = 0;
+
+    cred_st.st_size = 0;
+    if (fstat(state->data_fd, &st) < 0 || (state->cred_fd >= 0 && fstat(state->cred_fd, &cred_st) < 0)) {
+        return -1;
+    }
+    reloaded = st.st_dev != state->data_dev || st.st_ino != state->data_ino || st.st_size < state->data_loaded;
+    if (reloaded) {
+        state->data_loaded = 0;
+        state->cred_loaded = 0;
+    }
+    if (name_set_init(&added, (st.st_size - state->data_loaded) / row_size) < 0) {
+        return -1;
+    }
+    if (lseek(state->data_fd, state->data_loaded, SEEK_SET) < 0 ||
+        load_existing(state->data_fd, state->table, &added, &max_id) < 0 ||
+        (state->cred_fd >= 0 && (lseek(state->cred_fd, state->cred_loaded, SEEK_SET) < 0 ||
+                                 load_credentials(state->cred_fd, &added) < 0))) {
+        free(added.entries);
+        return -1;
+    }
+    state->data_dev = st.st_dev;
+    state->data_ino = st.st_ino;
+    state->data_loaded = st.st_size;
+    state->cred_loaded = cred_st.st_size;
+
+    // Course ids come from this shard's own range when the server is a shard
+    if (max_id > 0 || state->next_id == 0) {
+        int next_id = state->table == IMPORT_COURSES ? shard_next_course_id(max_id) : max_id + 1;
+
+        if (next_id > state->next_id) {
+            state->next_id = next_id;
+        }
+    }
+
+    for (int i = 0; i < state->batch_count; i++) {
+        char *record = state->batch + i * state->record_size;
+
+        if (name_set_find(&added, batch_name(state, i))) {
+            note_rejection_at(state, state->lines[i], state->table == IMPORT_COURSES ?
+                              "duplicate course code" : "username already exists");
+            continue;
+        }
+        if (kept != i) {
+            memcpy(state->batch + kept * state->record_size, record, state->record_size);
+            state->creds[kept] = state->creds[i];
+            state->lines[kept] = state->lines[i];
+        }
+        record = state->batch + kept * state->record_size;
+        if (state->table == IMPORT_STUDENTS) {
+            ((struct Student *)record)->id = take_id(state);
+        } else if (state->table == IMPORT_FACULTY) {
+            ((struct Faculty *)record)->id = take_id(state);
+        } else {
+            ((struct Course *)record)->course_id = take_id(state);
+        }
+        if (state->first_id == 0) {
+            state->first_id = state->last_id;
+        }
+        kept++;
+    }
+    state->batch_count = kept;
+
+    // A reread replaces the set; the rows still batched keep their names taken
+    if (reloaded) {
+        free(state->names.entries);
+        state->names = added;
+        for (int i = 0; i < state->batch_count; i++) {
+            if (name_set_add(&state->names, batch_name(state, i), 0) < 0) {
+                return -1;
+            }
+        }
+        return 0;
+    }
+    for (size_t i = 0; i < added.capacity; i++) {
+        if (added.entries[i].used && !name_set_find(&state->names, added.entries[i].name) &&
+            name_set_add(&state->names, added.entries[i].name, 0) < 0) {
+            free(added.entries);
+            return -1;
+        }
+    }
+    free(added.entries);
+    return 0;
+}
+
+// Write the synced batch: one write to the table (plus its heap) and one to the credentials file
+static int write_batch(struct ImportState *state) {
+    size_t data_bytes = state->batch_count * state->record_size;
+    size_t cred_bytes = state->batch_count * sizeof(struct Credentials);
+
+    if (state->heap) {
+        if (append_heap_records(state->heap, state->data_fd, state->batch, state->batch_count) < 0) {
+            return -1;
+        }
+    } else {
+        for (int i = 0; i < state->batch_count; i++) {
+            key_filter_add(FILTER_COURSE_CODE, ((struct Course *)state->batch)[i].course_code);
+        }
+        if (trace_write(state->data_fd, state->batch, data_bytes) != (ssize_t)data_bytes) {
+            return -1;
+        }
+        replication_log_write(state->data_fd, state->path, state->batch, data_bytes);
+    }
+    if (state->table != IMPORT_COURSES) {
+        if (trace_write(state->cred_fd, state->creds, cred_bytes) != (ssize_t)cred_bytes) {
+            return -1;
+        }
+        replication_log_write(state->cred_fd, CREDENTIALS_FILE, state->creds, cred_bytes);
+    }
+    return 0;
+}
+
+// Append the pending batch, holding the file locks only for this and never while the client
+// is sending
+static int flush_batch(struct ImportState *state) {
+    int result;
+
+    if (state->batch_count == 0) {
+        return 0;
+    }
+
+    // The router's validation pass counts what would be imported without writing it
+    if (shard_check_only()) {
+        for (int i = 0; i < state->batch_count; i++) {
+            take_id(state);
+            if (state->first_id == 0) {
+                state->first_id = state->last_id;
+            }
+        }
+        state->imported += state->batch_count;
+        state->batch_count = 0;
+        return 0;
+    }
+
+    result = lock_files(state) == 0 && sync_names(state) == 0 &&
+             (state->batch_count == 0 || write_batch(state) == 0) ? 0 : -1;
+    unlock_files(state);
+    if (result == 0) {
+        state->imported += state->batch_count;
+        state->batch_count = 0;
+    }
+    return result;
+}
+
+// Split a CSV line into fields in place; double quotes may wrap fields containing commas
+static int split_csv(char *line, char **fields, int max_fields) {
+    int count = 0;
+    char *src = line;
+    char *dst = line;
+
+    while (count < max_fields) {
+        int quoted = *src == '"';
+        fields[count++] = dst;
+        if (quoted) {
+            src++;
+        }
+        while (*src) {
+            if (quoted && *src == '"') {
+                if (src[1] == '"') {
+                    *dst++ = '"';
+                    src += 2;
+                    continue;
+                }
+                quoted = 0;
+                src++;
+                continue;
+            }
+            if (!quoted && *src == ',') {
+                break;
+            }
+            *dst++ = *src++;
+        }
+        if (*src != ',') {
+            *dst = '\0';
+            return count;
+        }
+        src++;
+        *dst++ = '\0';
+    }
+    // More fields than expected
+    return max_fields + 1;
+}
+
+static void import_row(struct ImportState *state, char *line) {
+    char *fields[IMPORT_MAX_FIELDS + 1];
+    int expected = state->table == IMPORT_STUDENTS ? 3 : 4;
+    int count;
+
+    state->line++;
+    line[strcspn(line, "\r")] = '\0';
+    if (line[0] == '\0') {
+        return;
+    }
+
+    count = split_csv(line, fields, IMPORT_MAX_FIELDS);
+
+    // An optional header row is recognised by its first column name
+    if (state->line == 1 && (strcmp(fields[0], "username") == 0 || strcmp(fields[0], "course_code") == 0)) {
+        return;
+    }
+    if (count != expected) {
+        note_rejection(state, "wrong number of fields");
+        return;
+    }
+
+    if (state->table == IMPORT_COURSES) {
+        struct Course *course = (struct Course *)(state->batch + state->batch_count * state->record_size);
+        struct NameEntry *owner;
+        int max_seats = atoi(fields[3]);
+
+        if (fields[0][0] == '\0' || strlen(fields[0]) >= MAX_COURSE_CODE_LENGTH) {
+            note_rejection(state, "invalid course code");
+            return;
+        }
+        if (fields[1][0] == '\0' || strlen(fields[1]) >= MAX_COURSE_NAME_LENGTH) {
+            note_rejection(state, "invalid course name");
+            return;
+        }
+        if (max_seats <= 0) {
+            note_rejection(state, "invalid max_seats");
+            return;
+        }
+        owner = name_set_find(&state->faculty, fields[2]);
+        if (!owner) {
+            note_rejection(state, "unknown faculty");
+            return;
+        }
+        if (name_set_find(&state->names, fields[0])) {
+            note_rejection(state, "duplicate course code");
+            return;
+        }
+
+        memset(course, 0, sizeof(struct Course));
+        strcpy(course->course_code, fields[0]);
+        strcpy(course->course_name, fields[1]);
+        course->faculty_id = owner->value;
+        course->max_seats = max_seats;
+        course->enrolled_count = 0;
+        if (name_set_add(&state->names, fields[0], 0) < 0) {
+            state->failed = 1;
+            return;
+        }
+    } else {
+        struct Credentials *cred = &state->creds[state->batch_count];
+
+        if (!validate_username(fields[0])) {
+            note_rejection(state, "invalid username");
+            return;
+        }
+        if (fields[1][0] == '\0' || strlen(fields[1]) >= MAX_NAME_LENGTH) {
+            note_rejection(state, "invalid name");
+            return;
+        }
+        if (strlen(fields[2]) >= MAX_EMAIL_LENGTH || !validate_email(fields[2])) {
+            note_rejection(state, "invalid email");
+            return;
+        }
+        if (state->table == IMPORT_FACULTY &&
+            (fields[3][0] == '\0' || strlen(fields[3]) >= MAX_DEPARTMENT_LENGTH)) {
+            note_rejection(state, "invalid department");
+            return;
+        }
+        if (name_set_find(&state->names, fields[0])) {
+            note_rejection(state, "username already exists");
+            return;
+        }
+
+        if (state->table == IMPORT_STUDENTS) {
+            struct Student *student = (struct Student *)(state->batch + state->batch_count * state->record_size);
+            memset(student, 0, sizeof(struct Student));
+            strcpy(student->username, fields[0]);
+            strcpy(student->name, fields[1]);
+            strcpy(student->email, fields[2]);
+            student->active = 1;
+        } else {
+            struct Faculty *faculty = (struct Faculty *)(state->batch + state->batch_count * state->record_size);
+            memset(faculty, 0, sizeof(struct Faculty));
+            strcpy(faculty->username, fields[0]);
+            strcpy(faculty->name, fields[1]);
+            strcpy(faculty->email, fields[2]);
+            strcpy(faculty->department, fields[3]);
+        }
+
+        // Same default credentials as ADD_STUDENT / ADD_FACULTY
+        memset(cred, 0, sizeof(struct Credentials));
+        strcpy(cred->username, fields[0]);
+        strcpy(cred->password_hash, "default");
+        strcpy(cred->role, state->table == IMPORT_STUDENTS ? "student" : "faculty");
+
+        if (name_set_add(&state->names, fields[0], 0) < 0) {
+            state->failed = 1;
+            return;
+        }
+    }
+
+    // Ids are given out when the batch is written, after other writers' rows are seen
+    state->lines[state->batch_count] = state->line;
+    if (++state->batch_count == IMPORT_BATCH_RECORDS && flush_batch(state) < 0) {
+        state->failed = 1;
+    }
+}
+
+// Read exactly `bytes` of CSV from the socket, handing complete lines to import_row
+static int stream_rows(struct ImportState *state, int client_socket, long bytes) {
+    char *buffer = malloc(IMPORT_CHUNK_SIZE + IMPORT_LINE_LENGTH);
+    size_t pending = 0;
+    long remaining = bytes;
+
+    if (!buffer) {
+        return -1;
+    }
+
+    while (remaining > 0 && !state->failed) {
+        size_t want = IMPORT_CHUNK_SIZE;
+        ssize_t n;
+        char *start;
+        char *newline;
+
+        if ((long)want > remaining) {
+            want = remaining;
+        }
+        n = read(client_socket, buffer + pending, want);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            free(buffer);
+            return -1;
+        }
+        remaining -= n;
+        pending += n;
+
+        // Validate and batch every complete line in this chunk
+        trace_begin("import_batch");
+        start = buffer;
+        while ((newline = memchr(start, '\n', pending - (start - buffer))) != NULL && !state->failed) {
+            *newline = '\0';
+            import_row(state, start);
+            start = newline + 1;
+        }
+        trace_end();
+
+        pending -= start - buffer;
+        if (pending >= IMPORT_LINE_LENGTH) {
+            // A line this long can't be a valid record; drop it
+            state->line++;
+            note_rejection(state, "line too long");
+            pending = 0;
+            // Skip the rest of it up to the next newline
+            while (remaining > 0) {
+                char c;
+                if (read(client_socket, &c, 1) != 1) {
+                    free(buffer);
+                    return -1;
+                }
+                remaining--;
+                if (c == '\n') {
+                    break;
+                }
+            }
+        } else {
+            memmove(buffer, start, pending);
+        }
+    }
+
+    // Last line without a trailing newline
+    if (pending > 0 && !state->failed) {
+        buffer[pending] = '\0';
+        import_row(state, buffer);
+    }
+
+    free(buffer);
+    return state->failed ? -1 : flush_batch(state);
+}
+
+// Load existing keys, then stream and append the CSV body
+static int run_import(struct ImportState *state, int client_socket, long bytes,
+                      const char *table_name, char *response) {
+    struct timeval timeout = { IMPORT_RECV_TIMEOUT_SEC, 0 };
+    struct timeval no_timeout = { 0, 0 };
+    int faculty_fd;
+    int max_id = 0;
+    int result;
+
+    // Existing names and the next id are read under the locks; each batch then reads
+    // only what was appended since
+    if (lock_files(state) < 0) {
+        sprintf(response, "ERROR:Cannot lock data files: %s", strerror(errno));
+        unlock_files(state);
+        return -1;
+    }
+    result = sync_names(state);
+    unlock_files(state);
+    if (result < 0) {
+        strcpy(response, "ERROR:Failed to read existing records");
+        return -1;
+    }
+
+    // Courses name their owner by username; resolve them all from one faculty scan
+    if (state->table == IMPORT_COURSES) {
+        if (name_set_init(&state->faculty, 0) < 0) {
+            strcpy(response, "ERROR:Out of memory");
+            return -1;
+        }
+        faculty_fd = trace_open(FACULTY_FILE, O_RDONLY, 0);
+        if (faculty_fd >= 0) {
+            FLOCK(faculty_fd, LOCK_SH, FACULTY_FILE);
+            load_existing(faculty_fd, IMPORT_FACULTY, &state->faculty, &max_id);
+            FLOCK(faculty_fd, LOCK_UN, FACULTY_FILE);
+            close(faculty_fd);
+        }
+    }
+
+    // A stalled client must not hold up its worker indefinitely
+    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    write(client_socket, "READY", 5);
+    result = stream_rows(state, client_socket, bytes);
+    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, &no_timeout, sizeof(no_timeout));
+
+    if (result < 0) {
+        snprintf(response, 1024, "ERROR:Import aborted after %ld records at line %ld (%s)",
+                 state->imported, state->line, state->failed ? "write failed" : "connection lost");
+    } else if (state->imported > 0) {
+        snprintf(response, 1024, "SUCCESS:Imported %ld %s (ids %d-%d), rejected %ld%s%s",
+                 state->imported, table_name, state->first_id, state->last_id, state->rejected,
+                 state->rejected ? ": " : "", state->errors);
+    } else {
+        snprintf(response, 1024, "SUCCESS:Imported 0 %s, rejected %ld%s%s",
+                 table_name, state->rejected, state->rejected ? ": " : "", state->errors);
+    }
+    return result;
+}
+
+int handle_import(int client_socket, char *params, char *response) {
+    struct ImportState state;
+    char table_name[16];
+    long bytes;
+    int result = -1;
+    TRACE_SCOPE(__func__);
+
+    if (sscanf(params, "%15[^:]:%ld", table_name, &bytes) != 2 || bytes < 0 || bytes > IMPORT_MAX_BYTES) {
+        strcpy(response, "ERROR:Invalid parameters for IMPORT (IMPORT:<students|faculty|courses>:<bytes>)");
+        return -1;
+    }
+
+    memset(&state, 0, sizeof(state));
+    if (strcmp(table_name, "students") == 0) {
+        state.table = IMPORT_STUDENTS;
+        state.path = STUDENT_FILE;
+        state.heap = &student_heap;
+        state.record_size = sizeof(struct Student);
+    } else if (strcmp(table_name, "faculty") == 0) {
+        state.table = IMPORT_FACULTY;
+        state.path = FACULTY_FILE;
+        state.heap = &faculty_heap;
+        state.record_size = sizeof(struct Faculty);
+    } else if (strcmp(table_name, "courses") == 0) {
+        state.table = IMPORT_COURSES;
+        state.path = COURSE_FILE;
+        state.record_size = sizeof(struct Course);
+    } else {
+        strcpy(response, "ERROR:Unknown table for IMPORT");
+        return -1;
+    }
+    state.data_fd = -1;
+    state.cred_fd = -1;
+
+    state.batch = malloc(IMPORT_BATCH_RECORDS * state.record_size);
+    state.creds = malloc(IMPORT_BATCH_RECORDS * sizeof(struct Credentials));
+    state.lines = malloc(IMPORT_BATCH_RECORDS * sizeof(long));
+
+    if (!state.batch || !state.creds || !state.lines) {
+        strcpy(response, "ERROR:Out of memory");
+    } else {
+        result = run_import(&state, client_socket, bytes, table_name, response);
+    }
+
+    free(state.names.entries);
+    free(state.faculty.entries);
+    free(state.batch);
+    free(state.creds);
+    free(state.lines);
+    return result;
+}
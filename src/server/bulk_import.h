@@ -0,0 +1,20 @@
+#ifndef BULK_IMPORT_H
+#define BULK_IMPORT_H
+
+// Largest CSV body a single IMPORT may stream
+#define IMPORT_MAX_BYTES (256L * 1024 * 1024)
+
+/**
+ * Bulk CSV import (IMPORT:<students|faculty|courses>:<bytes>). Replies READY, then reads
+ * exactly <bytes> of CSV from the socket and appends the valid rows in large batches.
+ *   students: username,name,email
+ *   faculty:  username,name,email,department
+ *   courses:  course_code,course_name,faculty_username,max_seats
+ * @param client_socket Connection the CSV body is streamed over
+ * @param params "<table>:<bytes>"
+ * @param response Final summary, written by the caller
+ * @return 0 on success, -1 on failure
+ */
+int handle_import(int client_socket, char *params, char *response);
+
+#endif // BULK_IMPORT_H
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "connection_pool.h"
+
+// Slabs are never freed; the memory stays with the pool for the next burst of connections
+struct ConnectionSlab {
+    struct ConnectionSlab *next;
+    struct Connection entries[CONNECTION_SLAB_ENTRIES];
+};
+
+static struct ConnectionSlab *slabs = NULL;
+static struct Connection *free_list = NULL;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long slab_count = 0;
+static unsigned long in_use = 0;
+static unsigned long peak_in_use = 0;
+static unsigned long acquired = 0;
+
+// Add a slab and thread its entries onto the free list (mutex held)
+static int grow_pool() {
+    struct ConnectionSlab *slab = malloc(sizeof(struct ConnectionSlab));
+
+    if (!slab) {
+        return -1;
+    }
+    for (int i = CONNECTION_SLAB_ENTRIES - 1; i >= 0; i--) {
+        slab->entries[i].arena = NULL;
+        slab->entries[i].next_free = free_list;
+        free_list = &slab->entries[i];
+    }
+    slab->next = slabs;
+    slabs = slab;
+    slab_count++;
+    return 0;
+}
+
+struct Connection *connection_acquire(int socket) {
+    struct Connection *connection;
+
+    pthread_mutex_lock(&pool_mutex);
+    if (!free_list && grow_pool() < 0) {
+        pthread_mutex_unlock(&pool_mutex);
+        return NULL;
+    }
+    connection = free_list;
+    free_list = connection->next_free;
+    acquired++;
+    if (++in_use > peak_in_use) {
+        peak_in_use = in_use;
+    }
+    pthread_mutex_unlock(&pool_mutex);
+
+    // The buffers are overwritten by every request; only the session has to start clean
+    memset(&connection->session, 0, sizeof(connection->session));
+    connection->session.socket = socket;
+    connection->next_free = NULL;
+    return connection;
+}
+
+void connection_release(struct Connection *connection) {
+    pthread_mutex_lock(&pool_mutex);
+    connection->next_free = free_list;
+    free_list = connection;
+    in_use--;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+int connection_pool_report(char *buffer, size_t size) {
+    unsigned long capacity, used, peak, total, count;
+    int written;
+
+    pthread_mutex_lock(&pool_mutex);
+    count = slab_count;
+    used = in_use;
+    peak = peak_in_use;
+    total = acquired;
+    pthread_mutex_unlock(&pool_mutex);
+    capacity = count * CONNECTION_SLAB_ENTRIES;
+
+    written = snprintf(buffer, size,
+                       "Connections: %lu in use, %lu free, peak %lu\n"
+                       "Slabs: %lu of %d entries, %lu bytes (%zu per entry)\n"
+                       "Acquired since startup: %lu\n",
+                       used, capacity - used, peak, count, CONNECTION_SLAB_ENTRIES,
+                       count * (unsigned long)sizeof(struct ConnectionSlab), sizeof(struct Connection),
+                       total);
+    return written < 0 || (size_t)written >= size ? -1 : 0;
+}
@@ -0,0 +1,44 @@
+#ifndef CONNECTION_POOL_H
+#define CONNECTION_POOL_H
+
+#include <stddef.h>
+#include "arena.h"
+
+// Per-connection state comes from fixed-size slabs. Released entries go on a free list and
+// are handed to the next connection, arena included, so a connect or disconnect allocates
+// nothing once the pool has grown to the peak number of connections.
+#define CONNECTION_SLAB_ENTRIES 64
+#define CONNECTION_BUFFER_SIZE 1024
+
+// Client session structure
+struct ClientSession {
+    int socket;
+    char username[50];
+    char role[10];
+    int authenticated;
+    int peer_trusted;               // authenticated from SO_PEERCRED, AUTH may still follow
+};
+
+// Everything one connection thread keeps between requests
+struct Connection {
+    struct ClientSession session;
+    char request[CONNECTION_BUFFER_SIZE];
+    char response[CONNECTION_BUFFER_SIZE];
+    struct Arena *arena;            // created by the entry's first connection, then kept
+    struct Connection *next_free;
+};
+
+/**
+ * Take an entry for a new connection, with a cleared session for socket
+ * @return NULL when a new slab is needed and cannot be allocated
+ */
+struct Connection *connection_acquire(int socket);
+
+// Return an entry once its connection is closed
+void connection_release(struct Connection *connection);
+
+// Entries in use, free and at peak, and the memory held by the slabs; -1 if the report
+// does not fit in buffer
+int connection_pool_report(char *buffer, size_t size);
+
+#endif // CONNECTION_POOL_H
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "department.h"
+
+// The whole dictionary is kept in memory; entries never change once written, so a code
+// that is missing here can only have been appended since the last read of the file
+static char names[MAX_DEPARTMENTS][MAX_DEPARTMENT_LENGTH];
+static int count = 0;
+static char file[256] = DEPARTMENT_FILE;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Read entries past the ones already known (mutex held)
+static void load_appended() {
+    struct Department entry;
+    int fd = open(file, O_RDONLY);
+
+    if (fd < 0) {
+        return;
+    }
+    while (count < MAX_DEPARTMENTS &&
+           pread(fd, &entry, sizeof(entry), (off_t)count * sizeof(entry)) == (ssize_t)sizeof(entry) &&
+           entry.code == count + 1) {
+        entry.name[sizeof(entry.name) - 1] = '\0';
+        strcpy(names[count++], entry.name);
+    }
+    close(fd);
+}
+
+static int find(const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+int department_code(const char *name) {
+    int code;
+
+    if (name[0] == '\0') {
+        return 0;
+    }
+    pthread_mutex_lock(&mutex);
+    code = find(name);
+    if (code < 0) {
+        load_appended();
+        code = find(name);
+    }
+    pthread_mutex_unlock(&mutex);
+    return code;
+}
+
+int department_name(int code, char *name, size_t size) {
+    int result = 0;
+
+    name[0] = '\0';
+    if (code == 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&mutex);
+    if (code > count) {
+        load_appended();
+    }
+    if (code < 1 || code > count) {
+        result = -1;
+    } else {
+        snprintf(name, size, "%s", names[code - 1]);
+    }
+    pthread_mutex_unlock(&mutex);
+    return result;
+}
+
+int department_intern(const char *name, struct Department *added) {
+    struct Department entry;
+    int code;
+    int fd;
+
+    if (added) {
+        memset(added, 0, sizeof(*added));
+    }
+    code = department_code(name);
+    if (code >= 0) {
+        return code;
+    }
+
+    pthread_mutex_lock(&mutex);
+    // Other writers wait for the faculty lock, so nobody appends between here and the write
+    code = find(name);
+    if (code > 0 || count >= MAX_DEPARTMENTS) {
+        pthread_mutex_unlock(&mutex);
+        return code;             // -1 when the dictionary is full
+    }
+    memset(&entry, 0, sizeof(entry));
+    entry.code = count + 1;
+    snprintf(entry.name, sizeof(entry.name), "%s", name);
+
+    fd = open(file, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0 || pwrite(fd, &entry, sizeof(entry), (off_t)count * sizeof(entry)) != (ssize_t)sizeof(entry)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        pthread_mutex_unlock(&mutex);
+        return -1;
+    }
+    close(fd);
+    strcpy(names[count++], entry.name);
+    pthread_mutex_unlock(&mutex);
+
+    if (added) {
+        *added = entry;
+    }
+    return entry.code;
+}
+
+int department_list(struct Department *departments, int max) {
+    int copied;
+
+    pthread_mutex_lock(&mutex);
+    load_appended();
+    for (copied = 0; copied < count && copied < max; copied++) {
+        departments[copied].code = copied + 1;
+        strcpy(departments[copied].name, names[copied]);
+    }
+    pthread_mutex_unlock(&mutex);
+    return copied;
+}
+
+int department_count() {
+    int known;
+
+    pthread_mutex_lock(&mutex);
+    load_appended();
+    known = count;
+    pthread_mutex_unlock(&mutex);
+    return known;
+}
+
+void department_use_file(const char *path) {
+    pthread_mutex_lock(&mutex);
+    snprintf(file, sizeof(file), "%s", path);
+    count = 0;
+    pthread_mutex_unlock(&mutex);
+}
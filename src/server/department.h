@@ -0,0 +1,45 @@
+#ifndef DEPARTMENT_H
+#define DEPARTMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/constants.h"
+
+// Interned department names. Faculty rows hold a department's code, its 1-based position in
+// this file, with 0 for none. Entries are only appended, under the lock on faculty.dat.
+#define DEPARTMENT_FILE "data/departments.dat"
+#define MAX_DEPARTMENTS 4096
+
+struct Department {
+    int32_t code;
+    char name[MAX_DEPARTMENT_LENGTH];
+};
+
+/**
+ * Look up a department, reading entries other processes appended if it is not known yet
+ * @return Its code, 0 for the empty name, -1 if it was never interned
+ */
+int department_code(const char *name);
+
+// Copy the name of a code into name (empty for 0); -1 if the code is unknown
+int department_name(int code, char *name, size_t size);
+
+/**
+ * Code for a department, appending it to the dictionary if it is new. The caller holds the
+ * exclusive lock on faculty.dat.
+ * @param added If not NULL, receives the appended entry (code 0 when nothing was appended)
+ * @return The code, or -1 when the dictionary is full or cannot be written
+ */
+int department_intern(const char *name, struct Department *added);
+
+// Copy up to max departments in code order; returns how many were copied
+int department_list(struct Department *departments, int max);
+
+// Number of departments interned so far, including those other processes appended
+int department_count();
+
+// Switch to another dictionary file, forgetting the entries read so far (for tools that
+// write a data directory other than data/, or replace its files)
+void department_use_file(const char *path);
+
+#endif // DEPARTMENT_H
@@ -0,0 +1,399 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../common/constants.h"
+#include "enrollment_store.h"
+#include "slow_log.h"
+
+#define MAX_VARINT_BYTES 10
+#define TAIL_READ_RECORDS 4096
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static size_t put_varint(unsigned char *out, uint64_t value) {
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+static int64_t column_value(const struct Enrollment *row, int column) {
+    switch (column) {
+        case COLUMN_ENROLLMENT_ID:   return row->enrollment_id;
+        case COLUMN_STUDENT_ID:      return row->student_id;
+        case COLUMN_COURSE_ID:       return row->course_id;
+        default:                     return row->enrollment_date;
+    }
+}
+
+static void set_column_value(struct Enrollment *row, int column, int64_t value) {
+    switch (column) {
+        case COLUMN_ENROLLMENT_ID:   row->enrollment_id = (int)value; break;
+        case COLUMN_STUDENT_ID:      row->student_id = (int)value; break;
+        case COLUMN_COURSE_ID:       row->course_id = (int)value; break;
+        default:                     row->enrollment_date = (time_t)value; break;
+    }
+}
+
+char *enrollment_segment_encode(const struct Enrollment *rows, uint32_t count, size_t *length) {
+    struct EnrollmentSegmentHeader header;
+    unsigned char *segment = malloc(sizeof(header) + (size_t)count * MAX_VARINT_BYTES * ENROLLMENT_COLUMN_COUNT);
+    size_t used = sizeof(header);
+    unsigned char *shrunk;
+
+    if (!segment) {
+        return NULL;
+    }
+    memset(&header, 0, sizeof(header));
+    header.magic = ENROLLMENT_SEGMENT_MAGIC;
+    header.rows = count;
+    header.min_student = header.max_student = count ? rows[0].student_id : 0;
+    header.min_course = header.max_course = count ? rows[0].course_id : 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (rows[i].student_id < header.min_student) header.min_student = rows[i].student_id;
+        if (rows[i].student_id > header.max_student) header.max_student = rows[i].student_id;
+        if (rows[i].course_id < header.min_course) header.min_course = rows[i].course_id;
+        if (rows[i].course_id > header.max_course) header.max_course = rows[i].course_id;
+        if (rows[i].enrollment_id > header.max_enrollment_id) header.max_enrollment_id = rows[i].enrollment_id;
+    }
+
+    for (int column = 0; column < ENROLLMENT_COLUMN_COUNT; column++) {
+        size_t start = used;
+        int64_t previous = 0;
+
+        for (uint32_t i = 0; i < count; i++) {
+            int64_t value = column_value(&rows[i], column);
+            used += put_varint(segment + used, zigzag(value - previous));
+            previous = value;
+        }
+        header.column_bytes[column] = used - start;
+    }
+    memcpy(segment, &header, sizeof(header));
+
+    shrunk = realloc(segment, used);
+    *length = used;
+    return (char *)(shrunk ? shrunk : segment);
+}
+
+// Fill one field of every row from an encoded column; -1 if the column is malformed
+static int decode_column(const unsigned char *data, size_t length, uint32_t rows, int column,
+                         struct Enrollment *out) {
+    size_t at = 0;
+    int64_t value = 0;
+
+    for (uint32_t i = 0; i < rows; i++) {
+        uint64_t encoded = 0;
+        int shift = 0;
+
+        do {
+            if (at >= length || shift >= 64) {
+                return -1;
+            }
+            encoded |= (uint64_t)(data[at] & 0x7f) << shift;
+            shift += 7;
+        } while (data[at++] & 0x80);
+
+        value += unzigzag(encoded);
+        set_column_value(&out[i], column, value);
+    }
+    return at == length ? 0 : -1;
+}
+
+static off_t segment_length(const struct EnrollmentSegmentHeader *header) {
+    off_t length = sizeof(*header);
+
+    for (int column = 0; column < ENROLLMENT_COLUMN_COUNT; column++) {
+        length += header->column_bytes[column];
+    }
+    return length;
+}
+
+// Read and check the header at offset; 0 at the end, 1 for a segment, -1 if damaged.
+// A segment extending past file_size (a replica still applying it) counts as the end.
+static int read_header(int fd, off_t offset, off_t file_size, struct EnrollmentSegmentHeader *header) {
+    if (offset >= file_size) {
+        return 0;
+    }
+    if (pread(fd, header, sizeof(*header), offset) != sizeof(*header) ||
+        header->magic != ENROLLMENT_SEGMENT_MAGIC) {
+        return -1;
+    }
+    return offset + segment_length(header) <= file_size ? 1 : 0;
+}
+
+// Read and decode a run of adjacent columns of the segment at offset into rows
+static int read_columns(int fd, off_t offset, const struct EnrollmentSegmentHeader *header,
+                        int first, int last, unsigned char **buffer, size_t *buffer_size,
+                        struct Enrollment *rows) {
+    off_t start = offset + sizeof(*header);
+    size_t length = 0;
+
+    for (int column = 0; column < first; column++) {
+        start += header->column_bytes[column];
+    }
+    for (int column = first; column <= last; column++) {
+        length += header->column_bytes[column];
+    }
+    if (length > *buffer_size) {
+        unsigned char *grown = realloc(*buffer, length);
+        if (!grown) {
+            return -1;
+        }
+        *buffer = grown;
+        *buffer_size = length;
+    }
+    if (pread(fd, *buffer, length, start) != (ssize_t)length) {
+        return -1;
+    }
+    for (int column = first, at = 0; column <= last; at += header->column_bytes[column], column++) {
+        if (decode_column(*buffer + at, header->column_bytes[column], header->rows, column, rows) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+long enrollment_segment_read(int segment_fd, off_t *offset, struct Enrollment **rows) {
+    struct EnrollmentSegmentHeader header;
+    struct stat st;
+    unsigned char *buffer = NULL;
+    size_t buffer_size = 0;
+    int found;
+
+    *rows = NULL;
+    if (fstat(segment_fd, &st) < 0) {
+        return -1;
+    }
+    found = read_header(segment_fd, *offset, st.st_size, &header);
+    if (found <= 0) {
+        return found;
+    }
+    *rows = calloc(header.rows ? header.rows : 1, sizeof(struct Enrollment));
+    if (!*rows || read_columns(segment_fd, *offset, &header, 0, ENROLLMENT_COLUMN_COUNT - 1,
+                               &buffer, &buffer_size, *rows) < 0) {
+        free(*rows);
+        free(buffer);
+        *rows = NULL;
+        return -1;
+    }
+    free(buffer);
+    slow_log_note_scan(ENROLLMENT_FILE, header.rows);
+    *offset += segment_length(&header);
+    return header.rows;
+}
+
+static int matches(const struct Enrollment *row, int student_id, int course_id) {
+    return (student_id == ENROLLMENT_ANY || row->student_id == student_id) &&
+           (course_id == ENROLLMENT_ANY || row->course_id == course_id);
+}
+
+// Scan the sealed segments; returns rows visited, or -1. *stopped is set if visit asked to stop.
+static long scan_segments(int student_id, int course_id, int full, enrollment_visit_fn visit,
+                          void *arg, int *stopped) {
+    struct EnrollmentSegmentHeader header;
+    struct Enrollment *rows = NULL;
+    size_t rows_size = 0;
+    unsigned char *buffer = NULL;
+    size_t buffer_size = 0;
+    struct stat st;
+    off_t offset = 0;
+    long visited = 0;
+    int found;
+    int fd = open(ENROLLMENT_SEGMENT_FILE, O_RDONLY);
+
+    if (fd < 0) {
+        return 0;            // legacy layout: everything is in the tail
+    }
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    while (!*stopped && (found = read_header(fd, offset, st.st_size, &header)) > 0) {
+        off_t next = offset + segment_length(&header);
+
+        if ((student_id != ENROLLMENT_ANY &&
+             (student_id < header.min_student || student_id > header.max_student)) ||
+            (course_id != ENROLLMENT_ANY &&
+             (course_id < header.min_course || course_id > header.max_course))) {
+            offset = next;
+            continue;
+        }
+
+        if (header.rows > rows_size) {
+            struct Enrollment *grown = realloc(rows, header.rows * sizeof(struct Enrollment));
+            if (!grown) {
+                found = -1;
+                break;
+            }
+            rows = grown;
+            rows_size = header.rows;
+        }
+        memset(rows, 0, header.rows * sizeof(struct Enrollment));
+
+        // Student and course ids are adjacent, so one read covers the filter columns
+        if (read_columns(fd, offset, &header, COLUMN_STUDENT_ID, COLUMN_COURSE_ID,
+                         &buffer, &buffer_size, rows) < 0 ||
+            (full && (read_columns(fd, offset, &header, COLUMN_ENROLLMENT_ID, COLUMN_ENROLLMENT_ID,
+                                   &buffer, &buffer_size, rows) < 0 ||
+                      read_columns(fd, offset, &header, COLUMN_ENROLLMENT_DATE, COLUMN_ENROLLMENT_DATE,
+                                   &buffer, &buffer_size, rows) < 0))) {
+            found = -1;
+            break;
+        }
+        slow_log_note_scan(ENROLLMENT_FILE, header.rows);
+
+        for (uint32_t i = 0; i < header.rows && !*stopped; i++) {
+            if (matches(&rows[i], student_id, course_id)) {
+                visited++;
+                *stopped = visit(&rows[i], arg);
+            }
+        }
+        offset = next;
+    }
+
+    free(rows);
+    free(buffer);
+    close(fd);
+    return found < 0 ? -1 : visited;
+}
+
+long enrollment_scan(int tail_fd, int student_id, int course_id, int full,
+                     enrollment_visit_fn visit, void *arg) {
+    struct Enrollment *records = malloc(TAIL_READ_RECORDS * sizeof(struct Enrollment));
+    int stopped = 0;
+    long visited;
+    ssize_t n;
+
+    if (!records) {
+        return -1;
+    }
+    visited = scan_segments(student_id, course_id, full, visit, arg, &stopped);
+
+    while (visited >= 0 && !stopped &&
+           (n = read(tail_fd, records, TAIL_READ_RECORDS * sizeof(struct Enrollment))) > 0) {
+        n /= sizeof(struct Enrollment);   // a partly written record is left for a later scan
+        slow_log_note_scan(ENROLLMENT_FILE, n);
+        for (ssize_t i = 0; i < n && !stopped; i++) {
+            if (matches(&records[i], student_id, course_id)) {
+                visited++;
+                stopped = visit(&records[i], arg);
+            }
+        }
+    }
+
+    free(records);
+    return visited;
+}
+
+int enrollment_segments_max_id() {
+    struct EnrollmentSegmentHeader header;
+    struct stat st;
+    off_t offset = 0;
+    int max_id = 0;
+    int fd = open(ENROLLMENT_SEGMENT_FILE, O_RDONLY);
+
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &st) == 0) {
+        while (read_header(fd, offset, st.st_size, &header) > 0) {
+            if (header.max_enrollment_id > max_id) {
+                max_id = header.max_enrollment_id;
+            }
+            offset += segment_length(&header);
+        }
+    }
+    close(fd);
+    return max_id;
+}
+
+static int write_all(int fd, const void *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n <= 0) {
+            return -1;
+        }
+        data = (const char *)data + n;
+        length -= n;
+    }
+    return 0;
+}
+
+long enrollment_segments_remove(int segment_fd, int out_fd, int student_id, int course_id,
+                                off_t *unchanged) {
+    struct EnrollmentSegmentHeader header;
+    struct stat st;
+    off_t offset = 0;
+    long removed = 0;
+    int found;
+
+    *unchanged = 0;
+    if (fstat(segment_fd, &st) < 0) {
+        return -1;
+    }
+
+    while ((found = read_header(segment_fd, offset, st.st_size, &header)) > 0) {
+        off_t length = segment_length(&header);
+        off_t next = offset;
+        struct Enrollment *rows = NULL;
+        long count = 0;
+        uint32_t kept = 0;
+
+        // Only a segment that may hold the pair is decoded
+        if (student_id >= header.min_student && student_id <= header.max_student &&
+            course_id >= header.min_course && course_id <= header.max_course) {
+            count = enrollment_segment_read(segment_fd, &next, &rows);
+            if (count < 0) {
+                return -1;
+            }
+            for (long i = 0; i < count; i++) {
+                if (!matches(&rows[i], student_id, course_id)) {
+                    rows[kept++] = rows[i];
+                }
+            }
+        }
+
+        if (rows && kept < count) {
+            size_t encoded_length = 0;
+            char *encoded = kept > 0 ? enrollment_segment_encode(rows, kept, &encoded_length) : NULL;
+
+            if (kept > 0 && (!encoded || write_all(out_fd, encoded, encoded_length) < 0)) {
+                free(encoded);
+                free(rows);
+                return -1;
+            }
+            free(encoded);
+            removed += count - kept;
+        } else {
+            char *raw = malloc(length);
+
+            if (!raw || pread(segment_fd, raw, length, offset) != length || write_all(out_fd, raw, length) < 0) {
+                free(raw);
+                free(rows);
+                return -1;
+            }
+            free(raw);
+            if (removed == 0) {
+                *unchanged += length;
+            }
+        }
+        free(rows);
+        offset += length;
+    }
+    return found < 0 ? -1 : removed;
+}
@@ -0,0 +1,82 @@
+#ifndef ENROLLMENT_STORE_H
+#define ENROLLMENT_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "../common/structures.h"
+
+// Sealed enrollments, stored column-wise. Once this file exists, enrollments.dat is only
+// the mutable tail of recent appends, sealed into a new segment when it reaches
+// ENROLLMENT_SEGMENT_ROWS. Both files are guarded by the lock on enrollments.dat.
+#define ENROLLMENT_SEGMENT_FILE "data/enrollments.seg"
+#define ENROLLMENT_SEGMENT_ROWS 65536
+#define ENROLLMENT_SEGMENT_MAGIC 0x47534e45   // "ENSG"
+
+// Matches any student or course in a scan filter
+#define ENROLLMENT_ANY -1
+
+enum EnrollmentColumn {
+    COLUMN_ENROLLMENT_ID,
+    COLUMN_STUDENT_ID,
+    COLUMN_COURSE_ID,
+    COLUMN_ENROLLMENT_DATE,
+    ENROLLMENT_COLUMN_COUNT
+};
+
+// Each column follows the header in enum order: zigzag deltas from the previous row, as
+// varints. The id ranges let a scan skip segments without reading any column.
+struct EnrollmentSegmentHeader {
+    uint32_t magic;
+    uint32_t rows;
+    int32_t min_student;
+    int32_t max_student;
+    int32_t min_course;
+    int32_t max_course;
+    int32_t max_enrollment_id;
+    uint32_t column_bytes[ENROLLMENT_COLUMN_COUNT];
+};
+
+// Return non-zero to stop the scan
+typedef int (*enrollment_visit_fn)(const struct Enrollment *enrollment, void *arg);
+
+/**
+ * Encode rows as one sealed segment.
+ * @param length Receives the segment's size in bytes
+ * @return malloc'd segment, or NULL when out of memory
+ */
+char *enrollment_segment_encode(const struct Enrollment *rows, uint32_t count, size_t *length);
+
+/**
+ * Decode the segment at *offset of the segment file and advance *offset past it.
+ * @param rows Receives a malloc'd array of every row; the caller frees it
+ * @return Number of rows, 0 at the end of the file, -1 on a damaged segment or read error
+ */
+long enrollment_segment_read(int segment_fd, off_t *offset, struct Enrollment **rows);
+
+/**
+ * Visit every enrollment matching student_id and course_id (either may be ENROLLMENT_ANY):
+ * sealed segments first, then the tail records of tail_fd, oldest first. Segments whose id
+ * ranges exclude the filter are skipped; from the rest only the student and course columns
+ * are read, plus the id and date columns when `full` is set (otherwise those fields are 0).
+ * The caller holds a lock on tail_fd, which must be positioned at its start.
+ * @return Number of matching rows visited, or -1 on a read error
+ */
+long enrollment_scan(int tail_fd, int student_id, int course_id, int full,
+                     enrollment_visit_fn visit, void *arg);
+
+/**
+ * Highest enrollment id among the sealed segments (0 without any).
+ */
+int enrollment_segments_max_id();
+
+/**
+ * Rewrite the segment file to out_fd without the rows of (student_id, course_id).
+ * Segments that keep all their rows are copied unchanged.
+ * @param unchanged Receives the length of the leading part identical to the old file
+ * @return Number of rows removed, or -1 on failure
+ */
+long enrollment_segments_remove(int segment_fd, int out_fd, int student_id, int course_id,
+                                off_t *unchanged);
+
+#endif // ENROLLMENT_STORE_H
@@ -10,7 +10,22 @@
 #include <time.h>
 #include "../common/structures.h"
 #include "../common/constants.h"
+#include "lock_stats.h"
+#include "slow_log.h"
+#include "trace.h"
 #include "auth.h"
+#include "file_ops.h"
+#include "replication.h"
+#include "shard.h"
+#include "admission.h"
+#include "record_index.h"
+#include "enrollment_store.h"
+#include "arena.h"
+#include "key_filter.h"
+
+// Courses handle_view_my_courses() lists; more are only counted, as they would not fit
+#define MY_COURSES_LISTED 32
+#define COURSE_COPY_CHUNK (16 * 1024)
 
 // Function declarations
 int handle_add_course(char *request, char *response, const char *username);
@@ -25,16 +40,19 @@ int is_course_owner(int course_id, const char *username);
 
 // Updated main faculty handler function
 int handle_faculty_request(int client_socket, char *request, const char *username) {
-    char response[1024];
-    char command[256];
-    char params[768];
-    
-    // Initialize response buffer
-    memset(response, 0, sizeof(response));
+    char *response = arena_calloc(1, ARENA_RESPONSE_SIZE);
+    char *command = arena_alloc(ARENA_COMMAND_SIZE);
+    char *params = arena_alloc(ARENA_PARAMS_SIZE);
+    TRACE_SCOPE(__func__);
     
+    if (!response || !command || !params) {
+        write(client_socket, "ERROR:Out of memory", 19);
+        return -1;
+    }
+
     // Parse the request
-    if (sscanf(request, "%[^:]:%[^\n]", command, params) != 2) {
-        strcpy(command, request); // Handle commands without parameters
+    if (sscanf(request, "%255[^:]:%767[^\n]", command, params) != 2) {
+        snprintf(command, ARENA_COMMAND_SIZE, "%s", request); // Handle commands without parameters
         params[0] = '\0';
     }
     
@@ -61,10 +79,14 @@ int handle_faculty_request(int client_socket, char *request, const char *usernam
 
 // Check if course code already exists in the course file
 int course_code_exists(const char *course_code) {
-    struct Course course;
     int fd;
     int exists = 0;
     
+    // A code the filter has never seen is new, without opening the file
+    if (!key_filter_may_contain(FILTER_COURSE_CODE, course_code)) {
+        return 0;
+    }
+    
     // Open course file
     fd = open(COURSE_FILE, O_RDONLY);
     if (fd < 0) {
@@ -76,22 +98,17 @@ int course_code_exists(const char *course_code) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, COURSE_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for the course code
-    while (read(fd, &course, sizeof(struct Course)) == sizeof(struct Course)) {
-        if (strcmp(course.course_code, course_code) == 0) {
-            // Course code already exists
-            exists = 1;
-            break;
-        }
-    }
+    // Look up the course code
+    exists = record_index_find_name(INDEX_COURSE_CODE, fd, course_code, NULL) >= 0;
+    key_filter_note_lookup(FILTER_COURSE_CODE, exists);
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
     close(fd);
     
     return exists;
@@ -136,110 +153,186 @@ int handle_add_course(char *params, char *response, const char *username) {
     course.max_seats = max_seats;
     course.enrolled_count = 0;
     
-    // Open file with write lock
-    fd = open(COURSE_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    // Open with write lock the file in place; a removal may have just replaced it
+    fd = OPEN_LOCKED(COURSE_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644, LOCK_EX);
     if (fd < 0) {
         sprintf(response, "ERROR:Cannot open course file: %s", strerror(errno));
         return -1;
     }
     
-    // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
-        close(fd);
-        sprintf(response, "ERROR:Cannot lock course file: %s", strerror(errno));
-        return -1;
-    }
-    
-    // Write course record
+    // Write course record; the filter learns the code first
+    key_filter_add(FILTER_COURSE_CODE, course.course_code);
     if (write(fd, &course, sizeof(struct Course)) != sizeof(struct Course)) {
-        flock(fd, LOCK_UN);
+        FLOCK(fd, LOCK_UN, COURSE_FILE);
         close(fd);
         sprintf(response, "ERROR:Failed to write course record: %s", strerror(errno));
         return -1;
     }
+    replication_log_write(fd, COURSE_FILE, &course, sizeof(struct Course));
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
     close(fd);
     
     sprintf(response, "SUCCESS:Course added with ID %d", course.course_id);
     return 0;
 }
 
-int handle_remove_course(char *params, char *response, const char *username) {
-    int course_id;
-    struct Course course;
-    int fd_read, fd_write;
-    char temp_file[] = "data/courses.tmp";
-    int found = 0;
-    
-    // Parse parameters
-    if (sscanf(params, "%d", &course_id) != 1) {
-        strcpy(response, "ERROR:Invalid course ID");
-        return -1;
+// Copy length bytes at offset of the course file to the end of another
+static int copy_range(int from, int to, off_t offset, off_t length) {
+    char buffer[COURSE_COPY_CHUNK];
+
+    while (length > 0) {
+        ssize_t n = pread(from, buffer, length < COURSE_COPY_CHUNK ? length : COURSE_COPY_CHUNK, offset);
+
+        if (n <= 0 || write(to, buffer, n) != n) {
+            return -1;
+        }
+        slow_log_note_scan(COURSE_FILE, n / sizeof(struct Course));
+        offset += n;
+        length -= n;
     }
+    return 0;
+}
+
+// Sequencer step for REMOVE_COURSE: runs in the course's admission queue so no enroll,
+// unenroll or waitlist join for the course is in flight while it disappears
+static void apply_remove_course(int course_id, struct AdmissionTicket **batch, int count) {
+    struct stat st;
+    int fd_read, fd_write;
+    char temp_file[] = COURSE_FILE ".XXXXXX";
+    off_t offset;
+    int copied = -1;
+    int renamed = 0;
+    char *response = batch[0]->response;
     
-    // Check if faculty owns the course
-    if (!is_course_owner(course_id, username)) {
-        strcpy(response, "ERROR:You can only remove courses you created");
-        return -1;
+    // Only the first of several identical removals can find the course
+    for (int i = 1; i < count; i++) {
+        strcpy(batch[i]->response, "ERROR:Course not found");
+        batch[i]->result = -1;
     }
+    batch[0]->result = 0;
     
-    // Open files
-    fd_read = open(COURSE_FILE, O_RDONLY);
-    fd_write = open(temp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    // Lock the file in place, then copy it to a file private to this call
+    fd_read = OPEN_LOCKED(COURSE_FILE, O_RDONLY, 0, LOCK_EX);
+    fd_write = fd_read >= 0 ? create_temp_file(temp_file) : -1;
     
     if (fd_read < 0 || fd_write < 0) {
-        if (fd_read >= 0) close(fd_read);
-        if (fd_write >= 0) close(fd_write);
         sprintf(response, "ERROR:Cannot open course files: %s", strerror(errno));
-        return -1;
+        if (fd_read >= 0) {
+            FLOCK(fd_read, LOCK_UN, COURSE_FILE);
+            close(fd_read);
+        }
+        batch[0]->result = -1;
+        return;
     }
     
-    // Apply locks
-    flock(fd_read, LOCK_EX);
-    flock(fd_write, LOCK_EX);
-    
-    // Copy all courses except the one to remove
-    while (read(fd_read, &course, sizeof(struct Course)) == sizeof(struct Course)) {
-        if (course.course_id != course_id) {
-            write(fd_write, &course, sizeof(struct Course));
-        } else {
-            found = 1;
+    // The index finds the course; the records before and after it are copied as they are
+    offset = record_index_find_id(INDEX_COURSE_ID, fd_read, course_id, NULL);
+    if (offset >= 0 && fstat(fd_read, &st) == 0) {
+        off_t after = offset + sizeof(struct Course);
+        off_t end = st.st_size - st.st_size % sizeof(struct Course);
+
+        if (copy_range(fd_read, fd_write, 0, offset) == 0 && copy_range(fd_read, fd_write, after, end - after) == 0) {
+            copied = 0;
+            // The copy is about to replace the file, so no index may go by its inode number
+            record_index_note_rewrite(COURSE_FILE);
         }
     }
     
-    // Release locks and close files
-    flock(fd_read, LOCK_UN);
-    flock(fd_write, LOCK_UN);
-    close(fd_read);
     close(fd_write);
     
-    if (found) {
-        // Replace original file with temp file
-        if (rename(temp_file, COURSE_FILE) == 0) {
-            sprintf(response, "SUCCESS:Course removed successfully");
+    // The copy replaces the file before the lock is released, so no write can land in the
+    // old file after it was copied; everything before the course is unchanged
+    if (offset >= 0 && copied == 0 && rename(temp_file, COURSE_FILE) == 0) {
+        replication_log_file(COURSE_FILE, offset);
+        renamed = 1;
+    } else {
+        unlink(temp_file);
+    }
+    FLOCK(fd_read, LOCK_UN, COURSE_FILE);
+    close(fd_read);
+    
+    if (offset < 0) {
+        sprintf(response, "ERROR:Course not found");
+    } else if (copied < 0) {
+        sprintf(response, "ERROR:Failed to copy course records");
+        batch[0]->result = -1;
+    } else if (renamed) {
+        // Nobody can be promoted into a removed course, so release its waitlist
+        int released = clear_waitlist(course_id);
+        if (released > 0) {
+            sprintf(response, "SUCCESS:Course removed successfully (%d waitlisted students released)",
+                    released);
         } else {
-            sprintf(response, "ERROR:Failed to update course file");
-            unlink(temp_file);
+            sprintf(response, "SUCCESS:Course removed successfully");
         }
     } else {
-        sprintf(response, "ERROR:Course not found");
-        unlink(temp_file);
+        sprintf(response, "ERROR:Failed to update course file");
+        batch[0]->result = -1;
+    }
+}
+
+int handle_remove_course(char *params, char *response, const char *username) {
+    int course_id;
+    struct AdmissionTicket ticket;
+    
+    // Parse parameters
+    if (sscanf(params, "%d", &course_id) != 1) {
+        strcpy(response, "ERROR:Invalid course ID");
+        return -1;
     }
     
+    // Check if faculty owns the course
+    if (!is_course_owner(course_id, username)) {
+        strcpy(response, "ERROR:You can only remove courses you created");
+        return -1;
+    }
+    
+    ticket.student_id = 0;
+    ticket.apply = apply_remove_course;
+    ticket.response = response;
+    ticket.result = -1;
+    admission_submit(course_id, &ticket);
     return 0;
 }
 
-int handle_view_enrollments(char *params, char *response) {
-    int course_id;
-    struct Enrollment enrollment;
+// Roster text being built by handle_view_enrollments
+struct RosterListing {
+    char *info;
+    size_t size;
+    int count;
+};
+
+static int list_enrolled_student(const struct Enrollment *enrollment, void *arg) {
+    struct RosterListing *roster = arg;
     struct Student student;
-    int fd_enrollment, fd_student;
-    char enrollments_info[1024] = "";
     char line[256];
-    int count = 0;
     
+    // Get student details
+    if (read_student_by_id(enrollment->student_id, &student) == 0) {
+        sprintf(line, "Student ID: %d, Name: %s, Email: %s\n", 
+                student.id, student.name, student.email);
+        if (strlen(roster->info) + strlen(line) < roster->size - 32) {
+            strcat(roster->info, line);
+        }
+        roster->count++;
+    }
+    return 0;
+}
+
+int handle_view_enrollments(char *params, char *response) {
+    int course_id;
+    int fd_enrollment;
+    char *enrollments_info = arena_alloc(ARENA_RESPONSE_SIZE);
+    struct RosterListing roster = { enrollments_info, ARENA_RESPONSE_SIZE, 0 };
+    
+    if (!enrollments_info) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+    enrollments_info[0] = '\0';
+
     // Parse parameters
     if (sscanf(params, "%d", &course_id) != 1) {
         strcpy(response, "ERROR:Invalid course ID");
@@ -254,35 +347,16 @@ int handle_view_enrollments(char *params, char *response) {
     }
     
     // Apply read lock
-    flock(fd_enrollment, LOCK_SH);
-    
-    // Find enrollments for the course
-    while (read(fd_enrollment, &enrollment, sizeof(struct Enrollment)) == sizeof(struct Enrollment)) {
-        if (enrollment.course_id == course_id) {
-            // Get student details
-            fd_student = open(STUDENT_FILE, O_RDONLY);
-            if (fd_student >= 0) {
-                flock(fd_student, LOCK_SH);
-                while (read(fd_student, &student, sizeof(struct Student)) == sizeof(struct Student)) {
-                    if (student.id == enrollment.student_id) {
-                        sprintf(line, "Student ID: %d, Name: %s, Email: %s\n", 
-                                student.id, student.name, student.email);
-                        strcat(enrollments_info, line);
-                        count++;
-                        break;
-                    }
-                }
-                flock(fd_student, LOCK_UN);
-                close(fd_student);
-            }
-        }
-    }
+    FLOCK(fd_enrollment, LOCK_SH, ENROLLMENT_FILE);
+    
+    // Find enrollments for the course; sealed segments only read their id columns
+    enrollment_scan(fd_enrollment, ENROLLMENT_ANY, course_id, 0, list_enrolled_student, &roster);
     
-    flock(fd_enrollment, LOCK_UN);
+    FLOCK(fd_enrollment, LOCK_UN, ENROLLMENT_FILE);
     close(fd_enrollment);
     
-    if (count > 0) {
-        sprintf(response, "Total enrollments: %d\n%s", count, enrollments_info);
+    if (roster.count > 0) {
+        sprintf(response, "Total enrollments: %d\n%s", roster.count, enrollments_info);
     } else {
         sprintf(response, "No enrollments found for course %d", course_id);
     }
@@ -300,42 +374,34 @@ int get_faculty_id_by_username(const char *username) {
         return -1;
     }
     
-    flock(fd, LOCK_SH);
+    FLOCK(fd, LOCK_SH, FACULTY_FILE);
     
-    while (read(fd, &faculty, sizeof(struct Faculty)) == sizeof(struct Faculty)) {
-        if (strcmp(faculty.username, username) == 0) {
-            faculty_id = faculty.id;
-            break;
-        }
+    if (record_index_find_name(INDEX_FACULTY_USERNAME, fd, username, &faculty) >= 0) {
+        faculty_id = faculty.id;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     
     return faculty_id;
 }
 
 int get_next_course_id() {
-    struct Course course;
-    int fd, max_id = 0;
+    int fd, max_id;
     
     fd = open(COURSE_FILE, O_RDONLY);
     if (fd < 0) {
-        return 1; // First course
+        return shard_next_course_id(0); // First course
     }
     
-    flock(fd, LOCK_SH);
+    FLOCK(fd, LOCK_SH, COURSE_FILE);
     
-    while (read(fd, &course, sizeof(struct Course)) == sizeof(struct Course)) {
-        if (course.course_id > max_id) {
-            max_id = course.course_id;
-        }
-    }
+    max_id = record_index_max_id(INDEX_COURSE_ID, fd);
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
     close(fd);
     
-    return max_id + 1;
+    return shard_next_course_id(max_id > 0 ? max_id : 0);
 }
 
 int is_course_owner(int course_id, const char *username) {
@@ -356,57 +422,57 @@ int is_course_owner(int course_id, const char *username) {
         return 0;
     }
     
-    flock(fd, LOCK_SH);
+    FLOCK(fd, LOCK_SH, COURSE_FILE);
     
     // Find the course and check ownership
-    while (read(fd, &course, sizeof(struct Course)) == sizeof(struct Course)) {
-        if (course.course_id == course_id) {
-            if (course.faculty_id == faculty_id) {
-                is_owner = 1;
-            }
-            break;
-        }
+    if (record_index_find_id(INDEX_COURSE_ID, fd, course_id, &course) >= 0 && course.faculty_id == faculty_id) {
+        is_owner = 1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
     close(fd);
     
     return is_owner;
 }
 
+static int keep_counting(const struct Enrollment *enrollment, void *arg) {
+    return 0;
+}
+
 int count_course_enrollments(int course_id) {
-    struct Enrollment enrollment;
     int fd;
-    int count = 0;
+    long count;
     
     fd = open(ENROLLMENT_FILE, O_RDONLY);
     if (fd < 0) {
         return 0;
     }
     
-    flock(fd, LOCK_SH);
+    FLOCK(fd, LOCK_SH, ENROLLMENT_FILE);
     
-    while (read(fd, &enrollment, sizeof(struct Enrollment)) == sizeof(struct Enrollment)) {
-        if (enrollment.course_id == course_id) {
-            count++;
-        }
-    }
+    count = enrollment_scan(fd, ENROLLMENT_ANY, course_id, 0, keep_counting, NULL);
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
     close(fd);
     
-    return count;
+    return count > 0 ? count : 0;
 }
 
 // Function to handle viewing courses offered by the logged-in faculty
 int handle_view_my_courses(char *response, const char *username) {
-    struct Course course;
+    struct Course *courses = arena_alloc(MY_COURSES_LISTED * sizeof(struct Course));
     int fd;
     int faculty_id;
-    char courses_info[1024] = "";
+    char *courses_info = arena_alloc(ARENA_RESPONSE_SIZE);
     char line[256];
-    int count = 0;
+    int count;
     
+    if (!courses || !courses_info) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+    courses_info[0] = '\0';
+
     // Get faculty ID from username
     faculty_id = get_faculty_id_by_username(username);
     if (faculty_id < 0) {
@@ -427,30 +493,35 @@ int handle_view_my_courses(char *response, const char *username) {
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, COURSE_FILE) < 0) {
         close(fd);
         sprintf(response, "ERROR:Cannot lock course file: %s", strerror(errno));
         return -1;
     }
     
-    // Find courses for this faculty
-    while (read(fd, &course, sizeof(struct Course)) == sizeof(struct Course)) {
-        if (course.faculty_id == faculty_id) {
-            // Get enrollment count
-            int enrolled = count_course_enrollments(course.course_id);
-            
-            sprintf(line, "ID: %d, Code: %s, Name: %s, Seats: %d/%d\n", 
-                    course.course_id, course.course_code, course.course_name, 
-                    enrolled, course.max_seats);
-            strcat(courses_info, line);
-            count++;
-        }
-    }
+    // Find courses for this faculty through the faculty index
+    count = record_index_find_all_id(INDEX_COURSE_FACULTY, fd, faculty_id, courses, MY_COURSES_LISTED);
     
     // Release lock and close file
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
     close(fd);
     
+    if (count < 0) {
+        strcpy(response, "ERROR:Failed to read course file");
+        return -1;
+    }
+    for (int i = 0; i < count && i < MY_COURSES_LISTED; i++) {
+        // Get enrollment count
+        int enrolled = count_course_enrollments(courses[i].course_id);
+        
+        sprintf(line, "ID: %d, Code: %s, Name: %s, Seats: %d/%d\n", 
+                courses[i].course_id, courses[i].course_code, courses[i].course_name, 
+                enrolled, courses[i].max_seats);
+        if (strlen(courses_info) + strlen(line) < ARENA_RESPONSE_SIZE - 32) {
+            strcat(courses_info, line);
+        }
+    }
+    
     if (count > 0) {
         sprintf(response, "Your courses (%d):\n%s", count, courses_info);
     } else {
@@ -458,4 +529,4 @@ int handle_view_my_courses(char *response, const char *username) {
     }
     
     return 0;
-}
\ No newline at end of file
+}
@@ -8,6 +8,7 @@ int handle_faculty_request(int client_socket, char *request, const char *usernam
 int handle_add_course(char *request, char *response, const char *username);
 int handle_remove_course(char *request, char *response, const char *username);
 int handle_view_enrollments(char *request, char *response);
+int handle_view_my_courses(char *response, const char *username);
 
 // Helper functions
 int get_faculty_id_by_username(const char *username);
@@ -9,6 +9,18 @@
 #include <errno.h>
 #include "../common/structures.h"
 #include "../common/constants.h"
+#include "lock_stats.h"
+#include "slow_log.h"
+#include "file_ops.h"
+#include "trace.h"
+#include "replication.h"
+#include "record_index.h"
+#include "search_index.h"
+#include "enrollment_store.h"
+#include "string_heap.h"
+#include "department.h"
+#include "arena.h"
+#include "key_filter.h"
 
 // File paths
 
@@ -18,27 +30,23 @@
 int read_student_by_id(int id, struct Student *student) {
     int fd;
     int found = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(STUDENT_FILE, O_RDONLY);
+    fd = trace_open(STUDENT_FILE, O_RDONLY, 0);
     if (fd < 0) {
         return -1;
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, STUDENT_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for student
-    while (read(fd, student, sizeof(struct Student)) == sizeof(struct Student)) {
-        if (student->id == id) {
-            found = 1;
-            break;
-        }
-    }
+    // Look up student
+    found = record_index_find_id(INDEX_STUDENT_ID, fd, id, student) >= 0;
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     
     return found ? 0 : -1;
@@ -47,27 +55,23 @@ int read_student_by_id(int id, struct Student *student) {
 int read_student_by_username(const char *username, struct Student *student) {
     int fd;
     int found = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(STUDENT_FILE, O_RDONLY);
+    fd = trace_open(STUDENT_FILE, O_RDONLY, 0);
     if (fd < 0) {
         return -1;
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, STUDENT_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for student
-    while (read(fd, student, sizeof(struct Student)) == sizeof(struct Student)) {
-        if (strcmp(student->username, username) == 0) {
-            found = 1;
-            break;
-        }
-    }
+    // Look up student
+    found = record_index_find_name(INDEX_STUDENT_USERNAME, fd, username, student) >= 0;
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, STUDENT_FILE);
     close(fd);
     
     return found ? 0 : -1;
@@ -76,56 +80,156 @@ int read_student_by_username(const char *username, struct Student *student) {
 int read_faculty_by_id(int id, struct Faculty *faculty) {
     int fd;
     int found = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(FACULTY_FILE, O_RDONLY);
+    fd = trace_open(FACULTY_FILE, O_RDONLY, 0);
     if (fd < 0) {
         return -1;
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, FACULTY_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for faculty
-    while (read(fd, faculty, sizeof(struct Faculty)) == sizeof(struct Faculty)) {
-        if (faculty->id == id) {
-            found = 1;
-            break;
-        }
-    }
+    // Look up faculty
+    found = record_index_find_id(INDEX_FACULTY_ID, fd, id, faculty) >= 0;
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, FACULTY_FILE);
     close(fd);
     
     return found ? 0 : -1;
 }
 
+// Large enough for a row or record of either string-heap table
+union HeapRow {
+    struct StudentRow student;
+    struct FacultyRow faculty;
+};
+
+union HeapRecord {
+    struct Student student;
+    struct Faculty faculty;
+};
+
+// New departments go into the dictionary, and to replicas, ahead of the rows using them
+static int intern_departments(const struct HeapTable *table, const void *records, int count) {
+    const struct Faculty *faculty = records;
+    struct Department added;
+
+    for (int i = 0; table == &faculty_heap && i < count; i++) {
+        if (department_intern(faculty[i].department, &added) < 0) {
+            return -1;
+        }
+        if (added.code > 0) {
+            replication_log_write_at(DEPARTMENT_FILE, &added, sizeof(added),
+                                     (off_t)(added.code - 1) * sizeof(added));
+        }
+    }
+    return 0;
+}
+
+// New usernames go into the table's filter before the rows holding them are written
+static void filter_usernames(const struct HeapTable *table, const void *records, int count) {
+    enum KeyFilterId filter = table == &student_heap ? FILTER_STUDENT_USERNAME : FILTER_FACULTY_USERNAME;
+
+    for (int i = 0; i < count; i++) {
+        key_filter_add(filter, (const char *)records + i * table->record_size + table->fields[HEAP_USERNAME]);
+    }
+}
+
+int append_heap_records(const struct HeapTable *table, int fd, const void *records, int count) {
+    size_t rows_length = count * table->row_size;
+    size_t mark = arena_mark();         // imports call this once per batch within one request
+    char *rows = arena_alloc(rows_length);
+    char *heap = NULL;
+    size_t heap_length = 0;
+    struct stat st;
+    int heap_fd;
+    int result = -1;
+    TRACE_SCOPE(__func__);
+    
+    heap_fd = trace_open(table->heap_path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    filter_usernames(table, records, count);
+    
+    // Strings first, so no reader or replica ever sees a row before its strings
+    if (rows && heap_fd >= 0 && intern_departments(table, records, count) == 0 && fstat(heap_fd, &st) == 0 &&
+        heap_encode(table, records, count, st.st_size, NULL, NULL, rows, &heap, &heap_length) == 0 &&
+        (heap_length == 0 || trace_write(heap_fd, heap, heap_length) == (ssize_t)heap_length)) {
+        if (heap_length > 0) {
+            replication_log_write(heap_fd, table->heap_path, heap, heap_length);
+        }
+        if (trace_write(fd, rows, rows_length) == (ssize_t)rows_length) {
+            replication_log_write(fd, table->path, rows, rows_length);
+            result = 0;
+        }
+    }
+    
+    free(heap);
+    arena_rewind(mark);
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    return result;
+}
+
+int update_heap_record(const struct HeapTable *table, int fd, off_t offset, const void *record) {
+    union HeapRow previous_row, row;
+    union HeapRecord previous;
+    char *heap = NULL;
+    size_t heap_length = 0;
+    struct stat st;
+    int heap_fd;
+    int result = -1;
+    TRACE_SCOPE(__func__);
+    
+    heap_fd = trace_open(table->heap_path, O_RDWR | O_APPEND | O_CREAT, 0644);
+    
+    // Only the strings that changed are added; the old ones stay behind as garbage
+    if (heap_fd >= 0 && intern_departments(table, record, 1) == 0 && fstat(heap_fd, &st) == 0 &&
+        pread(fd, &previous_row, table->row_size, offset) == (ssize_t)table->row_size &&
+        heap_decode(table, heap_fd, &previous_row, 1, &previous) == 0 &&
+        heap_encode(table, record, 1, st.st_size, &previous, &previous_row, &row, &heap, &heap_length) == 0 &&
+        (heap_length == 0 || trace_write(heap_fd, heap, heap_length) == (ssize_t)heap_length)) {
+        if (heap_length > 0) {
+            replication_log_write(heap_fd, table->heap_path, heap, heap_length);
+        }
+        if (trace_pwrite(fd, &row, table->row_size, offset) == (ssize_t)table->row_size) {
+            replication_log_write_at(table->path, &row, table->row_size, offset);
+            record_index_note_change(table->path, offset);
+            result = 0;
+            search_index_note_update(table, offset / table->row_size, &row, record, st.st_size, heap_length);
+        }
+    }
+    
+    free(heap);
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    return result;
+}
+
 int read_course_by_id(int id, struct Course *course) {
     int fd;
     int found = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(COURSE_FILE, O_RDONLY);
+    fd = trace_open(COURSE_FILE, O_RDONLY, 0);
     if (fd < 0) {
         return -1;
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, COURSE_FILE) < 0) {
         close(fd);
         return -1;
     }
     
-    // Search for course
-    while (read(fd, course, sizeof(struct Course)) == sizeof(struct Course)) {
-        if (course->course_id == id) {
-            found = 1;
-            break;
-        }
-    }
+    // Look up course
+    found = record_index_find_id(INDEX_COURSE_ID, fd, id, course) >= 0;
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
     close(fd);
     
     return found ? 0 : -1;
@@ -133,206 +237,639 @@ int read_course_by_id(int id, struct Course *course) {
 
 int update_course(struct Course *course) {
     int fd;
-    struct Course temp;
-    off_t offset = 0;
+    off_t offset;
     int found = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(COURSE_FILE, O_RDWR);
+    // Apply write lock, on the file in place after any removal's rename
+    fd = OPEN_LOCKED(COURSE_FILE, O_RDWR, 0, LOCK_EX);
     if (fd < 0) {
         return -1;
     }
     
+    // Find and update course
+    offset = record_index_find_id(INDEX_COURSE_ID, fd, course->course_id, NULL);
+    if (offset >= 0) {
+        if (trace_pwrite(fd, course, sizeof(struct Course), offset) != sizeof(struct Course)) {
+            FLOCK(fd, LOCK_UN, COURSE_FILE);
+            close(fd);
+            return -1;
+        }
+        replication_log_write_at(COURSE_FILE, course, sizeof(struct Course), offset);
+        found = 1;
+    }
+    
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
+    close(fd);
+    
+    return found ? 0 : -1;
+}
+
+int open_locked_at(const char *path, int flags, mode_t mode, int operation, const char *site, int line) {
+    struct stat opened, current;
+    int fd;
+    
+    while ((fd = trace_open(path, flags, mode)) >= 0) {
+        if (profiled_flock(fd, operation, path, site, line) < 0) {
+            close(fd);
+            return -1;
+        }
+        
+        // Still the file in place: it can't be replaced while we hold the lock
+        if (fstat(fd, &opened) < 0 || stat(path, &current) < 0 ||
+            (opened.st_dev == current.st_dev && opened.st_ino == current.st_ino)) {
+            return fd;
+        }
+        profiled_flock(fd, LOCK_UN, path, site, line);
+        close(fd);
+    }
+    return -1;
+}
+
+int create_temp_file(char *path_template) {
+    int fd = mkstemp(path_template);
+    
+    // mkstemp creates the file 0600; it becomes a data file when renamed
+    if (fd >= 0) {
+        fchmod(fd, 0644);
+    }
+    return fd;
+}
+
+// With sealed segments in use, move a full tail into a new segment (under the write lock)
+static void seal_enrollment_tail(int fd) {
+    struct Enrollment *rows;
+    struct stat st;
+    char *segment = NULL;
+    size_t length;
+    off_t sealed_size;
+    uint32_t count;
+    int segment_fd;
+    TRACE_SCOPE(__func__);
+    
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)(ENROLLMENT_SEGMENT_ROWS * sizeof(struct Enrollment))) {
+        return;
+    }
+    // Without a segment file the legacy layout keeps growing the tail
+    segment_fd = open(ENROLLMENT_SEGMENT_FILE, O_WRONLY | O_APPEND);
+    if (segment_fd < 0) {
+        return;
+    }
+    sealed_size = lseek(segment_fd, 0, SEEK_END);
+    count = st.st_size / sizeof(struct Enrollment);
+    rows = malloc(count * sizeof(struct Enrollment));
+    
+    if (sealed_size >= 0 && rows &&
+        pread(fd, rows, count * sizeof(struct Enrollment), 0) == (ssize_t)(count * sizeof(struct Enrollment)) &&
+        (segment = enrollment_segment_encode(rows, count, &length)) != NULL) {
+        slow_log_note_scan(ENROLLMENT_FILE, count);
+        if (trace_write(segment_fd, segment, length) == (ssize_t)length) {
+            replication_log_write(segment_fd, ENROLLMENT_SEGMENT_FILE, segment, length);
+            ftruncate(fd, 0);
+            replication_log_truncate(ENROLLMENT_FILE, 0);
+        } else {
+            ftruncate(segment_fd, sealed_size);
+        }
+    }
+    
+    free(segment);
+    free(rows);
+    close(segment_fd);
+}
+
+int add_enrollment(struct Enrollment *enrollment) {
+    int fd;
+    TRACE_SCOPE(__func__);
+    
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    fd = OPEN_LOCKED(ENROLLMENT_FILE, O_RDWR | O_APPEND | O_CREAT, 0644, LOCK_EX);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    // Write enrollment record
+    if (trace_write(fd, enrollment, sizeof(struct Enrollment)) != sizeof(struct Enrollment)) {
+        FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
         close(fd);
         return -1;
     }
+    replication_log_write(fd, ENROLLMENT_FILE, enrollment, sizeof(struct Enrollment));
+    seal_enrollment_tail(fd);
     
-    // Find and update course
-    while (read(fd, &temp, sizeof(struct Course)) == sizeof(struct Course)) {
-        if (temp.course_id == course->course_id) {
-            // Seek back to the record position
-            lseek(fd, offset, SEEK_SET);
-            
-            // Write updated record
-            if (write(fd, course, sizeof(struct Course)) != sizeof(struct Course)) {
-                flock(fd, LOCK_UN);
-                close(fd);
-                return -1;
-            }
-            found = 1;
-            break;
-        }
-        offset += sizeof(struct Course);
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
+    close(fd);
+    
+    return 0;
+}
+
+// Read several courses under one lock; found[i] tells whether course_ids[i] exists
+int read_courses_by_ids(const int *course_ids, int count, struct Course *courses, int *found) {
+    int fd;
+    TRACE_SCOPE(__func__);
+    
+    memset(found, 0, sizeof(int) * count);
+    
+    fd = trace_open(COURSE_FILE, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
     }
     
-    flock(fd, LOCK_UN);
+    // Apply read lock
+    if (FLOCK(fd, LOCK_SH, COURSE_FILE) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        found[i] = record_index_find_id(INDEX_COURSE_ID, fd, course_ids[i], &courses[i]) >= 0;
+    }
+    
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
     close(fd);
     
-    return found ? 0 : -1;
+    return 0;
 }
 
-int add_enrollment(struct Enrollment *enrollment) {
+// Write back several courses under one lock; fails if any of them is missing
+int update_courses(struct Course *courses, int count) {
     int fd;
+    off_t offset;
+    int updated = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(ENROLLMENT_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    // Apply write lock, on the file in place after any removal's rename
+    fd = OPEN_LOCKED(COURSE_FILE, O_RDWR, 0, LOCK_EX);
     if (fd < 0) {
         return -1;
     }
     
+    for (int i = 0; i < count; i++) {
+        offset = record_index_find_id(INDEX_COURSE_ID, fd, courses[i].course_id, NULL);
+        if (offset < 0) {
+            continue;
+        }
+        if (trace_pwrite(fd, &courses[i], sizeof(struct Course), offset) != sizeof(struct Course)) {
+            FLOCK(fd, LOCK_UN, COURSE_FILE);
+            close(fd);
+            return -1;
+        }
+        replication_log_write_at(COURSE_FILE, &courses[i], sizeof(struct Course), offset);
+        updated++;
+    }
+    
+    FLOCK(fd, LOCK_UN, COURSE_FILE);
+    close(fd);
+    
+    return updated == count ? 0 : -1;
+}
+
+// Append several enrollments in one write, numbering them after the last record under the lock
+int add_enrollments(struct Enrollment *enrollments, int count) {
+    int fd;
+    struct Enrollment last;
+    off_t size;
+    int next_id = 1;
+    TRACE_SCOPE(__func__);
+    
+    if (count <= 0) {
+        return 0;
+    }
+    
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
-        close(fd);
+    fd = OPEN_LOCKED(ENROLLMENT_FILE, O_RDWR | O_APPEND | O_CREAT, 0644, LOCK_EX);
+    if (fd < 0) {
         return -1;
     }
     
-    // Write enrollment record
-    if (write(fd, enrollment, sizeof(struct Enrollment)) != sizeof(struct Enrollment)) {
-        flock(fd, LOCK_UN);
+    // Ids only ever grow along the file, so the last record holds the highest one;
+    // right after a seal the tail is empty and the last id is in the segments
+    size = lseek(fd, 0, SEEK_END);
+    if (size >= (off_t)sizeof(struct Enrollment) &&
+        pread(fd, &last, sizeof(struct Enrollment), size - sizeof(struct Enrollment)) == sizeof(struct Enrollment)) {
+        next_id = last.enrollment_id + 1;
+    } else {
+        next_id = enrollment_segments_max_id() + 1;
+    }
+    for (int i = 0; i < count; i++) {
+        enrollments[i].enrollment_id = next_id + i;
+    }
+    
+    // Write all records at once
+    if (trace_write(fd, enrollments, sizeof(struct Enrollment) * count) != (ssize_t)(sizeof(struct Enrollment) * count)) {
+        FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
         close(fd);
         return -1;
     }
+    replication_log_write(fd, ENROLLMENT_FILE, enrollments, sizeof(struct Enrollment) * count);
+    seal_enrollment_tail(fd);
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
     close(fd);
     
     return 0;
 }
 
+// Rewrite the segment file without (student_id, course_id); called under the enrollment write lock
+static long remove_sealed_enrollment(int student_id, int course_id) {
+    char temp_file[] = ENROLLMENT_SEGMENT_FILE ".XXXXXX";
+    off_t unchanged = 0;
+    long removed = -1;
+    int fd_read, fd_write;
+    TRACE_SCOPE(__func__);
+    
+    fd_read = open(ENROLLMENT_SEGMENT_FILE, O_RDONLY);
+    if (fd_read < 0) {
+        return 0;
+    }
+    fd_write = create_temp_file(temp_file);
+    if (fd_write >= 0) {
+        removed = enrollment_segments_remove(fd_read, fd_write, student_id, course_id, &unchanged);
+        close(fd_write);
+    }
+    close(fd_read);
+    
+    if (removed > 0 && rename(temp_file, ENROLLMENT_SEGMENT_FILE) == 0) {
+        replication_log_file(ENROLLMENT_SEGMENT_FILE, unchanged);
+        return removed;
+    }
+    if (fd_write >= 0) {
+        unlink(temp_file);
+    }
+    return removed > 0 ? -1 : removed;
+}
+
 int remove_enrollment(int student_id, int course_id) {
     int fd_read, fd_write;
     struct Enrollment enrollment;
-    char temp_file[] = "data/enrollments.tmp";
+    char temp_file[] = ENROLLMENT_FILE ".XXXXXX";
     int found = 0;
+    int failed = 0;
+    int result = -1;
+    off_t unchanged = 0;
+    TRACE_SCOPE(__func__);
     
-    fd_read = open(ENROLLMENT_FILE, O_RDONLY);
-    fd_write = open(temp_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    
-    if (fd_read < 0 || fd_write < 0) {
-        if (fd_read >= 0) close(fd_read);
-        if (fd_write >= 0) close(fd_write);
+    // Apply write lock
+    fd_read = OPEN_LOCKED(ENROLLMENT_FILE, O_RDONLY, 0, LOCK_EX);
+    if (fd_read < 0) {
         return -1;
     }
     
-    // Apply locks
-    flock(fd_read, LOCK_EX);
-    flock(fd_write, LOCK_EX);
+    // The copy is private to this call, so concurrent rewrites never share it
+    fd_write = create_temp_file(temp_file);
+    if (fd_write < 0) {
+        FLOCK(fd_read, LOCK_UN, ENROLLMENT_FILE);
+        close(fd_read);
+        return -1;
+    }
     
     // Copy all enrollments except the one to remove
+    trace_begin("rewrite");
     while (read(fd_read, &enrollment, sizeof(struct Enrollment)) == sizeof(struct Enrollment)) {
+        slow_log_note_scan(ENROLLMENT_FILE, 1);
         if (!(enrollment.student_id == student_id && enrollment.course_id == course_id)) {
-            write(fd_write, &enrollment, sizeof(struct Enrollment));
+            if (write(fd_write, &enrollment, sizeof(struct Enrollment)) != sizeof(struct Enrollment)) {
+                failed = 1;
+            }
+            if (!found) {
+                unchanged += sizeof(struct Enrollment);
+            }
         } else {
             found = 1;
         }
     }
-    
-    flock(fd_read, LOCK_UN);
-    flock(fd_write, LOCK_UN);
-    close(fd_read);
+    trace_end();
     close(fd_write);
     
-    if (found) {
-        rename(temp_file, ENROLLMENT_FILE);
-        return 0;
+    // The new file replaces the old one before the lock is released, so no write can
+    // land in the old file after it was copied
+    if (found && !failed && rename(temp_file, ENROLLMENT_FILE) == 0) {
+        replication_log_file(ENROLLMENT_FILE, unchanged);
+        result = 0;
     } else {
         unlink(temp_file);
-        return -1;
+        
+        // Not a recent enrollment: remove it from the sealed segment that holds it
+        if (!found && remove_sealed_enrollment(student_id, course_id) > 0) {
+            result = 0;
+        }
     }
+    
+    FLOCK(fd_read, LOCK_UN, ENROLLMENT_FILE);
+    close(fd_read);
+    return result;
+}
+
+static int stop_at_first(const struct Enrollment *enrollment, void *arg) {
+    return 1;
+}
+
+// Which of a list of ids (courses of one student, or students of one course) were visited
+struct EnrollmentMarks {
+    const int *ids;
+    int count;
+    int *enrolled;
+    int by_course;
+};
+
+static int mark_enrolled(const struct Enrollment *enrollment, void *arg) {
+    struct EnrollmentMarks *marks = arg;
+    int id = marks->by_course ? enrollment->course_id : enrollment->student_id;
+    
+    for (int i = 0; i < marks->count; i++) {
+        if (marks->ids[i] == id) {
+            marks->enrolled[i] = 1;
+        }
+    }
+    return 0;
 }
 
 int check_enrollment_exists(int student_id, int course_id) {
     int fd;
-    struct Enrollment enrollment;
     int exists = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(ENROLLMENT_FILE, O_RDONLY);
+    fd = trace_open(ENROLLMENT_FILE, O_RDONLY, 0);
     if (fd < 0) {
         return 0;
     }
     
     // Apply read lock
-    if (flock(fd, LOCK_SH) < 0) {
+    if (FLOCK(fd, LOCK_SH, ENROLLMENT_FILE) < 0) {
         close(fd);
         return 0;
     }
     
     // Check if enrollment exists
-    while (read(fd, &enrollment, sizeof(struct Enrollment)) == sizeof(struct Enrollment)) {
-        if (enrollment.student_id == student_id && enrollment.course_id == course_id) {
-            exists = 1;
-            break;
-        }
-    }
+    trace_begin("scan");
+    exists = enrollment_scan(fd, student_id, course_id, 0, stop_at_first, NULL) > 0;
+    trace_end();
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
     close(fd);
     
     return exists;
 }
 
+// Mark which of the given courses a student is already enrolled in, in one scan
+int find_student_enrollments(int student_id, const int *course_ids, int count, int *enrolled) {
+    struct EnrollmentMarks marks = { course_ids, count, enrolled, 1 };
+    int fd;
+    long visited;
+    TRACE_SCOPE(__func__);
+    
+    memset(enrolled, 0, sizeof(int) * count);
+    
+    fd = trace_open(ENROLLMENT_FILE, O_RDONLY, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    // Apply read lock
+    if (FLOCK(fd, LOCK_SH, ENROLLMENT_FILE) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    trace_begin("scan");
+    visited = enrollment_scan(fd, student_id, ENROLLMENT_ANY, 0, mark_enrolled, &marks);
+    trace_end();
+    
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
+    close(fd);
+    
+    return visited < 0 ? -1 : 0;
+}
+
+// Mark which of the given students are already enrolled in a course, in one scan
+int find_course_enrollments(int course_id, const int *student_ids, int count, int *enrolled) {
+    struct EnrollmentMarks marks = { student_ids, count, enrolled, 0 };
+    int fd;
+    long visited;
+    TRACE_SCOPE(__func__);
+    
+    memset(enrolled, 0, sizeof(int) * count);
+    
+    fd = trace_open(ENROLLMENT_FILE, O_RDONLY, 0);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    // Apply read lock
+    if (FLOCK(fd, LOCK_SH, ENROLLMENT_FILE) < 0) {
+        close(fd);
+        return -1;
+    }
+    
+    trace_begin("scan");
+    visited = enrollment_scan(fd, ENROLLMENT_ANY, course_id, 0, mark_enrolled, &marks);
+    trace_end();
+    
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
+    close(fd);
+    
+    return visited < 0 ? -1 : 0;
+}
+
 int get_next_enrollment_id() {
     struct Enrollment enrollment;
-    int fd, max_id = 0;
+    int fd, max_id;
+    TRACE_SCOPE(__func__);
     
-    fd = open(ENROLLMENT_FILE, O_RDONLY);
+    fd = trace_open(ENROLLMENT_FILE, O_RDONLY, 0);
     if (fd < 0) {
         return 1; // First enrollment
     }
     
-    flock(fd, LOCK_SH);
+    FLOCK(fd, LOCK_SH, ENROLLMENT_FILE);
+    
+    // Sealed segments record their highest id; only the tail is scanned
+    max_id = enrollment_segments_max_id();
     
+    trace_begin("scan");
     while (read(fd, &enrollment, sizeof(struct Enrollment)) == sizeof(struct Enrollment)) {
+        slow_log_note_scan(ENROLLMENT_FILE, 1);
         if (enrollment.enrollment_id > max_id) {
             max_id = enrollment.enrollment_id;
         }
     }
+    trace_end();
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, ENROLLMENT_FILE);
     close(fd);
     
     return max_id + 1;
 }
 
+// Append a student to a course's waitlist; returns their position, 0 if already waiting
+int add_waitlist_entry(struct WaitlistEntry *entry) {
+    int fd;
+    struct WaitlistEntry existing;
+    int position = 1;
+    TRACE_SCOPE(__func__);
+    
+    // Apply write lock, on the file in place after any removal's rename
+    fd = OPEN_LOCKED(WAITLIST_FILE, O_RDWR | O_APPEND | O_CREAT, 0644, LOCK_EX);
+    if (fd < 0) {
+        return -1;
+    }
+    
+    // Count who is ahead in this course's line
+    trace_begin("scan");
+    while (read(fd, &existing, sizeof(struct WaitlistEntry)) == sizeof(struct WaitlistEntry)) {
+        slow_log_note_scan(WAITLIST_FILE, 1);
+        if (existing.course_id != entry->course_id) {
+            continue;
+        }
+        if (existing.student_id == entry->student_id) {
+            position = 0;
+            break;
+        }
+        position++;
+    }
+    trace_end();
+    
+    if (position > 0) {
+        if (trace_write(fd, entry, sizeof(struct WaitlistEntry)) != sizeof(struct WaitlistEntry)) {
+            position = -1;
+        } else {
+            replication_log_write(fd, WAITLIST_FILE, entry, sizeof(struct WaitlistEntry));
+        }
+    }
+    
+    FLOCK(fd, LOCK_UN, WAITLIST_FILE);
+    close(fd);
+    
+    return position;
+}
+
+// Rewrite the waitlist without the course's first entry (first_only) or all of its entries;
+// returns how many were removed, or -1 if the file could not be replaced
+static int rewrite_waitlist(int course_id, int first_only, struct WaitlistEntry *removed) {
+    int fd_read, fd_write;
+    struct WaitlistEntry entry;
+    char temp_file[] = WAITLIST_FILE ".XXXXXX";
+    int found = 0;
+    int failed = 0;
+    off_t unchanged = 0;
+    
+    // Apply write lock, then copy to a file private to this call
+    fd_read = OPEN_LOCKED(WAITLIST_FILE, O_RDONLY, 0, LOCK_EX);
+    if (fd_read < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    fd_write = create_temp_file(temp_file);
+    if (fd_write < 0) {
+        FLOCK(fd_read, LOCK_UN, WAITLIST_FILE);
+        close(fd_read);
+        return -1;
+    }
+    
+    // Copy all entries except the ones to remove
+    trace_begin("rewrite");
+    while (read(fd_read, &entry, sizeof(struct WaitlistEntry)) == sizeof(struct WaitlistEntry)) {
+        slow_log_note_scan(WAITLIST_FILE, 1);
+        if (entry.course_id == course_id && (!first_only || found == 0)) {
+            if (found == 0 && removed) {
+                *removed = entry;
+            }
+            found++;
+        } else {
+            if (write(fd_write, &entry, sizeof(struct WaitlistEntry)) != sizeof(struct WaitlistEntry)) {
+                failed = 1;
+            }
+            if (!found) {
+                unchanged += sizeof(struct WaitlistEntry);
+            }
+        }
+    }
+    trace_end();
+    close(fd_write);
+    
+    // Renamed before the lock is released, so no join can land in the old file after the copy
+    if (found && (failed || rename(temp_file, WAITLIST_FILE) < 0)) {
+        found = -1;
+    }
+    if (found > 0) {
+        replication_log_file(WAITLIST_FILE, unchanged);
+    } else {
+        unlink(temp_file);
+    }
+    
+    FLOCK(fd_read, LOCK_UN, WAITLIST_FILE);
+    close(fd_read);
+    return found;
+}
+
+// Look at the longest-waiting student of a course without taking them off the waitlist
+int peek_waitlist_entry(int course_id, struct WaitlistEntry *entry) {
+    int fd;
+    int found = 0;
+    TRACE_SCOPE(__func__);
+    
+    fd = trace_open(WAITLIST_FILE, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    FLOCK(fd, LOCK_SH, WAITLIST_FILE);
+    while (!found && read(fd, entry, sizeof(struct WaitlistEntry)) == sizeof(struct WaitlistEntry)) {
+        slow_log_note_scan(WAITLIST_FILE, 1);
+        found = entry->course_id == course_id;
+    }
+    FLOCK(fd, LOCK_UN, WAITLIST_FILE);
+    close(fd);
+    
+    return found ? 0 : -1;
+}
+
+// Take the longest-waiting student off a course's waitlist
+int pop_waitlist_entry(int course_id, struct WaitlistEntry *entry) {
+    TRACE_SCOPE(__func__);
+    
+    return rewrite_waitlist(course_id, 1, entry) == 1 ? 0 : -1;
+}
+
+// Drop every waitlist entry for a course; returns how many were removed
+int clear_waitlist(int course_id) {
+    TRACE_SCOPE(__func__);
+    
+    return rewrite_waitlist(course_id, 0, NULL);
+}
+
 int update_credentials(const char *username, const char *new_password_hash) {
     int fd;
     struct Credentials cred;
-    off_t offset = 0;
+    off_t offset;
     int found = 0;
+    TRACE_SCOPE(__func__);
     
-    fd = open(CREDENTIALS_FILE, O_RDWR);
+    fd = trace_open(CREDENTIALS_FILE, O_RDWR, 0);
     if (fd < 0) {
         return -1;
     }
     
     // Apply write lock
-    if (flock(fd, LOCK_EX) < 0) {
+    if (FLOCK(fd, LOCK_EX, CREDENTIALS_FILE) < 0) {
         close(fd);
         return -1;
     }
     
     // Find and update credentials
-    while (read(fd, &cred, sizeof(struct Credentials)) == sizeof(struct Credentials)) {
-        if (strcmp(cred.username, username) == 0) {
-            // Update password
-            strncpy(cred.password_hash, new_password_hash, sizeof(cred.password_hash) - 1);
-            
-            // Seek back to the record position
-            lseek(fd, offset, SEEK_SET);
-            
-            // Write updated record
-            if (write(fd, &cred, sizeof(struct Credentials)) != sizeof(struct Credentials)) {
-                flock(fd, LOCK_UN);
-                close(fd);
-                return -1;
-            }
-            found = 1;
-            break;
+    offset = record_index_find_name(INDEX_CREDENTIALS_USERNAME, fd, username, &cred);
+    if (offset >= 0) {
+        // Update password
+        strncpy(cred.password_hash, new_password_hash, sizeof(cred.password_hash) - 1);
+        
+        // Write updated record in place
+        if (trace_pwrite(fd, &cred, sizeof(struct Credentials), offset) != sizeof(struct Credentials)) {
+            FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
+            close(fd);
+            return -1;
         }
-        offset += sizeof(struct Credentials);
+        replication_log_write_at(CREDENTIALS_FILE, &cred, sizeof(struct Credentials), offset);
+        found = 1;
     }
     
-    flock(fd, LOCK_UN);
+    FLOCK(fd, LOCK_UN, CREDENTIALS_FILE);
     close(fd);
     
     return found ? 0 : -1;
@@ -1,13 +1,17 @@
 #ifndef FILE_OPS_H
 #define FILE_OPS_H
 
+#include <sys/types.h>
 #include "../common/structures.h"
 
+struct HeapTable;
+
 // File paths
 #define STUDENT_FILE "data/students.dat"
 #define FACULTY_FILE "data/faculty.dat"
 #define COURSE_FILE "data/courses.dat"
 #define ENROLLMENT_FILE "data/enrollments.dat"
+#define WAITLIST_FILE "data/waitlists.dat"
 #define CREDENTIALS_FILE "data/credentials.dat"
 
 // Student file operations
@@ -17,16 +21,56 @@ int read_student_by_username(const char *username, struct Student *student);
 // Faculty file operations
 int read_faculty_by_id(int id, struct Faculty *faculty);
 
+/**
+ * Append student or faculty records (student_heap / faculty_heap): their strings to the
+ * table's heap, then the rows. fd is the table file, opened with O_APPEND and locked exclusively.
+ */
+int append_heap_records(const struct HeapTable *table, int fd, const void *records, int count);
+
+/**
+ * Overwrite the record whose row is at offset, under an exclusive lock on fd. Strings that
+ * did not change keep their place in the heap.
+ */
+int update_heap_record(const struct HeapTable *table, int fd, off_t offset, const void *record);
+
+/**
+ * Open path and lock it. Courses, enrollments, segments and waitlists are rewritten by
+ * renaming a new copy over the file, which can happen while a caller waits for the lock;
+ * the open is then retried on the file now in place, so no change goes to a replaced copy.
+ * @param operation LOCK_SH or LOCK_EX
+ * @return The locked descriptor, or -1 if the file cannot be opened or locked
+ */
+int open_locked_at(const char *path, int flags, mode_t mode, int operation, const char *site, int line);
+#define OPEN_LOCKED(path, flags, mode, op) open_locked_at((path), (flags), (mode), (op), __func__, __LINE__)
+
+/**
+ * Create a private temporary file for a rewrite, next to the file it will replace
+ * @param path_template Path ending in "XXXXXX", replaced with the name actually created
+ * @return Descriptor open for writing, or -1
+ */
+int create_temp_file(char *path_template);
+
 // Course file operations
 int read_course_by_id(int id, struct Course *course);
 int update_course(struct Course *course);
+int read_courses_by_ids(const int *course_ids, int count, struct Course *courses, int *found);
+int update_courses(struct Course *courses, int count);
 
 // Enrollment file operations
 int add_enrollment(struct Enrollment *enrollment);
+int add_enrollments(struct Enrollment *enrollments, int count);
 int remove_enrollment(int student_id, int course_id);
 int check_enrollment_exists(int student_id, int course_id);
+int find_course_enrollments(int course_id, const int *student_ids, int count, int *enrolled);
+int find_student_enrollments(int student_id, const int *course_ids, int count, int *enrolled);
 int get_next_enrollment_id();
 
+// Waitlist file operations
+int add_waitlist_entry(struct WaitlistEntry *entry);
+int peek_waitlist_entry(int course_id, struct WaitlistEntry *entry);
+int pop_waitlist_entry(int course_id, struct WaitlistEntry *entry);
+int clear_waitlist(int course_id);
+
 // Credentials file operations
 int update_credentials(const char *username, const char *new_password_hash);
 
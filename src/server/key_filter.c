@@ -0,0 +1,367 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../common/constants.h"
+#include "key_filter.h"
+#include "string_heap.h"
+#include "lock_stats.h"
+#include "slow_log.h"
+#include "trace.h"
+
+#define FILTER_MAGIC 0x544c4642         // "BFLT"
+#define FILTER_VERSION 1
+#define FILTER_MIN_KEYS 16384
+#define FILTER_BITS_PER_KEY 10          // with 7 hashes, about 1% false positives when full
+#define FILTER_HASHES 7
+#define FILTER_READ_ROWS 4096
+
+// Where a filter's names sit in its table; heap tables keep the username in their heap
+struct FilterSpec {
+    const char *name;
+    const char *path;
+    const char *filter_path;
+    size_t record_size;
+    size_t key_offset;
+    size_t key_size;
+    const struct HeapTable *heap;
+};
+
+static const struct FilterSpec filter_specs[KEY_FILTER_COUNT] = {
+    [FILTER_STUDENT_USERNAME] = { "student username", STUDENT_FILE, STUDENT_FILTER_FILE, sizeof(struct StudentRow),
+                                  0, sizeof(((struct Student *)0)->username), &student_heap },
+    [FILTER_FACULTY_USERNAME] = { "faculty username", FACULTY_FILE, FACULTY_FILTER_FILE, sizeof(struct FacultyRow),
+                                  0, sizeof(((struct Faculty *)0)->username), &faculty_heap },
+    [FILTER_COURSE_CODE]      = { "course code", COURSE_FILE, COURSE_FILTER_FILE, sizeof(struct Course),
+                                  offsetof(struct Course, course_code), sizeof(((struct Course *)0)->course_code) },
+};
+
+// Start of a filter file, followed by the bit array. Pre-forked workers share the mapping,
+// so a name one of them adds is seen by all.
+struct FilterHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t bits;              // a power of two
+    uint64_t capacity;          // names the size was chosen for
+    uint64_t keys;              // names added so far
+    uint32_t hash_count;
+    uint32_t clean;             // set at shutdown, cleared while a server has the file mapped
+    uint64_t dev;               // the table the bits describe, as of that shutdown
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    uint8_t reserved[56];
+};
+
+struct KeyFilter {
+    struct FilterHeader *header;
+    uint64_t *words;
+    size_t mapped_size;
+    int valid;
+    unsigned long checks;       // this process's lookups
+    unsigned long rejected;     // answered without opening the table
+    unsigned long false_positives;
+};
+
+static struct KeyFilter filters[KEY_FILTER_COUNT];
+
+static uint64_t hash_key(const char *name, size_t max_length) {
+    uint64_t hash = 14695981039346656037ULL;      // FNV-1a, then the murmur3 finalizer
+    for (size_t i = 0; i < max_length && name[i]; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb93fe53b2e55ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Bit i of a name, by double hashing
+static uint64_t bit_at(const struct KeyFilter *filter, uint64_t hash, int i) {
+    uint64_t step = (hash >> 32) | 1;
+    return (hash + i * step) & (filter->header->bits - 1);
+}
+
+static void set_bits(struct KeyFilter *filter, const char *name, size_t key_size) {
+    uint64_t hash = hash_key(name, key_size);
+
+    for (int i = 0; i < FILTER_HASHES; i++) {
+        uint64_t bit = bit_at(filter, hash, i);
+        __atomic_fetch_or(&filter->words[bit / 64], 1ULL << (bit % 64), __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&filter->header->keys, 1, __ATOMIC_RELAXED);
+}
+
+int key_filter_may_contain(enum KeyFilterId id, const char *name) {
+    struct KeyFilter *filter = &filters[id];
+    const struct FilterSpec *spec = &filter_specs[id];
+    uint64_t hash;
+
+    if (!filter->valid) {
+        return 1;
+    }
+    __sync_fetch_and_add(&filter->checks, 1);
+    // Stored names always end within their field, so a longer one cannot be there
+    if (strlen(name) >= spec->key_size) {
+        __sync_fetch_and_add(&filter->rejected, 1);
+        return 0;
+    }
+    hash = hash_key(name, spec->key_size);
+    for (int i = 0; i < FILTER_HASHES; i++) {
+        uint64_t bit = bit_at(filter, hash, i);
+        if (!(__atomic_load_n(&filter->words[bit / 64], __ATOMIC_RELAXED) & (1ULL << (bit % 64)))) {
+            __sync_fetch_and_add(&filter->rejected, 1);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void key_filter_note_lookup(enum KeyFilterId id, int found) {
+    if (filters[id].valid && !found) {
+        __sync_fetch_and_add(&filters[id].false_positives, 1);
+    }
+}
+
+void key_filter_add(enum KeyFilterId id, const char *name) {
+    if (filters[id].header) {
+        set_bits(&filters[id], name, filter_specs[id].key_size);
+    }
+}
+
+void key_filter_invalidate(const char *path) {
+    for (int i = 0; i < KEY_FILTER_COUNT; i++) {
+        if (strcmp(filter_specs[i].path, path) == 0) {
+            filters[i].valid = 0;
+        }
+    }
+}
+
+static int64_t mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+static int map_file(struct KeyFilter *filter, int fd, size_t size) {
+    void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+    filter->header = mapping;
+    filter->words = (uint64_t *)((char *)mapping + sizeof(struct FilterHeader));
+    filter->mapped_size = size;
+    return 0;
+}
+
+// Take the existing file if it was closed cleanly over exactly this table (data_fd may be -1)
+static int map_existing(int id, int data_fd) {
+    const struct FilterSpec *spec = &filter_specs[id];
+    struct FilterHeader header;
+    struct stat st, data_st;
+    int fd = open(spec->filter_path, O_RDWR);
+    int result = -1;
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (data_fd >= 0 && fstat(data_fd, &data_st) == 0 && fstat(fd, &st) == 0 &&
+        pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+        header.magic == FILTER_MAGIC && header.version == FILTER_VERSION && header.clean &&
+        header.hash_count == FILTER_HASHES && header.bits >= 64 && !(header.bits & (header.bits - 1)) &&
+        st.st_size == (off_t)(sizeof(header) + header.bits / 8) && header.keys <= header.capacity &&
+        header.dev == (uint64_t)data_st.st_dev && header.ino == (uint64_t)data_st.st_ino &&
+        header.size == (int64_t)data_st.st_size && header.mtime_ns == mtime_ns(&data_st)) {
+        result = map_file(&filters[id], fd, st.st_size);
+    }
+    close(fd);
+    return result;
+}
+
+// Add every name in the table behind data_fd
+static int add_table(int id, int data_fd) {
+    const struct FilterSpec *spec = &filter_specs[id];
+    struct KeyFilter *filter = &filters[id];
+    char *rows = malloc(FILTER_READ_ROWS * spec->record_size);
+    char *names = spec->heap ? malloc(FILTER_READ_ROWS * spec->key_size) : NULL;
+    int heap_fd = spec->heap ? heap_open(spec->heap) : -1;
+    off_t offset = 0;
+    ssize_t n;
+    int result = 0;
+
+    if (!rows || (spec->heap && !names)) {
+        result = -1;
+    }
+    while (result == 0 && (n = pread(data_fd, rows, FILTER_READ_ROWS * spec->record_size, offset)) > 0) {
+        size_t count = n / spec->record_size;
+
+        if (count == 0) {
+            break;
+        }
+        slow_log_note_scan(spec->path, count);
+        if (spec->heap && heap_read_column(spec->heap, heap_fd, rows, count, HEAP_USERNAME, names,
+                                           spec->key_size) < 0) {
+            result = -1;
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            const char *name = spec->heap ? names + i * spec->key_size
+                                          : rows + i * spec->record_size + spec->key_offset;
+            set_bits(filter, name, spec->key_size);
+        }
+        offset += count * spec->record_size;
+    }
+
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    free(names);
+    free(rows);
+    return result;
+}
+
+// Recreate a filter sized for the table behind data_fd (-1 for a table not created yet)
+static int rebuild(int id, int data_fd) {
+    const struct FilterSpec *spec = &filter_specs[id];
+    struct KeyFilter *filter = &filters[id];
+    struct stat st;
+    uint64_t records = data_fd >= 0 && fstat(data_fd, &st) == 0 ? st.st_size / spec->record_size : 0;
+    uint64_t capacity = records * 2 > FILTER_MIN_KEYS ? records * 2 : FILTER_MIN_KEYS;
+    uint64_t bits = 64;
+    size_t size;
+    int fd;
+
+    while (bits < capacity * FILTER_BITS_PER_KEY) {
+        bits *= 2;
+    }
+    size = sizeof(struct FilterHeader) + bits / 8;
+    fd = open(spec->filter_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0 || map_file(filter, fd, size) < 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    close(fd);
+
+    filter->header->magic = FILTER_MAGIC;
+    filter->header->version = FILTER_VERSION;
+    filter->header->bits = bits;
+    filter->header->capacity = capacity;
+    filter->header->hash_count = FILTER_HASHES;
+    return data_fd >= 0 ? add_table(id, data_fd) : 0;
+}
+
+int key_filter_load() {
+    struct timespec started, now;
+    int reused = 0, rebuilt = 0;
+    TRACE_SCOPE(__func__);
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (int i = 0; i < KEY_FILTER_COUNT; i++) {
+        const struct FilterSpec *spec = &filter_specs[i];
+        struct KeyFilter *filter = &filters[i];
+        int data_fd = open(spec->path, O_RDONLY);
+
+        if (data_fd >= 0) {
+            FLOCK(data_fd, LOCK_SH, spec->path);
+        }
+        if (map_existing(i, data_fd) == 0) {
+            reused++;
+            filter->valid = 1;
+        } else {
+            if (filter->header) {
+                munmap(filter->header, filter->mapped_size);
+                filter->header = NULL;
+            }
+            filter->valid = rebuild(i, data_fd) == 0;
+            rebuilt++;
+            if (!filter->valid) {
+                fprintf(stderr, "Failed to build %s filter; duplicate checks will read %s\n", spec->name, spec->path);
+            }
+        }
+        // Until the next clean shutdown the file may fall behind the table
+        if (filter->header) {
+            filter->header->clean = 0;
+            msync(filter->header, filter->mapped_size, MS_SYNC);
+        }
+        if (data_fd >= 0) {
+            FLOCK(data_fd, LOCK_UN, spec->path);
+            close(data_fd);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("Key filters: %d reused, %d rebuilt in %.1f ms\n", reused, rebuilt,
+           (now.tv_sec - started.tv_sec) * 1000.0 + (now.tv_nsec - started.tv_nsec) / 1e6);
+    return rebuilt;
+}
+
+void key_filter_close() {
+    for (int i = 0; i < KEY_FILTER_COUNT; i++) {
+        const struct FilterSpec *spec = &filter_specs[i];
+        struct KeyFilter *filter = &filters[i];
+        struct stat st;
+        int data_fd;
+
+        if (!filter->header) {
+            continue;
+        }
+        data_fd = filter->valid ? open(spec->path, O_RDONLY) : -1;
+        if (data_fd >= 0) {
+            FLOCK(data_fd, LOCK_SH, spec->path);
+            if (fstat(data_fd, &st) == 0) {
+                filter->header->dev = st.st_dev;
+                filter->header->ino = st.st_ino;
+                filter->header->size = st.st_size;
+                filter->header->mtime_ns = mtime_ns(&st);
+                filter->header->clean = 1;
+            }
+            FLOCK(data_fd, LOCK_UN, spec->path);
+            close(data_fd);
+        }
+        msync(filter->header, filter->mapped_size, MS_SYNC);
+    }
+}
+
+int key_filter_report(char *buffer, size_t size) {
+    size_t used = snprintf(buffer, size, "Filter | Bits | Names/capacity | Fill %% | Est. false %% | "
+                                         "Checks | No I/O | False positives\n");
+
+    for (int i = 0; i < KEY_FILTER_COUNT && used < size; i++) {
+        const struct KeyFilter *filter = &filters[i];
+        uint64_t set = 0;
+        double fill, false_rate = 1.0;
+        int written;
+
+        if (!filter->header) {
+            written = snprintf(buffer + used, size - used, "%s | not loaded\n", filter_specs[i].name);
+        } else {
+            for (uint64_t w = 0; w < filter->header->bits / 64; w++) {
+                set += __builtin_popcountll(__atomic_load_n(&filter->words[w], __ATOMIC_RELAXED));
+            }
+            fill = (double)set / filter->header->bits;
+            for (int h = 0; h < FILTER_HASHES; h++) {
+                false_rate *= fill;
+            }
+            written = snprintf(buffer + used, size - used, "%s%s | %llu | %llu/%llu | %.1f | %.2f | %lu | %lu | %lu\n",
+                               filter_specs[i].name, filter->valid ? "" : " (invalidated)",
+                               (unsigned long long)filter->header->bits, (unsigned long long)filter->header->keys,
+                               (unsigned long long)filter->header->capacity, fill * 100, false_rate * 100,
+                               filter->checks, filter->rejected, filter->false_positives);
+        }
+        if (written < 0 || (size_t)written >= size - used) {
+            return -1;
+        }
+        used += written;
+    }
+    return used < size ? 0 : -1;
+}
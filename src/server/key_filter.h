@@ -0,0 +1,52 @@
+#ifndef KEY_FILTER_H
+#define KEY_FILTER_H
+
+#include <stddef.h>
+
+// Bloom filters over the unique names of the student, faculty and course tables, kept in
+// shared mappings of these files. A name the filter has never seen is certainly new, so
+// duplicate checks only open the table on a possible hit. Names are never removed; a
+// removed course's code stays behind as a false positive.
+#define STUDENT_FILTER_FILE "data/students.bloom"
+#define FACULTY_FILTER_FILE "data/faculty.bloom"
+#define COURSE_FILTER_FILE "data/courses.bloom"
+
+enum KeyFilterId {
+    FILTER_STUDENT_USERNAME,
+    FILTER_FACULTY_USERNAME,
+    FILTER_COURSE_CODE,
+    KEY_FILTER_COUNT
+};
+
+/**
+ * Whether name may be in the table. Filters that are not loaded, or were invalidated,
+ * answer 1 for everything.
+ * @return 0 if the name is certainly absent, 1 if it needs an exact lookup
+ */
+int key_filter_may_contain(enum KeyFilterId filter, const char *name);
+
+// Count the outcome of the exact lookup that followed a possible hit (for the report)
+void key_filter_note_lookup(enum KeyFilterId filter, int found);
+
+// Add a name; called under the table's exclusive lock, before the record is written
+void key_filter_add(enum KeyFilterId filter, const char *name);
+
+// Stop trusting every filter over path (a replica applying changes it did not make);
+// it is rebuilt at the next start
+void key_filter_invalidate(const char *path);
+
+/**
+ * Called from setup_data_directory(), before any fork: map each filter file, and rebuild
+ * the ones that do not match their table as of the last clean shutdown, or have filled past
+ * the number of names they were sized for.
+ * @return Number of filters rebuilt, or -1 on failure
+ */
+int key_filter_load();
+
+// Called at shutdown: record the table each filter matches so the next start can reuse it
+void key_filter_close();
+
+// Size, fill and lookup counts of every filter; -1 if the report does not fit in buffer
+int key_filter_report(char *buffer, size_t size);
+
+#endif // KEY_FILTER_H
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "lock_stats.h"
+#include "trace.h"
+#include "slow_log.h"
+
+#define MAX_LOCK_SITES 256
+#define MAX_HELD_LOCKS 16
+#define LOCK_PATH_LENGTH 64
+
+// Aggregated statistics for one (file, mode, call site) combination
+struct LockSite {
+    char path[LOCK_PATH_LENGTH];
+    const char *site;
+    int line;
+    int mode;
+    unsigned long acquisitions;
+    unsigned long contended;
+    unsigned long long wait_total_ns;
+    unsigned long long wait_max_ns;
+    unsigned long long hold_total_ns;
+    unsigned long long hold_max_ns;
+};
+
+// A lock currently held by this thread
+struct HeldLock {
+    int fd;
+    int site_index;
+    int mode;
+    unsigned long long acquired_ns;
+};
+
+static struct LockSite lock_sites[MAX_LOCK_SITES];
+static int lock_site_count = 0;
+static pthread_mutex_t lock_sites_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread struct HeldLock held_locks[MAX_HELD_LOCKS];
+static __thread int held_lock_count = 0;
+
+// Find or create the statistics slot for a call site (caller holds lock_sites_mutex)
+static int find_lock_site(const char *path, int mode, const char *site, int line) {
+    int i;
+
+    for (i = 0; i < lock_site_count; i++) {
+        if (lock_sites[i].line == line && lock_sites[i].mode == mode &&
+            lock_sites[i].site == site && strcmp(lock_sites[i].path, path) == 0) {
+            return i;
+        }
+    }
+
+    if (lock_site_count >= MAX_LOCK_SITES) {
+        return -1;
+    }
+
+    i = lock_site_count++;
+    memset(&lock_sites[i], 0, sizeof(struct LockSite));
+    strncpy(lock_sites[i].path, path, sizeof(lock_sites[i].path) - 1);
+    lock_sites[i].site = site;
+    lock_sites[i].line = line;
+    lock_sites[i].mode = mode;
+    return i;
+}
+
+static void record_acquire(int fd, const char *path, int mode, const char *site, int line,
+                           unsigned long long wait_ns, int contended) {
+    int index;
+
+    pthread_mutex_lock(&lock_sites_mutex);
+    index = find_lock_site(path, mode, site, line);
+    if (index >= 0) {
+        lock_sites[index].acquisitions++;
+        if (contended) {
+            lock_sites[index].contended++;
+        }
+        lock_sites[index].wait_total_ns += wait_ns;
+        if (wait_ns > lock_sites[index].wait_max_ns) {
+            lock_sites[index].wait_max_ns = wait_ns;
+        }
+    }
+    pthread_mutex_unlock(&lock_sites_mutex);
+
+    if (index < 0) {
+        return;
+    }
+
+    // Remember when this descriptor was locked so the unlock can compute hold time
+    struct HeldLock *held = NULL;
+    for (int i = 0; i < held_lock_count; i++) {
+        if (held_locks[i].fd == fd) {
+            held = &held_locks[i];
+            break;
+        }
+    }
+    if (!held && held_lock_count < MAX_HELD_LOCKS) {
+        held = &held_locks[held_lock_count++];
+    }
+    if (held) {
+        held->fd = fd;
+        held->site_index = index;
+        held->mode = mode;
+        held->acquired_ns = trace_now_ns();
+    }
+}
+
+static void record_release(int fd) {
+    unsigned long long hold_ns;
+    int index;
+
+    for (int i = 0; i < held_lock_count; i++) {
+        if (held_locks[i].fd != fd) {
+            continue;
+        }
+
+        hold_ns = trace_now_ns() - held_locks[i].acquired_ns;
+        index = held_locks[i].site_index;
+
+        held_locks[i] = held_locks[--held_lock_count];
+
+        pthread_mutex_lock(&lock_sites_mutex);
+        lock_sites[index].hold_total_ns += hold_ns;
+        if (hold_ns > lock_sites[index].hold_max_ns) {
+            lock_sites[index].hold_max_ns = hold_ns;
+        }
+        pthread_mutex_unlock(&lock_sites_mutex);
+        return;
+    }
+}
+
+int profiled_flock(int fd, int operation, const char *path, const char *site, int line) {
+    unsigned long long start;
+    int mode = operation & ~LOCK_NB;
+    int contended = 0;
+    int result;
+
+    if (mode == LOCK_UN) {
+        record_release(fd);
+        return flock(fd, operation);
+    }
+
+    // Try without blocking first so contention is detected exactly
+    start = trace_now_ns();
+    result = flock(fd, mode | LOCK_NB);
+    if (result < 0 && errno == EWOULDBLOCK) {
+        contended = 1;
+        if (operation & LOCK_NB) {
+            pthread_mutex_lock(&lock_sites_mutex);
+            int index = find_lock_site(path, mode, site, line);
+            if (index >= 0) {
+                lock_sites[index].contended++;
+            }
+            pthread_mutex_unlock(&lock_sites_mutex);
+            return result;
+        }
+        result = flock(fd, mode);
+    }
+
+    if (result == 0) {
+        unsigned long long wait_ns = trace_now_ns() - start;
+        const char *name = strrchr(path, '/');
+
+        record_acquire(fd, path, mode, site, line, wait_ns, contended);
+        slow_log_note_lock_wait(wait_ns);
+        trace_complete(mode == LOCK_EX ? "lock_wait_ex" : "lock_wait_sh",
+                       name ? name + 1 : path, start, wait_ns);
+    }
+
+    return result;
+}
+
+static int compare_by_wait(const void *a, const void *b) {
+    const struct LockSite *sa = a;
+    const struct LockSite *sb = b;
+
+    if (sa->wait_total_ns == sb->wait_total_ns) {
+        return 0;
+    }
+    return sa->wait_total_ns < sb->wait_total_ns ? 1 : -1;
+}
+
+int lock_stats_report(int top_n, char *buffer, size_t buffer_size) {
+    struct LockSite *snapshot;
+    int count;
+    size_t used;
+
+    pthread_mutex_lock(&lock_sites_mutex);
+    count = lock_site_count;
+    snapshot = malloc(sizeof(struct LockSite) * (count > 0 ? count : 1));
+    if (!snapshot) {
+        pthread_mutex_unlock(&lock_sites_mutex);
+        return -1;
+    }
+    memcpy(snapshot, lock_sites, sizeof(struct LockSite) * count);
+    pthread_mutex_unlock(&lock_sites_mutex);
+
+    qsort(snapshot, count, sizeof(struct LockSite), compare_by_wait);
+
+    if (top_n <= 0 || top_n > count) {
+        top_n = count;
+    }
+
+    used = snprintf(buffer, buffer_size, "Top %d of %d lock sites by total wait\n"
+                    "File | Mode | Site | Acquired | Contended | Wait total/max ms | Hold total/max ms\n",
+                    top_n, count);
+
+    for (int i = 0; i < top_n && used < buffer_size; i++) {
+        const char *name = strrchr(snapshot[i].path, '/');
+        int written = snprintf(buffer + used, buffer_size - used,
+                               "%s | %s | %s:%d | %lu | %lu | %.2f/%.2f | %.2f/%.2f\n",
+                               name ? name + 1 : snapshot[i].path,
+                               snapshot[i].mode == LOCK_EX ? "EX" : "SH",
+                               snapshot[i].site, snapshot[i].line,
+                               snapshot[i].acquisitions, snapshot[i].contended,
+                               snapshot[i].wait_total_ns / 1e6, snapshot[i].wait_max_ns / 1e6,
+                               snapshot[i].hold_total_ns / 1e6, snapshot[i].hold_max_ns / 1e6);
+        if (written < 0 || (size_t)written >= buffer_size - used) {
+            // Drop the partial line rather than sending a truncated row
+            buffer[used] = '\0';
+            break;
+        }
+        used += written;
+    }
+
+    free(snapshot);
+    return 0;
+}
+
+void lock_stats_reset() {
+    pthread_mutex_lock(&lock_sites_mutex);
+    for (int i = 0; i < lock_site_count; i++) {
+        lock_sites[i].acquisitions = 0;
+        lock_sites[i].contended = 0;
+        lock_sites[i].wait_total_ns = 0;
+        lock_sites[i].wait_max_ns = 0;
+        lock_sites[i].hold_total_ns = 0;
+        lock_sites[i].hold_max_ns = 0;
+    }
+    pthread_mutex_unlock(&lock_sites_mutex);
+}
@@ -0,0 +1,24 @@
+#ifndef LOCK_STATS_H
+#define LOCK_STATS_H
+
+#include <stddef.h>
+
+/**
+ * flock() wrapper that records wait and hold times per call site
+ * @param fd File descriptor to lock or unlock
+ * @param operation LOCK_SH, LOCK_EX or LOCK_UN (LOCK_NB is honoured)
+ * @param path Data file the descriptor refers to
+ * @param site Function name of the caller
+ * @param line Source line of the caller
+ * @return Result of the underlying flock() call
+ */
+int profiled_flock(int fd, int operation, const char *path, const char *site, int line);
+
+// All lock acquisitions on data files go through this macro
+#define FLOCK(fd, op, path) profiled_flock((fd), (op), (path), __func__, __LINE__)
+
+// Reporting
+int lock_stats_report(int top_n, char *buffer, size_t buffer_size);
+void lock_stats_reset();
+
+#endif // LOCK_STATS_H
@@ -0,0 +1,783 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../common/constants.h"
+#include "record_index.h"
+#include "string_heap.h"
+#include "lock_stats.h"
+#include "slow_log.h"
+#include "trace.h"
+
+#define INDEX_IMAGE_MAGIC 0x58444941   // "AIDX"
+#define INDEX_IMAGE_VERSION 1
+#define INDEX_MIN_CAPACITY 1024
+#define INDEX_READ_CHUNK (1024 * 1024)
+#define INDEX_IMAGE_ALIGN 4096          // tables start on a page so they can be mapped directly
+
+// Where an index's key sits in its file's records; integer keys have key_size 0. In a
+// string-heap table the records are rows, and a string key is the username's heap reference.
+struct IndexSpec {
+    const char *name;
+    const char *path;
+    size_t record_size;
+    size_t key_offset;
+    size_t key_size;
+    const struct HeapTable *heap;
+};
+
+#define STRING_KEY(type, field) offsetof(type, field), sizeof(((type *)0)->field)
+#define INT_KEY(type, field) offsetof(type, field), 0
+#define HEAP_KEY(row, record, field) offsetof(row, offsets[HEAP_USERNAME]), sizeof(((record *)0)->field)
+
+static const struct IndexSpec index_specs[RECORD_INDEX_COUNT] = {
+    [INDEX_STUDENT_USERNAME]     = { "student username", STUDENT_FILE, sizeof(struct StudentRow),
+                                     HEAP_KEY(struct StudentRow, struct Student, username), &student_heap },
+    [INDEX_STUDENT_ID]           = { "student id", STUDENT_FILE, sizeof(struct StudentRow),
+                                     INT_KEY(struct StudentRow, id), &student_heap },
+    [INDEX_FACULTY_USERNAME]     = { "faculty username", FACULTY_FILE, sizeof(struct FacultyRow),
+                                     HEAP_KEY(struct FacultyRow, struct Faculty, username), &faculty_heap },
+    [INDEX_FACULTY_ID]           = { "faculty id", FACULTY_FILE, sizeof(struct FacultyRow),
+                                     INT_KEY(struct FacultyRow, id), &faculty_heap },
+    [INDEX_COURSE_ID]            = { "course id", COURSE_FILE, sizeof(struct Course), INT_KEY(struct Course, course_id) },
+    [INDEX_COURSE_CODE]          = { "course code", COURSE_FILE, sizeof(struct Course), STRING_KEY(struct Course, course_code) },
+    [INDEX_COURSE_FACULTY]       = { "course faculty", COURSE_FILE, sizeof(struct Course), INT_KEY(struct Course, faculty_id) },
+    [INDEX_CREDENTIALS_USERNAME] = { "credentials username", CREDENTIALS_FILE, sizeof(struct Credentials), STRING_KEY(struct Credentials, username) },
+};
+
+// The files the indexes cover; startup rebuilds run one thread per file
+static const char *indexed_files[] = { STUDENT_FILE, FACULTY_FILE, COURSE_FILE, CREDENTIALS_FILE };
+#define INDEXED_FILE_COUNT (int)(sizeof(indexed_files) / sizeof(indexed_files[0]))
+
+// Open addressing with linear probing; slot is the record number + 1, so 0 marks a free entry
+struct IndexEntry {
+    uint32_t hash;
+    uint32_t slot;
+};
+
+struct RecordIndex {
+    pthread_mutex_t mutex;
+    struct IndexEntry *entries;
+    int mapped;                 // entries is a private mapping of the image, not malloc'd
+    uint32_t capacity;          // a power of two, or 0 before the first build
+    uint32_t count;
+    int max_id;                 // integer indexes only
+    int valid;
+    dev_t dev;                  // the file the entries describe
+    ino_t ino;
+    uint64_t generation;        // its rewrite generation when the entries were built
+    off_t size;                 // bytes of it indexed so far
+};
+
+static struct RecordIndex indexes[RECORD_INDEX_COUNT] = {
+    [0 ... RECORD_INDEX_COUNT - 1] = { .mutex = PTHREAD_MUTEX_INITIALIZER }
+};
+
+// Per indexed file, mapped shared so every worker sees the others' writes: the rewrite
+// generation, and a ring of the last records changed in place
+struct SharedFileState {
+    uint64_t generation;
+    uint64_t changes;                       // records ever logged; slot changes % log size is next
+    uint64_t changed[RECORD_INDEX_CHANGE_LOG];
+};
+
+static struct SharedFileState *shared_files = NULL;
+static pthread_once_t shared_files_once = PTHREAD_ONCE_INIT;
+
+// Large enough for a record (or row) of any indexed file
+union AnyRecord {
+    struct StudentRow student;
+    struct FacultyRow faculty;
+    struct Course course;
+    struct Credentials credentials;
+};
+
+// Image layout: header, one descriptor per index, then each table at its descriptor's offset
+struct ImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t index_count;
+    uint32_t reserved;
+};
+
+struct ImageIndex {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    uint64_t offset;
+    uint32_t capacity;
+    uint32_t count;
+    int32_t max_id;
+    uint32_t record_size;       // guards against a layout change between builds
+};
+
+static uint32_t hash_name(const char *name, size_t max_length) {
+    uint32_t hash = 2166136261u;      // FNV-1a
+    for (size_t i = 0; i < max_length && name[i]; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t hash_id(int id) {
+    uint32_t hash = (uint32_t)id;     // murmur3 finalizer; ids are dense and would cluster
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6b;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static uint32_t hash_record(const struct IndexSpec *spec, const char *record) {
+    int id;
+
+    if (spec->key_size) {
+        return hash_name(record + spec->key_offset, spec->key_size);
+    }
+    memcpy(&id, record + spec->key_offset, sizeof(id));
+    return hash_id(id);
+}
+
+static uint32_t capacity_for(uint32_t records) {
+    uint32_t capacity = INDEX_MIN_CAPACITY;
+    while (capacity < records * 2) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+// Reallocate the table with room for at least `records` entries at load factor 1/2
+static int resize(struct RecordIndex *ix, uint32_t records) {
+    uint32_t capacity = capacity_for(records);
+    struct IndexEntry *entries;
+
+    if (capacity <= ix->capacity) {
+        return 0;
+    }
+    entries = calloc(capacity, sizeof(struct IndexEntry));
+    if (!entries) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < ix->capacity; i++) {
+        if (ix->entries[i].slot) {
+            uint32_t at = ix->entries[i].hash & (capacity - 1);
+            while (entries[at].slot) {
+                at = (at + 1) & (capacity - 1);
+            }
+            entries[at] = ix->entries[i];
+        }
+    }
+    if (ix->mapped) {
+        munmap(ix->entries, sizeof(struct IndexEntry) * ix->capacity);
+    } else {
+        free(ix->entries);
+    }
+    ix->entries = entries;
+    ix->mapped = 0;
+    ix->capacity = capacity;
+    return 0;
+}
+
+static int insert(struct RecordIndex *ix, uint32_t hash, uint32_t slot) {
+    uint32_t at;
+
+    if ((ix->count + 1) * 2 > ix->capacity && resize(ix, ix->count + 1) < 0) {
+        return -1;
+    }
+    at = hash & (ix->capacity - 1);
+    while (ix->entries[at].slot) {
+        at = (at + 1) & (ix->capacity - 1);
+    }
+    ix->entries[at].hash = hash;
+    ix->entries[at].slot = slot;
+    ix->count++;
+    return 0;
+}
+
+// Add the records in [ix->size, size) of the file to the index
+static int index_tail(struct RecordIndex *ix, const struct IndexSpec *spec, int fd, off_t size) {
+    size_t chunk = INDEX_READ_CHUNK - INDEX_READ_CHUNK % spec->record_size;
+    int heap_names = spec->heap && spec->key_size;
+    char *buffer = malloc(chunk);
+    char *names = heap_names ? malloc(chunk / spec->record_size * spec->key_size) : NULL;
+    int heap_fd = heap_names ? heap_open(spec->heap) : -1;
+    int result = 0;
+    TRACE_SCOPE(__func__);
+
+    if (!buffer || (heap_names && !names) ||
+        resize(ix, ix->count + (size - ix->size) / spec->record_size) < 0) {
+        result = -1;
+    }
+    while (result == 0 && ix->size < size) {
+        size_t wanted = size - ix->size < (off_t)chunk ? (size_t)(size - ix->size) : chunk;
+        ssize_t n = pread(fd, buffer, wanted, ix->size);
+
+        n -= n % spec->record_size;
+        slow_log_note_scan(spec->path, n / (ssize_t)spec->record_size);
+        // Usernames of a heap table come from its heap, a chunk of rows at a time
+        if (n <= 0 || (heap_names && heap_read_column(spec->heap, heap_fd, buffer, n / spec->record_size,
+                                                      HEAP_USERNAME, names, spec->key_size) < 0)) {
+            result = -1;
+            break;
+        }
+        for (ssize_t at = 0; at < n && result == 0; at += spec->record_size) {
+            uint32_t slot = (ix->size + at) / spec->record_size + 1;
+            uint32_t hash = heap_names ? hash_name(names + at / spec->record_size * spec->key_size, spec->key_size)
+                                       : hash_record(spec, buffer + at);
+
+            result = insert(ix, hash, slot);
+            if (!spec->key_size) {
+                int id;
+                memcpy(&id, buffer + at + spec->key_offset, sizeof(id));
+                if (id > ix->max_id) {
+                    ix->max_id = id;
+                }
+            }
+        }
+        ix->size += n;
+    }
+
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    free(names);
+    free(buffer);
+    return result;
+}
+
+static void map_shared_files() {
+    size_t size = INDEXED_FILE_COUNT * sizeof(struct SharedFileState);
+    int fd = open(RECORD_INDEX_GENERATIONS, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    void *map;
+
+    if (fd < 0) {
+        return;
+    }
+    // Extending to the same size is harmless if two processes race here
+    if (fstat(fd, &st) == 0 && (st.st_size >= (off_t)size || ftruncate(fd, size) == 0)) {
+        map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            shared_files = map;
+        }
+    }
+    close(fd);
+}
+
+// The shared state of path, or NULL if it is not indexed or the file is unavailable
+static struct SharedFileState *shared_state_of(const char *path) {
+    pthread_once(&shared_files_once, map_shared_files);
+    for (int f = 0; shared_files && f < INDEXED_FILE_COUNT; f++) {
+        if (strcmp(indexed_files[f], path) == 0) {
+            return &shared_files[f];
+        }
+    }
+    return NULL;
+}
+
+static uint64_t current_generation(const char *path) {
+    struct SharedFileState *state = shared_state_of(path);
+
+    return state ? __atomic_load_n(&state->generation, __ATOMIC_ACQUIRE) : 0;
+}
+
+// Bring the index up to date with the file behind fd; called with ix->mutex and the file lock held
+static int refresh(struct RecordIndex *ix, const struct IndexSpec *spec, int fd) {
+    uint64_t generation = current_generation(spec->path);
+    struct stat st;
+    off_t size;
+
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    size = st.st_size - st.st_size % spec->record_size;
+
+    // A replaced or shrunk file (removals rewrite it) is indexed from scratch. The generation
+    // catches a replacement that reuses the inode number of a file indexed before.
+    if (!ix->valid || ix->generation != generation || ix->dev != st.st_dev || ix->ino != st.st_ino ||
+        size < ix->size) {
+        if (ix->entries) {
+            memset(ix->entries, 0, sizeof(struct IndexEntry) * ix->capacity);
+        }
+        ix->count = 0;
+        ix->max_id = 0;
+        ix->size = 0;
+        ix->dev = st.st_dev;
+        ix->ino = st.st_ino;
+        ix->generation = generation;
+        ix->valid = 1;
+    }
+    if (size > ix->size && index_tail(ix, spec, fd, size) < 0) {
+        ix->valid = 0;
+        return -1;
+    }
+    return 0;
+}
+
+static int key_matches(const struct IndexSpec *spec, const char *record, const char *name, int id, int *heap_fd) {
+    int record_id;
+
+    if (spec->heap && spec->key_size) {
+        char stored[MAX_USERNAME_LENGTH];
+
+        if (*heap_fd < 0) {
+            *heap_fd = heap_open(spec->heap);
+        }
+        return heap_read_column(spec->heap, *heap_fd, record, 1, HEAP_USERNAME, stored, sizeof(stored)) == 0 &&
+               strncmp(stored, name, spec->key_size) == 0;
+    }
+    if (spec->key_size) {
+        return strncmp(record + spec->key_offset, name, spec->key_size) == 0;
+    }
+    memcpy(&record_id, record + spec->key_offset, sizeof(record_id));
+    return record_id == id;
+}
+
+static off_t find(enum RecordIndexId index, int fd, const char *name, int id, uint32_t hash, void *record) {
+    const struct IndexSpec *spec = &index_specs[index];
+    struct RecordIndex *ix = &indexes[index];
+    union AnyRecord candidate;
+    off_t found = -1;
+    int heap_fd = -1;
+
+    pthread_mutex_lock(&ix->mutex);
+    if (refresh(ix, spec, fd) == 0 && ix->count > 0) {
+        for (uint32_t at = hash & (ix->capacity - 1); ix->entries[at].slot; at = (at + 1) & (ix->capacity - 1)) {
+            off_t offset;
+
+            if (ix->entries[at].hash != hash) {
+                continue;
+            }
+            offset = (off_t)(ix->entries[at].slot - 1) * spec->record_size;
+            slow_log_note_scan(spec->path, 1);
+            if (pread(fd, &candidate, spec->record_size, offset) == (ssize_t)spec->record_size &&
+                key_matches(spec, (const char *)&candidate, name, id, &heap_fd)) {
+                found = offset;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ix->mutex);
+
+    if (found >= 0 && record) {
+        if (!spec->heap) {
+            memcpy(record, &candidate, spec->record_size);
+        } else {
+            if (heap_fd < 0) {
+                heap_fd = heap_open(spec->heap);
+            }
+            if (heap_decode(spec->heap, heap_fd, &candidate, 1, record) < 0) {
+                found = -1;
+            }
+        }
+    }
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    return found;
+}
+
+off_t record_index_find_name(enum RecordIndexId index, int fd, const char *name, void *record) {
+    // Stored keys always end within their field, so a longer name cannot match
+    if (strlen(name) >= index_specs[index].key_size) {
+        return -1;
+    }
+    return find(index, fd, name, 0, hash_name(name, index_specs[index].key_size), record);
+}
+
+off_t record_index_find_id(enum RecordIndexId index, int fd, int id, void *record) {
+    return find(index, fd, NULL, id, hash_id(id), record);
+}
+
+int record_index_find_all_id(enum RecordIndexId index, int fd, int id, void *records, int max) {
+    const struct IndexSpec *spec = &index_specs[index];
+    struct RecordIndex *ix = &indexes[index];
+    uint32_t hash = hash_id(id);
+    uint32_t *slots = NULL;
+    uint32_t slot_count = 0, slot_capacity = 0;
+    union AnyRecord candidate;
+    int found = 0;
+    int result = 0;
+
+    // Equal keys share a hash, so they all sit in one probe run
+    pthread_mutex_lock(&ix->mutex);
+    if (refresh(ix, spec, fd) < 0) {
+        result = -1;
+    }
+    for (uint32_t at = hash & (ix->capacity - 1); result == 0 && ix->count > 0 && ix->entries[at].slot;
+         at = (at + 1) & (ix->capacity - 1)) {
+        if (ix->entries[at].hash != hash) {
+            continue;
+        }
+        if (slot_count == slot_capacity) {
+            uint32_t *grown = realloc(slots, (slot_capacity = slot_capacity * 2 + 16) * sizeof(uint32_t));
+
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            slots = grown;
+        }
+        slots[slot_count++] = ix->entries[at].slot;
+    }
+    pthread_mutex_unlock(&ix->mutex);
+
+    // Probing can wrap around the table, so restore file order before reading
+    for (uint32_t i = 1; i < slot_count; i++) {
+        uint32_t slot = slots[i];
+        uint32_t j = i;
+
+        for (; j > 0 && slots[j - 1] > slot; j--) {
+            slots[j] = slots[j - 1];
+        }
+        slots[j] = slot;
+    }
+    for (uint32_t i = 0; i < slot_count && result == 0; i++) {
+        off_t offset = (off_t)(slots[i] - 1) * spec->record_size;
+
+        slow_log_note_scan(spec->path, 1);
+        if (pread(fd, &candidate, spec->record_size, offset) != (ssize_t)spec->record_size) {
+            result = -1;
+        } else if (key_matches(spec, (const char *)&candidate, NULL, id, NULL)) {
+            if (records && found < max) {
+                memcpy((char *)records + found * spec->record_size, &candidate, spec->record_size);
+            }
+            found++;
+        }
+    }
+    free(slots);
+    return result < 0 ? -1 : found;
+}
+
+int record_index_max_id(enum RecordIndexId index, int fd) {
+    struct RecordIndex *ix = &indexes[index];
+    int max_id;
+
+    pthread_mutex_lock(&ix->mutex);
+    max_id = refresh(ix, &index_specs[index], fd) == 0 ? ix->max_id : -1;
+    pthread_mutex_unlock(&ix->mutex);
+    return max_id;
+}
+
+void record_index_invalidate(const char *path) {
+    for (int i = 0; i < RECORD_INDEX_COUNT; i++) {
+        if (strcmp(index_specs[i].path, path) == 0) {
+            pthread_mutex_lock(&indexes[i].mutex);
+            indexes[i].valid = 0;
+            pthread_mutex_unlock(&indexes[i].mutex);
+        }
+    }
+}
+
+void record_index_note_rewrite(const char *path) {
+    struct SharedFileState *state = shared_state_of(path);
+
+    if (state) {
+        __atomic_add_fetch(&state->generation, 1, __ATOMIC_RELEASE);
+    } else {
+        record_index_invalidate(path);
+    }
+}
+
+void record_index_note_change(const char *path, off_t offset) {
+    struct SharedFileState *state = shared_state_of(path);
+    uint64_t changes;
+
+    if (!state) {
+        return;
+    }
+    // Writers hold the file's exclusive lock, so only readers run alongside
+    changes = __atomic_load_n(&state->changes, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->changed[changes % RECORD_INDEX_CHANGE_LOG], (uint64_t)offset, __ATOMIC_RELAXED);
+    __atomic_store_n(&state->changes, changes + 1, __ATOMIC_RELEASE);
+}
+
+int record_index_changes_since(const char *path, uint64_t *seen, off_t *offsets, int max) {
+    struct SharedFileState *state = shared_state_of(path);
+    uint64_t changes;
+    int count;
+
+    if (!state) {
+        return -1;
+    }
+    changes = __atomic_load_n(&state->changes, __ATOMIC_ACQUIRE);
+    // Also catches a log that restarted below *seen, as a huge difference
+    if (changes - *seen > (uint64_t)max || changes - *seen > RECORD_INDEX_CHANGE_LOG) {
+        *seen = changes;
+        return -1;
+    }
+    count = (int)(changes - *seen);
+    for (int i = 0; i < count; i++) {
+        offsets[i] = (off_t)__atomic_load_n(&state->changed[(*seen + i) % RECORD_INDEX_CHANGE_LOG], __ATOMIC_RELAXED);
+    }
+    *seen = changes;
+    return count;
+}
+
+void record_index_note_overwrite(const char *path, off_t offset, const void *before, const void *after,
+                                 size_t length) {
+    for (int i = 0; i < RECORD_INDEX_COUNT; i++) {
+        const struct IndexSpec *spec = &index_specs[i];
+        // A changed heap string always moves, so its offset alone tells whether the key changed
+        size_t key_length = spec->key_size && !spec->heap ? spec->key_size : sizeof(int32_t);
+        int changed = 0;
+
+        if (strcmp(spec->path, path) != 0) {
+            continue;
+        }
+        // Compare the key bytes of every record the write touched
+        for (off_t record = offset - offset % spec->record_size; !changed && record < offset + (off_t)length;
+             record += spec->record_size) {
+            off_t start = record + spec->key_offset;
+            off_t end = start + key_length;
+
+            if (start < offset) {
+                start = offset;
+            }
+            if (end > offset + (off_t)length) {
+                end = offset + (off_t)length;
+            }
+            changed = start < end && memcmp((const char *)before + (start - offset),
+                                            (const char *)after + (start - offset), end - start) != 0;
+        }
+        if (changed) {
+            pthread_mutex_lock(&indexes[i].mutex);
+            indexes[i].valid = 0;
+            pthread_mutex_unlock(&indexes[i].mutex);
+        }
+    }
+    // Every record the write touched is logged for the search indexes
+    for (int i = 0; i < RECORD_INDEX_COUNT; i++) {
+        off_t size = (off_t)index_specs[i].record_size;
+
+        if (strcmp(index_specs[i].path, path) == 0) {
+            for (off_t record = offset - offset % size; record < offset + (off_t)length; record += size) {
+                record_index_note_change(path, record);
+            }
+            break;
+        }
+    }
+}
+
+// Build every stale index over one file under a shared lock
+static void *rebuild_file(void *arg) {
+    const char *path = arg;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0) {
+        return NULL;         // built on first use once the file exists
+    }
+    FLOCK(fd, LOCK_SH, path);
+    for (int i = 0; i < RECORD_INDEX_COUNT; i++) {
+        if (strcmp(index_specs[i].path, path) == 0) {
+            pthread_mutex_lock(&indexes[i].mutex);
+            if (!indexes[i].valid && refresh(&indexes[i], &index_specs[i], fd) < 0) {
+                fprintf(stderr, "Failed to build %s index\n", index_specs[i].name);
+            }
+            pthread_mutex_unlock(&indexes[i].mutex);
+        }
+    }
+    FLOCK(fd, LOCK_UN, path);
+    close(fd);
+    return NULL;
+}
+
+static int64_t mtime_ns(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+// Map one index's table from the image if its file is exactly as it was at the checkpoint.
+// The mapping is private, so later inserts copy just the pages they touch.
+static int load_index(int index, int image_fd, size_t image_size, const struct ImageIndex *entry) {
+    const struct IndexSpec *spec = &index_specs[index];
+    struct RecordIndex *ix = &indexes[index];
+    struct IndexEntry *entries;
+    struct stat st;
+    size_t table_size = (size_t)entry->capacity * sizeof(struct IndexEntry);
+
+    if (stat(spec->path, &st) < 0 || entry->dev != (uint64_t)st.st_dev || entry->ino != (uint64_t)st.st_ino ||
+        entry->size != (int64_t)(st.st_size - st.st_size % spec->record_size) ||
+        entry->mtime_ns != mtime_ns(&st) || entry->record_size != spec->record_size ||
+        entry->capacity < INDEX_MIN_CAPACITY || (entry->capacity & (entry->capacity - 1)) ||
+        entry->offset % INDEX_IMAGE_ALIGN || entry->offset > image_size || table_size > image_size - entry->offset) {
+        return -1;
+    }
+    entries = mmap(NULL, table_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, image_fd, entry->offset);
+    if (entries == MAP_FAILED) {
+        return -1;
+    }
+    ix->entries = entries;
+    ix->mapped = 1;
+    ix->capacity = entry->capacity;
+    ix->count = entry->count;
+    ix->max_id = entry->max_id;
+    ix->dev = st.st_dev;
+    ix->ino = st.st_ino;
+    ix->generation = current_generation(spec->path);
+    ix->size = entry->size;
+    ix->valid = 1;
+    return 0;
+}
+
+int record_index_load() {
+    pthread_t threads[INDEXED_FILE_COUNT];
+    struct timespec started, now;
+    struct stat st;
+    int loaded = 0, rebuilt = 0;
+    int fd;
+    TRACE_SCOPE(__func__);
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    fd = open(RECORD_INDEX_IMAGE, O_RDONLY);
+    if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct ImageHeader)) {
+        size_t descriptors = sizeof(struct ImageHeader) + RECORD_INDEX_COUNT * sizeof(struct ImageIndex);
+        char *image = mmap(NULL, descriptors, PROT_READ, MAP_PRIVATE, fd, 0);
+        const struct ImageHeader *header = (const struct ImageHeader *)image;
+
+        if (image != MAP_FAILED) {
+            if (st.st_size >= (off_t)descriptors && header->magic == INDEX_IMAGE_MAGIC &&
+                header->version == INDEX_IMAGE_VERSION && header->index_count == RECORD_INDEX_COUNT) {
+                const struct ImageIndex *entries = (const struct ImageIndex *)(image + sizeof(*header));
+                for (int i = 0; i < RECORD_INDEX_COUNT; i++) {
+                    if (load_index(i, fd, st.st_size, &entries[i]) == 0) {
+                        loaded++;
+                    }
+                }
+            }
+            munmap(image, descriptors);
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    // Whatever the image could not vouch for is rebuilt, every file in parallel
+    for (int f = 0; f < INDEXED_FILE_COUNT; f++) {
+        threads[f] = 0;
+        for (int i = 0; i < RECORD_INDEX_COUNT; i++) {
+            if (!indexes[i].valid && strcmp(index_specs[i].path, indexed_files[f]) == 0) {
+                if (pthread_create(&threads[f], NULL, rebuild_file, (void *)indexed_files[f]) != 0) {
+                    rebuild_file((void *)indexed_files[f]);
+                    threads[f] = 0;
+                }
+                break;
+            }
+        }
+    }
+    for (int f = 0; f < INDEXED_FILE_COUNT; f++) {
+        if (threads[f]) {
+            pthread_join(threads[f], NULL);
+        }
+    }
+    for (int i = 0; i < RECORD_INDEX_COUNT; i++) {
+        rebuilt += indexes[i].valid;
+    }
+    rebuilt -= loaded;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("Indexes: %d loaded from %s, %d rebuilt in %.1f ms\n", loaded, RECORD_INDEX_IMAGE, rebuilt,
+           (now.tv_sec - started.tv_sec) * 1000.0 + (now.tv_nsec - started.tv_nsec) / 1e6);
+
+    if (rebuilt > 0 && record_index_checkpoint() < 0) {
+        perror("Failed to write index image");
+    }
+    return rebuilt;
+}
+
+static int write_all_at(int fd, const void *data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = pwrite(fd, data, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data = (const char *)data + n;
+        length -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+// Describe and write one index, current as of a shared lock on its file
+static int checkpoint_index(int index, int out, off_t *offset, struct ImageIndex *entry) {
+    const struct IndexSpec *spec = &index_specs[index];
+    struct RecordIndex *ix = &indexes[index];
+    struct stat st;
+    int result = 0;
+    int fd = open(spec->path, O_RDONLY);
+
+    memset(entry, 0, sizeof(*entry));
+    if (fd < 0) {
+        return 0;            // nothing to index yet; an empty descriptor never validates
+    }
+    FLOCK(fd, LOCK_SH, spec->path);
+    pthread_mutex_lock(&ix->mutex);
+    if (refresh(ix, spec, fd) == 0 && fstat(fd, &st) == 0) {
+        *offset = (*offset + INDEX_IMAGE_ALIGN - 1) / INDEX_IMAGE_ALIGN * INDEX_IMAGE_ALIGN;
+        entry->dev = st.st_dev;
+        entry->ino = st.st_ino;
+        entry->size = ix->size;
+        entry->mtime_ns = mtime_ns(&st);
+        entry->offset = *offset;
+        entry->capacity = ix->capacity;
+        entry->count = ix->count;
+        entry->max_id = ix->max_id;
+        entry->record_size = spec->record_size;
+        result = write_all_at(out, ix->entries, sizeof(struct IndexEntry) * ix->capacity, *offset);
+        *offset += sizeof(struct IndexEntry) * ix->capacity;
+    }
+    pthread_mutex_unlock(&ix->mutex);
+    FLOCK(fd, LOCK_UN, spec->path);
+    close(fd);
+    return result;
+}
+
+int record_index_checkpoint() {
+    struct ImageHeader header = { INDEX_IMAGE_MAGIC, INDEX_IMAGE_VERSION, RECORD_INDEX_COUNT, 0 };
+    struct ImageIndex entries[RECORD_INDEX_COUNT];
+    off_t offset = sizeof(header) + sizeof(entries);
+    char temp_path[64];
+    int result = 0;
+    int out;
+    TRACE_SCOPE(__func__);
+
+    // Pre-forked workers checkpoint independently; each writes its own file and the last rename wins
+    snprintf(temp_path, sizeof(temp_path), "%s.%d", RECORD_INDEX_IMAGE, getpid());
+    out = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out < 0) {
+        return -1;
+    }
+    for (int i = 0; i < RECORD_INDEX_COUNT && result == 0; i++) {
+        result = checkpoint_index(i, out, &offset, &entries[i]);
+    }
+    if (result == 0) {
+        result = write_all_at(out, &header, sizeof(header), 0);
+    }
+    if (result == 0) {
+        result = write_all_at(out, entries, sizeof(entries), sizeof(header));
+    }
+    if (result == 0) {
+        result = fsync(out);
+    }
+    close(out);
+    if (result == 0) {
+        result = rename(temp_path, RECORD_INDEX_IMAGE);
+    }
+    if (result < 0) {
+        unlink(temp_path);
+    }
+    return result;
+}
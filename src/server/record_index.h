@@ -0,0 +1,103 @@
+#ifndef RECORD_INDEX_H
+#define RECORD_INDEX_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+// Checkpoint of every index, validated against the data files when the server starts
+#define RECORD_INDEX_IMAGE "data/index.img"
+
+// Rewrite generation and in-place change log of each indexed file, shared by every process
+// through a mapping
+#define RECORD_INDEX_GENERATIONS "data/index.gen"
+#define RECORD_INDEX_CHANGE_LOG 1024
+
+// In-memory hash indexes from a key to the record's position in its data file. Keys are
+// unique except in INDEX_COURSE_FACULTY, which maps a faculty id to each of their courses.
+enum RecordIndexId {
+    INDEX_STUDENT_USERNAME,
+    INDEX_STUDENT_ID,
+    INDEX_FACULTY_USERNAME,
+    INDEX_FACULTY_ID,
+    INDEX_COURSE_ID,
+    INDEX_COURSE_CODE,
+    INDEX_COURSE_FACULTY,
+    INDEX_CREDENTIALS_USERNAME,
+    RECORD_INDEX_COUNT
+};
+
+/**
+ * Look up a record through an index. The caller holds a lock on fd, an open descriptor of
+ * the index's data file; the index first catches up with records appended since its last
+ * use, or is rebuilt if the file was replaced. A hit is read back and compared, so a stale
+ * entry can never return the wrong record.
+ * @param record Receives the record when found (may be NULL)
+ * @return Byte offset of the record, or -1 if there is none
+ */
+off_t record_index_find_name(enum RecordIndexId index, int fd, const char *name, void *record);
+off_t record_index_find_id(enum RecordIndexId index, int fd, int id, void *record);
+
+/**
+ * Every record with the given key in a non-unique integer index, in file order. The caller
+ * holds a lock on fd, as for record_index_find_id().
+ * @param records Receives the first max of them (may be NULL)
+ * @return Number of matching records, which may exceed max, or -1 on a read error
+ */
+int record_index_find_all_id(enum RecordIndexId index, int fd, int id, void *records, int max);
+
+/**
+ * Highest id in an integer index's file, for handing out the next one.
+ * @return The highest id, 0 for an empty file, -1 on a read error
+ */
+int record_index_max_id(enum RecordIndexId index, int fd);
+
+// Forget every index over path, to be rebuilt on next use
+void record_index_invalidate(const char *path);
+
+/**
+ * Called by a rename-style rewrite of path before the rename, holding the file's exclusive
+ * lock: every process rebuilds its indexes over path on next use, even if the new file
+ * gets the inode number of one an index was built over before.
+ */
+void record_index_note_rewrite(const char *path);
+
+/**
+ * Called by a replica before it overwrites existing bytes of path: invalidates the indexes
+ * whose keys the write changes (in-place updates of other fields keep them).
+ * @param before The bytes currently at [offset, offset + length)
+ * @param after The bytes about to replace them
+ */
+void record_index_note_overwrite(const char *path, off_t offset, const void *before, const void *after,
+                                 size_t length);
+
+/**
+ * Called by a writer that overwrites a record of path in place, holding the file's exclusive
+ * lock (after its bytes are written): logs the record's offset for every process, so their
+ * search indexes reread just the records that changed.
+ */
+void record_index_note_change(const char *path, off_t offset);
+
+/**
+ * Offsets of the records of path changed in place since *seen, the number of changes the
+ * caller has already taken, which is then advanced. The caller holds a lock on the file.
+ * @param offsets Receives up to max offsets, oldest first (one record may appear twice)
+ * @return Number of offsets filled, or -1 if more changes were made than max or than the
+ *         log holds, or the log is unavailable: the caller has to compare every record
+ */
+int record_index_changes_since(const char *path, uint64_t *seen, off_t *offsets, int max);
+
+/**
+ * Called from setup_data_directory(): map the image and take every index whose file still
+ * has the recorded device, inode, size and modification time; rebuild the rest with one
+ * thread per data file, then write a fresh image if anything was rebuilt.
+ * @return Number of indexes that had to be rebuilt, or -1 on failure
+ */
+int record_index_load();
+
+/**
+ * Write every index to the image (through a temporary file and rename).
+ * @return 0 on success, -1 on failure
+ */
+int record_index_checkpoint();
+
+#endif // RECORD_INDEX_H
@@ -0,0 +1,879 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../common/constants.h"
+#include "replication.h"
+#include "lock_stats.h"
+#include "trace.h"
+#include "record_index.h"
+#include "enrollment_store.h"
+#include "string_heap.h"
+#include "department.h"
+#include "key_filter.h"
+
+#define REPLICATION_HEARTBEAT_MS 1000
+#define REPLICATION_RETRY_SEC 2
+#define REPLICATION_SEND_BATCH (2 * REPLICATION_MAX_PAYLOAD)
+
+// The stream is a sequence of fixed headers, each followed by `length` payload bytes.
+// Data records are physical and idempotent (bytes at an offset, or a file size), so a
+// replica can replay them over a snapshot that was copied while writes continued.
+enum ReplicationRecordType {
+    REPL_HELLO = 1,                   // offset carries the primary's epoch
+    REPL_WRITE,                       // payload goes at offset
+    REPL_TRUNCATE,                    // offset is the new file size
+    REPL_SNAPSHOT_BEGIN,              // data records until SNAPSHOT_END build a fresh copy
+    REPL_SNAPSHOT_END,                // lsn is where the log stream continues
+    REPL_HEARTBEAT                    // lsn is the primary's current log position
+};
+
+struct ReplicationRecord {
+    uint64_t lsn;                     // log position of this record
+    uint64_t timestamp_ns;            // primary wall clock when the change was logged
+    int64_t offset;
+    uint32_t length;
+    uint16_t type;
+    uint16_t file;
+};
+
+// Data files that are shipped, by index
+static const char *replicated_files[] = {
+    STUDENT_FILE, FACULTY_FILE, COURSE_FILE, ENROLLMENT_FILE, WAITLIST_FILE, CREDENTIALS_FILE,
+    ENROLLMENT_SEGMENT_FILE, STUDENT_HEAP_FILE, FACULTY_HEAP_FILE, DEPARTMENT_FILE
+};
+#define REPLICATED_FILE_COUNT (int)(sizeof(replicated_files) / sizeof(replicated_files[0]))
+
+// Primary: mutation log in a ring; the lsn is the count of bytes ever appended to it
+static char *ring = NULL;
+static uint64_t next_lsn = 0;
+static uint64_t log_epoch = 0;
+static pthread_mutex_t ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ring_grew = PTHREAD_COND_INITIALIZER;
+
+struct ReplicaConnection {
+    int active;
+    char address[64];
+    uint64_t sent_lsn;
+    time_t connected_at;
+};
+static struct ReplicaConnection replicas[REPLICATION_MAX_REPLICAS];
+
+// Replica: what has been applied from which primary
+static int replica_mode = 0;
+static char primary_address[128];
+static char primary_login[128];
+static pthread_mutex_t replica_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t replica_epoch = 0;
+static uint64_t applied_lsn = 0;
+static uint64_t primary_lsn = 0;
+static uint64_t last_applied_ns = 0;
+static uint64_t last_heard_ns = 0;
+static int replica_connected = 0;
+static int replica_syncing = 0;
+static unsigned long snapshots_received = 0;
+
+static uint64_t realtime_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int file_index(const char *path) {
+    for (int i = 0; i < REPLICATED_FILE_COUNT; i++) {
+        if (strcmp(path, replicated_files[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int write_all(int sock, const void *data, size_t length) {
+    const char *p = data;
+
+    while (length > 0) {
+        ssize_t n = write(sock, p, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+static int read_exact(int sock, void *data, size_t length) {
+    char *p = data;
+
+    while (length > 0) {
+        ssize_t n = read(sock, p, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// Ring copies wrap at the end of the buffer (caller holds ring_mutex)
+static void ring_copy_in(uint64_t position, const void *data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    size_t offset = position % REPLICATION_RING_SIZE;
+    size_t first = length < REPLICATION_RING_SIZE - offset ? length : REPLICATION_RING_SIZE - offset;
+
+    memcpy(ring + offset, data, first);
+    memcpy(ring, (const char *)data + first, length - first);
+}
+
+static void ring_copy_out(uint64_t position, void *data, size_t length) {
+    size_t offset = position % REPLICATION_RING_SIZE;
+    size_t first = length < REPLICATION_RING_SIZE - offset ? length : REPLICATION_RING_SIZE - offset;
+
+    memcpy(data, ring + offset, first);
+    memcpy((char *)data + first, ring, length - first);
+}
+
+static void append_record(int type, int file, int64_t offset, const void *data, size_t length) {
+    struct ReplicationRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.timestamp_ns = realtime_ns();
+    record.offset = offset;
+    record.length = length;
+    record.type = type;
+    record.file = file;
+
+    pthread_mutex_lock(&ring_mutex);
+    record.lsn = next_lsn;
+    ring_copy_in(next_lsn, &record, sizeof(record));
+    ring_copy_in(next_lsn + sizeof(record), data, length);
+    next_lsn += sizeof(record) + length;
+    pthread_cond_broadcast(&ring_grew);
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+int replication_init() {
+    ring = malloc(REPLICATION_RING_SIZE);
+    if (!ring) {
+        return -1;
+    }
+    // A new epoch tells replicas that log positions from an earlier run mean nothing
+    log_epoch = realtime_ns() ^ ((uint64_t)getpid() << 32);
+    return 0;
+}
+
+void replication_log_write(int fd, const char *path, const void *data, size_t length) {
+    off_t end;
+
+    if (!ring) {
+        return;
+    }
+    // The descriptor sits just past the bytes written, O_APPEND or not
+    end = lseek(fd, 0, SEEK_CUR);
+    if (end < (off_t)length) {
+        return;
+    }
+    replication_log_write_at(path, data, length, end - length);
+}
+
+void replication_log_write_at(const char *path, const void *data, size_t length, off_t offset) {
+    int file;
+
+    if (!ring || (file = file_index(path)) < 0) {
+        return;
+    }
+    for (size_t done = 0; done < length; done += REPLICATION_MAX_PAYLOAD) {
+        size_t chunk = length - done < REPLICATION_MAX_PAYLOAD ? length - done : REPLICATION_MAX_PAYLOAD;
+        append_record(REPL_WRITE, file, offset + done, (const char *)data + done, chunk);
+    }
+}
+
+void replication_log_truncate(const char *path, off_t size) {
+    int file;
+
+    if (!ring || (file = file_index(path)) < 0) {
+        return;
+    }
+    append_record(REPL_TRUNCATE, file, size, NULL, 0);
+}
+
+void replication_log_file(const char *path, off_t from) {
+    char *buffer;
+    int file;
+    int fd;
+    ssize_t n;
+    TRACE_SCOPE(__func__);
+
+    if (!ring || (file = file_index(path)) < 0) {
+        return;
+    }
+    fd = open(path, O_RDONLY);
+    buffer = malloc(REPLICATION_MAX_PAYLOAD);
+    if (fd < 0 || !buffer) {
+        if (fd >= 0) close(fd);
+        free(buffer);
+        return;
+    }
+
+    // Read and log under the file lock so no other write to the new file interleaves
+    FLOCK(fd, LOCK_SH, path);
+    while ((n = pread(fd, buffer, REPLICATION_MAX_PAYLOAD, from)) > 0) {
+        append_record(REPL_WRITE, file, from, buffer, n);
+        from += n;
+    }
+    append_record(REPL_TRUNCATE, file, from, NULL, 0);
+    FLOCK(fd, LOCK_UN, path);
+
+    close(fd);
+    free(buffer);
+}
+
+static int send_record(int sock, int type, int file, uint64_t lsn, int64_t offset,
+                       const void *data, size_t length) {
+    struct ReplicationRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.lsn = lsn;
+    record.timestamp_ns = realtime_ns();
+    record.offset = offset;
+    record.length = length;
+    record.type = type;
+    record.file = file;
+
+    if (write_all(sock, &record, sizeof(record)) < 0) {
+        return -1;
+    }
+    return length > 0 ? write_all(sock, data, length) : 0;
+}
+
+// Copy every data file to the replica. Each chunk is read under its own shared lock, so the
+// copy is fuzzy; replaying the log from `cut` afterwards brings it to a consistent state.
+static int send_snapshot(int sock, uint64_t *cursor) {
+    char *buffer = malloc(REPLICATION_MAX_PAYLOAD);
+    uint64_t cut;
+    int failed = 0;
+    TRACE_SCOPE("replication_snapshot");
+
+    if (!buffer) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&ring_mutex);
+    cut = next_lsn;
+    pthread_mutex_unlock(&ring_mutex);
+
+    failed = send_record(sock, REPL_SNAPSHOT_BEGIN, 0, cut, 0, NULL, 0);
+    for (int i = 0; i < REPLICATED_FILE_COUNT && !failed; i++) {
+        off_t offset = 0;
+        ssize_t n;
+        int fd;
+
+        // Start the replica's copy empty, even when the primary has no such file
+        failed = send_record(sock, REPL_TRUNCATE, i, cut, 0, NULL, 0);
+        fd = open(replicated_files[i], O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        while (!failed) {
+            FLOCK(fd, LOCK_SH, replicated_files[i]);
+            n = pread(fd, buffer, REPLICATION_MAX_PAYLOAD, offset);
+            FLOCK(fd, LOCK_UN, replicated_files[i]);
+            if (n <= 0) {
+                break;
+            }
+            failed = send_record(sock, REPL_WRITE, i, cut, offset, buffer, n);
+            offset += n;
+        }
+        close(fd);
+    }
+    if (!failed) {
+        failed = send_record(sock, REPL_SNAPSHOT_END, 0, cut, 0, NULL, 0);
+    }
+
+    free(buffer);
+    *cursor = cut;
+    return failed ? -1 : 0;
+}
+
+static int register_replica(int sock) {
+    struct sockaddr_in address;
+    socklen_t length = sizeof(address);
+    int slot = -1;
+
+    pthread_mutex_lock(&ring_mutex);
+    for (int i = 0; i < REPLICATION_MAX_REPLICAS; i++) {
+        if (!replicas[i].active) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot >= 0) {
+        memset(&replicas[slot], 0, sizeof(replicas[slot]));
+        replicas[slot].active = 1;
+        replicas[slot].connected_at = time(NULL);
+        if (getpeername(sock, (struct sockaddr *)&address, &length) == 0) {
+            snprintf(replicas[slot].address, sizeof(replicas[slot].address), "%s:%d",
+                     inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+        } else {
+            strcpy(replicas[slot].address, "unknown");
+        }
+    }
+    pthread_mutex_unlock(&ring_mutex);
+    return slot;
+}
+
+// Ship log records from cursor onwards until the replica goes away or falls off the ring
+static void stream_log(int sock, int slot, uint64_t cursor) {
+    char *batch = malloc(REPLICATION_SEND_BATCH);
+
+    if (!batch) {
+        return;
+    }
+
+    while (1) {
+        struct timespec deadline;
+        size_t used = 0;
+        uint64_t head;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += REPLICATION_HEARTBEAT_MS / 1000;
+
+        pthread_mutex_lock(&ring_mutex);
+        while (cursor == next_lsn &&
+               pthread_cond_timedwait(&ring_grew, &ring_mutex, &deadline) != ETIMEDOUT) {
+        }
+        if (cursor + REPLICATION_RING_SIZE < next_lsn) {
+            // Overwritten before it was shipped; the replica reconnects and resyncs
+            pthread_mutex_unlock(&ring_mutex);
+            break;
+        }
+        while (cursor < next_lsn) {
+            struct ReplicationRecord record;
+            size_t total;
+
+            ring_copy_out(cursor, &record, sizeof(record));
+            total = sizeof(record) + record.length;
+            if (used + total > REPLICATION_SEND_BATCH) {
+                break;
+            }
+            ring_copy_out(cursor, batch + used, total);
+            used += total;
+            cursor += total;
+        }
+        head = next_lsn;
+        replicas[slot].sent_lsn = cursor;
+        pthread_mutex_unlock(&ring_mutex);
+
+        if (used > 0) {
+            if (write_all(sock, batch, used) < 0) {
+                break;
+            }
+        } else if (send_record(sock, REPL_HEARTBEAT, 0, head, 0, NULL, 0) < 0) {
+            break;
+        }
+    }
+
+    free(batch);
+}
+
+void replication_serve(int client_socket, const char *params) {
+    unsigned long long epoch = 0, lsn = 0;
+    uint64_t cursor;
+    int resumable;
+    int slot;
+
+    if (!ring) {
+        // Pre-forked workers keep no log: each one only sees its own share of the writes
+        const char *refusal = "ERROR:Replication log is not enabled on this server "
+                              "(pre-forked workers cannot serve replicas)";
+        write(client_socket, refusal, strlen(refusal));
+        return;
+    }
+    sscanf(params, "%llu:%llu", &epoch, &lsn);
+
+    slot = register_replica(client_socket);
+    if (slot < 0) {
+        write(client_socket, "ERROR:Too many replicas", 23);
+        return;
+    }
+    printf("Replica %s connected (epoch %llu, lsn %llu)\n", replicas[slot].address, epoch, lsn);
+
+    pthread_mutex_lock(&ring_mutex);
+    resumable = epoch == log_epoch && lsn <= next_lsn && lsn + REPLICATION_RING_SIZE >= next_lsn;
+    pthread_mutex_unlock(&ring_mutex);
+
+    cursor = lsn;
+    if (send_record(client_socket, REPL_HELLO, 0, lsn, (int64_t)log_epoch, NULL, 0) == 0 &&
+        (resumable || send_snapshot(client_socket, &cursor) == 0)) {
+        stream_log(client_socket, slot, cursor);
+    }
+
+    pthread_mutex_lock(&ring_mutex);
+    printf("Replica %s disconnected at lsn %llu\n", replicas[slot].address,
+           (unsigned long long)replicas[slot].sent_lsn);
+    replicas[slot].active = 0;
+    pthread_mutex_unlock(&ring_mutex);
+}
+
+// Write one data record's bytes (or size) to an open file
+static int write_record(int fd, const struct ReplicationRecord *record, const char *payload) {
+    if (record->type == REPL_TRUNCATE) {
+        return ftruncate(fd, record->offset);
+    }
+    for (size_t done = 0; done < record->length; ) {
+        ssize_t n = pwrite(fd, payload + done, record->length - done, record->offset + done);
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return 0;
+}
+
+int replication_log_position(uint64_t *lsn) {
+    if (!ring) {
+        return -1;
+    }
+    pthread_mutex_lock(&ring_mutex);
+    *lsn = next_lsn;
+    pthread_mutex_unlock(&ring_mutex);
+    return 0;
+}
+
+int replication_replay(uint64_t from, uint64_t to, const char *directory) {
+    char *batch;
+    uint64_t cursor = from;
+    int result = 0;
+    TRACE_SCOPE(__func__);
+
+    if (!ring || !(batch = malloc(REPLICATION_SEND_BATCH))) {
+        return -1;
+    }
+
+    while (cursor < to && result == 0) {
+        size_t used = 0;
+
+        // Copy a batch out so the ring is not held while the files are written
+        pthread_mutex_lock(&ring_mutex);
+        if (cursor + REPLICATION_RING_SIZE < next_lsn) {
+            pthread_mutex_unlock(&ring_mutex);
+            result = -1;
+            break;
+        }
+        while (cursor < to) {
+            struct ReplicationRecord record;
+            size_t total;
+
+            ring_copy_out(cursor, &record, sizeof(record));
+            total = sizeof(record) + record.length;
+            if (used + total > REPLICATION_SEND_BATCH) {
+                break;
+            }
+            ring_copy_out(cursor, batch + used, total);
+            used += total;
+            cursor += total;
+        }
+        pthread_mutex_unlock(&ring_mutex);
+
+        for (size_t at = 0; at < used && result == 0; ) {
+            struct ReplicationRecord record;
+            const char *name;
+            char path[256];
+            int fd;
+
+            memcpy(&record, batch + at, sizeof(record));
+            name = strrchr(replicated_files[record.file], '/') + 1;
+            snprintf(path, sizeof(path), "%s/%s", directory, name);
+            fd = open(path, O_WRONLY | O_CREAT, 0600);
+            if (fd < 0 || write_record(fd, &record, batch + at + sizeof(record)) < 0) {
+                result = -1;
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+            at += sizeof(record) + record.length;
+        }
+    }
+
+    free(batch);
+    return result;
+}
+
+static void save_replica_state() {
+    char temp_path[] = REPLICATION_STATE_FILE ".tmp";
+    char line[64];
+    int fd;
+    int length;
+
+    pthread_mutex_lock(&replica_mutex);
+    length = snprintf(line, sizeof(line), "%llu %llu\n",
+                      (unsigned long long)replica_epoch, (unsigned long long)applied_lsn);
+    pthread_mutex_unlock(&replica_mutex);
+
+    fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return;
+    }
+    if (write(fd, line, length) == length) {
+        rename(temp_path, REPLICATION_STATE_FILE);
+    }
+    close(fd);
+}
+
+static void load_replica_state() {
+    unsigned long long epoch, lsn;
+    FILE *file = fopen(REPLICATION_STATE_FILE, "r");
+
+    if (!file) {
+        return;
+    }
+    if (fscanf(file, "%llu %llu", &epoch, &lsn) == 2) {
+        replica_epoch = epoch;
+        applied_lsn = lsn;
+    }
+    fclose(file);
+}
+
+// An in-place write may change keys the local indexes hold; appends never do
+static void note_overwrite(int fd, const char *path, const struct ReplicationRecord *record, const char *payload) {
+    struct stat st;
+    size_t length;
+    char *before;
+
+    if (fstat(fd, &st) < 0 || record->offset >= st.st_size) {
+        return;
+    }
+    length = st.st_size - record->offset < (off_t)record->length ? (size_t)(st.st_size - record->offset)
+                                                                : record->length;
+    before = malloc(length);
+    if (!before || pread(fd, before, length, record->offset) != (ssize_t)length) {
+        record_index_invalidate(path);
+    } else {
+        record_index_note_overwrite(path, record->offset, before, payload, length);
+    }
+    free(before);
+}
+
+// Apply one data record; during a snapshot it goes to a side copy that is renamed in at the end
+static int apply_data(const struct ReplicationRecord *record, const char *payload, int syncing) {
+    const char *path = replicated_files[record->file];
+    char sync_path[64];
+    int fd;
+    int result;
+
+    // Names arriving from the primary never reach this server's filters
+    key_filter_invalidate(path);
+    if (syncing) {
+        snprintf(sync_path, sizeof(sync_path), "%s.sync", path);
+        path = sync_path;
+    }
+
+    // Read-write: an overwrite compares the bytes it replaces
+    fd = open(path, O_RDWR | O_CREAT, record->file == file_index(CREDENTIALS_FILE) ? 0600 : 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    // Local readers take shared locks, so each record appears to them atomically
+    FLOCK(fd, LOCK_EX, path);
+    if (!syncing && record->type == REPL_WRITE) {
+        note_overwrite(fd, path, record, payload);
+    }
+    result = write_record(fd, record, payload);
+    FLOCK(fd, LOCK_UN, path);
+    close(fd);
+    return result;
+}
+
+static int apply_record(const struct ReplicationRecord *record, const char *payload, uint64_t *hello_epoch) {
+    switch (record->type) {
+        case REPL_HELLO:
+            *hello_epoch = (uint64_t)record->offset;
+            return 0;
+
+        case REPL_SNAPSHOT_BEGIN:
+            pthread_mutex_lock(&replica_mutex);
+            replica_syncing = 1;
+            pthread_mutex_unlock(&replica_mutex);
+            printf("Replica: receiving snapshot from %s\n", primary_address);
+            return 0;
+
+        case REPL_WRITE:
+        case REPL_TRUNCATE:
+            if (record->file >= REPLICATED_FILE_COUNT) {
+                return -1;
+            }
+            if (apply_data(record, payload, replica_syncing) < 0) {
+                return -1;
+            }
+            if (!replica_syncing) {
+                pthread_mutex_lock(&replica_mutex);
+                applied_lsn = record->lsn + sizeof(*record) + record->length;
+                last_applied_ns = record->timestamp_ns;
+                if (primary_lsn < applied_lsn) {
+                    primary_lsn = applied_lsn;
+                }
+                pthread_mutex_unlock(&replica_mutex);
+            }
+            return 0;
+
+        case REPL_SNAPSHOT_END:
+            // Swap every copy in at once; readers holding the old files finish on them
+            for (int i = 0; i < REPLICATED_FILE_COUNT; i++) {
+                char sync_path[64];
+                snprintf(sync_path, sizeof(sync_path), "%s.sync", replicated_files[i]);
+                record_index_note_rewrite(replicated_files[i]);
+                if (rename(sync_path, replicated_files[i]) < 0) {
+                    return -1;
+                }
+            }
+            pthread_mutex_lock(&replica_mutex);
+            replica_syncing = 0;
+            replica_epoch = *hello_epoch;
+            applied_lsn = record->lsn;
+            primary_lsn = record->lsn;
+            last_applied_ns = record->timestamp_ns;
+            snapshots_received++;
+            pthread_mutex_unlock(&replica_mutex);
+            save_replica_state();
+            printf("Replica: snapshot applied, streaming from lsn %llu\n",
+                   (unsigned long long)record->lsn);
+            return 0;
+
+        case REPL_HEARTBEAT:
+            pthread_mutex_lock(&replica_mutex);
+            primary_lsn = record->lsn;
+            pthread_mutex_unlock(&replica_mutex);
+            save_replica_state();
+            return 0;
+
+        default:
+            return -1;
+    }
+}
+
+static int connect_primary() {
+    struct addrinfo hints, *result;
+    char host[128];
+    char *port;
+    int sock;
+
+    strncpy(host, primary_address, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+    port = strrchr(host, ':');
+    if (!port) {
+        return -1;
+    }
+    *port++ = '\0';
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port, &hints, &result) != 0) {
+        return -1;
+    }
+    sock = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (sock >= 0 && connect(sock, result->ai_addr, result->ai_addrlen) < 0) {
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(result);
+    return sock;
+}
+
+// Log in, ask for the stream from our position and apply it until the connection drops
+static void follow_primary(int sock) {
+    struct ReplicationRecord record;
+    char request[256];
+    char response[256];
+    char *payload = malloc(REPLICATION_MAX_PAYLOAD);
+    uint64_t hello_epoch = 0;
+    ssize_t n;
+
+    if (!payload) {
+        return;
+    }
+
+    snprintf(request, sizeof(request), "AUTH:%s", primary_login);
+    write_all(sock, request, strlen(request));
+    n = read(sock, response, sizeof(response) - 1);
+    if (n <= 0 || strncmp(response, "SUCCESS:admin", 13) != 0) {
+        fprintf(stderr, "Replica: login to %s failed\n", primary_address);
+        free(payload);
+        return;
+    }
+
+    pthread_mutex_lock(&replica_mutex);
+    snprintf(request, sizeof(request), "REPLICATE:%llu:%llu",
+             (unsigned long long)replica_epoch, (unsigned long long)applied_lsn);
+    replica_connected = 1;
+    pthread_mutex_unlock(&replica_mutex);
+    write_all(sock, request, strlen(request));
+
+    // A primary that cannot serve replicas answers with an error instead of the HELLO record
+    n = recv(sock, response, 6, MSG_PEEK | MSG_WAITALL);
+    if (n == 6 && strncmp(response, "ERROR:", 6) == 0) {
+        n = read(sock, response, sizeof(response) - 1);
+        response[n > 0 ? n : 0] = '\0';
+        fprintf(stderr, "Replica: %s refused replication: %s\n", primary_address, response + 6);
+        pthread_mutex_lock(&replica_mutex);
+        replica_connected = 0;
+        pthread_mutex_unlock(&replica_mutex);
+        free(payload);
+        return;
+    }
+    printf("Replica: following %s\n", primary_address);
+
+    while (read_exact(sock, &record, sizeof(record)) == 0) {
+        if (record.length > REPLICATION_MAX_PAYLOAD ||
+            (record.length > 0 && read_exact(sock, payload, record.length) < 0)) {
+            break;
+        }
+        pthread_mutex_lock(&replica_mutex);
+        last_heard_ns = realtime_ns();
+        pthread_mutex_unlock(&replica_mutex);
+
+        if (apply_record(&record, payload, &hello_epoch) < 0) {
+            fprintf(stderr, "Replica: failed to apply record at lsn %llu\n",
+                    (unsigned long long)record.lsn);
+            break;
+        }
+    }
+
+    // A half-received snapshot is discarded; the next connection starts another
+    pthread_mutex_lock(&replica_mutex);
+    replica_connected = 0;
+    replica_syncing = 0;
+    pthread_mutex_unlock(&replica_mutex);
+    save_replica_state();
+    free(payload);
+}
+
+static void *replica_thread(void *arg) {
+    (void)arg;
+
+    while (1) {
+        int sock = connect_primary();
+
+        if (sock >= 0) {
+            follow_primary(sock);
+            close(sock);
+            printf("Replica: lost connection to %s, retrying\n", primary_address);
+        }
+        sleep(REPLICATION_RETRY_SEC);
+    }
+    return NULL;
+}
+
+int replica_start(const char *primary, const char *login) {
+    pthread_t tid;
+
+    strncpy(primary_address, primary, sizeof(primary_address) - 1);
+    strncpy(primary_login, login, sizeof(primary_login) - 1);
+    replica_mode = 1;
+    load_replica_state();
+
+    if (pthread_create(&tid, NULL, replica_thread, NULL) != 0) {
+        return -1;
+    }
+    pthread_detach(tid);
+    return 0;
+}
+
+int replication_is_replica() {
+    return replica_mode;
+}
+
+int replication_allows(const char *request) {
+    static const char *read_only[] = {
+        "LOCK_STATS", "TRACE_DUMP", "SLOW_LOG", "ADMISSION_STATS", "EXPORT", "REPLICATION_STATUS",
+        "SNAPSHOT", "ARENA_STATS", "CONNECTION_STATS", "FILTER_STATS",
+        "SEARCH_STUDENTS", "SEARCH_FACULTY"
+    };
+    size_t length = strcspn(request, ":");
+
+    if (strncmp(request, "VIEW_", 5) == 0) {
+        return 1;
+    }
+    for (size_t i = 0; i < sizeof(read_only) / sizeof(read_only[0]); i++) {
+        if (strlen(read_only[i]) == length && strncmp(request, read_only[i], length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int replication_report(char *buffer, size_t buffer_size) {
+    uint64_t now = realtime_ns();
+    size_t used;
+
+    if (replica_mode) {
+        uint64_t behind;
+        double lag_seconds = 0;
+        double heard_seconds;
+
+        pthread_mutex_lock(&replica_mutex);
+        behind = primary_lsn > applied_lsn ? primary_lsn - applied_lsn : 0;
+        if (behind > 0 && now > last_applied_ns) {
+            lag_seconds = (now - last_applied_ns) / 1e9;
+        }
+        heard_seconds = last_heard_ns ? (now - last_heard_ns) / 1e9 : -1;
+        snprintf(buffer, buffer_size,
+                 "Role: replica of %s (%s)\n"
+                 "Primary epoch: %llu\n"
+                 "Applied LSN: %llu\n"
+                 "Primary LSN: %llu\n"
+                 "Lag: %llu bytes, %.1f s\n"
+                 "Last heard from primary: %.1f s ago\n"
+                 "Snapshots received: %lu\n",
+                 primary_address,
+                 !replica_connected ? "disconnected" : replica_syncing ? "syncing" : "streaming",
+                 (unsigned long long)replica_epoch, (unsigned long long)applied_lsn,
+                 (unsigned long long)primary_lsn, (unsigned long long)behind, lag_seconds,
+                 heard_seconds, snapshots_received);
+        pthread_mutex_unlock(&replica_mutex);
+        return 0;
+    }
+
+    if (!ring) {
+        snprintf(buffer, buffer_size, "Role: standalone (replication log disabled)\n");
+        return 0;
+    }
+
+    pthread_mutex_lock(&ring_mutex);
+    used = snprintf(buffer, buffer_size,
+                    "Role: primary (epoch %llu)\n"
+                    "Log LSN: %llu (last %llu bytes retained)\n"
+                    "Replica | Sent LSN | Lag bytes | Connected s\n",
+                    (unsigned long long)log_epoch, (unsigned long long)next_lsn,
+                    (unsigned long long)(next_lsn < REPLICATION_RING_SIZE ? next_lsn : REPLICATION_RING_SIZE));
+    for (int i = 0; i < REPLICATION_MAX_REPLICAS && used < buffer_size; i++) {
+        if (replicas[i].active) {
+            used += snprintf(buffer + used, buffer_size - used, "%s | %llu | %llu | %ld\n",
+                             replicas[i].address, (unsigned long long)replicas[i].sent_lsn,
+                             (unsigned long long)(next_lsn - replicas[i].sent_lsn),
+                             (long)(time(NULL) - replicas[i].connected_at));
+        }
+    }
+    pthread_mutex_unlock(&ring_mutex);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Recent mutations kept in memory for replicas to tail; one further behind is resynced
+#define REPLICATION_RING_SIZE (16 * 1024 * 1024)
+#define REPLICATION_MAX_PAYLOAD (256 * 1024)
+#define REPLICATION_MAX_REPLICAS 8
+#define REPLICATION_STATE_FILE "data/replica.state"
+
+// Primary: start recording mutations of the data files. Until then the log calls do nothing.
+int replication_init();
+
+/**
+ * Record a write that was just made through fd (call while still holding the file lock).
+ * The offset is taken from the descriptor, so positioned and O_APPEND writes both work.
+ * @param fd Descriptor the data was written through
+ * @param path Data file the descriptor refers to
+ * @param data Bytes that were written
+ * @param length Number of bytes written
+ */
+void replication_log_write(int fd, const char *path, const void *data, size_t length);
+
+// Same for a pwrite() at offset, which leaves the descriptor where it was
+void replication_log_write_at(const char *path, const void *data, size_t length, off_t offset);
+
+// Record that a file was cut to size while the caller held its write lock
+void replication_log_truncate(const char *path, off_t size);
+
+/**
+ * Record a data file that was rewritten and renamed into place: everything from `from`
+ * onward, plus its new size. Bytes before `from` must be unchanged by the rewrite.
+ */
+void replication_log_file(const char *path, off_t from);
+
+/**
+ * Primary: turn the connection into a replication stream (REPLICATE:<epoch>:<lsn>).
+ * Resumes from lsn when this server's log still holds it, otherwise sends a snapshot first.
+ * Returns when the replica disconnects.
+ */
+void replication_serve(int client_socket, const char *params);
+
+// Primary: current end of the log (-1 when this server keeps no log)
+int replication_log_position(uint64_t *lsn);
+
+/**
+ * Apply the logged changes in [from, to) to copies of the data files in a directory
+ * (same file names). Replaying over a copy taken after `from` brings it to the state at `to`.
+ * @return 0 on success, -1 if part of the range has already been overwritten in the ring
+ */
+int replication_replay(uint64_t from, uint64_t to, const char *directory);
+
+/**
+ * Replica: apply the stream from a primary on a background thread, reconnecting as needed
+ * @param primary "host:port" of the primary
+ * @param login "username:password" of an admin account on the primary
+ * @return 0 if the thread started, -1 otherwise
+ */
+int replica_start(const char *primary, const char *login);
+
+// Non-zero when this server is a replica and rejects writes
+int replication_is_replica();
+
+// Non-zero if a request may run on a replica (reads and diagnostics only)
+int replication_allows(const char *request);
+
+// Replication role, position and lag for REPLICATION_STATUS
+int replication_report(char *buffer, size_t buffer_size);
+
+#endif // REPLICATION_H
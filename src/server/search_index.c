@@ -0,0 +1,665 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "../common/structures.h"
+#include "lock_stats.h"
+#include "slow_log.h"
+#include "arena.h"
+#include "record_index.h"
+#include "search_index.h"
+
+#define SEARCH_BATCH_ROWS 4096
+#define SEARCH_MIN_SLOTS 1024
+#define SEARCH_MAX_ROWS (1u << 30)          // posting entries keep the string number in the low bits
+#define SEARCH_STRING_TRIGRAMS 128          // more than any string field can hold
+#define SEARCH_BUILD_ROWS (64 * 1024)       // rows the startup build indexes per hold of the file lock
+#define SEARCH_VERIFY_BATCH 64
+
+// Every row of one trigram, as row_number << 2 | string
+struct PostingList {
+    uint32_t trigram;                       // 0 for an empty slot
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t sorted;                        // entries before this are ascending and distinct
+    uint32_t *entries;
+};
+
+struct SearchTable {
+    const struct HeapTable *table;
+    const char *name;
+    pthread_mutex_t mutex;
+    int built;
+    dev_t dev;
+    ino_t ino;
+    char *rows;                             // copy of the table file, to spot rows changed elsewhere
+    size_t row_count;
+    size_t row_capacity;
+    off_t heap_size;                        // heap bytes accounted for by the indexed strings
+    uint64_t changes_seen;                  // rows changed in place the index has caught up with
+    struct PostingList *lists;              // open addressing on the trigram
+    size_t list_slots;
+    size_t list_count;
+};
+
+static struct SearchTable search_tables[] = {
+    { &student_heap, "students", PTHREAD_MUTEX_INITIALIZER },
+    { &faculty_heap, "faculty", PTHREAD_MUTEX_INITIALIZER }
+};
+
+union SearchRow {
+    struct StudentRow student;
+    struct FacultyRow faculty;
+};
+
+union SearchRecord {
+    struct Student student;
+    struct Faculty faculty;
+};
+
+static struct SearchTable *search_table(const struct HeapTable *table) {
+    return table == &student_heap ? &search_tables[0] : &search_tables[1];
+}
+
+static uint32_t trigram_at(const char *text) {
+    return (uint32_t)tolower((unsigned char)text[0]) << 16 | (uint32_t)tolower((unsigned char)text[1]) << 8 |
+           (uint32_t)tolower((unsigned char)text[2]);
+}
+
+static size_t list_slot(const struct SearchTable *search, uint32_t trigram) {
+    size_t slot = (trigram * 2654435761u) & (search->list_slots - 1);
+
+    while (search->lists[slot].trigram != 0 && search->lists[slot].trigram != trigram) {
+        slot = (slot + 1) & (search->list_slots - 1);
+    }
+    return slot;
+}
+
+static struct PostingList *find_list(const struct SearchTable *search, uint32_t trigram) {
+    struct PostingList *list;
+
+    if (search->list_slots == 0) {
+        return NULL;
+    }
+    list = &search->lists[list_slot(search, trigram)];
+    return list->trigram == trigram ? list : NULL;
+}
+
+// Double the slots once they are three quarters full
+static int grow_lists(struct SearchTable *search) {
+    struct PostingList *old = search->lists;
+    size_t old_slots = search->list_slots;
+    size_t slots = old_slots ? old_slots * 2 : SEARCH_MIN_SLOTS;
+
+    if (!(search->lists = calloc(slots, sizeof(struct PostingList)))) {
+        search->lists = old;
+        return -1;
+    }
+    search->list_slots = slots;
+    for (size_t i = 0; i < old_slots; i++) {
+        if (old[i].trigram != 0) {
+            search->lists[list_slot(search, old[i].trigram)] = old[i];
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static int add_entry(struct SearchTable *search, uint32_t trigram, uint32_t entry) {
+    struct PostingList *list;
+
+    if ((search->list_count + 1) * 4 > search->list_slots * 3 && grow_lists(search) < 0) {
+        return -1;
+    }
+    list = &search->lists[list_slot(search, trigram)];
+    if (list->trigram == 0) {
+        list->trigram = trigram;
+        search->list_count++;
+    }
+    if (list->count > 0 && list->entries[list->count - 1] == entry) {
+        return 0;
+    }
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity < 1024 ? list->capacity * 2 + 4 : list->capacity + list->capacity / 2;
+        uint32_t *entries = realloc(list->entries, capacity * sizeof(uint32_t));
+
+        if (!entries) {
+            return -1;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+    if (list->sorted == list->count && (list->count == 0 || list->entries[list->count - 1] < entry)) {
+        list->sorted++;
+    }
+    list->entries[list->count++] = entry;
+    return 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    uint32_t left = *(const uint32_t *)a, right = *(const uint32_t *)b;
+
+    return left < right ? -1 : left > right;
+}
+
+// Rows updated in place are posted again out of order; sort them back in before a search
+// (dropping entries posted twice) so lists can be intersected
+static int settle_list(struct PostingList *list) {
+    uint32_t *merged;
+    uint32_t i = 0, j, count = 0;
+
+    if (list->sorted == list->count) {
+        return 0;
+    }
+    if (!(merged = malloc(list->capacity * sizeof(uint32_t)))) {
+        return -1;
+    }
+    qsort(list->entries + list->sorted, list->count - list->sorted, sizeof(uint32_t), compare_entries);
+    j = list->sorted;
+    while (i < list->sorted || j < list->count) {
+        uint32_t entry = j == list->count || (i < list->sorted && list->entries[i] < list->entries[j]) ?
+                         list->entries[i++] : list->entries[j++];
+
+        if (count == 0 || merged[count - 1] != entry) {
+            merged[count++] = entry;
+        }
+    }
+    free(list->entries);
+    list->entries = merged;
+    list->count = count;
+    list->sorted = count;
+    return 0;
+}
+
+// Post every distinct trigram of each string of a record
+static int index_record(struct SearchTable *search, size_t row_number, const void *record) {
+    const struct HeapTable *table = search->table;
+
+    for (int s = 0; s < table->string_count; s++) {
+        const char *value = (const char *)record + table->fields[s];
+        size_t length = strnlen(value, table->field_sizes[s] - 1);
+        uint32_t seen[SEARCH_STRING_TRIGRAMS];
+        int seen_count = 0;
+
+        for (size_t i = 0; i + 2 < length && seen_count < SEARCH_STRING_TRIGRAMS; i++) {
+            uint32_t trigram = trigram_at(value + i);
+            int duplicate = 0;
+
+            for (int j = 0; j < seen_count && !duplicate; j++) {
+                duplicate = seen[j] == trigram;
+            }
+            if (duplicate) {
+                continue;
+            }
+            seen[seen_count++] = trigram;
+            if (add_entry(search, trigram, (uint32_t)row_number << 2 | s) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static size_t row_heap_bytes(const struct HeapTable *table, const char *row) {
+    const uint8_t *lengths = (const uint8_t *)(row + table->row_lengths);
+    size_t bytes = 0;
+
+    for (int s = 0; s < table->string_count; s++) {
+        bytes += lengths[s];
+    }
+    return bytes;
+}
+
+static void reset_table(struct SearchTable *search) {
+    for (size_t i = 0; i < search->list_slots; i++) {
+        free(search->lists[i].entries);
+    }
+    free(search->lists);
+    free(search->rows);
+    search->lists = NULL;
+    search->list_slots = 0;
+    search->list_count = 0;
+    search->rows = NULL;
+    search->row_count = 0;
+    search->row_capacity = 0;
+    search->heap_size = 0;
+    search->built = 0;
+}
+
+// Index the rows appended since the last refresh, a batch at a time
+static int catch_up(struct SearchTable *search, int fd, int heap_fd, size_t total_rows) {
+    const struct HeapTable *table = search->table;
+    union SearchRecord *records;
+
+    if (total_rows <= search->row_count) {
+        return 0;
+    }
+    if (total_rows > SEARCH_MAX_ROWS) {
+        return -1;
+    }
+    if (total_rows > search->row_capacity) {
+        size_t capacity = search->row_capacity + search->row_capacity / 2;
+        char *rows;
+
+        if (capacity < total_rows) {
+            capacity = total_rows;
+        }
+        if (!(rows = realloc(search->rows, capacity * table->row_size))) {
+            return -1;
+        }
+        search->rows = rows;
+        search->row_capacity = capacity;
+    }
+    if (!(records = malloc(SEARCH_BATCH_ROWS * sizeof(union SearchRecord)))) {
+        return -1;
+    }
+
+    while (search->row_count < total_rows) {
+        size_t count = total_rows - search->row_count;
+        char *rows = search->rows + search->row_count * table->row_size;
+
+        if (count > SEARCH_BATCH_ROWS) {
+            count = SEARCH_BATCH_ROWS;
+        }
+        if (pread(fd, rows, count * table->row_size, search->row_count * table->row_size) !=
+                (ssize_t)(count * table->row_size) ||
+            heap_decode(table, heap_fd, rows, count, records) < 0) {
+            free(records);
+            return -1;
+        }
+        slow_log_note_scan(table->path, count);
+        for (size_t i = 0; i < count; i++) {
+            if (index_record(search, search->row_count + i, (const char *)records + i * table->record_size) < 0) {
+                free(records);
+                return -1;
+            }
+            search->heap_size += row_heap_bytes(table, rows + i * table->row_size);
+        }
+        search->row_count += count;
+    }
+    free(records);
+    return 0;
+}
+
+// Compare a row read from the file with the copy, indexing its strings if they changed
+static int compare_row(struct SearchTable *search, int heap_fd, size_t row_number, const char *row) {
+    const struct HeapTable *table = search->table;
+    size_t strings = table->row_lengths + table->string_count - table->row_offsets;
+    char *copy = search->rows + row_number * table->row_size;
+    union SearchRecord record;
+
+    if (memcmp(row + table->row_offsets, copy + table->row_offsets, strings) == 0) {
+        return 0;
+    }
+    if (heap_decode(table, heap_fd, row, 1, &record) < 0 || index_record(search, row_number, &record) < 0) {
+        return -1;
+    }
+    memcpy(copy, row, table->row_size);
+    return 0;
+}
+
+// The change log lost track of rows updated in place: compare every row with the copy
+static int resync(struct SearchTable *search, int fd, int heap_fd) {
+    const struct HeapTable *table = search->table;
+    char *rows = malloc(SEARCH_BATCH_ROWS * table->row_size);
+
+    if (!rows) {
+        return -1;
+    }
+    for (size_t first = 0; first < search->row_count; first += SEARCH_BATCH_ROWS) {
+        size_t count = search->row_count - first;
+
+        if (count > SEARCH_BATCH_ROWS) {
+            count = SEARCH_BATCH_ROWS;
+        }
+        if (pread(fd, rows, count * table->row_size, first * table->row_size) != (ssize_t)(count * table->row_size)) {
+            free(rows);
+            return -1;
+        }
+        slow_log_note_scan(table->path, count);
+        for (size_t i = 0; i < count; i++) {
+            if (compare_row(search, heap_fd, first + i, rows + i * table->row_size) < 0) {
+                free(rows);
+                return -1;
+            }
+        }
+    }
+    free(rows);
+    return 0;
+}
+
+// Reread the rows another process (or the replication stream) logged as updated in place.
+// Only when the log has overflowed and the heap grew by more than the indexed strings does
+// every row have to be compared.
+static int catch_up_changes(struct SearchTable *search, int fd, int heap_fd, off_t heap_size) {
+    const struct HeapTable *table = search->table;
+    off_t *offsets = malloc(RECORD_INDEX_CHANGE_LOG * sizeof(off_t));
+    union SearchRow row;
+    int count;
+
+    if (!offsets) {
+        return -1;
+    }
+    count = record_index_changes_since(table->path, &search->changes_seen, offsets, RECORD_INDEX_CHANGE_LOG);
+    if (count < 0) {
+        free(offsets);
+        return search->heap_size != heap_size ? resync(search, fd, heap_fd) : 0;
+    }
+    slow_log_note_scan(table->path, count);
+    for (int i = 0; i < count; i++) {
+        size_t row_number = offsets[i] / table->row_size;
+
+        // Rows past the copy were just read by catch_up()
+        if (row_number >= search->row_count) {
+            continue;
+        }
+        if (pread(fd, &row, table->row_size, row_number * table->row_size) != (ssize_t)table->row_size ||
+            compare_row(search, heap_fd, row_number, (const char *)&row) < 0) {
+            free(offsets);
+            return -1;
+        }
+    }
+    free(offsets);
+    return 0;
+}
+
+/**
+ * Bring the index up to date with the file (mutex and a lock on fd held)
+ * @param limit Most rows to index in this call
+ * @return 1 if rows are left for another call, 0 once up to date, -1 on failure
+ */
+static int refresh(struct SearchTable *search, int fd, size_t limit) {
+    const struct HeapTable *table = search->table;
+    struct stat st, heap_st;
+    size_t total_rows;
+    int heap_fd;
+    int result;
+
+    if (fstat(fd, &st) < 0) {
+        return -1;
+    }
+    if (search->built && (st.st_dev != search->dev || st.st_ino != search->ino ||
+                          (size_t)st.st_size < search->row_count * table->row_size)) {
+        reset_table(search);
+    }
+    if (!search->built) {
+        search->dev = st.st_dev;
+        search->ino = st.st_ino;
+        search->built = 1;
+        // Rows changed before now are read as they are
+        record_index_changes_since(table->path, &search->changes_seen, NULL, 0);
+    }
+    heap_fd = heap_open(table);
+    heap_st.st_size = 0;
+    if (heap_fd >= 0 && fstat(heap_fd, &heap_st) < 0) {
+        close(heap_fd);
+        return -1;
+    }
+
+    total_rows = st.st_size / table->row_size;
+    if (total_rows - search->row_count > limit) {
+        result = catch_up(search, fd, heap_fd, search->row_count + limit) < 0 ? -1 : 1;
+    } else {
+        result = catch_up(search, fd, heap_fd, total_rows);
+    }
+    // Strings left behind by earlier updates also make the heap larger than the indexed ones
+    if (result == 0) {
+        result = catch_up_changes(search, fd, heap_fd, heap_st.st_size);
+        search->heap_size = heap_st.st_size;
+    }
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    if (result < 0) {
+        reset_table(search);
+    }
+    return result;
+}
+
+// Index of the first entry at or after from that is not below entry, galloping ahead
+static uint32_t seek_entry(const struct PostingList *list, uint32_t from, uint32_t entry) {
+    uint32_t step = 1, low = from, high;
+
+    while (from + step < list->count && list->entries[from + step] < entry) {
+        low = from + step;
+        step *= 2;
+    }
+    high = from + step < list->count ? from + step : list->count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (list->entries[middle] < entry) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static int contains_folded(const char *value, const char *text) {
+    char folded[128];
+    size_t length = strnlen(value, sizeof(folded) - 1);
+
+    for (size_t i = 0; i < length; i++) {
+        folded[i] = tolower((unsigned char)value[i]);
+    }
+    folded[length] = '\0';
+    return strstr(folded, text) != NULL;
+}
+
+/**
+ * Check candidates (all of one string, none matched yet) against their current strings,
+ * marking the rows that match and collecting those past skip into page
+ * @return -1 on a read error
+ */
+static int verify_batch(struct SearchTable *search, int heap_fd, const uint32_t *candidates, size_t count,
+                        const char *text, unsigned char *matched, int *skip, size_t *page, int *filled) {
+    const struct HeapTable *table = search->table;
+    int s = candidates[0] & 3;
+    char rows[SEARCH_VERIFY_BATCH * sizeof(union SearchRow)];
+    char strings[SEARCH_VERIFY_BATCH][128];
+
+    for (size_t i = 0; i < count; i++) {
+        memcpy(rows + i * table->row_size, search->rows + (candidates[i] >> 2) * table->row_size, table->row_size);
+    }
+    if (heap_read_column(table, heap_fd, rows, count, s, strings[0], sizeof(strings[0])) < 0) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        size_t row_number = candidates[i] >> 2;
+
+        // Trigrams out of order, or a string since replaced
+        if (!contains_folded(strings[i], text)) {
+            continue;
+        }
+        matched[row_number / 8] |= 1 << (row_number % 8);
+        if (*skip > 0) {
+            (*skip)--;
+        } else {
+            page[(*filled)++] = row_number;
+        }
+    }
+    return 0;
+}
+
+int search_index_find(const struct HeapTable *table, int fd, const char *text, int skip, int max,
+                      void *records, long *candidates) {
+    struct SearchTable *search = search_table(table);
+    struct PostingList *lists[SEARCH_MAX_TEXT];
+    uint32_t cursors[SEARCH_MAX_TEXT];
+    char folded[SEARCH_MAX_TEXT + 1];
+    unsigned char *matched;
+    size_t *page;
+    size_t length = strnlen(text, SEARCH_MAX_TEXT);
+    int list_count = 0;
+    int filled = 0;
+    int result = 0;
+    int heap_fd;
+
+    *candidates = 0;
+    if (length < SEARCH_MIN_TEXT || max <= 0) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        folded[i] = tolower((unsigned char)text[i]);
+    }
+    folded[length] = '\0';
+
+    pthread_mutex_lock(&search->mutex);
+    if (refresh(search, fd, SIZE_MAX) < 0) {
+        pthread_mutex_unlock(&search->mutex);
+        return -1;
+    }
+
+    // The text's distinct trigrams, rarest first
+    for (size_t i = 0; i + 2 < length; i++) {
+        struct PostingList *list = find_list(search, trigram_at(folded + i));
+        int position = list_count;
+
+        if (!list) {
+            pthread_mutex_unlock(&search->mutex);
+            return 0;
+        }
+        for (int j = 0; j < list_count && position == list_count; j++) {
+            if (lists[j] == list) {
+                position = -1;
+            }
+        }
+        if (position < 0) {
+            continue;
+        }
+        if (settle_list(list) < 0) {
+            pthread_mutex_unlock(&search->mutex);
+            return -1;
+        }
+        for (; position > 0 && lists[position - 1]->count > list->count; position--) {
+            lists[position] = lists[position - 1];
+        }
+        lists[position] = list;
+        list_count++;
+    }
+    *candidates = lists[0]->count;
+
+    matched = arena_calloc(search->row_count / 8 + 1, 1);
+    page = arena_alloc(max * sizeof(size_t));
+    if (!matched || !page) {
+        pthread_mutex_unlock(&search->mutex);
+        return -1;
+    }
+
+    // Walk the rarest list once per string, so username hits come first, then name, then
+    // email, each in row order. Only as many candidates as the page needs are checked: an
+    // entry must be in every other list, then its string is read back a batch at a time.
+    // Rows already matched through an earlier string are passed over.
+    heap_fd = heap_open(table);
+    for (int s = 0; s < table->string_count && filled < max && result == 0; s++) {
+        uint32_t batch[SEARCH_VERIFY_BATCH];
+        size_t count = 0;
+
+        memset(cursors, 0, sizeof(cursors));
+        for (uint32_t i = 0; i < lists[0]->count && filled < max && result == 0; i++) {
+            uint32_t entry = lists[0]->entries[i];
+            size_t row_number = entry >> 2;
+            int found = 1;
+
+            if ((int)(entry & 3) != s || (matched[row_number / 8] & (1 << (row_number % 8)))) {
+                continue;
+            }
+            for (int j = 1; j < list_count && found; j++) {
+                cursors[j] = seek_entry(lists[j], cursors[j], entry);
+                found = cursors[j] < lists[j]->count && lists[j]->entries[cursors[j]] == entry;
+            }
+            if (!found) {
+                continue;
+            }
+            batch[count++] = entry;
+            if (count == SEARCH_VERIFY_BATCH || count == (size_t)(max - filled) + (size_t)skip) {
+                result = verify_batch(search, heap_fd, batch, count, folded, matched, &skip, page, &filled);
+                count = 0;
+            }
+        }
+        if (count > 0 && result == 0) {
+            result = verify_batch(search, heap_fd, batch, count, folded, matched, &skip, page, &filled);
+        }
+    }
+    pthread_mutex_unlock(&search->mutex);
+
+    // The page is decoded from the file, for the fields that change without new strings
+    slow_log_note_scan(table->path, filled);
+    for (int i = 0; i < filled && result == 0; i++) {
+        union SearchRow row;
+
+        if (pread(fd, &row, table->row_size, page[i] * table->row_size) != (ssize_t)table->row_size ||
+            heap_decode(table, heap_fd, &row, 1, (char *)records + i * table->record_size) < 0) {
+            result = -1;
+        }
+    }
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+    return result < 0 ? -1 : filled;
+}
+
+void search_index_note_update(const struct HeapTable *table, size_t row_number, const void *row,
+                              const void *record, off_t heap_base, size_t heap_length) {
+    struct SearchTable *search = search_table(table);
+
+    pthread_mutex_lock(&search->mutex);
+    // Only an index that has seen every earlier string can take this one directly
+    if (search->built && search->heap_size == heap_base && row_number < search->row_count) {
+        if (heap_length == 0 || index_record(search, row_number, record) == 0) {
+            memcpy(search->rows + row_number * table->row_size, row, table->row_size);
+            search->heap_size += heap_length;
+        } else {
+            reset_table(search);
+        }
+    }
+    pthread_mutex_unlock(&search->mutex);
+}
+
+// Index each table a slice at a time, so writers are held up for a slice, not a full scan
+static void *build_indexes(void *arg) {
+    struct timespec started, now;
+    (void)arg;
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (size_t i = 0; i < sizeof(search_tables) / sizeof(search_tables[0]); i++) {
+        struct SearchTable *search = &search_tables[i];
+        int fd = open(search->table->path, O_RDONLY);
+        int result = 1;
+
+        while (fd >= 0 && result > 0 && FLOCK(fd, LOCK_SH, search->table->path) == 0) {
+            pthread_mutex_lock(&search->mutex);
+            result = refresh(search, fd, SEARCH_BUILD_ROWS);
+            pthread_mutex_unlock(&search->mutex);
+            FLOCK(fd, LOCK_UN, search->table->path);
+        }
+        if (result < 0) {
+            fprintf(stderr, "Failed to build the %s search index\n", search->name);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    printf("Search indexes: %zu students, %zu faculty in %ld ms\n", search_tables[0].row_count,
+           search_tables[1].row_count,
+           (long)((now.tv_sec - started.tv_sec) * 1000 + (now.tv_nsec - started.tv_nsec) / 1000000));
+    return NULL;
+}
+
+void search_index_start() {
+    pthread_t builder;
+
+    if (pthread_create(&builder, NULL, build_indexes, NULL) == 0) {
+        pthread_detach(builder);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "string_heap.h"
+
+// Trigram indexes over the username, name and email of every student and faculty member,
+// kept in memory by each server process. Every case-folded three-byte window of a string
+// maps to the rows holding it; a search only reads the rows whose strings contain all of
+// the text's trigrams. Old strings stay in the posting lists until the next start, and every
+// hit is checked against the current row.
+#define SEARCH_MIN_TEXT 3
+#define SEARCH_MAX_TEXT 64
+
+/**
+ * Find the rows whose username, name or email contains text (ignoring case), best first:
+ * username matches, then name, then email, each in file order. The caller holds a lock on
+ * fd, an open descriptor of the table's file; the index first catches up with rows appended
+ * since its last use, and rereads the rows logged as changed by another process.
+ * @param skip Number of matches to pass over (the earlier pages)
+ * @param records Receives up to max matching records
+ * @param candidates Receives the number of strings holding the text's rarest trigram, an
+ *        upper bound on the number of matches
+ * @return Number of records filled, or -1 on failure
+ */
+int search_index_find(const struct HeapTable *table, int fd, const char *text, int skip, int max,
+                      void *records, long *candidates);
+
+/**
+ * Called by update_heap_record() under the table's exclusive lock, once the new row is
+ * written: index its strings. Changes the index cannot account for this way are found by
+ * the next search, from record_index_changes_since().
+ * @param row_number Position of the row in the table
+ * @param heap_base Size of the heap before the update appended heap_length bytes to it
+ */
+void search_index_note_update(const struct HeapTable *table, size_t row_number, const void *row,
+                              const void *record, off_t heap_base, size_t heap_length);
+
+// Build both indexes in the background, so the first search does not wait for a full scan
+void search_index_start();
+
+#endif // SEARCH_INDEX_H
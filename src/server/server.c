@@ -1,3 +1,4 @@
+#define _GNU_SOURCE  // struct ucred for SO_PEERCRED
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -6,10 +7,14 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/prctl.h>
+#include <time.h>
 #include <errno.h>
 #include <pthread.h>
 #include "../common/structures.h"
@@ -18,22 +23,35 @@
 #include "admin_handler.h"
 #include "student_handler.h"
 #include "faculty_handler.h"
+#include "trace.h"
+#include "slow_log.h"
+#include "replication.h"
+#include "shard.h"
+#include "snapshot.h"
+#include "record_index.h"
+#include "string_heap.h"
+#include "arena.h"
+#include "connection_pool.h"
+#include "key_filter.h"
+#include "search_index.h"
+
+// Upper bound for -P
+#define MAX_WORKERS 64
 
 // Global variables
 int server_socket = -1;
+int local_socket = -1;              // optional AF_UNIX listener, shared by pre-forked workers
+int trust_local_peers = 0;          // -T: local peers with our uid (or root) skip AUTH
 volatile sig_atomic_t running = 1;
 
-// Client session structure
-struct ClientSession {
-    int socket;
-    char username[50];
-    char role[10];
-    int authenticated;
-};
-
 // Function declarations
-int create_server_socket(int port);
-void handle_client(int client_socket);
+int run_server(int port, int worker, int slow_threshold_ms);
+int run_supervisor(int port, int worker_count, int slow_threshold_ms);
+int create_server_socket(int port, int reuse_port);
+int create_local_socket(const char *path);
+void accept_client(int listener);
+void handle_client(struct Connection *connection);
+int authenticate_peer(struct ClientSession *session);
 void *client_thread(void *arg);
 void handle_authentication(struct ClientSession *session, char *request);
 void handle_request(struct ClientSession *session, char *request);
@@ -41,72 +59,295 @@ void signal_handler(int sig);
 void cleanup_server();
 void setup_data_directory();
 void reap_zombies(int sig);
+void request_trace_dump(int sig);
 
 int main(int argc, char *argv[]) {
     int port = DEFAULT_PORT;
-    struct sockaddr_in client_addr;
-    socklen_t client_addr_len = sizeof(client_addr);
-    int client_socket;
+    int slow_threshold_ms = DEFAULT_SLOW_THRESHOLD_MS;
+    const char *primary = NULL;
+    const char *replica_login = "admin:admin123";
+    const char *local_path = NULL;
+    int shard_index = 0, shard_count = 1;
+    int worker_count = 0;
+    int opt;
+    
+    // Parse command line arguments:
+    //   server [-s slow_ms] [-R primary_host:port [-A user:password]] [-S index/count] [-P workers]
+    //          [-U socket_path [-T]] [port]
+    while ((opt = getopt(argc, argv, "s:R:A:S:P:U:T")) != -1) {
+        switch (opt) {
+            case 's':
+                slow_threshold_ms = atoi(optarg);
+                break;
+            case 'R':
+                primary = optarg;
+                break;
+            case 'A':
+                replica_login = optarg;
+                break;
+            case 'S':
+                if (sscanf(optarg, "%d/%d", &shard_index, &shard_count) != 2 ||
+                    shard_configure(shard_index, shard_count) < 0) {
+                    fprintf(stderr, "Invalid shard '%s' (expected index/count, e.g. 0/4)\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'P':
+                worker_count = atoi(optarg);
+                if (worker_count < 1 || worker_count > MAX_WORKERS) {
+                    fprintf(stderr, "Invalid worker count '%s' (1-%d)\n", optarg, MAX_WORKERS);
+                    return 1;
+                }
+                break;
+            case 'U':
+                local_path = optarg;
+                break;
+            case 'T':
+                trust_local_peers = 1;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-s slow_request_ms] [-R primary_host:port [-A admin:password]] "
+                        "[-S shard_index/shard_count] [-P workers] [-U socket_path [-T]] [port]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (optind < argc) {
+        port = atoi(argv[optind]);
+    }
+    
+    // The replication log and a replica's applier live in one process's memory
+    if (worker_count > 0 && primary) {
+        fprintf(stderr, "A replica cannot run pre-forked workers (-P with -R)\n");
+        return 1;
+    }
+    
+    signal(SIGPIPE, SIG_IGN);       // Ignore broken pipe signals
+    
+    // Setup data directory
+    setup_data_directory();
     
-    // Parse command line arguments
-    if (argc > 1) {
-        port = atoi(argv[1]);
+    // Created before any fork so every worker accepts from the same local listener
+    if (local_path) {
+        local_socket = create_local_socket(local_path);
+        if (local_socket < 0) {
+            fprintf(stderr, "Failed to listen on %s\n", local_path);
+            return 1;
+        }
+        printf("Listening on local socket %s%s\n", local_path,
+               trust_local_peers ? " (trusting same-user peers)" : "");
     }
     
+    if (shard_count > 1) {
+        printf("Serving shard %d of %d (course_id %% %d == %d)\n", shard_index, shard_count,
+               shard_count, shard_index);
+    }
+    if (worker_count > 0) {
+        // The replication log lives in one process, and each worker sees only its own writes
+        printf("Replication log disabled: pre-forked workers do not serve replicas\n");
+        int status = run_supervisor(port, worker_count, slow_threshold_ms);
+        if (local_path) {
+            unlink(local_path);
+        }
+        return status;
+    }
+    
+    // A replica applies the primary's mutation stream; a primary records it for replicas
+    if (primary) {
+        if (replica_start(primary, replica_login) < 0) {
+            fprintf(stderr, "Failed to start replication from %s\n", primary);
+            return 1;
+        }
+        printf("Running as read-only replica of %s\n", primary);
+    } else if (replication_init() < 0) {
+        fprintf(stderr, "Failed to allocate replication log\n");
+    }
+    
+    int status = run_server(port, -1, slow_threshold_ms);
+    if (local_path) {
+        unlink(local_path);
+    }
+    return status;
+}
+
+// Accept loop of a single-process server (worker -1) or of one pre-forked worker
+int run_server(int port, int worker, int slow_threshold_ms) {
+    struct pollfd listeners[2];
+    
     // Set up signal handlers
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
     signal(SIGCHLD, reap_zombies);  // Handle zombie processes
-    signal(SIGPIPE, SIG_IGN);       // Ignore broken pipe signals
     
-    // Setup data directory
-    setup_data_directory();
+    // SIGUSR1 dumps request traces; installed without SA_RESTART so accept() wakes up
+    struct sigaction trace_action;
+    memset(&trace_action, 0, sizeof(trace_action));
+    trace_action.sa_handler = request_trace_dump;
+    sigemptyset(&trace_action.sa_mask);
+    sigaction(SIGUSR1, &trace_action, NULL);
+    
+    if (worker >= 0) {
+        // Exit with the supervisor, and keep each worker's trace dump separate
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        snprintf(trace_dump_file, sizeof(trace_dump_file), "data/trace.%d.json", worker);
+        // A snapshot taken by one worker must also pause the writes of the others
+        snapshot_share_barrier();
+    }
+    
+    // Start the asynchronous slow-request log
+    if (slow_log_start(slow_threshold_ms) < 0) {
+        fprintf(stderr, "Failed to start slow request log\n");
+    }
+    
+    // Each process searches its own in-memory trigram index; build it before the first search
+    search_index_start();
     
     // Create server socket
-    server_socket = create_server_socket(port);
+    server_socket = create_server_socket(port, worker >= 0);
     if (server_socket < 0) {
         fprintf(stderr, "Failed to create server socket\n");
         return 1;
     }
     
-    printf("Academia Portal Server started on port %d\n", port);
-    printf("Press Ctrl+C to stop the server\n");
+    if (worker >= 0) {
+        printf("Worker %d (pid %d) accepting on port %d\n", worker, getpid(), port);
+    } else {
+        printf("Academia Portal Server started on port %d\n", port);
+        printf("Press Ctrl+C to stop the server\n");
+    }
+    
+    listeners[0].fd = server_socket;
+    listeners[0].events = POLLIN;
+    listeners[1].fd = local_socket;    // ignored by poll() when -1
+    listeners[1].events = POLLIN;
     
     // Main server loop
     while (running) {
-        // Accept client connections
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_addr_len);
-        if (client_socket < 0) {
+        // Wait for a connection on either listener
+        if (poll(listeners, 2, -1) < 0) {
             if (errno == EINTR) {
+                if (trace_dump_requested) {
+                    trace_dump_requested = 0;
+                    int events = trace_dump(trace_dump_file);
+                    if (events < 0) {
+                        perror("Trace dump failed");
+                    } else {
+                        printf("Wrote %d trace events to %s\n", events, trace_dump_file);
+                    }
+                }
                 continue;  // Interrupted by signal, retry
             }
-            perror("Accept failed");
+            perror("Poll failed");
             continue;
         }
         
-        printf("New client connected from %s:%d\n", 
-               inet_ntoa(client_addr.sin_addr), 
-               ntohs(client_addr.sin_port));
+        for (int i = 0; i < 2; i++) {
+            if (listeners[i].revents & POLLIN) {
+                accept_client(listeners[i].fd);
+            }
+        }
+    }
+    
+    cleanup_server();
+    return 0;
+}
+
+static pid_t spawn_worker(int worker, int port, int slow_threshold_ms) {
+    pid_t pid;
+    
+    fflush(stdout);  // or the child repeats whatever is still buffered
+    pid = fork();
+    if (pid == 0) {
+        exit(run_server(port, worker, slow_threshold_ms));
+    }
+    if (pid < 0) {
+        perror("Failed to fork worker");
+    }
+    return pid;
+}
+
+// Pre-fork mode: start the workers, restart any that die, and stop them all on shutdown.
+// Every worker binds its own SO_REUSEPORT listener, so the kernel spreads connections
+// across them; the data files are shared through the usual file locks.
+int run_supervisor(int port, int worker_count, int slow_threshold_ms) {
+    pid_t workers[MAX_WORKERS];
+    time_t started[MAX_WORKERS];
+    struct sigaction action;
+    int status;
+    
+    // No SA_RESTART: a signal must wake waitpid() below
+    memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = signal_handler;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    action.sa_handler = request_trace_dump;
+    sigaction(SIGUSR1, &action, NULL);
+    signal(SIGCHLD, SIG_DFL);
+    
+    printf("Academia Portal Server starting %d workers on port %d\n", worker_count, port);
+    printf("Press Ctrl+C to stop the server\n");
+    for (int i = 0; i < worker_count; i++) {
+        workers[i] = spawn_worker(i, port, slow_threshold_ms);
+        started[i] = time(NULL);
+    }
+    
+    while (running) {
+        pid_t pid = waitpid(-1, &status, 0);
         
-        // Create new thread for client
-        pthread_t client_tid;
-        int *client_sock_ptr = malloc(sizeof(int));
-        *client_sock_ptr = client_socket;
+        if (pid < 0) {
+            if (errno != EINTR) {
+                break;
+            }
+            if (trace_dump_requested) {
+                trace_dump_requested = 0;
+                for (int i = 0; i < worker_count; i++) {
+                    if (workers[i] > 0) {
+                        kill(workers[i], SIGUSR1);
+                    }
+                }
+            }
+            continue;
+        }
         
-        if (pthread_create(&client_tid, NULL, client_thread, client_sock_ptr) != 0) {
-            perror("Failed to create client thread");
-            close(client_socket);
-            free(client_sock_ptr);
-        } else {
-            pthread_detach(client_tid);  // Detach thread to clean up automatically
+        for (int i = 0; i < worker_count; i++) {
+            if (workers[i] != pid) {
+                continue;
+            }
+            if (WIFSIGNALED(status)) {
+                printf("Worker %d (pid %d) killed by signal %d\n", i, pid, WTERMSIG(status));
+            } else {
+                printf("Worker %d (pid %d) exited with status %d\n", i, pid, WEXITSTATUS(status));
+            }
+            workers[i] = -1;
+            if (!running) {
+                break;
+            }
+            // A worker that dies straight away (e.g. cannot bind) is not restarted in a tight loop
+            if (time(NULL) - started[i] < 1) {
+                sleep(1);
+            }
+            workers[i] = spawn_worker(i, port, slow_threshold_ms);
+            started[i] = time(NULL);
+            break;
         }
     }
     
-    cleanup_server();
+    printf("Stopping workers...\n");
+    for (int i = 0; i < worker_count; i++) {
+        if (workers[i] > 0) {
+            kill(workers[i], SIGTERM);
+        }
+    }
+    for (int i = 0; i < worker_count; i++) {
+        if (workers[i] > 0) {
+            waitpid(workers[i], &status, 0);
+        }
+    }
+    printf("Server shutdown complete.\n");
     return 0;
 }
 
-int create_server_socket(int port) {
+int create_server_socket(int port, int reuse_port) {
     int sock;
     struct sockaddr_in server_addr;
     int opt = 1;
@@ -125,6 +366,13 @@ int create_server_socket(int port) {
         return -1;
     }
     
+    // Pre-forked workers each bind the same port and the kernel balances between them
+    if (reuse_port && setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("Setsockopt SO_REUSEPORT failed");
+        close(sock);
+        return -1;
+    }
+    
     // Bind socket
     memset(&server_addr, 0, sizeof(server_addr));
     server_addr.sin_family = AF_INET;
@@ -147,31 +395,119 @@ int create_server_socket(int port) {
     return sock;
 }
 
+// Accept one pending connection and hand it to its own thread
+void accept_client(int listener) {
+    struct sockaddr_storage client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    int client_socket;
+    
+    client_socket = accept(listener, (struct sockaddr *)&client_addr, &client_addr_len);
+    if (client_socket < 0) {
+        // Pre-forked workers share the local listener, so another may have taken it
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            perror("Accept failed");
+        }
+        return;
+    }
+    
+    if (client_addr.ss_family == AF_INET) {
+        struct sockaddr_in *address = (struct sockaddr_in *)&client_addr;
+        printf("New client connected from %s:%d\n",
+               inet_ntoa(address->sin_addr),
+               ntohs(address->sin_port));
+    } else {
+        printf("New client connected on local socket\n");
+    }
+    
+    // Create new thread for client, with its state from the connection pool
+    pthread_t client_tid;
+    struct Connection *connection = connection_acquire(client_socket);
+    
+    if (!connection) {
+        fprintf(stderr, "No memory for connection state\n");
+        close(client_socket);
+        return;
+    }
+    if (pthread_create(&client_tid, NULL, client_thread, connection) != 0) {
+        perror("Failed to create client thread");
+        close(client_socket);
+        connection_release(connection);
+    } else {
+        pthread_detach(client_tid);  // Detach thread to clean up automatically
+    }
+}
+
+// Listen on an AF_UNIX stream socket for clients on the same host
+int create_local_socket(const char *path) {
+    struct sockaddr_un address;
+    int sock;
+    
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", path);
+        return -1;
+    }
+    
+    // Non-blocking so a worker that loses the race for a connection goes back to poll()
+    sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    
+    // A socket file left by a previous run would make bind() fail
+    unlink(path);
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    
+    if (bind(sock, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("Bind failed");
+        close(sock);
+        return -1;
+    }
+    
+    if (listen(sock, MAX_CLIENTS) < 0) {
+        perror("Listen failed");
+        close(sock);
+        unlink(path);
+        return -1;
+    }
+    
+    return sock;
+}
+
 void *client_thread(void *arg) {
-    int client_socket = *(int *)arg;
-    free(arg);
+    struct Connection *connection = arg;
     
-    handle_client(client_socket);
+    handle_client(connection);
+    connection_release(connection);
     
     return NULL;
 }
 
-void handle_client(int client_socket) {
-    struct ClientSession session;
-    char request[1024];
-    char response[1024];
+void handle_client(struct Connection *connection) {
+    struct ClientSession *session = &connection->session;
+    char *request = connection->request;
+    char *response = connection->response;
+    int client_socket = session->socket;
     ssize_t bytes_read;
     
-    // Initialize session
-    memset(&session, 0, sizeof(session));
-    session.socket = client_socket;
-    session.authenticated = 0;
+    // Requests allocate from the entry's arena, which the pool hands to the next connection
+    if (!connection->arena) {
+        connection->arena = arena_create();
+    }
+    arena_use(connection->arena);
+    
+    // Trusted local tools are logged in as admin from their socket credentials
+    if (trust_local_peers && authenticate_peer(session) == 0) {
+        printf("User %s authenticated as admin by peer credentials\n", session->username);
+    }
     
     // Client communication loop
     while (1) {
         // Read request from client
-        memset(request, 0, sizeof(request));
-        bytes_read = read(client_socket, request, sizeof(request) - 1);
+        memset(request, 0, CONNECTION_BUFFER_SIZE);
+        bytes_read = read(client_socket, request, CONNECTION_BUFFER_SIZE - 1);
         
         if (bytes_read <= 0) {
             if (bytes_read < 0) {
@@ -184,9 +520,15 @@ void handle_client(int client_socket) {
         request[strcspn(request, "\n")] = '\0';
         
         // Handle authentication for first request
-        if (!session.authenticated) {
+        if (!session->authenticated || (session->peer_trusted && strncmp(request, "AUTH:", 5) == 0)) {
             if (strncmp(request, "AUTH:", 5) == 0) {
-                handle_authentication(&session, request);
+                // An explicit AUTH replaces a peer-credential login, even if it fails
+                session->authenticated = 0;
+                session->peer_trusted = 0;
+                trace_request_begin(request);
+                handle_authentication(session, request);
+                trace_request_end();
+                arena_reset(request);
             } else {
                 strcpy(response, "ERROR: Not authenticated");
                 write(client_socket, response, strlen(response));
@@ -194,17 +536,27 @@ void handle_client(int client_socket) {
         } else {
             // Handle authenticated requests
             if (strcmp(request, "LOGOUT") == 0) {
-                printf("User %s logged out\n", session.username);
+                printf("User %s logged out\n", session->username);
                 strcpy(response, "SUCCESS: Logged out");
                 write(client_socket, response, strlen(response));
                 break;
+            } else if (strncmp(request, "REPLICATE:", 10) == 0 && strcmp(session->role, "admin") == 0) {
+                // The connection becomes a replication stream until the replica leaves
+                replication_serve(client_socket, request + 10);
+                break;
             } else {
-                handle_request(&session, request);
+                session->peer_trusted = 0;
+                trace_request_begin(request);
+                handle_request(session, request);
+                trace_request_end();
+                // Everything the request took from the arena is released here
+                arena_reset(request);
             }
         }
     }
     
     // Clean up
+    arena_use(NULL);
     close(client_socket);
     printf("Client disconnected\n");
 }
@@ -238,9 +590,54 @@ void handle_authentication(struct ClientSession *session, char *request) {
     write(session->socket, response, strlen(response));
 }
 
+// Log a local-socket peer in as admin if it runs as root or as the server's own user
+int authenticate_peer(struct ClientSession *session) {
+    struct sockaddr_storage address;
+    socklen_t address_len = sizeof(address);
+    struct ucred credentials;
+    socklen_t credentials_len = sizeof(credentials);
+    
+    if (getsockname(session->socket, (struct sockaddr *)&address, &address_len) < 0 ||
+        address.ss_family != AF_UNIX ||
+        getsockopt(session->socket, SOL_SOCKET, SO_PEERCRED, &credentials, &credentials_len) < 0) {
+        return -1;
+    }
+    if (credentials.uid != 0 && credentials.uid != geteuid()) {
+        return -1;
+    }
+    
+    session->authenticated = 1;
+    session->peer_trusted = 1;
+    snprintf(session->username, sizeof(session->username), "uid%u", (unsigned int)credentials.uid);
+    strcpy(session->role, "admin");
+    return 0;
+}
+
 void handle_request(struct ClientSession *session, char *request) {
+    TRACE_SCOPE("dispatch");
+    int checking = strncmp(request, "CHECK:", 6) == 0;
+    
+    // CHECK:<request> validates a user change the router is about to apply on every shard
+    if (checking) {
+        request += 6;
+        if (!shard_checkable(request)) {
+            char response[256];
+            strcpy(response, "ERROR:CHECK only applies to changes of students, faculty and credentials");
+            write(session->socket, response, strlen(response));
+            return;
+        }
+        shard_check_begin();
+    }
+    
+    slow_log_request_begin(request, session->role, session->username);
+    int barrier = snapshot_write_begin(request);
+    
     // Route request based on user role
-    if (strcmp(session->role, "admin") == 0) {
+    if (replication_is_replica() && (checking || !replication_allows(request))) {
+        char response[256];
+        strcpy(response, "ERROR:Read-only replica; send changes to the primary");
+        write(session->socket, response, strlen(response));
+    } else if (strcmp(session->role, "admin") == 0) {
         handle_admin_request(session->socket, request);
     } else if (strcmp(session->role, "student") == 0) {
         handle_student_request(session->socket, request, session->username);
@@ -251,18 +648,29 @@ void handle_request(struct ClientSession *session, char *request) {
         strcpy(response, "ERROR:Unknown role");
         write(session->socket, response, strlen(response));
     }
+    
+    snapshot_write_end(barrier);
+    slow_log_request_end();
+    shard_check_end();
 }
 
 void signal_handler(int sig) {
     printf("\nReceived signal %d. Shutting down server...\n", sig);
     running = 0;
     
-    // Close server socket to interrupt accept()
-    if (server_socket >= 0) {
-        close(server_socket);
+    // Close server socket to interrupt accept(); only once, as a second signal (Ctrl+C
+    // reaches workers along with the supervisor's SIGTERM) would close a reused descriptor
+    int listener = server_socket;
+    server_socket = -1;
+    if (listener >= 0) {
+        close(listener);
     }
 }
 
+void request_trace_dump(int sig) {
+    trace_dump_requested = 1;
+}
+
 void reap_zombies(int sig) {
     int status;
     while (waitpid(-1, &status, WNOHANG) > 0) {
@@ -277,6 +685,14 @@ void cleanup_server() {
         close(server_socket);
     }
     
+    slow_log_stop();
+    
+    // The next start loads the indexes instead of scanning every file
+    if (record_index_checkpoint() < 0) {
+        perror("Failed to write index image");
+    }
+    key_filter_close();
+    
     printf("Server shutdown complete.\n");
 }
 
@@ -307,4 +723,14 @@ void setup_data_directory() {
     } else {
         close(fd);
     }
+    
+    // Data from before the string heaps is converted once, before anything reads it
+    if (heap_upgrade(&student_heap) < 0 || heap_upgrade(&faculty_heap) < 0) {
+        fprintf(stderr, "Failed to convert student or faculty records to the string heap format\n");
+        exit(1);
+    }
+    
+    // Before any fork, so pre-forked workers start with the indexes built and share the filters
+    record_index_load();
+    key_filter_load();
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include <string.h>
+#include "shard.h"
+
+// From utils.c
+int shard_for_course(int course_id, int shard_count);
+
+static int shard_index = 0;
+static int shard_count = 1;
+
+int shard_configure(int index, int count) {
+    if (count < 1 || index < 0 || index >= count) {
+        return -1;
+    }
+    shard_index = index;
+    shard_count = count;
+    return 0;
+}
+
+int shard_next_course_id(int max_id) {
+    int id = max_id + 1;
+
+    // Every shard draws ids from its own residue class, so ids never collide across shards
+    while (shard_for_course(id, shard_count) != shard_index) {
+        id++;
+    }
+    return id;
+}
+
+int shard_checkable(const char *request) {
+    static const char *checkable[] = {
+        "ADD_STUDENT", "ADD_FACULTY", "UPDATE_STUDENT_STATUS", "UPDATE_STUDENT_NAME",
+        "UPDATE_STUDENT_EMAIL", "UPDATE_FACULTY_NAME", "UPDATE_FACULTY_EMAIL",
+        "UPDATE_FACULTY_DEPT", "CHANGE_PASSWORD", "IMPORT"
+    };
+    size_t length = strcspn(request, ":");
+
+    for (size_t i = 0; i < sizeof(checkable) / sizeof(checkable[0]); i++) {
+        if (strlen(checkable[i]) == length && strncmp(request, checkable[i], length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static __thread int check_only = 0;
+
+void shard_check_begin() {
+    check_only = 1;
+}
+
+void shard_check_end() {
+    check_only = 0;
+}
+
+int shard_check_only() {
+    return check_only;
+}
@@ -0,0 +1,31 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+// Courses, with their enrollments and waitlists, are split across shard servers by
+// shard_for_course() (utils.c). Students, faculty and credentials are whole on every shard;
+// the router sends their changes to all of them in the same order.
+
+/**
+ * Make this server one shard of a sharded deployment
+ * @param index This server's shard number, 0-based
+ * @param count Number of shards
+ * @return 0 on success, -1 if the numbers are out of range
+ */
+int shard_configure(int index, int count);
+
+// Next course id after max_id that this shard owns (max_id + 1 when not sharded)
+int shard_next_course_id(int max_id);
+
+/**
+ * Whether request (without its CHECK: prefix) is a change to the tables kept whole on
+ * every shard, which the router validates on all shards before it applies it anywhere
+ */
+int shard_checkable(const char *request);
+
+// CHECK:<request> runs the request's validation but stops before its first write, so the
+// calling thread's handlers consult shard_check_only() between shard_check_begin/end
+void shard_check_begin();
+void shard_check_end();
+int shard_check_only();
+
+#endif // SHARD_H
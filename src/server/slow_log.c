@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include "../common/constants.h"
+#include "slow_log.h"
+#include "trace.h"
+
+#define SLOW_LOG_QUEUE_SIZE 256
+#define SLOW_LOG_FIELD_LENGTH 32
+
+// Data files whose scans are attributed to a request
+enum DataFileIndex {
+    DATA_STUDENTS,
+    DATA_FACULTY,
+    DATA_COURSES,
+    DATA_ENROLLMENTS,
+    DATA_WAITLISTS,
+    DATA_CREDENTIALS,
+    DATA_FILE_COUNT
+};
+
+static const struct {
+    const char *path;
+    const char *label;
+} data_files[DATA_FILE_COUNT] = {
+    { STUDENT_FILE, "students" },
+    { FACULTY_FILE, "faculty" },
+    { COURSE_FILE, "courses" },
+    { ENROLLMENT_FILE, "enrollments" },
+    { WAITLIST_FILE, "waitlists" },
+    { CREDENTIALS_FILE, "credentials" },
+};
+
+// Everything captured about one request while it runs
+struct RequestContext {
+    char command[SLOW_LOG_FIELD_LENGTH];
+    char role[10];
+    char username[50];
+    unsigned long long start_ns;
+    unsigned long long lock_wait_ns;
+    long long scanned[DATA_FILE_COUNT];
+    time_t started_at;
+};
+
+// A slow request waiting to be written by the background thread
+struct SlowLogEntry {
+    struct RequestContext context;
+    unsigned long long latency_ns;
+};
+
+static struct SlowLogEntry slow_queue[SLOW_LOG_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static unsigned long dropped_entries = 0;
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer_thread;
+static int writer_running = 0;
+static volatile int slow_threshold_ms = -1;
+
+static __thread struct RequestContext current_context;
+static __thread int request_active = 0;
+
+// Set between slow_log_charge_begin() and slow_log_charge_end(); notes collect here
+static __thread int charging = 0;
+static __thread unsigned long long charged_lock_wait_ns;
+static __thread long long charged_scanned[DATA_FILE_COUNT];
+
+static void write_entry(int fd, struct SlowLogEntry *entry) {
+    char timestamp[32];
+    char line[512];
+    struct tm tm_info;
+    int length;
+
+    localtime_r(&entry->context.started_at, &tm_info);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm_info);
+
+    length = snprintf(line, sizeof(line),
+                      "[%s] SLOW %.1f ms command=%s role=%s user=%s lock_wait=%.1f ms scanned",
+                      timestamp, entry->latency_ns / 1e6, entry->context.command,
+                      entry->context.role, entry->context.username,
+                      entry->context.lock_wait_ns / 1e6);
+    for (int i = 0; i < DATA_FILE_COUNT && length < (int)sizeof(line); i++) {
+        length += snprintf(line + length, sizeof(line) - length, " %s=%lld",
+                           data_files[i].label, entry->context.scanned[i]);
+    }
+    if (length >= (int)sizeof(line) - 1) {
+        length = sizeof(line) - 2;
+    }
+    line[length++] = '\n';
+
+    write(fd, line, length);
+}
+
+// Background writer: drains the queue so request threads never touch the log file
+static void *slow_log_writer(void *arg) {
+    struct SlowLogEntry entry;
+    unsigned long reported_drops = 0;
+    int fd;
+
+    fd = open(SLOW_LOG_FILE, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("Cannot open slow log");
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    while (writer_running || queue_count > 0) {
+        if (queue_count == 0) {
+            pthread_cond_wait(&queue_cond, &queue_mutex);
+            continue;
+        }
+
+        entry = slow_queue[queue_head];
+        queue_head = (queue_head + 1) % SLOW_LOG_QUEUE_SIZE;
+        queue_count--;
+        unsigned long drops = dropped_entries;
+        pthread_mutex_unlock(&queue_mutex);
+
+        if (fd >= 0) {
+            if (drops != reported_drops) {
+                char note[96];
+                int length = snprintf(note, sizeof(note), "[slow log] %lu entries dropped (queue full)\n",
+                                      drops - reported_drops);
+                write(fd, note, length);
+                reported_drops = drops;
+            }
+            write_entry(fd, &entry);
+        }
+
+        pthread_mutex_lock(&queue_mutex);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+int slow_log_start(int threshold_ms) {
+    slow_threshold_ms = threshold_ms;
+
+    pthread_mutex_lock(&queue_mutex);
+    if (writer_running) {
+        pthread_mutex_unlock(&queue_mutex);
+        return 0;
+    }
+    writer_running = 1;
+    pthread_mutex_unlock(&queue_mutex);
+
+    if (pthread_create(&writer_thread, NULL, slow_log_writer, NULL) != 0) {
+        writer_running = 0;
+        return -1;
+    }
+    return 0;
+}
+
+void slow_log_stop() {
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_running) {
+        pthread_mutex_unlock(&queue_mutex);
+        return;
+    }
+    writer_running = 0;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_mutex);
+
+    pthread_join(writer_thread, NULL);
+}
+
+void slow_log_set_threshold(int threshold_ms) {
+    slow_threshold_ms = threshold_ms;
+}
+
+int slow_log_get_threshold() {
+    return slow_threshold_ms;
+}
+
+void slow_log_request_begin(const char *request, const char *role, const char *username) {
+    size_t length = strcspn(request, ":");
+
+    // Only the command name is kept; parameters may carry passwords
+    memset(&current_context, 0, sizeof(current_context));
+    if (length >= sizeof(current_context.command)) {
+        length = sizeof(current_context.command) - 1;
+    }
+    memcpy(current_context.command, request, length);
+    strncpy(current_context.role, role, sizeof(current_context.role) - 1);
+    strncpy(current_context.username, username, sizeof(current_context.username) - 1);
+    current_context.start_ns = trace_now_ns();
+    current_context.started_at = time(NULL);
+    request_active = 1;
+}
+
+void slow_log_request_end() {
+    unsigned long long latency_ns;
+    int threshold = slow_threshold_ms;
+
+    if (!request_active) {
+        return;
+    }
+    request_active = 0;
+
+    latency_ns = trace_now_ns() - current_context.start_ns;
+    if (threshold < 0 || latency_ns < (unsigned long long)threshold * 1000000ULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&queue_mutex);
+    if (!writer_running || queue_count == SLOW_LOG_QUEUE_SIZE) {
+        dropped_entries++;
+    } else {
+        struct SlowLogEntry *entry = &slow_queue[(queue_head + queue_count) % SLOW_LOG_QUEUE_SIZE];
+        entry->context = current_context;
+        entry->latency_ns = latency_ns;
+        queue_count++;
+        pthread_cond_signal(&queue_cond);
+    }
+    pthread_mutex_unlock(&queue_mutex);
+}
+
+void slow_log_note_lock_wait(unsigned long long wait_ns) {
+    if (charging) {
+        charged_lock_wait_ns += wait_ns;
+    } else if (request_active) {
+        current_context.lock_wait_ns += wait_ns;
+    }
+}
+
+void slow_log_note_scan(const char *path, long long records) {
+    if ((!request_active && !charging) || records <= 0) {
+        return;
+    }
+
+    for (int i = 0; i < DATA_FILE_COUNT; i++) {
+        if (strcmp(path, data_files[i].path) == 0) {
+            if (charging) {
+                charged_scanned[i] += records;
+            } else {
+                current_context.scanned[i] += records;
+            }
+            return;
+        }
+    }
+}
+
+struct RequestContext *slow_log_current() {
+    return request_active ? &current_context : NULL;
+}
+
+void slow_log_charge_begin() {
+    charging = 1;
+    charged_lock_wait_ns = 0;
+    memset(charged_scanned, 0, sizeof(charged_scanned));
+}
+
+void slow_log_charge_end(struct RequestContext **requests, int count) {
+    charging = 0;
+
+    // The owners are blocked until their work is marked done, so their contexts are quiet
+    for (int i = 0; i < count; i++) {
+        if (!requests[i]) {
+            continue;
+        }
+        requests[i]->lock_wait_ns += charged_lock_wait_ns;
+        for (int f = 0; f < DATA_FILE_COUNT; f++) {
+            requests[i]->scanned[f] += charged_scanned[f];
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef SLOW_LOG_H
+#define SLOW_LOG_H
+
+#define SLOW_LOG_FILE "data/slow.log"
+#define DEFAULT_SLOW_THRESHOLD_MS 500
+
+// Start the background writer; a negative threshold disables the slow log
+int slow_log_start(int threshold_ms);
+void slow_log_stop();
+void slow_log_set_threshold(int threshold_ms);
+int slow_log_get_threshold();
+
+// Request scope on the calling thread; the end call decides whether the request was slow
+void slow_log_request_begin(const char *request, const char *role, const char *username);
+void slow_log_request_end();
+
+// Called from the lock wrapper while a request is in flight
+void slow_log_note_lock_wait(unsigned long long wait_ns);
+
+/**
+ * Called next to the reads of a data file while a request is in flight
+ * @param path Data file the records belong to (segments count as ENROLLMENT_FILE)
+ * @param records Records read
+ */
+void slow_log_note_scan(const char *path, long long records);
+
+struct RequestContext;
+
+// The calling thread's request, for work another thread does on its behalf; NULL if none
+struct RequestContext *slow_log_current();
+
+/**
+ * Work done for other requests, like an admission batch applied by the course's
+ * sequencer: what is noted between the two calls goes to each of requests instead of the
+ * calling thread's own request
+ */
+void slow_log_charge_begin();
+void slow_log_charge_end(struct RequestContext **requests, int count);
+
+#endif // SLOW_LOG_H
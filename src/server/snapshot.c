@@ -0,0 +1,336 @@
+#define _GNU_SOURCE  // writer-preferring rwlock initializer
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "../common/constants.h"
+#include "snapshot.h"
+#include "replication.h"
+#include "lock_stats.h"
+#include "trace.h"
+#include "enrollment_store.h"
+#include "string_heap.h"
+#include "department.h"
+
+// Every data file, in the order handlers nest their locks (credentials before tables)
+static const char *snapshot_files[] = {
+    CREDENTIALS_FILE, STUDENT_FILE, FACULTY_FILE, COURSE_FILE, ENROLLMENT_FILE, WAITLIST_FILE,
+    ENROLLMENT_SEGMENT_FILE, STUDENT_HEAP_FILE, FACULTY_HEAP_FILE, DEPARTMENT_FILE
+};
+#define SNAPSHOT_FILE_COUNT (int)(sizeof(snapshot_files) / sizeof(snapshot_files[0]))
+
+// Writing requests hold this shared for their whole run; a snapshot takes it exclusively to
+// pick its cut. Writer preference keeps a steady stream of requests from starving the snapshot.
+static pthread_rwlock_t write_barrier = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+
+// One snapshot at a time
+static pthread_mutex_t snapshot_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Pre-forked workers share the barrier through fcntl locks on SNAPSHOT_LOCK_FILE. Those
+// belong to the process, so a worker read-locks the barrier byte while any of its threads
+// is writing. A snapshot write-locks the gate byte first: new writers in every worker stop
+// at the gate, and the barrier drains instead of staying held by a steady stream of them.
+#define SNAPSHOT_GATE_BYTE 0
+#define SNAPSHOT_BARRIER_BYTE 1
+
+// Never closed, since closing any descriptor of the file drops the process's locks on it
+static int shared_lock_fd = -1;
+static int shared_writers = 0;      // this process's writers holding the barrier byte
+static pthread_mutex_t shared_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double elapsed_ms(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int set_shared_lock(int byte, int length, short type) {
+    struct flock lock;
+
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = byte;
+    lock.l_len = length;
+    while (fcntl(shared_lock_fd, F_SETLKW, &lock) < 0) {
+        // A worker waiting at the gate still holds the barrier byte for its other threads'
+        // writes, which the kernel takes for a cycle with the snapshot; those writes end
+        if (errno == EDEADLK) {
+            usleep(1000);
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void snapshot_share_barrier() {
+    shared_lock_fd = open(SNAPSHOT_LOCK_FILE, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (shared_lock_fd < 0) {
+        perror("Failed to open " SNAPSHOT_LOCK_FILE);
+    }
+}
+
+int snapshot_write_begin(const char *request) {
+    // Whatever a replica may serve changes nothing (this includes SNAPSHOT itself)
+    if (replication_allows(request)) {
+        return 0;
+    }
+    pthread_rwlock_rdlock(&write_barrier);
+    if (shared_lock_fd >= 0) {
+        // Pass the gate, then join this process's hold on the barrier
+        set_shared_lock(SNAPSHOT_GATE_BYTE, 1, F_RDLCK);
+        set_shared_lock(SNAPSHOT_GATE_BYTE, 1, F_UNLCK);
+        pthread_mutex_lock(&shared_mutex);
+        if (shared_writers++ == 0) {
+            set_shared_lock(SNAPSHOT_BARRIER_BYTE, 1, F_RDLCK);
+        }
+        pthread_mutex_unlock(&shared_mutex);
+    }
+    return 1;
+}
+
+void snapshot_write_end(int held) {
+    if (!held) {
+        return;
+    }
+    if (shared_lock_fd >= 0) {
+        pthread_mutex_lock(&shared_mutex);
+        if (--shared_writers == 0) {
+            set_shared_lock(SNAPSHOT_BARRIER_BYTE, 1, F_UNLCK);
+        }
+        pthread_mutex_unlock(&shared_mutex);
+    }
+    pthread_rwlock_unlock(&write_barrier);
+}
+
+// Wait for in-flight writes in this process and, when pre-forked, in every worker
+static int pause_writers() {
+    pthread_rwlock_wrlock(&write_barrier);
+    if (shared_lock_fd >= 0 && (set_shared_lock(SNAPSHOT_GATE_BYTE, 1, F_WRLCK) < 0 ||
+                                set_shared_lock(SNAPSHOT_BARRIER_BYTE, 1, F_WRLCK) < 0)) {
+        set_shared_lock(SNAPSHOT_GATE_BYTE, 2, F_UNLCK);
+        pthread_rwlock_unlock(&write_barrier);
+        return -1;
+    }
+    return 0;
+}
+
+static void resume_writers() {
+    if (shared_lock_fd >= 0) {
+        set_shared_lock(SNAPSHOT_GATE_BYTE, 2, F_UNLCK);
+    }
+    pthread_rwlock_unlock(&write_barrier);
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        length -= n;
+    }
+    return 0;
+}
+
+// Copy every data file into directory. With hold_locks every file stays share-locked for
+// the whole copy; otherwise each chunk is read under its own lock and the copy is fuzzy.
+static long long copy_data_files(const char *directory, int hold_locks) {
+    char *buffer = malloc(SNAPSHOT_CHUNK_SIZE);
+    int fds[SNAPSHOT_FILE_COUNT];
+    long long total = 0;
+    TRACE_SCOPE(__func__);
+
+    if (!buffer) {
+        return -1;
+    }
+    for (int i = 0; i < SNAPSHOT_FILE_COUNT; i++) {
+        fds[i] = open(snapshot_files[i], O_RDONLY);
+        if (hold_locks && fds[i] >= 0) {
+            FLOCK(fds[i], LOCK_SH, snapshot_files[i]);
+        }
+    }
+
+    for (int i = 0; i < SNAPSHOT_FILE_COUNT && total >= 0; i++) {
+        char path[256];
+        off_t offset = 0;
+        ssize_t n;
+        int out;
+
+        // A missing file is copied as an empty one, so the snapshot is always complete
+        snprintf(path, sizeof(path), "%s/%s", directory, strrchr(snapshot_files[i], '/') + 1);
+        out = open(path, O_WRONLY | O_CREAT | O_TRUNC, i == 0 ? 0600 : 0644);
+        if (out < 0) {
+            total = -1;
+            break;
+        }
+        while (fds[i] >= 0) {
+            if (!hold_locks) {
+                FLOCK(fds[i], LOCK_SH, snapshot_files[i]);
+            }
+            n = pread(fds[i], buffer, SNAPSHOT_CHUNK_SIZE, offset);
+            if (!hold_locks) {
+                FLOCK(fds[i], LOCK_UN, snapshot_files[i]);
+            }
+            if (n <= 0) {
+                break;
+            }
+            if (write_all(out, buffer, n) < 0) {
+                total = -1;
+                break;
+            }
+            offset += n;
+            total += n;
+        }
+        close(out);
+    }
+
+    for (int i = 0; i < SNAPSHOT_FILE_COUNT; i++) {
+        if (fds[i] >= 0) {
+            if (hold_locks) {
+                FLOCK(fds[i], LOCK_UN, snapshot_files[i]);
+            }
+            close(fds[i]);
+        }
+    }
+    free(buffer);
+    return total;
+}
+
+static int fsync_path(const char *path) {
+    int fd = open(path, O_RDONLY);
+    int result;
+
+    if (fd < 0) {
+        return -1;
+    }
+    result = fsync(fd);
+    close(fd);
+    return result;
+}
+
+// Flush the finished copies and their directory; returns their total size or -1
+static long long sync_directory(const char *directory) {
+    long long total = 0;
+
+    for (int i = 0; i < SNAPSHOT_FILE_COUNT; i++) {
+        char path[256];
+        struct stat st;
+
+        snprintf(path, sizeof(path), "%s/%s", directory, strrchr(snapshot_files[i], '/') + 1);
+        if (fsync_path(path) < 0 || stat(path, &st) < 0) {
+            return -1;
+        }
+        total += st.st_size;
+    }
+    return fsync_path(directory) < 0 ? -1 : total;
+}
+
+static int valid_snapshot_name(const char *name) {
+    if (name[0] == '\0' || name[0] == '.' || strlen(name) >= 64) {
+        return 0;
+    }
+    for (const char *p = name; *p; p++) {
+        if (!isalnum((unsigned char)*p) && *p != '-' && *p != '_' && *p != '.') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int handle_snapshot(char *params, char *response) {
+    char name[64];
+    char directory[128];
+    char partial[160];
+    struct timespec started, paused;
+    struct stat st;
+    uint64_t from, to;
+    long long bytes = -1;
+    double pause_ms = 0;
+    const char *method = "log replay";
+    TRACE_SCOPE(__func__);
+
+    if (strcmp(params, "now") == 0) {
+        time_t now = time(NULL);
+        strftime(name, sizeof(name), "%Y%m%d-%H%M%S", localtime(&now));
+    } else if (valid_snapshot_name(params)) {
+        strcpy(name, params);
+    } else {
+        strcpy(response, "ERROR:Invalid snapshot name (SNAPSHOT:now or SNAPSHOT:<letters, digits, -_.>)");
+        return -1;
+    }
+
+    snprintf(directory, sizeof(directory), "%s/%s", SNAPSHOT_DIR, name);
+    snprintf(partial, sizeof(partial), "%s.partial", directory);
+    pthread_mutex_lock(&snapshot_mutex);
+    clock_gettime(CLOCK_MONOTONIC, &started);
+
+    mkdir(SNAPSHOT_DIR, 0755);
+    if (stat(directory, &st) == 0) {
+        pthread_mutex_unlock(&snapshot_mutex);
+        sprintf(response, "ERROR:Snapshot %s already exists", directory);
+        return -1;
+    }
+    if (mkdir(partial, 0755) < 0 && errno != EEXIST) {
+        pthread_mutex_unlock(&snapshot_mutex);
+        sprintf(response, "ERROR:Cannot create %s: %s", partial, strerror(errno));
+        return -1;
+    }
+
+    // Copy while writes continue, then cut at a moment with no write request in flight and
+    // replay the log up to the cut. The copy only ever runs ahead of `from`, never of `to`.
+    if (replication_log_position(&from) == 0) {
+        bytes = copy_data_files(partial, 0);
+
+        clock_gettime(CLOCK_MONOTONIC, &paused);
+        if (pause_writers() < 0) {
+            bytes = -1;
+        } else {
+            replication_log_position(&to);
+            resume_writers();
+        }
+        pause_ms = elapsed_ms(&paused);
+
+        if (bytes >= 0 && replication_replay(from, to, partial) < 0) {
+            bytes = -1;          // too many writes during the copy; the ring wrapped
+        }
+    }
+
+    // No log, or it could not cover the copy: copy with writers paused
+    if (bytes < 0) {
+        method = "writers paused";
+        clock_gettime(CLOCK_MONOTONIC, &paused);
+        if (pause_writers() == 0) {
+            bytes = copy_data_files(partial, 1);
+            resume_writers();
+        }
+        pause_ms = elapsed_ms(&paused);
+    }
+
+    if (bytes >= 0) {
+        bytes = sync_directory(partial);
+    }
+    if (bytes < 0 || rename(partial, directory) < 0) {
+        pthread_mutex_unlock(&snapshot_mutex);
+        sprintf(response, "ERROR:Snapshot failed: %s (partial copy left in %s)", strerror(errno), partial);
+        return -1;
+    }
+    fsync_path(SNAPSHOT_DIR);
+    pthread_mutex_unlock(&snapshot_mutex);
+
+    sprintf(response, "SUCCESS:Snapshot %s: %d files, %lld bytes in %.1f ms; writers paused %.2f ms (%s)",
+            directory, SNAPSHOT_FILE_COUNT, bytes, elapsed_ms(&started), pause_ms, method);
+    return 0;
+}
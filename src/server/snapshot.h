@@ -0,0 +1,31 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// Completed snapshots are directories here, named by SNAPSHOT:<name> or by the time taken
+#define SNAPSHOT_DIR "data/snapshots"
+#define SNAPSHOT_CHUNK_SIZE (256 * 1024)
+#define SNAPSHOT_LOCK_FILE "data/snapshot.lock"
+
+// Pre-forked workers: extend the barrier to every process through SNAPSHOT_LOCK_FILE
+void snapshot_share_barrier();
+
+/**
+ * Called around every request: requests that may write hold the snapshot barrier shared,
+ * so a snapshot can pick a moment when no change is half done.
+ * @return Non-zero if the barrier was taken; pass it to snapshot_write_end()
+ */
+int snapshot_write_begin(const char *request);
+void snapshot_write_end(int held);
+
+/**
+ * Point-in-time copy of every data file (SNAPSHOT:<name|now>).
+ * With the replication log, files are copied while writes continue and the log is replayed
+ * over the copy up to a cut taken under the barrier, so writers pause only for the cut.
+ * Without it (pre-forked workers, replicas) writers are paused for the whole copy.
+ * @param params Snapshot name, or "now" for a timestamp
+ * @param response Directory, bytes, duration and writer pause
+ * @return 0 on success, -1 on failure
+ */
+int handle_snapshot(char *params, char *response);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "../common/constants.h"
+#include "string_heap.h"
+#include "department.h"
+
+#define HEAP_READ_GAP 4096              // strings this close together are read in one go
+#define HEAP_READ_SPAN (1024 * 1024)
+#define HEAP_UPGRADE_RECORDS 4096
+
+#define FIELD_SIZE(type, field) sizeof(((type *)0)->field)
+
+static const size_t student_fields[] = {
+    offsetof(struct Student, username), offsetof(struct Student, name), offsetof(struct Student, email)
+};
+static const size_t student_field_sizes[] = {
+    FIELD_SIZE(struct Student, username), FIELD_SIZE(struct Student, name), FIELD_SIZE(struct Student, email)
+};
+
+// The department is not a heap string: rows refer to the department dictionary instead
+static const size_t faculty_fields[] = {
+    offsetof(struct Faculty, username), offsetof(struct Faculty, name), offsetof(struct Faculty, email)
+};
+static const size_t faculty_field_sizes[] = {
+    FIELD_SIZE(struct Faculty, username), FIELD_SIZE(struct Faculty, name), FIELD_SIZE(struct Faculty, email)
+};
+
+static void decode_student(void *record, const void *row) {
+    struct Student *student = record;
+    const struct StudentRow *student_row = row;
+
+    student->id = student_row->id;
+    student->active = student_row->active;
+}
+
+static int encode_student(void *row, const void *record) {
+    struct StudentRow *student_row = row;
+    const struct Student *student = record;
+
+    student_row->id = student->id;
+    student_row->active = student->active;
+    return 0;
+}
+
+static void decode_faculty(void *record, const void *row) {
+    struct Faculty *faculty = record;
+    const struct FacultyRow *faculty_row = row;
+
+    faculty->id = faculty_row->id;
+    department_name(faculty_row->department, faculty->department, sizeof(faculty->department));
+}
+
+// Servers intern new departments beforehand so they can be replicated; here they only
+// get added by the offline conversion
+static int encode_faculty(void *row, const void *record) {
+    struct FacultyRow *faculty_row = row;
+    const struct Faculty *faculty = record;
+    char department[MAX_DEPARTMENT_LENGTH];
+
+    snprintf(department, sizeof(department), "%s", faculty->department);
+    faculty_row->id = faculty->id;
+    faculty_row->department = department_intern(department, NULL);
+    return faculty_row->department < 0 ? -1 : 0;
+}
+
+const struct HeapTable student_heap = {
+    STUDENT_FILE, STUDENT_HEAP_FILE, sizeof(struct StudentRow), sizeof(struct Student), 3,
+    offsetof(struct StudentRow, offsets), offsetof(struct StudentRow, lengths),
+    student_fields, student_field_sizes, decode_student, encode_student
+};
+
+const struct HeapTable faculty_heap = {
+    FACULTY_FILE, FACULTY_HEAP_FILE, sizeof(struct FacultyRow), sizeof(struct Faculty), 3,
+    offsetof(struct FacultyRow, offsets), offsetof(struct FacultyRow, lengths),
+    faculty_fields, faculty_field_sizes, decode_faculty, encode_faculty
+};
+
+// One string to copy out of the heap into a NUL-terminated buffer
+struct HeapFetch {
+    uint32_t offset;
+    uint32_t length;
+    char *dest;
+    size_t size;
+};
+
+static uint32_t string_offset(const struct HeapTable *table, const void *row, int string) {
+    uint32_t offset;
+    memcpy(&offset, (const char *)row + table->row_offsets + string * sizeof(uint32_t), sizeof(offset));
+    return offset;
+}
+
+static uint32_t string_length(const struct HeapTable *table, const void *row, int string) {
+    return ((const uint8_t *)row)[table->row_lengths + string];
+}
+
+static void set_string(const struct HeapTable *table, void *row, int string, uint32_t offset, uint32_t length) {
+    memcpy((char *)row + table->row_offsets + string * sizeof(uint32_t), &offset, sizeof(offset));
+    ((uint8_t *)row)[table->row_lengths + string] = (uint8_t)length;
+}
+
+static int read_fully(int fd, void *buffer, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = pread(fd, buffer, length, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;       // a string past the end of the heap is as bad as a failed read
+        }
+        buffer = (char *)buffer + n;
+        length -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+static int by_offset(const void *a, const void *b) {
+    const struct HeapFetch *x = a, *y = b;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+// Sort the strings by position and read each run of nearby ones with one pread
+static int fetch_strings(int heap_fd, struct HeapFetch *fetch, size_t count) {
+    char *buffer = NULL;
+    size_t buffer_size = 0;
+    int result = 0;
+
+    qsort(fetch, count, sizeof(*fetch), by_offset);
+    for (size_t first = 0, last; first < count && result == 0; first = last) {
+        uint64_t start = fetch[first].offset;
+        uint64_t end = start + fetch[first].length;
+
+        for (last = first + 1; last < count; last++) {
+            uint64_t string_end = (uint64_t)fetch[last].offset + fetch[last].length;
+            if (fetch[last].offset > end + HEAP_READ_GAP || string_end - start > HEAP_READ_SPAN) {
+                break;
+            }
+            if (string_end > end) {
+                end = string_end;
+            }
+        }
+
+        if (end - start > buffer_size) {
+            char *grown = realloc(buffer, end - start);
+            if (!grown) {
+                result = -1;
+                break;
+            }
+            buffer = grown;
+            buffer_size = end - start;
+        }
+        if (end > start && read_fully(heap_fd, buffer, end - start, start) < 0) {
+            result = -1;
+            break;
+        }
+        for (size_t i = first; i < last; i++) {
+            size_t length = fetch[i].length < fetch[i].size ? fetch[i].length : fetch[i].size - 1;
+            memcpy(fetch[i].dest, buffer + (fetch[i].offset - start), length);
+            fetch[i].dest[length] = '\0';
+        }
+    }
+    free(buffer);
+    return result;
+}
+
+int heap_open(const struct HeapTable *table) {
+    return open(table->heap_path, O_RDONLY);
+}
+
+int heap_decode(const struct HeapTable *table, int heap_fd, const void *rows, size_t count, void *records) {
+    struct HeapFetch *fetch;
+    size_t fetches = 0;
+    int result;
+
+    if (count == 0) {
+        return 0;
+    }
+    fetch = malloc(count * table->string_count * sizeof(*fetch));
+    if (!fetch) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *row = (const char *)rows + i * table->row_size;
+        char *record = (char *)records + i * table->record_size;
+
+        memset(record, 0, table->record_size);
+        table->decode_fixed(record, row);
+        for (int s = 0; s < table->string_count; s++) {
+            fetch[fetches].offset = string_offset(table, row, s);
+            fetch[fetches].length = string_length(table, row, s);
+            fetch[fetches].dest = record + table->fields[s];
+            fetch[fetches].size = table->field_sizes[s];
+            fetches++;
+        }
+    }
+    result = heap_fd >= 0 ? fetch_strings(heap_fd, fetch, fetches) : -1;
+    free(fetch);
+    return result;
+}
+
+int heap_read_column(const struct HeapTable *table, int heap_fd, const void *rows, size_t count,
+                     int string, char *out, size_t stride) {
+    struct HeapFetch *fetch;
+    int result;
+
+    if (count == 0) {
+        return 0;
+    }
+    fetch = malloc(count * sizeof(*fetch));
+    if (!fetch) {
+        return -1;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const char *row = (const char *)rows + i * table->row_size;
+
+        fetch[i].offset = string_offset(table, row, string);
+        fetch[i].length = string_length(table, row, string);
+        fetch[i].dest = out + i * stride;
+        fetch[i].size = stride;
+    }
+    result = heap_fd >= 0 ? fetch_strings(heap_fd, fetch, count) : -1;
+    free(fetch);
+    return result;
+}
+
+long heap_read_records(const struct HeapTable *table, int fd, int heap_fd, void *records, size_t max) {
+    char *rows = malloc(max * table->row_size);
+    ssize_t n;
+    long count;
+
+    if (!rows) {
+        return -1;
+    }
+    n = read(fd, rows, max * table->row_size);
+    count = n < 0 ? -1 : n / (ssize_t)table->row_size;
+    if (count > 0 && heap_decode(table, heap_fd, rows, count, records) < 0) {
+        count = -1;
+    }
+    free(rows);
+    return count;
+}
+
+int heap_encode(const struct HeapTable *table, const void *records, size_t count, uint64_t heap_base,
+                const void *previous, const void *previous_row, void *rows, char **heap, size_t *heap_length) {
+    size_t total = 0, used = 0;
+
+    // Size the strings first so the heap buffer is allocated once
+    for (size_t i = 0; i < count; i++) {
+        const char *record = (const char *)records + i * table->record_size;
+        for (int s = 0; s < table->string_count; s++) {
+            total += strnlen(record + table->fields[s], table->field_sizes[s] - 1);
+        }
+    }
+    *heap = NULL;
+    *heap_length = 0;
+    if (heap_base + total > UINT32_MAX) {
+        return -1;
+    }
+    if (total > 0 && !(*heap = malloc(total))) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        const char *record = (const char *)records + i * table->record_size;
+        char *row = (char *)rows + i * table->row_size;
+
+        memset(row, 0, table->row_size);
+        if (table->encode_fixed(row, record) < 0) {
+            free(*heap);
+            *heap = NULL;
+            return -1;
+        }
+        for (int s = 0; s < table->string_count; s++) {
+            const char *value = record + table->fields[s];
+            size_t length = strnlen(value, table->field_sizes[s] - 1);
+
+            if (previous && strncmp((const char *)previous + table->fields[s], value, table->field_sizes[s]) == 0) {
+                set_string(table, row, s, string_offset(table, previous_row, s),
+                           string_length(table, previous_row, s));
+                continue;
+            }
+            memcpy(*heap + used, value, length);
+            set_string(table, row, s, heap_base + used, length);
+            used += length;
+        }
+    }
+    *heap_length = used;
+    if (used == 0) {
+        free(*heap);
+        *heap = NULL;
+    }
+    return 0;
+}
+
+static int write_fully(int fd, const void *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        data = (const char *)data + n;
+        length -= n;
+    }
+    return 0;
+}
+
+// Old records -> rows.upgrade and heap.upgrade, a batch at a time
+static long convert_records(const struct HeapTable *table, int in, int rows_fd, int heap_fd) {
+    char *records = malloc(HEAP_UPGRADE_RECORDS * table->record_size);
+    char *rows = malloc(HEAP_UPGRADE_RECORDS * table->row_size);
+    uint64_t heap_size = 0;
+    long converted = 0;
+    ssize_t n = 0;
+
+    while (records && rows && (n = read(in, records, HEAP_UPGRADE_RECORDS * table->record_size)) > 0) {
+        size_t count = n / table->record_size;
+        char *heap;
+        size_t heap_length;
+
+        // Old records were not always zero-filled past the NUL
+        for (size_t i = 0; i < count; i++) {
+            for (int s = 0; s < table->string_count; s++) {
+                records[i * table->record_size + table->fields[s] + table->field_sizes[s] - 1] = '\0';
+            }
+        }
+        if (n % table->record_size ||
+            heap_encode(table, records, count, heap_size, NULL, NULL, rows, &heap, &heap_length) < 0) {
+            n = -1;
+            break;
+        }
+        if (write_fully(heap_fd, heap, heap_length) < 0 || write_fully(rows_fd, rows, count * table->row_size) < 0) {
+            free(heap);
+            n = -1;
+            break;
+        }
+        free(heap);
+        heap_size += heap_length;
+        converted += count;
+    }
+    free(records);
+    free(rows);
+    return !records || !rows || n < 0 ? -1 : converted;
+}
+
+long heap_upgrade(const struct HeapTable *table) {
+    char rows_tmp[256], heap_tmp[256];
+    struct stat st;
+    long converted = -1;
+    int in, rows_fd, heap_fd;
+
+    snprintf(rows_tmp, sizeof(rows_tmp), "%s.upgrade", table->path);
+    snprintf(heap_tmp, sizeof(heap_tmp), "%s.upgrade", table->heap_path);
+
+    // The heap is renamed into place first: with it there, only the rows were left to move
+    if (access(rows_tmp, F_OK) == 0) {
+        if (access(table->heap_path, F_OK) == 0) {
+            return rename(rows_tmp, table->path) == 0 ? 0 : -1;
+        }
+        unlink(rows_tmp);
+        unlink(heap_tmp);
+    }
+    if (stat(table->path, &st) < 0 || st.st_size == 0 || access(table->heap_path, F_OK) == 0) {
+        return 0;
+    }
+    if (st.st_size % table->record_size) {
+        fprintf(stderr, "%s has no string heap and is not in the old record format\n", table->path);
+        return -1;
+    }
+
+    in = open(table->path, O_RDONLY);
+    rows_fd = open(rows_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    heap_fd = open(heap_tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (in >= 0 && rows_fd >= 0 && heap_fd >= 0) {
+        converted = convert_records(table, in, rows_fd, heap_fd);
+    }
+    if (converted >= 0 && (fsync(rows_fd) < 0 || fsync(heap_fd) < 0)) {
+        converted = -1;
+    }
+    if (in >= 0) {
+        close(in);
+    }
+    if (rows_fd >= 0) {
+        close(rows_fd);
+    }
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+
+    if (converted < 0 || rename(heap_tmp, table->heap_path) < 0) {
+        perror(table->path);
+        unlink(rows_tmp);
+        unlink(heap_tmp);
+        return -1;
+    }
+    if (rename(rows_tmp, table->path) < 0) {
+        perror(table->path);     // finished by the next start
+        return -1;
+    }
+    printf("Converted %ld records of %s to rows and a string heap\n", converted, table->path);
+    return converted;
+}
@@ -0,0 +1,96 @@
+#ifndef STRING_HEAP_H
+#define STRING_HEAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "../common/structures.h"
+
+// Student and faculty strings, each stored once at its real length. The heaps are only
+// appended to, and are guarded by the lock on their table file.
+#define STUDENT_HEAP_FILE "data/students.str"
+#define FACULTY_HEAP_FILE "data/faculty.str"
+
+// Rows of students.dat and faculty.dat: the fixed-size fields inline, and each string as
+// its offset and length in the table's heap. The handlers work with the decoded
+// struct Student / struct Faculty from structures.h.
+struct StudentRow {
+    int32_t id;
+    int32_t active;
+    uint32_t offsets[3];        // username, name, email
+    uint8_t lengths[3];
+    uint8_t reserved;
+};
+
+struct FacultyRow {
+    int32_t id;
+    int32_t department;         // code in the department dictionary (department.h)
+    uint32_t offsets[3];        // username, name, email
+    uint8_t lengths[3];
+    uint8_t reserved;
+};
+
+// Every row keeps its username first
+#define HEAP_USERNAME 0
+
+// How a table's rows map onto its records
+struct HeapTable {
+    const char *path;
+    const char *heap_path;
+    size_t row_size;
+    size_t record_size;
+    int string_count;
+    size_t row_offsets;                 // offsetof(row, offsets)
+    size_t row_lengths;                 // offsetof(row, lengths)
+    const size_t *fields;               // offset of each string's char array in the record
+    const size_t *field_sizes;
+    void (*decode_fixed)(void *record, const void *row);
+    int (*encode_fixed)(void *row, const void *record);      // -1 fails the encoding
+};
+
+extern const struct HeapTable student_heap;
+extern const struct HeapTable faculty_heap;
+
+// Open a table's heap for reading; -1 if there is none yet
+int heap_open(const struct HeapTable *table);
+
+/**
+ * Decode rows into records. Strings of neighbouring rows are usually adjacent in the
+ * heap, so they are fetched with a single read where possible.
+ * @return 0, or -1 on a read error or a string outside the heap
+ */
+int heap_decode(const struct HeapTable *table, int heap_fd, const void *rows, size_t count, void *records);
+
+/**
+ * Fetch one string of every row, NUL-terminated, into out + i * stride (stride bytes each)
+ * @return 0, or -1 on a read error or a string outside the heap
+ */
+int heap_read_column(const struct HeapTable *table, int heap_fd, const void *rows, size_t count,
+                     int string, char *out, size_t stride);
+
+/**
+ * Read up to max rows from fd's current position and decode them.
+ * @return Number of records, 0 at the end of the file, -1 on failure
+ */
+long heap_read_records(const struct HeapTable *table, int fd, int heap_fd, void *records, size_t max);
+
+/**
+ * Encode records as rows whose strings are placed in a heap buffer that will be written at
+ * heap_base. With `previous` (count 1), strings equal to those of the record previous_row
+ * decodes to keep their place and are not added again.
+ * @param heap Receives the malloc'd strings to append (NULL if there are none)
+ * @param heap_length Receives their length
+ * @return 0, or -1 when out of memory, the heap would outgrow 4 GB or a department cannot
+ *         be interned
+ */
+int heap_encode(const struct HeapTable *table, const void *records, size_t count, uint64_t heap_base,
+                const void *previous, const void *previous_row, void *rows, char **heap, size_t *heap_length);
+
+/**
+ * Called from setup_data_directory(): rewrite a table still in the old fixed-width record
+ * format (rows but no heap file) as rows and a heap.
+ * @return Number of records converted, or -1 on failure
+ */
+long heap_upgrade(const struct HeapTable *table);
+
+#endif // STRING_HEAP_H
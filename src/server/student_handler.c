@@ -10,12 +10,16 @@
 #include <time.h>
 #include "../common/structures.h"
 #include "../common/constants.h"
+#include "lock_stats.h"
+#include "trace.h"
 #include "auth.h"
 #include "file_ops.h"
 
 // Function declarations
 int handle_enroll_course(char *request, char *response, const char *username);
+int handle_enroll_courses(char *request, char *response, const char *username);
 int handle_unenroll_course(char *request, char *response, const char *username);
+int handle_join_waitlist(char *request, char *response, const char *username);
 int handle_view_enrolled_courses(char *request, char *response, const char *username);
 
 int get_student_id_by_username(const char *username);
@@ -37,18 +41,30 @@ int get_enrolled_courses(int student_id, char *buffer, size_t buffer_size);
 #include "../common/constants.h"
 #include "auth.h"  // Include auth.h for handle_password_change
 #include "file_ops.h"
+#include "admission.h"
+#include "enrollment_store.h"
+#include "arena.h"
+
+// Most courses one ENROLL_COURSES request may list
+#define MAX_ENROLL_COURSES 16
 
 // NO handle_password_change implementation here - it's in auth.c
 
 // Main student handler function
 int handle_student_request(int client_socket, char *request, const char *username) {
-    char response[1024];
-    char command[256];
-    char params[768];
+    char *response = arena_alloc(ARENA_RESPONSE_SIZE);
+    char *command = arena_alloc(ARENA_COMMAND_SIZE);
+    char *params = arena_alloc(ARENA_PARAMS_SIZE);
+    TRACE_SCOPE(__func__);
     
+    if (!response || !command || !params) {
+        write(client_socket, "ERROR:Out of memory", 19);
+        return -1;
+    }
+
     // Parse the request
-    if (sscanf(request, "%[^:]:%[^\n]", command, params) != 2) {
-        strcpy(command, request); // Handle commands without parameters
+    if (sscanf(request, "%255[^:]:%767[^\n]", command, params) != 2) {
+        snprintf(command, ARENA_COMMAND_SIZE, "%s", request); // Handle commands without parameters
         params[0] = '\0';
     }
     
@@ -57,10 +73,18 @@ int handle_student_request(int client_socket, char *request, const char *usernam
         handle_enroll_course(params, response, username);
         write(client_socket, response, strlen(response));
         return 0;
+    } else if (strcmp(command, "ENROLL_COURSES") == 0) {
+        handle_enroll_courses(params, response, username);
+        write(client_socket, response, strlen(response));
+        return 0;
     } else if (strcmp(command, "UNENROLL_COURSE") == 0) {
         handle_unenroll_course(params, response, username);
         write(client_socket, response, strlen(response));
         return 0;
+    } else if (strcmp(command, "JOIN_WAITLIST") == 0) {
+        handle_join_waitlist(params, response, username);
+        write(client_socket, response, strlen(response));
+        return 0;
     } else if (strcmp(command, "VIEW_ENROLLED_COURSES") == 0) {
         handle_view_enrolled_courses(params, response, username);
         write(client_socket, response, strlen(response));
@@ -77,11 +101,89 @@ int handle_student_request(int client_socket, char *request, const char *usernam
 
 // Rest of your student_handler.c functions remain the same...
 
+// Sequencer step for ENROLL_COURSE: one course read, one duplicate scan and one append
+// for the whole run of queued enrolls, with seats handed out in queue order
+static void apply_enroll_batch(int course_id, struct AdmissionTicket **batch, int count) {
+    struct Course course;
+    struct Enrollment enrollments[ADMISSION_MAX_BATCH];
+    struct AdmissionTicket *accepted[ADMISSION_MAX_BATCH];
+    int student_ids[ADMISSION_MAX_BATCH];
+    int enrolled[ADMISSION_MAX_BATCH];
+    int accepted_count = 0;
+    
+    // Read course details
+    if (read_course_by_id(course_id, &course) < 0) {
+        for (int i = 0; i < count; i++) {
+            strcpy(batch[i]->response, "ERROR:Course not found");
+            batch[i]->result = -1;
+        }
+        return;
+    }
+    
+    // Check which students are already enrolled
+    for (int i = 0; i < count; i++) {
+        student_ids[i] = batch[i]->student_id;
+    }
+    find_course_enrollments(course_id, student_ids, count, enrolled);
+    
+    for (int i = 0; i < count; i++) {
+        int duplicate = enrolled[i];
+        
+        // The same student may be queued twice in one batch
+        for (int j = 0; j < accepted_count && !duplicate; j++) {
+            duplicate = accepted[j]->student_id == batch[i]->student_id;
+        }
+        
+        if (duplicate) {
+            strcpy(batch[i]->response, "ERROR:Already enrolled in this course");
+            batch[i]->result = -1;
+        } else if (course.enrolled_count >= course.max_seats) {
+            strcpy(batch[i]->response, "ERROR:Course is full (JOIN_WAITLIST to queue for a seat)");
+            batch[i]->result = -1;
+        } else {
+            enrollments[accepted_count].student_id = batch[i]->student_id;
+            enrollments[accepted_count].course_id = course_id;
+            enrollments[accepted_count].enrollment_date = time(NULL);
+            accepted[accepted_count++] = batch[i];
+            course.enrolled_count++;
+        }
+    }
+    
+    if (accepted_count == 0) {
+        return;
+    }
+    
+    // Add enrollments
+    if (add_enrollments(enrollments, accepted_count) < 0) {
+        for (int i = 0; i < accepted_count; i++) {
+            strcpy(accepted[i]->response, "ERROR:Failed to enroll");
+            accepted[i]->result = -1;
+        }
+        return;
+    }
+    
+    // Update course enrollment count
+    if (update_course(&course) < 0) {
+        // Rollback enrollments if course update fails
+        for (int i = 0; i < accepted_count; i++) {
+            remove_enrollment(accepted[i]->student_id, course_id);
+            strcpy(accepted[i]->response, "ERROR:Failed to update course");
+            accepted[i]->result = -1;
+        }
+        return;
+    }
+    
+    for (int i = 0; i < accepted_count; i++) {
+        sprintf(accepted[i]->response, "SUCCESS:Enrolled in course %s (%s), queue position %d",
+                course.course_code, course.course_name, accepted[i]->position);
+        accepted[i]->result = 0;
+    }
+}
+
 int handle_enroll_course(char *params, char *response, const char *username) {
     int course_id;
     int student_id;
-    struct Course course;
-    struct Enrollment enrollment;
+    struct AdmissionTicket ticket;
     
     // Parse course ID
     if (sscanf(params, "%d", &course_id) != 1) {
@@ -108,54 +210,224 @@ int handle_enroll_course(char *params, char *response, const char *username) {
         return -1;
     }
     
-    // Check if already enrolled
-    if (check_enrollment_exists(student_id, course_id)) {
-        strcpy(response, "ERROR:Already enrolled in this course");
+    // Seat checks and the enrollment itself run in the course's admission queue
+    ticket.student_id = student_id;
+    ticket.apply = apply_enroll_batch;
+    ticket.response = response;
+    ticket.result = -1;
+    return admission_submit(course_id, &ticket);
+}
+
+static int compare_course_ids(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+// The all-or-none part of ENROLL_COURSES; caller holds every listed course's sequencer role
+static int enroll_courses_locked(int student_id, const int *course_ids, int count, char *response) {
+    struct Course courses[MAX_ENROLL_COURSES];
+    struct Enrollment enrollments[MAX_ENROLL_COURSES];
+    int found[MAX_ENROLL_COURSES];
+    int enrolled[MAX_ENROLL_COURSES];
+    
+    // One scan of each file covers every listed course
+    if (read_courses_by_ids(course_ids, count, courses, found) < 0 ||
+        find_student_enrollments(student_id, course_ids, count, enrolled) < 0) {
+        strcpy(response, "ERROR:Cannot read course data");
         return -1;
     }
     
-    // Read course details
-    if (read_course_by_id(course_id, &course) < 0) {
-        strcpy(response, "ERROR:Course not found");
-        return -1;
+    // Every course must accept the student before anything is written
+    for (int i = 0; i < count; i++) {
+        if (!found[i]) {
+            sprintf(response, "ERROR:Course %d not found", course_ids[i]);
+            return -1;
+        }
+        if (enrolled[i]) {
+            sprintf(response, "ERROR:Already enrolled in course %s", courses[i].course_code);
+            return -1;
+        }
+        if (courses[i].enrolled_count >= courses[i].max_seats) {
+            sprintf(response, "ERROR:Course %s is full", courses[i].course_code);
+            return -1;
+        }
     }
     
-    // Check if course has available seats
-    if (course.enrolled_count >= course.max_seats) {
-        strcpy(response, "ERROR:Course is full");
-        return -1;
+    for (int i = 0; i < count; i++) {
+        enrollments[i].student_id = student_id;
+        enrollments[i].course_id = course_ids[i];
+        enrollments[i].enrollment_date = time(NULL);
+        courses[i].enrolled_count++;
     }
     
-    // Create enrollment
-    enrollment.enrollment_id = get_next_enrollment_id();
-    enrollment.student_id = student_id;
-    enrollment.course_id = course_id;
-    enrollment.enrollment_date = time(NULL);
-    
-    // Add enrollment
-    if (add_enrollment(&enrollment) < 0) {
+    // Add enrollments
+    if (add_enrollments(enrollments, count) < 0) {
         strcpy(response, "ERROR:Failed to enroll");
         return -1;
     }
     
-    // Update course enrollment count
-    course.enrolled_count++;
-    if (update_course(&course) < 0) {
-        // Rollback enrollment if course update fails
-        remove_enrollment(student_id, course_id);
+    // Update course enrollment counts
+    if (update_courses(courses, count) < 0) {
+        // Rollback every enrollment if the course update fails
+        for (int i = 0; i < count; i++) {
+            remove_enrollment(student_id, course_ids[i]);
+        }
         strcpy(response, "ERROR:Failed to update course");
         return -1;
     }
     
-    sprintf(response, "SUCCESS:Enrolled in course %s (%s)", 
-            course.course_code, course.course_name);
+    sprintf(response, "SUCCESS:Enrolled in %d courses:", count);
+    for (int i = 0; i < count; i++) {
+        strcat(response, i == 0 ? " " : ", ");
+        strcat(response, courses[i].course_code);
+    }
     return 0;
 }
 
+// ENROLL_COURSES:<id,id,...> - enroll in every listed course or in none of them
+int handle_enroll_courses(char *params, char *response, const char *username) {
+    int course_ids[MAX_ENROLL_COURSES];
+    int count = 0;
+    int student_id;
+    struct Student student;
+    char *saveptr;
+    int result;
+    
+    // Parse the course list
+    for (char *item = strtok_r(params, ",", &saveptr); item; item = strtok_r(NULL, ",", &saveptr)) {
+        if (count == MAX_ENROLL_COURSES) {
+            sprintf(response, "ERROR:At most %d courses per request", MAX_ENROLL_COURSES);
+            return -1;
+        }
+        if (sscanf(item, "%d", &course_ids[count]) != 1) {
+            strcpy(response, "ERROR:Invalid course ID");
+            return -1;
+        }
+        count++;
+    }
+    if (count == 0) {
+        strcpy(response, "ERROR:Invalid course ID");
+        return -1;
+    }
+    
+    // Courses are always taken in ascending id order, so concurrent requests can't deadlock
+    qsort(course_ids, count, sizeof(int), compare_course_ids);
+    for (int i = 1; i < count; i++) {
+        if (course_ids[i] == course_ids[i - 1]) {
+            sprintf(response, "ERROR:Course %d listed twice", course_ids[i]);
+            return -1;
+        }
+    }
+    
+    // Get student ID and check the account once for the whole request
+    student_id = get_student_id_by_username(username);
+    if (student_id < 0) {
+        strcpy(response, "ERROR:Student not found");
+        return -1;
+    }
+    if (read_student_by_id(student_id, &student) < 0) {
+        strcpy(response, "ERROR:Cannot read student data");
+        return -1;
+    }
+    if (!student.active) {
+        strcpy(response, "ERROR:Student account is inactive");
+        return -1;
+    }
+    
+    if (admission_acquire(course_ids, count) < 0) {
+        strcpy(response, "ERROR:Failed to enroll");
+        return -1;
+    }
+    
+    result = enroll_courses_locked(student_id, course_ids, count, response);
+    admission_release(course_ids, count);
+    return result;
+}
+
+// Give a freed seat to the longest-waiting eligible student (called by the course's sequencer);
+// returns the promoted student's id, or -1 if nobody eligible was waiting
+static int promote_from_waitlist(int course_id) {
+    struct WaitlistEntry entry, popped;
+    
+    // The head only leaves the waitlist once it is enrolled (or found ineligible), so a
+    // failed enrollment keeps the student's place in line
+    while (peek_waitlist_entry(course_id, &entry) == 0) {
+        struct Student student;
+        struct Enrollment enrollment;
+        
+        // Skip students deactivated or enrolled some other way since they joined
+        if (read_student_by_id(entry.student_id, &student) < 0 || !student.active ||
+            check_enrollment_exists(entry.student_id, course_id)) {
+            if (pop_waitlist_entry(course_id, &popped) < 0) {
+                return -1;
+            }
+            continue;
+        }
+        
+        enrollment.student_id = entry.student_id;
+        enrollment.course_id = course_id;
+        enrollment.enrollment_date = time(NULL);
+        if (add_enrollments(&enrollment, 1) < 0) {
+            return -1;
+        }
+        pop_waitlist_entry(course_id, &popped);
+        return entry.student_id;
+    }
+    return -1;
+}
+
+// Sequencer step for UNENROLL_COURSE: shares the course's queue so seat counts
+// are only ever changed by its sequencer; a freed seat goes straight to the waitlist
+static void apply_unenroll_batch(int course_id, struct AdmissionTicket **batch, int count) {
+    struct Course course;
+    int changed = 0;
+    
+    // Read course details
+    if (read_course_by_id(course_id, &course) < 0) {
+        for (int i = 0; i < count; i++) {
+            strcpy(batch[i]->response, "ERROR:Course not found");
+            batch[i]->result = -1;
+        }
+        return;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        // Check if enrolled
+        if (!check_enrollment_exists(batch[i]->student_id, course_id)) {
+            strcpy(batch[i]->response, "ERROR:Not enrolled in this course");
+            batch[i]->result = -1;
+            continue;
+        }
+        
+        // Remove enrollment
+        if (remove_enrollment(batch[i]->student_id, course_id) < 0) {
+            strcpy(batch[i]->response, "ERROR:Failed to unenroll");
+            batch[i]->result = -1;
+            continue;
+        }
+        
+        // The seat count only drops if nobody was waiting for it
+        if (promote_from_waitlist(course_id) < 0) {
+            course.enrolled_count--;
+            changed = 1;
+        }
+        sprintf(batch[i]->response, "SUCCESS:Unenrolled from course %s", course.course_code);
+        batch[i]->result = 0;
+    }
+    
+    // Update course enrollment count
+    if (changed && update_course(&course) < 0) {
+        for (int i = 0; i < count; i++) {
+            if (batch[i]->result == 0) {
+                strcpy(batch[i]->response, "WARNING:Unenrolled but failed to update course count");
+            }
+        }
+    }
+}
+
 int handle_unenroll_course(char *params, char *response, const char *username) {
     int course_id;
     int student_id;
-    struct Course course;
+    struct AdmissionTicket ticket;
     
     // Parse course ID
     if (sscanf(params, "%d", &course_id) != 1) {
@@ -170,39 +442,99 @@ int handle_unenroll_course(char *params, char *response, const char *username) {
         return -1;
     }
     
-    // Check if enrolled
-    if (!check_enrollment_exists(student_id, course_id)) {
-        strcpy(response, "ERROR:Not enrolled in this course");
-        return -1;
-    }
+    ticket.student_id = student_id;
+    ticket.apply = apply_unenroll_batch;
+    ticket.response = response;
+    ticket.result = -1;
+    return admission_submit(course_id, &ticket);
+}
+
+// Sequencer step for JOIN_WAITLIST: ordered with enrolls so a seat can't open in between
+static void apply_join_waitlist(int course_id, struct AdmissionTicket **batch, int count) {
+    struct Course course;
+    struct WaitlistEntry entry;
     
     // Read course details
     if (read_course_by_id(course_id, &course) < 0) {
-        strcpy(response, "ERROR:Course not found");
+        for (int i = 0; i < count; i++) {
+            strcpy(batch[i]->response, "ERROR:Course not found");
+            batch[i]->result = -1;
+        }
+        return;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        int position;
+        
+        if (check_enrollment_exists(batch[i]->student_id, course_id)) {
+            strcpy(batch[i]->response, "ERROR:Already enrolled in this course");
+            batch[i]->result = -1;
+            continue;
+        }
+        if (course.enrolled_count < course.max_seats) {
+            strcpy(batch[i]->response, "ERROR:Course has open seats, enroll instead");
+            batch[i]->result = -1;
+            continue;
+        }
+        
+        entry.student_id = batch[i]->student_id;
+        entry.course_id = course_id;
+        entry.joined_at = time(NULL);
+        position = add_waitlist_entry(&entry);
+        if (position < 0) {
+            strcpy(batch[i]->response, "ERROR:Failed to join waitlist");
+            batch[i]->result = -1;
+        } else if (position == 0) {
+            strcpy(batch[i]->response, "ERROR:Already on the waitlist for this course");
+            batch[i]->result = -1;
+        } else {
+            sprintf(batch[i]->response, "SUCCESS:Waitlisted for course %s at position %d",
+                    course.course_code, position);
+            batch[i]->result = 0;
+        }
+    }
+}
+
+int handle_join_waitlist(char *params, char *response, const char *username) {
+    int course_id;
+    int student_id;
+    struct Student student;
+    struct AdmissionTicket ticket;
+    
+    // Parse course ID
+    if (sscanf(params, "%d", &course_id) != 1) {
+        strcpy(response, "ERROR:Invalid course ID");
         return -1;
     }
     
-    // Remove enrollment
-    if (remove_enrollment(student_id, course_id) < 0) {
-        strcpy(response, "ERROR:Failed to unenroll");
+    // Get student ID
+    student_id = get_student_id_by_username(username);
+    if (student_id < 0) {
+        strcpy(response, "ERROR:Student not found");
         return -1;
     }
     
-    // Update course enrollment count
-    course.enrolled_count--;
-    if (update_course(&course) < 0) {
-        strcpy(response, "WARNING:Unenrolled but failed to update course count");
-        return 0;
+    if (read_student_by_id(student_id, &student) < 0 || !student.active) {
+        strcpy(response, "ERROR:Student account is inactive");
+        return -1;
     }
     
-    sprintf(response, "SUCCESS:Unenrolled from course %s", course.course_code);
-    return 0;
+    ticket.student_id = student_id;
+    ticket.apply = apply_join_waitlist;
+    ticket.response = response;
+    ticket.result = -1;
+    return admission_submit(course_id, &ticket);
 }
 
 int handle_view_enrolled_courses(char *params, char *response, const char *username) {
     int student_id;
-    char courses_info[1024];
+    char *courses_info = arena_alloc(ARENA_RESPONSE_SIZE);
     
+    if (!courses_info) {
+        strcpy(response, "ERROR:Out of memory");
+        return -1;
+    }
+
     // Get student ID
     student_id = get_student_id_by_username(username);
     if (student_id < 0) {
@@ -211,7 +543,7 @@ int handle_view_enrolled_courses(char *params, char *response, const char *usern
     }
     
     // Get enrolled courses
-    if (get_enrolled_courses(student_id, courses_info, sizeof(courses_info)) < 0) {
+    if (get_enrolled_courses(student_id, courses_info, ARENA_RESPONSE_SIZE) < 0) {
         strcpy(response, "No courses enrolled");
         return 0;
     }
@@ -232,12 +564,37 @@ int get_student_id_by_username(const char *username) {
     return student.id;
 }
 
-int get_enrolled_courses(int student_id, char *buffer, size_t buffer_size) {
-    struct Enrollment enrollment;
+// Course listing being built by get_enrolled_courses
+struct CourseListing {
+    char *buffer;
+    size_t buffer_size;
+    int count;
+};
+
+static int list_enrolled_course(const struct Enrollment *enrollment, void *arg) {
+    struct CourseListing *listing = arg;
     struct Course course;
+    char line[256];
+    
+    // Get course details
+    if (read_course_by_id(enrollment->course_id, &course) == 0) {
+        sprintf(line, "Course ID: %d | Code: %s | Name: %s | Seats: %d/%d\n",
+                course.course_id, course.course_code, course.course_name,
+                course.enrolled_count, course.max_seats);
+        
+        if (strlen(listing->buffer) + strlen(line) < listing->buffer_size) {
+            strcat(listing->buffer, line);
+            listing->count++;
+        }
+    }
+    return 0;
+}
+
+int get_enrolled_courses(int student_id, char *buffer, size_t buffer_size) {
+    struct CourseListing listing = { buffer, buffer_size, 0 };
     int fd_enrollment;
     char line[256];
-    int count = 0;
+    int count;
     
     buffer[0] = '\0';
     sprintf(buffer, "Enrolled Courses:\n");
@@ -249,26 +606,13 @@ int get_enrolled_courses(int student_id, char *buffer, size_t buffer_size) {
     }
     
     // Apply read lock
-    flock(fd_enrollment, LOCK_SH);
+    FLOCK(fd_enrollment, LOCK_SH, ENROLLMENT_FILE);
     
     // Find all enrollments for the student
-    while (read(fd_enrollment, &enrollment, sizeof(struct Enrollment)) == sizeof(struct Enrollment)) {
-        if (enrollment.student_id == student_id) {
-            // Get course details
-            if (read_course_by_id(enrollment.course_id, &course) == 0) {
-                sprintf(line, "Course ID: %d | Code: %s | Name: %s | Seats: %d/%d\n",
-                        course.course_id, course.course_code, course.course_name,
-                        course.enrolled_count, course.max_seats);
-                
-                if (strlen(buffer) + strlen(line) < buffer_size) {
-                    strcat(buffer, line);
-                    count++;
-                }
-            }
-        }
-    }
+    enrollment_scan(fd_enrollment, student_id, ENROLLMENT_ANY, 0, list_enrolled_course, &listing);
+    count = listing.count;
     
-    flock(fd_enrollment, LOCK_UN);
+    FLOCK(fd_enrollment, LOCK_UN, ENROLLMENT_FILE);
     close(fd_enrollment);
     
     if (count == 0) {
@@ -276,7 +620,9 @@ int get_enrolled_courses(int student_id, char *buffer, size_t buffer_size) {
     }
     
     sprintf(line, "\nTotal courses enrolled: %d\n", count);
-    strcat(buffer, line);
+    if (strlen(buffer) + strlen(line) < buffer_size) {
+        strcat(buffer, line);
+    }
     
     return 0;
 }
\ No newline at end of file
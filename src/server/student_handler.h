@@ -6,7 +6,9 @@ int handle_student_request(int client_socket, char *request, const char *usernam
 
 // Student operation functions
 int handle_enroll_course(char *request, char *response, const char *username);
+int handle_enroll_courses(char *request, char *response, const char *username);
 int handle_unenroll_course(char *request, char *response, const char *username);
+int handle_join_waitlist(char *request, char *response, const char *username);
 int handle_view_enrolled_courses(char *request, char *response, const char *username);
 
 // REMOVE THIS LINE - it's now in auth.h with different signature
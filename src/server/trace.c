@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace.h"
+
+#define TRACE_BUFFER_EVENTS 2048
+#define TRACE_MAX_DEPTH 32
+#define TRACE_DETAIL_LENGTH 24
+#define TRACE_WRITE_CHUNK 65536
+
+// One completed span
+struct TraceEvent {
+    const char *name;
+    char detail[TRACE_DETAIL_LENGTH];
+    unsigned long long start_ns;
+    unsigned long long duration_ns;
+    unsigned int request_id;
+};
+
+// Ring of completed spans owned by one thread at a time
+struct TraceBuffer {
+    pthread_mutex_t lock;
+    int tid;
+    int in_use;
+    unsigned long head;
+    struct TraceEvent events[TRACE_BUFFER_EVENTS];
+    struct TraceBuffer *next;
+};
+
+struct OpenSpan {
+    const char *name;
+    unsigned long long start_ns;
+};
+
+volatile sig_atomic_t trace_dump_requested = 0;
+char trace_dump_file[64] = TRACE_DUMP_FILE;
+
+static struct TraceBuffer *trace_buffers = NULL;
+static pthread_mutex_t trace_buffers_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t trace_buffer_key;
+static pthread_once_t trace_key_once = PTHREAD_ONCE_INIT;
+static int next_trace_tid = 1;
+static unsigned int next_request_id = 0;
+
+static __thread struct TraceBuffer *thread_buffer = NULL;
+static __thread unsigned int current_request = 0;
+static __thread char current_command[TRACE_DETAIL_LENGTH];
+static __thread struct OpenSpan open_spans[TRACE_MAX_DEPTH];
+static __thread int span_depth = 0;
+
+unsigned long long trace_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Thread exit: hand the buffer back to the pool, keeping its events for later dumps
+static void release_trace_buffer(void *arg) {
+    struct TraceBuffer *buffer = arg;
+
+    pthread_mutex_lock(&trace_buffers_mutex);
+    buffer->in_use = 0;
+    pthread_mutex_unlock(&trace_buffers_mutex);
+}
+
+static void create_trace_key() {
+    pthread_key_create(&trace_buffer_key, release_trace_buffer);
+}
+
+static struct TraceBuffer *get_trace_buffer() {
+    struct TraceBuffer *buffer;
+
+    if (thread_buffer) {
+        return thread_buffer;
+    }
+
+    pthread_once(&trace_key_once, create_trace_key);
+
+    pthread_mutex_lock(&trace_buffers_mutex);
+    for (buffer = trace_buffers; buffer; buffer = buffer->next) {
+        if (!buffer->in_use) {
+            break;
+        }
+    }
+    if (!buffer) {
+        buffer = calloc(1, sizeof(struct TraceBuffer));
+        if (!buffer) {
+            pthread_mutex_unlock(&trace_buffers_mutex);
+            return NULL;
+        }
+        pthread_mutex_init(&buffer->lock, NULL);
+        buffer->tid = next_trace_tid++;
+        buffer->next = trace_buffers;
+        trace_buffers = buffer;
+    }
+    buffer->in_use = 1;
+    pthread_mutex_unlock(&trace_buffers_mutex);
+
+    pthread_setspecific(trace_buffer_key, buffer);
+    thread_buffer = buffer;
+    return buffer;
+}
+
+static void record_event(const char *name, const char *detail,
+                         unsigned long long start_ns, unsigned long long duration_ns) {
+    struct TraceBuffer *buffer = get_trace_buffer();
+    struct TraceEvent *event;
+
+    if (!buffer) {
+        return;
+    }
+
+    pthread_mutex_lock(&buffer->lock);
+    event = &buffer->events[buffer->head % TRACE_BUFFER_EVENTS];
+    event->name = name;
+    strncpy(event->detail, detail ? detail : "", sizeof(event->detail) - 1);
+    event->detail[sizeof(event->detail) - 1] = '\0';
+    event->start_ns = start_ns;
+    event->duration_ns = duration_ns;
+    event->request_id = current_request;
+    buffer->head++;
+    pthread_mutex_unlock(&buffer->lock);
+}
+
+void trace_request_begin(const char *command) {
+    size_t length = strcspn(command, ":");
+
+    if (length >= sizeof(current_command)) {
+        length = sizeof(current_command) - 1;
+    }
+    memcpy(current_command, command, length);
+    current_command[length] = '\0';
+
+    current_request = __sync_add_and_fetch(&next_request_id, 1);
+    span_depth = 0;
+    trace_begin("request");
+}
+
+void trace_request_end() {
+    trace_end_to(0);
+    current_request = 0;
+}
+
+int trace_begin(const char *name) {
+    int depth = span_depth;
+
+    if (span_depth < TRACE_MAX_DEPTH) {
+        open_spans[span_depth].name = name;
+        open_spans[span_depth].start_ns = trace_now_ns();
+    }
+    span_depth++;
+    return depth;
+}
+
+void trace_end() {
+    if (span_depth == 0) {
+        return;
+    }
+
+    span_depth--;
+    if (span_depth < TRACE_MAX_DEPTH) {
+        // The outermost span of a request is labelled with its command
+        const char *detail = (span_depth == 0 && current_request) ? current_command : NULL;
+        record_event(open_spans[span_depth].name, detail, open_spans[span_depth].start_ns,
+                     trace_now_ns() - open_spans[span_depth].start_ns);
+    }
+}
+
+void trace_end_to(int depth) {
+    while (span_depth > depth) {
+        trace_end();
+    }
+}
+
+void trace_scope_end(int *depth) {
+    trace_end_to(*depth);
+}
+
+void trace_complete(const char *name, const char *detail,
+                    unsigned long long start_ns, unsigned long long duration_ns) {
+    record_event(name, detail, start_ns, duration_ns);
+}
+
+int trace_open(const char *path, int flags, mode_t mode) {
+    unsigned long long start = trace_now_ns();
+    const char *name = strrchr(path, '/');
+    int fd;
+
+    fd = open(path, flags, mode);
+    record_event("open", name ? name + 1 : path, start, trace_now_ns() - start);
+    return fd;
+}
+
+ssize_t trace_write(int fd, const void *buf, size_t count) {
+    unsigned long long start = trace_now_ns();
+    char detail[TRACE_DETAIL_LENGTH];
+    ssize_t written;
+
+    written = write(fd, buf, count);
+    snprintf(detail, sizeof(detail), "%zu bytes", count);
+    record_event("write", detail, start, trace_now_ns() - start);
+    return written;
+}
+
+ssize_t trace_pwrite(int fd, const void *buf, size_t count, off_t offset) {
+    unsigned long long start = trace_now_ns();
+    char detail[TRACE_DETAIL_LENGTH];
+    ssize_t written;
+
+    written = pwrite(fd, buf, count, offset);
+    snprintf(detail, sizeof(detail), "%zu bytes at %lld", count, (long long)offset);
+    record_event("write", detail, start, trace_now_ns() - start);
+    return written;
+}
+
+// Copy a string into JSON output, escaping anything that would break the document
+static size_t json_escape(char *out, size_t out_size, const char *in) {
+    size_t used = 0;
+
+    for (; *in && used + 7 < out_size; in++) {
+        unsigned char c = (unsigned char)*in;
+        if (c == '"' || c == '\\') {
+            out[used++] = '\\';
+            out[used++] = c;
+        } else if (c < 0x20) {
+            used += snprintf(out + used, out_size - used, "\\u%04x", c);
+        } else {
+            out[used++] = c;
+        }
+    }
+    out[used] = '\0';
+    return used;
+}
+
+static int flush_chunk(int fd, char *chunk, size_t *used) {
+    size_t offset = 0;
+
+    while (offset < *used) {
+        ssize_t written = write(fd, chunk + offset, *used - offset);
+        if (written <= 0) {
+            return -1;
+        }
+        offset += written;
+    }
+    *used = 0;
+    return 0;
+}
+
+int trace_dump(const char *path) {
+    char temp_path[256];
+    char *chunk;
+    size_t used = 0;
+    int fd;
+    int count = 0;
+    int failed = 0;
+    pid_t pid = getpid();
+
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+
+    chunk = malloc(TRACE_WRITE_CHUNK);
+    if (!chunk) {
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+
+    used += snprintf(chunk, TRACE_WRITE_CHUNK, "{\"traceEvents\":[\n");
+
+    pthread_mutex_lock(&trace_buffers_mutex);
+    for (struct TraceBuffer *buffer = trace_buffers; buffer && !failed; buffer = buffer->next) {
+        unsigned long first;
+
+        pthread_mutex_lock(&buffer->lock);
+        first = buffer->head > TRACE_BUFFER_EVENTS ? buffer->head - TRACE_BUFFER_EVENTS : 0;
+        for (unsigned long i = first; i < buffer->head; i++) {
+            struct TraceEvent *event = &buffer->events[i % TRACE_BUFFER_EVENTS];
+            char detail[TRACE_DETAIL_LENGTH * 6 + 1];
+
+            if (used + 512 > TRACE_WRITE_CHUNK && flush_chunk(fd, chunk, &used) < 0) {
+                failed = 1;
+                break;
+            }
+
+            json_escape(detail, sizeof(detail), event->detail);
+            used += snprintf(chunk + used, TRACE_WRITE_CHUNK - used,
+                             "%s{\"name\":\"%s\",\"cat\":\"academia\",\"ph\":\"X\","
+                             "\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d,"
+                             "\"args\":{\"request\":%u,\"detail\":\"%s\"}}",
+                             count > 0 ? ",\n" : "", event->name,
+                             event->start_ns / 1000.0, event->duration_ns / 1000.0,
+                             (int)pid, buffer->tid, event->request_id, detail);
+            count++;
+        }
+        pthread_mutex_unlock(&buffer->lock);
+    }
+    pthread_mutex_unlock(&trace_buffers_mutex);
+
+    used += snprintf(chunk + used, TRACE_WRITE_CHUNK - used, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    if (failed || flush_chunk(fd, chunk, &used) < 0) {
+        free(chunk);
+        close(fd);
+        unlink(temp_path);
+        return -1;
+    }
+
+    free(chunk);
+    close(fd);
+
+    if (rename(temp_path, path) < 0) {
+        unlink(temp_path);
+        return -1;
+    }
+
+    return count;
+}
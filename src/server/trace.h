@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <signal.h>
+
+#define TRACE_DUMP_FILE "data/trace.json"
+
+// Set from the SIGUSR1 handler; the accept loop performs the dump
+extern volatile sig_atomic_t trace_dump_requested;
+
+// Where SIGUSR1 and TRACE_DUMP write (TRACE_DUMP_FILE, or one file per pre-forked worker)
+extern char trace_dump_file[64];
+
+// Request scope: every span recorded until trace_request_end() carries the same request id
+void trace_request_begin(const char *command);
+void trace_request_end();
+
+/**
+ * Open a span on the calling thread
+ * @param name Span name (must be a string literal or otherwise static)
+ * @return Span depth before the push, for use with trace_end_to()
+ */
+int trace_begin(const char *name);
+void trace_end();
+void trace_end_to(int depth);
+
+// Record an already measured span (used for lock waits)
+void trace_complete(const char *name, const char *detail,
+                    unsigned long long start_ns, unsigned long long duration_ns);
+
+// Current monotonic time in the clock used for trace timestamps
+unsigned long long trace_now_ns();
+
+// Closes the span automatically when the enclosing block exits, including early returns
+void trace_scope_end(int *depth);
+#define TRACE_SCOPE(name) \
+    int trace_scope_depth __attribute__((cleanup(trace_scope_end))) = trace_begin(name)
+
+// Traced system call wrappers for the open and write phases of file operations
+int trace_open(const char *path, int flags, mode_t mode);
+ssize_t trace_write(int fd, const void *buf, size_t count);
+ssize_t trace_pwrite(int fd, const void *buf, size_t count, off_t offset);
+
+// Write every buffered span as Chrome trace-event JSON; returns number of events or -1
+int trace_dump(const char *path);
+
+#endif // TRACE_H
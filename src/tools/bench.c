@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "../common/structures.h"
+#include "../common/constants.h"
+#include "../server/file_ops.h"
+#include "../server/auth.h"
+#include "../server/admin_handler.h"
+#include "../server/student_handler.h"
+#include "../server/faculty_handler.h"
+#include "../server/enrollment_store.h"
+#include "../server/record_index.h"
+#include "../server/string_heap.h"
+#include "../server/department.h"
+#include "../server/arena.h"
+
+// Storage micro-benchmarks: links the server's file operations and handlers directly
+// and times them against generated data files of increasing size. Results are JSON.
+
+#define MAX_SIZES 8
+#define MAX_SAMPLES 100000
+#define WRITE_BATCH 4096
+
+struct BenchResult {
+    const char *operation;
+    long records;
+    int iterations;
+    double mean_us;
+    double p50_us;
+    double p99_us;
+    double min_us;
+    double max_us;
+};
+
+static double time_budget = 1.0;
+static int max_iterations = 1000;
+static double samples[MAX_SAMPLES];
+static unsigned int seed = 12345;
+
+static double now_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double da = *(const double *)a;
+    double db = *(const double *)b;
+    return (da > db) - (da < db);
+}
+
+// Write count records of the given size produced by fill(), in large sequential batches;
+// heap tables are stored as rows and strings
+static int write_table(const char *path, size_t record_size, long count,
+                       void (*fill)(long index, long count, void *record), const struct HeapTable *heap) {
+    char *batch = malloc(record_size * WRITE_BATCH);
+    int fd;
+
+    if (!batch) {
+        return -1;
+    }
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || (heap && truncate(heap->heap_path, 0) < 0 && errno != ENOENT)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(batch);
+        return -1;
+    }
+
+    for (long i = 0; i < count; i += WRITE_BATCH) {
+        long n = count - i < WRITE_BATCH ? count - i : WRITE_BATCH;
+        memset(batch, 0, record_size * n);
+        for (long j = 0; j < n; j++) {
+            fill(i + j, count, batch + j * record_size);
+        }
+        if (heap ? append_heap_records(heap, fd, batch, n) < 0
+                 : write(fd, batch, record_size * n) != (ssize_t)(record_size * n)) {
+            close(fd);
+            free(batch);
+            return -1;
+        }
+    }
+
+    close(fd);
+    free(batch);
+    return 0;
+}
+
+static void fill_student(long index, long count, void *record) {
+    struct Student *student = record;
+    student->id = index + 1;
+    snprintf(student->username, sizeof(student->username), "student%ld", index + 1);
+    snprintf(student->name, sizeof(student->name), "Student %ld", index + 1);
+    snprintf(student->email, sizeof(student->email), "student%ld@bench.test", index + 1);
+    student->active = 1;
+}
+
+static void fill_faculty(long index, long count, void *record) {
+    struct Faculty *faculty = record;
+    faculty->id = index + 1;
+    snprintf(faculty->username, sizeof(faculty->username), "faculty%ld", index + 1);
+    snprintf(faculty->name, sizeof(faculty->name), "Faculty %ld", index + 1);
+    snprintf(faculty->email, sizeof(faculty->email), "faculty%ld@bench.test", index + 1);
+    snprintf(faculty->department, sizeof(faculty->department), "DEPT%ld", index % 30);
+}
+
+static void fill_course(long index, long count, void *record) {
+    struct Course *course = record;
+    course->course_id = index + 1;
+    snprintf(course->course_code, sizeof(course->course_code), "C%d", (int)(index + 1));
+    snprintf(course->course_name, sizeof(course->course_name), "Course %ld", index + 1);
+    course->faculty_id = index + 1;
+    course->max_seats = 1000000;
+    course->enrolled_count = 1;
+}
+
+// Enrollment i pairs student i+1 with course ((i * 7) % count) + 1
+static void fill_enrollment(long index, long count, void *record) {
+    struct Enrollment *enrollment = record;
+    enrollment->enrollment_id = index + 1;
+    enrollment->student_id = index + 1;
+    enrollment->course_id = (index * 7) % count + 1;
+    enrollment->enrollment_date = 1700000000 + index;
+}
+
+static void fill_credentials(long index, long count, void *record) {
+    struct Credentials *cred = record;
+    if (index == 0) {
+        strcpy(cred->username, "admin");
+        strcpy(cred->password_hash, "admin123");
+        strcpy(cred->role, "admin");
+        return;
+    }
+    snprintf(cred->username, sizeof(cred->username), "student%ld", index);
+    strcpy(cred->password_hash, "default");
+    strcpy(cred->role, "student");
+}
+
+static int populate(long records) {
+    mkdir("data", 0755);
+    if (write_table(STUDENT_FILE, sizeof(struct Student), records, fill_student, &student_heap) < 0 ||
+        write_table(FACULTY_FILE, sizeof(struct Faculty), records, fill_faculty, &faculty_heap) < 0 ||
+        write_table(COURSE_FILE, sizeof(struct Course), records, fill_course, NULL) < 0 ||
+        write_table(ENROLLMENT_FILE, sizeof(struct Enrollment), records, fill_enrollment, NULL) < 0 ||
+        write_table(CREDENTIALS_FILE, sizeof(struct Credentials), records + 1, fill_credentials,
+                    NULL) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static long random_key(long records) {
+    return 1 + rand_r(&seed) % records;
+}
+
+// Operations under test; each receives a random key in 1..records
+static void op_read_student_by_id(long records, long key) {
+    struct Student student;
+    read_student_by_id(key, &student);
+}
+
+static void op_read_student_by_username(long records, long key) {
+    struct Student student;
+    char username[50];
+    snprintf(username, sizeof(username), "student%ld", key);
+    read_student_by_username(username, &student);
+}
+
+static void op_check_enrollment_exists(long records, long key) {
+    check_enrollment_exists(key, ((key - 1) * 7) % records + 1);
+}
+
+static void op_update_course(long records, long key) {
+    struct Course course;
+    if (read_course_by_id(key, &course) == 0) {
+        update_course(&course);
+    }
+}
+
+static void op_authenticate_user(long records, long key) {
+    char username[50];
+    char role[10];
+    snprintf(username, sizeof(username), "student%ld", key);
+    authenticate_user(username, "default", role);
+}
+
+static void op_view_students(long records, long key) {
+    char response[1024];
+    char params[] = "all";
+    handle_view_students(params, response);
+}
+
+static void op_view_faculty(long records, long key) {
+    char response[1024];
+    char params[] = "all";
+    handle_view_faculty(params, response);
+}
+
+static void op_view_enrollments(long records, long key) {
+    char response[1024];
+    char params[32];
+    snprintf(params, sizeof(params), "%ld", ((key - 1) * 7) % records + 1);
+    handle_view_enrollments(params, response);
+}
+
+static void op_view_my_courses(long records, long key) {
+    char response[1024];
+    char username[50];
+    snprintf(username, sizeof(username), "faculty%ld", key);
+    handle_view_my_courses(response, username);
+}
+
+static void op_view_enrolled_courses(long records, long key) {
+    char buffer[1024];
+    get_enrolled_courses(key, buffer, sizeof(buffer));
+}
+
+static struct BenchResult run_operation(const char *name, long records,
+                                        void (*operation)(long records, long key)) {
+    struct BenchResult result = { name, records, 0, 0, 0, 0, 0, 0 };
+    double started = now_us();
+    double total = 0;
+
+    while (result.iterations < max_iterations && result.iterations < MAX_SAMPLES &&
+           (result.iterations < 3 || now_us() - started < time_budget * 1e6)) {
+        long key = random_key(records);
+        double start = now_us();
+        operation(records, key);
+        samples[result.iterations] = now_us() - start;
+        arena_reset(name);              // as handle_client() does after each request
+        total += samples[result.iterations];
+        result.iterations++;
+    }
+
+    qsort(samples, result.iterations, sizeof(double), compare_doubles);
+    result.mean_us = total / result.iterations;
+    result.p50_us = samples[result.iterations / 2];
+    result.p99_us = samples[(int)(result.iterations * 0.99)];
+    result.min_us = samples[0];
+    result.max_us = samples[result.iterations - 1];
+    return result;
+}
+
+// remove_enrollment is destructive: time the removal, then put the record back untimed
+static struct BenchResult run_remove_enrollment(long records) {
+    struct BenchResult result = { "remove_enrollment", records, 0, 0, 0, 0, 0, 0 };
+    double started = now_us();
+    double total = 0;
+
+    while (result.iterations < max_iterations && result.iterations < MAX_SAMPLES &&
+           (result.iterations < 3 || now_us() - started < time_budget * 1e6)) {
+        long key = random_key(records);
+        struct Enrollment enrollment;
+        double start;
+
+        fill_enrollment(key - 1, records, &enrollment);
+        start = now_us();
+        remove_enrollment(enrollment.student_id, enrollment.course_id);
+        samples[result.iterations] = now_us() - start;
+        total += samples[result.iterations];
+        result.iterations++;
+
+        add_enrollment(&enrollment);
+    }
+
+    qsort(samples, result.iterations, sizeof(double), compare_doubles);
+    result.mean_us = total / result.iterations;
+    result.p50_us = samples[result.iterations / 2];
+    result.p99_us = samples[(int)(result.iterations * 0.99)];
+    result.min_us = samples[0];
+    result.max_us = samples[result.iterations - 1];
+    return result;
+}
+
+static void print_result(FILE *out, struct BenchResult *result, int first) {
+    fprintf(out, "%s    {\"operation\": \"%s\", \"records\": %ld, \"iterations\": %d, "
+            "\"mean_us\": %.2f, \"p50_us\": %.2f, \"p99_us\": %.2f, \"min_us\": %.2f, "
+            "\"max_us\": %.2f, \"ops_per_sec\": %.1f}",
+            first ? "" : ",\n", result->operation, result->records, result->iterations,
+            result->mean_us, result->p50_us, result->p99_us, result->min_us, result->max_us,
+            result->mean_us > 0 ? 1e6 / result->mean_us : 0.0);
+    fflush(out);
+}
+
+static int remove_tree_files(const char *dir) {
+    const char *files[] = { STUDENT_FILE, FACULTY_FILE, COURSE_FILE, ENROLLMENT_FILE,
+                            CREDENTIALS_FILE, "data/enrollments.tmp",
+                            ENROLLMENT_SEGMENT_FILE, RECORD_INDEX_IMAGE,
+                            STUDENT_HEAP_FILE, FACULTY_HEAP_FILE, DEPARTMENT_FILE };
+    char path[512];
+
+    for (size_t i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/data", dir);
+    return rmdir(path);
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-n sizes] [-t seconds] [-i iterations] [-d dir] [-o file]\n"
+            "  -n sizes       comma-separated record counts (default 1000,100000,1000000)\n"
+            "  -t seconds     time budget per operation and size (default 1.0)\n"
+            "  -i iterations  maximum iterations per operation (default 1000)\n"
+            "  -d dir         scratch directory for generated data (default: temporary)\n"
+            "  -o file        write JSON results to file (default stdout)\n",
+            program);
+}
+
+int main(int argc, char *argv[]) {
+    long sizes[MAX_SIZES] = { 1000, 100000, 1000000 };
+    int size_count = 3;
+    char scratch[256] = "";
+    char original_dir[512];
+    FILE *out = stdout;
+    int first = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:t:i:d:o:")) != -1) {
+        switch (opt) {
+            case 'n': {
+                char *saveptr;
+                size_count = 0;
+                for (char *item = strtok_r(optarg, ",", &saveptr); item && size_count < MAX_SIZES;
+                     item = strtok_r(NULL, ",", &saveptr)) {
+                    sizes[size_count++] = atol(item);
+                }
+                break;
+            }
+            case 't': time_budget = atof(optarg); break;
+            case 'i': max_iterations = atoi(optarg); break;
+            case 'd': snprintf(scratch, sizeof(scratch), "%s", optarg); break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (!out) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (!getcwd(original_dir, sizeof(original_dir))) {
+        perror("getcwd");
+        return 1;
+    }
+    if (scratch[0] == '\0') {
+        strcpy(scratch, "/tmp/academia-bench-XXXXXX");
+        if (!mkdtemp(scratch)) {
+            perror("mkdtemp");
+            return 1;
+        }
+    } else {
+        mkdir(scratch, 0755);
+    }
+    if (chdir(scratch) < 0) {
+        perror(scratch);
+        return 1;
+    }
+
+    time_t now = time(NULL);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    fprintf(out, "{\n  \"benchmark\": \"file_ops\",\n  \"timestamp\": \"%s\",\n"
+            "  \"time_budget_s\": %.2f,\n  \"results\": [\n", timestamp, time_budget);
+
+    for (int s = 0; s < size_count; s++) {
+        long records = sizes[s];
+        struct BenchResult result;
+
+        if (records <= 0) {
+            continue;
+        }
+
+        fprintf(stderr, "Generating %ld records per table in %s...\n", records, scratch);
+        if (populate(records) < 0) {
+            fprintf(stderr, "Failed to generate data: %s\n", strerror(errno));
+            return 1;
+        }
+
+        struct {
+            const char *name;
+            void (*operation)(long records, long key);
+        } operations[] = {
+            { "read_student_by_id", op_read_student_by_id },
+            { "read_student_by_username", op_read_student_by_username },
+            { "check_enrollment_exists", op_check_enrollment_exists },
+            { "update_course", op_update_course },
+            { "authenticate_user", op_authenticate_user },
+            { "view_students", op_view_students },
+            { "view_faculty", op_view_faculty },
+            { "view_enrollments", op_view_enrollments },
+            { "view_my_courses", op_view_my_courses },
+            { "view_enrolled_courses", op_view_enrolled_courses },
+        };
+
+        for (size_t i = 0; i < sizeof(operations) / sizeof(operations[0]); i++) {
+            fprintf(stderr, "  %s\n", operations[i].name);
+            result = run_operation(operations[i].name, records, operations[i].operation);
+            print_result(out, &result, first);
+            first = 0;
+        }
+
+        fprintf(stderr, "  remove_enrollment\n");
+        result = run_remove_enrollment(records);
+        print_result(out, &result, first);
+    }
+
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    remove_tree_files(".");
+    if (chdir(original_dir) == 0 && strncmp(scratch, "/tmp/academia-bench-", 20) == 0) {
+        rmdir(scratch);
+    }
+    return 0;
+}
@@ -0,0 +1,646 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../common/structures.h"
+#include "../common/constants.h"
+#include "../server/string_heap.h"
+#include "../server/department.h"
+
+// Synthetic dataset generator: writes every data file directly in the binary layouts
+// from structures.h. Tables are split into ranges generated by worker threads, each of
+// which fills a large buffer and pwrite()s it at the range's fixed offset. Students and
+// faculty are written as rows plus a string heap; their ranges are generated twice, first
+// to measure each range's share of the heap and then to write it at its place.
+
+#define DEFAULT_THREADS 4
+#define BLOCK_RECORDS 16384
+#define MAX_PER_STUDENT 4096
+
+struct Config {
+    long students;
+    long faculty;
+    long courses;
+    long enrollments;
+    double skew;
+    int threads;
+    unsigned int seed;
+    const char *dir;
+    const char *password;
+    int min_seats;
+};
+
+// One worker's share of a table
+struct Range {
+    long first;
+    long count;
+    long enrollment_first;   // enrollments only: first enrollment index of this range
+    unsigned int seed;
+    int fd;
+    int status;
+    const struct HeapTable *heap;    // heap tables only
+    int heap_fd;
+    int measure;             // first pass: only count the range's heap bytes
+    uint64_t heap_base;      // second pass: where the range's strings start
+    uint64_t heap_bytes;
+};
+
+static struct Config config = {
+    .students = 1000,
+    .faculty = 50,
+    .courses = 200,
+    .enrollments = 5000,
+    .skew = 1.0,
+    .threads = DEFAULT_THREADS,
+    .seed = 42,
+    .dir = "data",
+    .password = "default",
+    .min_seats = 60,
+};
+
+static const char *departments[] = {
+    "Computer Science", "Mathematics", "Physics", "Chemistry", "Biology",
+    "Economics", "History", "Philosophy", "Electrical Engineering", "Mechanical Engineering",
+};
+#define DEPARTMENT_COUNT (sizeof(departments) / sizeof(departments[0]))
+
+static double *course_cdf;     // cumulative Zipf probabilities by popularity rank
+static int *rank_to_course;    // popularity rank -> course id, shuffled
+static int *course_enrolled;   // enrollments generated per course id
+static time_t base_time;
+
+static unsigned int next_random(unsigned int *state) {
+    // xorshift32: cheap, per-thread and reproducible for a given seed
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static double next_uniform(unsigned int *state) {
+    return (next_random(state) >> 8) / 16777216.0;
+}
+
+static int write_block(int fd, const void *buffer, size_t length, off_t offset) {
+    const char *data = buffer;
+
+    while (length > 0) {
+        ssize_t written = pwrite(fd, data, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += written;
+        length -= written;
+        offset += written;
+    }
+    return 0;
+}
+
+// Encode a block of records as rows and strings at the range's next heap position
+static int write_heap_block(struct Range *range, const void *records, long n, long done) {
+    const struct HeapTable *heap = range->heap;
+    char *rows = malloc(n * heap->row_size);
+    char *strings = NULL;
+    size_t length = 0;
+    int result = -1;
+
+    if (rows && heap_encode(heap, records, n, range->heap_base + range->heap_bytes, NULL, NULL,
+                            rows, &strings, &length) == 0) {
+        result = 0;
+        if (!range->measure &&
+            (write_block(range->fd, rows, n * heap->row_size, (range->first + done) * heap->row_size) < 0 ||
+             write_block(range->heap_fd, strings, length, range->heap_base + range->heap_bytes) < 0)) {
+            result = -1;
+        }
+        range->heap_bytes += length;
+    }
+    free(rows);
+    free(strings);
+    return result;
+}
+
+static void *generate_students(void *arg) {
+    struct Range *range = arg;
+    struct Student *block = calloc(BLOCK_RECORDS, sizeof(struct Student));
+
+    if (!block) {
+        range->status = -1;
+        return NULL;
+    }
+
+    for (long done = 0; done < range->count; done += BLOCK_RECORDS) {
+        long n = range->count - done < BLOCK_RECORDS ? range->count - done : BLOCK_RECORDS;
+        memset(block, 0, n * sizeof(struct Student));
+        for (long i = 0; i < n; i++) {
+            long id = range->first + done + i + 1;
+            block[i].id = id;
+            snprintf(block[i].username, sizeof(block[i].username), "student%ld", id);
+            snprintf(block[i].name, sizeof(block[i].name), "Student %ld", id);
+            snprintf(block[i].email, sizeof(block[i].email), "student%ld@university.edu", id);
+            // Roughly one in fifty accounts is deactivated
+            block[i].active = next_random(&range->seed) % 50 != 0;
+        }
+        if (write_heap_block(range, block, n, done) < 0) {
+            range->status = -1;
+            break;
+        }
+    }
+
+    free(block);
+    return NULL;
+}
+
+static void *generate_faculty(void *arg) {
+    struct Range *range = arg;
+    struct Faculty *block = calloc(BLOCK_RECORDS, sizeof(struct Faculty));
+
+    if (!block) {
+        range->status = -1;
+        return NULL;
+    }
+
+    for (long done = 0; done < range->count; done += BLOCK_RECORDS) {
+        long n = range->count - done < BLOCK_RECORDS ? range->count - done : BLOCK_RECORDS;
+        memset(block, 0, n * sizeof(struct Faculty));
+        for (long i = 0; i < n; i++) {
+            long id = range->first + done + i + 1;
+            block[i].id = id;
+            snprintf(block[i].username, sizeof(block[i].username), "faculty%ld", id);
+            snprintf(block[i].name, sizeof(block[i].name), "Faculty %ld", id);
+            snprintf(block[i].email, sizeof(block[i].email), "faculty%ld@university.edu", id);
+            snprintf(block[i].department, sizeof(block[i].department), "%s",
+                     departments[next_random(&range->seed) % DEPARTMENT_COUNT]);
+        }
+        if (write_heap_block(range, block, n, done) < 0) {
+            range->status = -1;
+            break;
+        }
+    }
+
+    free(block);
+    return NULL;
+}
+
+// Courses run after enrollments so enrolled_count matches the generated enrollments
+static void *generate_courses(void *arg) {
+    struct Range *range = arg;
+    struct Course *block = calloc(BLOCK_RECORDS, sizeof(struct Course));
+
+    if (!block) {
+        range->status = -1;
+        return NULL;
+    }
+
+    for (long done = 0; done < range->count; done += BLOCK_RECORDS) {
+        long n = range->count - done < BLOCK_RECORDS ? range->count - done : BLOCK_RECORDS;
+        memset(block, 0, n * sizeof(struct Course));
+        for (long i = 0; i < n; i++) {
+            long id = range->first + done + i + 1;
+            int enrolled = course_enrolled[id];
+            block[i].course_id = id;
+            snprintf(block[i].course_code, sizeof(block[i].course_code), "CS%06d", (int)id);
+            snprintf(block[i].course_name, sizeof(block[i].course_name), "Course %ld", id);
+            block[i].faculty_id = config.faculty > 0 ? (id - 1) % config.faculty + 1 : 0;
+            block[i].enrolled_count = enrolled;
+            // Leave some headroom above the generated enrollment so new enrolls can succeed
+            block[i].max_seats = enrolled + enrolled / 10 > config.min_seats ?
+                                 enrolled + enrolled / 10 : config.min_seats;
+        }
+        if (write_block(range->fd, block, n * sizeof(struct Course),
+                        (range->first + done) * sizeof(struct Course)) < 0) {
+            range->status = -1;
+            break;
+        }
+    }
+
+    free(block);
+    return NULL;
+}
+
+// Enrollments a given student gets: the total is spread evenly, remainder to the first students
+static long enrollments_for_student(long index) {
+    long per_student = config.enrollments / config.students;
+    long remainder = config.enrollments % config.students;
+    return per_student + (index < remainder ? 1 : 0);
+}
+
+static long enrollments_before_student(long index) {
+    long per_student = config.enrollments / config.students;
+    long remainder = config.enrollments % config.students;
+    return per_student * index + (index < remainder ? index : remainder);
+}
+
+static int sample_course(unsigned int *state) {
+    double u = next_uniform(state);
+    long low = 0;
+    long high = config.courses - 1;
+
+    while (low < high) {
+        long mid = (low + high) / 2;
+        if (course_cdf[mid] < u) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return rank_to_course[low];
+}
+
+static void *generate_enrollments(void *arg) {
+    struct Range *range = arg;
+    struct Enrollment *block = calloc(BLOCK_RECORDS, sizeof(struct Enrollment));
+    int chosen[MAX_PER_STUDENT];
+    long used = 0;
+    long next_index = range->enrollment_first;
+    off_t offset = range->enrollment_first * sizeof(struct Enrollment);
+
+    if (!block) {
+        range->status = -1;
+        return NULL;
+    }
+
+    for (long s = range->first; s < range->first + range->count; s++) {
+        long wanted = enrollments_for_student(s);
+
+        for (long k = 0; k < wanted; k++) {
+            int course_id;
+            int duplicate;
+
+            // A student never takes the same course twice; resample on collision
+            do {
+                course_id = sample_course(&range->seed);
+                duplicate = 0;
+                for (long j = 0; j < k; j++) {
+                    if (chosen[j] == course_id) {
+                        duplicate = 1;
+                        break;
+                    }
+                }
+            } while (duplicate);
+            chosen[k] = course_id;
+            __atomic_fetch_add(&course_enrolled[course_id], 1, __ATOMIC_RELAXED);
+
+            memset(&block[used], 0, sizeof(struct Enrollment));
+            block[used].enrollment_id = ++next_index;
+            block[used].student_id = s + 1;
+            block[used].course_id = course_id;
+            block[used].enrollment_date = base_time - (next_random(&range->seed) % (120 * 86400));
+            if (++used == BLOCK_RECORDS) {
+                if (write_block(range->fd, block, used * sizeof(struct Enrollment), offset) < 0) {
+                    range->status = -1;
+                    free(block);
+                    return NULL;
+                }
+                offset += used * sizeof(struct Enrollment);
+                used = 0;
+            }
+        }
+    }
+
+    if (used > 0 && write_block(range->fd, block, used * sizeof(struct Enrollment), offset) < 0) {
+        range->status = -1;
+    }
+
+    free(block);
+    return NULL;
+}
+
+// Credentials: admin first, then every student, then every faculty member
+static void *generate_credentials(void *arg) {
+    struct Range *range = arg;
+    struct Credentials *block = calloc(BLOCK_RECORDS, sizeof(struct Credentials));
+
+    if (!block) {
+        range->status = -1;
+        return NULL;
+    }
+
+    for (long done = 0; done < range->count; done += BLOCK_RECORDS) {
+        long n = range->count - done < BLOCK_RECORDS ? range->count - done : BLOCK_RECORDS;
+        memset(block, 0, n * sizeof(struct Credentials));
+        for (long i = 0; i < n; i++) {
+            long index = range->first + done + i;
+            if (index == 0) {
+                strcpy(block[i].username, "admin");
+                strcpy(block[i].password_hash, "admin123");
+                strcpy(block[i].role, "admin");
+            } else if (index <= config.students) {
+                snprintf(block[i].username, sizeof(block[i].username), "student%ld", index);
+                snprintf(block[i].password_hash, sizeof(block[i].password_hash), "%s", config.password);
+                strcpy(block[i].role, "student");
+            } else {
+                snprintf(block[i].username, sizeof(block[i].username), "faculty%ld",
+                         index - config.students);
+                snprintf(block[i].password_hash, sizeof(block[i].password_hash), "%s", config.password);
+                strcpy(block[i].role, "faculty");
+            }
+        }
+        if (write_block(range->fd, block, n * sizeof(struct Credentials),
+                        (range->first + done) * sizeof(struct Credentials)) < 0) {
+            range->status = -1;
+            break;
+        }
+    }
+
+    free(block);
+    return NULL;
+}
+
+// Run one worker per range, each starting from its own seed; returns -1 if any failed
+static int run_ranges(struct Range *ranges, int *thread_count, size_t record_size, void *(*worker)(void *)) {
+    pthread_t threads[64];
+    int failed = 0;
+
+    for (int t = 0; t < *thread_count; t++) {
+        ranges[t].seed = config.seed * 2654435761u + t * 40503u + record_size;
+        if (ranges[t].seed == 0) {
+            ranges[t].seed = 1;
+        }
+        ranges[t].status = 0;
+        if (pthread_create(&threads[t], NULL, worker, &ranges[t]) != 0) {
+            ranges[t].status = -1;
+            *thread_count = t;
+            failed = 1;
+            break;
+        }
+    }
+
+    for (int t = 0; t < *thread_count; t++) {
+        pthread_join(threads[t], NULL);
+        if (ranges[t].status < 0) {
+            failed = 1;
+        }
+    }
+    return failed ? -1 : 0;
+}
+
+// Generate one table with config.threads workers; returns the number of records written
+static long generate_table(const char *name, long records, size_t record_size,
+                           void *(*worker)(void *), int split_by_student, const struct HeapTable *heap) {
+    char path[512];
+    char heap_path[512];
+    struct Range ranges[64];
+    int thread_count = config.threads;
+    long per_thread;
+    size_t row_size = heap ? heap->row_size : record_size;
+    uint64_t heap_size = 0;
+    int fd;
+    int heap_fd = -1;
+    int failed = 0;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    snprintf(path, sizeof(path), "%s/%s", config.dir, name);
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(path);
+        return -1;
+    }
+    if (heap) {
+        // Heap file names are relative to the data directory like the tables
+        snprintf(heap_path, sizeof(heap_path), "%s/%s", config.dir, strrchr(heap->heap_path, '/') + 1);
+        heap_fd = open(heap_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (heap_fd < 0) {
+            perror(heap_path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    // Size the file up front so every worker can pwrite its own region
+    long total = split_by_student ? config.enrollments : records;
+    if (ftruncate(fd, total * row_size) < 0) {
+        perror(path);
+        close(fd);
+        if (heap_fd >= 0) {
+            close(heap_fd);
+        }
+        return -1;
+    }
+
+    if (thread_count > records) {
+        thread_count = records > 0 ? records : 1;
+    }
+    per_thread = (records + thread_count - 1) / thread_count;
+
+    for (int t = 0; t < thread_count; t++) {
+        memset(&ranges[t], 0, sizeof(ranges[t]));
+        ranges[t].first = t * per_thread;
+        ranges[t].count = ranges[t].first >= records ? 0 :
+                          (records - ranges[t].first < per_thread ? records - ranges[t].first : per_thread);
+        ranges[t].enrollment_first = split_by_student ? enrollments_before_student(ranges[t].first) : 0;
+        ranges[t].fd = fd;
+        ranges[t].heap = heap;
+        ranges[t].heap_fd = heap_fd;
+        ranges[t].measure = heap != NULL;
+    }
+
+    if (heap && run_ranges(ranges, &thread_count, record_size, worker) == 0) {
+        // Each range's strings follow those of the ranges before it
+        for (int t = 0; t < thread_count; t++) {
+            ranges[t].heap_base = heap_size;
+            heap_size += ranges[t].heap_bytes;
+            ranges[t].heap_bytes = 0;
+            ranges[t].measure = 0;
+        }
+        if (heap_size > UINT32_MAX) {
+            fprintf(stderr, "%s would exceed 4 GB of strings\n", heap_path);
+            failed = 1;
+        }
+    } else if (heap) {
+        failed = 1;
+    }
+    if (!failed && run_ranges(ranges, &thread_count, record_size, worker) < 0) {
+        failed = 1;
+    }
+    close(fd);
+    if (heap_fd >= 0) {
+        close(heap_fd);
+    }
+
+    if (failed) {
+        fprintf(stderr, "Failed writing %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-16s %10ld records %8.1f MB %7.2f s\n", name, total,
+           total * row_size / 1048576.0, seconds);
+    if (heap) {
+        printf("%-16s %10s strings %8.1f MB\n", strrchr(heap_path, '/') + 1, "", heap_size / 1048576.0);
+    }
+    return total;
+}
+
+// Zipf(skew) over popularity ranks, with ranks assigned to course ids in shuffled order
+static int build_course_distribution() {
+    unsigned int state = config.seed ? config.seed : 1;
+    double sum = 0;
+
+    course_cdf = malloc(sizeof(double) * config.courses);
+    rank_to_course = malloc(sizeof(int) * config.courses);
+    course_enrolled = calloc(config.courses + 1, sizeof(int));
+    if (!course_cdf || !rank_to_course || !course_enrolled) {
+        return -1;
+    }
+
+    for (long r = 0; r < config.courses; r++) {
+        sum += 1.0 / pow(r + 1, config.skew);
+        course_cdf[r] = sum;
+    }
+    for (long r = 0; r < config.courses; r++) {
+        course_cdf[r] /= sum;
+    }
+    course_cdf[config.courses - 1] = 1.0;
+
+    for (long r = 0; r < config.courses; r++) {
+        rank_to_course[r] = r + 1;
+    }
+    for (long r = config.courses - 1; r > 0; r--) {
+        long j = next_random(&state) % (r + 1);
+        int tmp = rank_to_course[r];
+        rank_to_course[r] = rank_to_course[j];
+        rank_to_course[j] = tmp;
+    }
+    return 0;
+}
+
+static long parse_count(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+
+    // Accept k/m suffixes, e.g. 1m students, 20k courses
+    if (*end == 'k' || *end == 'K') {
+        value *= 1000;
+    } else if (*end == 'm' || *end == 'M') {
+        value *= 1000000;
+    }
+    return (long)value;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s count     students (default 1000; k/m suffixes accepted)\n"
+            "  -f count     faculty (default 50)\n"
+            "  -c count     courses (default 200)\n"
+            "  -e count     enrollments (default 5000)\n"
+            "  -z skew      Zipf exponent for course popularity, 0 = uniform (default 1.0)\n"
+            "  -m seats     minimum max_seats per course (default 60)\n"
+            "  -j threads   generator threads (default %d)\n"
+            "  -r seed      random seed (default 42)\n"
+            "  -P password  password for generated users (default: accept any)\n"
+            "  -o dir       output directory (default data)\n",
+            program, DEFAULT_THREADS);
+}
+
+int main(int argc, char *argv[]) {
+    char path[512];
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:f:c:e:z:m:j:r:P:o:")) != -1) {
+        switch (opt) {
+            case 's': config.students = parse_count(optarg); break;
+            case 'f': config.faculty = parse_count(optarg); break;
+            case 'c': config.courses = parse_count(optarg); break;
+            case 'e': config.enrollments = parse_count(optarg); break;
+            case 'z': config.skew = atof(optarg); break;
+            case 'm': config.min_seats = atoi(optarg); break;
+            case 'j': config.threads = atoi(optarg); break;
+            case 'r': config.seed = strtoul(optarg, NULL, 10); break;
+            case 'P': config.password = optarg; break;
+            case 'o': config.dir = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if (config.threads < 1 || config.threads > 64) {
+        fprintf(stderr, "Thread count must be between 1 and 64\n");
+        return 1;
+    }
+    if (config.students < 0 || config.faculty < 0 || config.courses < 0 || config.enrollments < 0 ||
+        config.students > 2147483647L || config.courses > 2147483647L) {
+        fprintf(stderr, "Counts must be non-negative and fit record ids\n");
+        return 1;
+    }
+    if (config.enrollments > 0 && (config.students == 0 || config.courses == 0)) {
+        fprintf(stderr, "Enrollments need at least one student and one course\n");
+        return 1;
+    }
+    if (config.students > 0) {
+        long most = (config.enrollments + config.students - 1) / config.students;
+        if (most > config.courses || most >= MAX_PER_STUDENT) {
+            fprintf(stderr, "Cannot give a student %ld distinct courses (courses: %ld, limit: %d)\n",
+                    most, config.courses, MAX_PER_STUDENT - 1);
+            return 1;
+        }
+    }
+
+    mkdir(config.dir, 0755);
+    base_time = time(NULL);
+
+    if (build_course_distribution() < 0) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    // Enrollments are written in the plain record format; sealed segments would shadow them
+    snprintf(path, sizeof(path), "%s/enrollments.seg", config.dir);
+    unlink(path);
+
+    // Faculty rows refer to departments by code; intern them up front so codes are stable
+    snprintf(path, sizeof(path), "%s/departments.dat", config.dir);
+    unlink(path);
+    department_use_file(path);
+    for (size_t i = 0; i < DEPARTMENT_COUNT; i++) {
+        if (department_intern(departments[i], NULL) < 0) {
+            perror(path);
+            return 1;
+        }
+    }
+
+    printf("Generating into %s/ with %d threads (Zipf skew %.2f)\n",
+           config.dir, config.threads, config.skew);
+
+    if (generate_table("students.dat", config.students, sizeof(struct Student),
+                       generate_students, 0, &student_heap) < 0 ||
+        generate_table("faculty.dat", config.faculty, sizeof(struct Faculty),
+                       generate_faculty, 0, &faculty_heap) < 0 ||
+        generate_table("enrollments.dat", config.students, sizeof(struct Enrollment),
+                       generate_enrollments, 1, NULL) < 0 ||
+        generate_table("courses.dat", config.courses, sizeof(struct Course),
+                       generate_courses, 0, NULL) < 0 ||
+        generate_table("credentials.dat", 1 + config.students + config.faculty,
+                       sizeof(struct Credentials), generate_credentials, 0, NULL) < 0) {
+        return 1;
+    }
+
+    if (config.courses > 0) {
+        int busiest = 0;
+        for (long c = 1; c <= config.courses; c++) {
+            if (course_enrolled[c] > course_enrolled[busiest]) {
+                busiest = c;
+            }
+        }
+        printf("Most popular course: %d with %d enrollments\n", busiest, course_enrolled[busiest]);
+    }
+
+    free(course_cdf);
+    free(rank_to_course);
+    free(course_enrolled);
+    return 0;
+}
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include "../common/structures.h"
+#include "../server/enrollment_store.h"
+
+// Offline conversion between the plain enrollments.dat and sealed column segments.
+// Run it with the server stopped: it takes the enrollments lock, but the server's
+// indexes and replicas only learn of the new files when it restarts.
+
+static const char *dir = "data";
+
+static void data_path(char *path, size_t size, const char *name) {
+    snprintf(path, size, "%s/%s", dir, name);
+}
+
+static int write_all(int fd, const void *data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n <= 0) {
+            return -1;
+        }
+        data = (const char *)data + n;
+        length -= n;
+    }
+    return 0;
+}
+
+// Whole contents of a record file; *count receives the number of records
+static struct Enrollment *read_records(int fd, long *count) {
+    struct stat st;
+    struct Enrollment *records;
+    size_t done = 0;
+
+    if (fstat(fd, &st) < 0) {
+        return NULL;
+    }
+    *count = st.st_size / sizeof(struct Enrollment);
+    records = malloc(*count > 0 ? *count * sizeof(struct Enrollment) : 1);
+    while (records && done < *count * sizeof(struct Enrollment)) {
+        ssize_t n = pread(fd, (char *)records + done, *count * sizeof(struct Enrollment) - done, done);
+        if (n <= 0) {
+            free(records);
+            return NULL;
+        }
+        done += n;
+    }
+    return records;
+}
+
+// Copy src to the open dst
+static int copy_file(const char *src, int dst) {
+    char buffer[65536];
+    ssize_t n;
+    int fd = open(src, O_RDONLY);
+
+    if (fd < 0) {
+        return errno == ENOENT ? 0 : -1;
+    }
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0) {
+        if (write_all(dst, buffer, n) < 0) {
+            n = -1;
+            break;
+        }
+    }
+    close(fd);
+    return n < 0 ? -1 : 0;
+}
+
+// Write data to name.tmp and rename it over name
+static int replace_file(const char *name, const void *data, size_t length, const char *prefix_from) {
+    char path[512], tmp[sizeof(path) + 4];     // room for ".tmp" after any path
+    int fd;
+
+    data_path(path, sizeof(path), name);
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    if ((prefix_from && copy_file(prefix_from, fd) < 0) || write_all(fd, data, length) < 0 ||
+        fsync(fd) < 0) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+    close(fd);
+    return rename(tmp, path);
+}
+
+// Move every full segment's worth of tail rows into the segment file
+static int seal(int tail_fd) {
+    char segment_path[512];
+    struct Enrollment *records;
+    char *segments = NULL;
+    size_t segments_length = 0;
+    long count, sealed = 0;
+
+    data_path(segment_path, sizeof(segment_path), "enrollments.seg");
+    records = read_records(tail_fd, &count);
+    if (!records) {
+        perror("read enrollments.dat");
+        return -1;
+    }
+
+    while (count - sealed >= ENROLLMENT_SEGMENT_ROWS) {
+        size_t length;
+        char *encoded = enrollment_segment_encode(records + sealed, ENROLLMENT_SEGMENT_ROWS, &length);
+        char *grown = encoded ? realloc(segments, segments_length + length) : NULL;
+
+        if (!grown) {
+            fprintf(stderr, "Out of memory\n");
+            free(encoded);
+            free(segments);
+            free(records);
+            return -1;
+        }
+        memcpy(grown + segments_length, encoded, length);
+        segments = grown;
+        segments_length += length;
+        sealed += ENROLLMENT_SEGMENT_ROWS;
+        free(encoded);
+    }
+
+    // Segments go in first: a failure in between leaves rows in both files, never in neither
+    if (replace_file("enrollments.seg", segments, segments_length, segment_path) < 0 ||
+        replace_file("enrollments.dat", records + sealed, (count - sealed) * sizeof(struct Enrollment),
+                     NULL) < 0) {
+        perror("write");
+        free(segments);
+        free(records);
+        return -1;
+    }
+    printf("Sealed %ld rows into %ld segments (%zu bytes, %zu as records); %ld rows left in the tail\n",
+           sealed, sealed / ENROLLMENT_SEGMENT_ROWS, segments_length,
+           sealed * sizeof(struct Enrollment), count - sealed);
+    free(segments);
+    free(records);
+    return 0;
+}
+
+// Decode every segment in front of the tail rows and drop the segment file
+static int unseal(int tail_fd) {
+    char segment_path[512];
+    struct Enrollment *records, *all = NULL;
+    long count, total = 0;
+    off_t offset = 0;
+    int segment_fd;
+
+    data_path(segment_path, sizeof(segment_path), "enrollments.seg");
+    segment_fd = open(segment_path, O_RDONLY);
+    if (segment_fd < 0) {
+        printf("No segments to unseal\n");
+        return 0;
+    }
+
+    while (1) {
+        struct Enrollment *rows, *grown;
+        long n = enrollment_segment_read(segment_fd, &offset, &rows);
+
+        if (n <= 0) {
+            if (n < 0) {
+                fprintf(stderr, "Damaged segment at offset %lld\n", (long long)offset);
+                free(all);
+                close(segment_fd);
+                return -1;
+            }
+            break;
+        }
+        grown = realloc(all, (total + n) * sizeof(struct Enrollment));
+        if (!grown) {
+            fprintf(stderr, "Out of memory\n");
+            free(rows);
+            free(all);
+            close(segment_fd);
+            return -1;
+        }
+        memcpy(grown + total, rows, n * sizeof(struct Enrollment));
+        all = grown;
+        total += n;
+        free(rows);
+    }
+    close(segment_fd);
+
+    records = read_records(tail_fd, &count);
+    if (records) {
+        struct Enrollment *grown = realloc(all, (total + count + 1) * sizeof(struct Enrollment));
+        if (grown) {
+            memcpy(grown + total, records, count * sizeof(struct Enrollment));
+            all = grown;
+        }
+        free(records);
+        records = grown;
+    }
+    if (!records || replace_file("enrollments.dat", all, (total + count) * sizeof(struct Enrollment),
+                                 NULL) < 0 || unlink(segment_path) < 0) {
+        perror("unseal");
+        free(all);
+        return -1;
+    }
+    printf("Unsealed %ld rows; enrollments.dat now holds %ld records\n", total, total + count);
+    free(all);
+    return 0;
+}
+
+static int print_stats(int tail_fd) {
+    static const char *names[] = { "enrollment_id", "student_id", "course_id", "enrollment_date" };
+    struct EnrollmentSegmentHeader header;
+    unsigned long long column_bytes[ENROLLMENT_COLUMN_COUNT] = {0};
+    unsigned long long rows = 0;
+    char segment_path[512];
+    struct stat st;
+    off_t offset = 0, segment_size = 0;
+    long segments = 0;
+    int segment_fd;
+
+    data_path(segment_path, sizeof(segment_path), "enrollments.seg");
+    segment_fd = open(segment_path, O_RDONLY);
+    if (segment_fd >= 0 && fstat(segment_fd, &st) == 0) {
+        segment_size = st.st_size;
+        while (pread(segment_fd, &header, sizeof(header), offset) == sizeof(header) &&
+               header.magic == ENROLLMENT_SEGMENT_MAGIC) {
+            offset += sizeof(header);
+            for (int column = 0; column < ENROLLMENT_COLUMN_COUNT; column++) {
+                column_bytes[column] += header.column_bytes[column];
+                offset += header.column_bytes[column];
+            }
+            rows += header.rows;
+            segments++;
+        }
+    }
+    if (segment_fd >= 0) {
+        close(segment_fd);
+    }
+    if (fstat(tail_fd, &st) < 0) {
+        return -1;
+    }
+
+    printf("Segments: %s\n", segment_fd >= 0 ? "enabled" : "disabled (plain enrollments.dat)");
+    printf("Sealed:   %ld segments, %llu rows, %lld bytes (%llu as records, %.1fx)\n",
+           segments, rows, (long long)segment_size, rows * sizeof(struct Enrollment),
+           segment_size > 0 ? (double)(rows * sizeof(struct Enrollment)) / segment_size : 0.0);
+    for (int column = 0; column < ENROLLMENT_COLUMN_COUNT; column++) {
+        printf("  %-16s %12llu bytes  %.2f bytes/row\n", names[column], column_bytes[column],
+               rows > 0 ? (double)column_bytes[column] / rows : 0.0);
+    }
+    printf("Tail:     %lld rows, %lld bytes\n", (long long)(st.st_size / sizeof(struct Enrollment)),
+           (long long)st.st_size);
+    if (offset != segment_size) {
+        printf("Warning: %lld bytes after the last valid segment\n", (long long)(segment_size - offset));
+    }
+    return 0;
+}
+
+static void usage(const char *program) {
+    fprintf(stderr,
+            "Usage: %s [-d dir] seal|unseal|stat\n"
+            "  seal     move enrollments.dat into column segments of %d rows,\n"
+            "           leaving the remainder as the tail; the server seals from then on\n"
+            "  unseal   decode every segment back into a plain enrollments.dat\n"
+            "  stat     segment count and bytes per column\n"
+            "  -d dir   data directory (default data)\n",
+            program, ENROLLMENT_SEGMENT_ROWS);
+}
+
+int main(int argc, char *argv[]) {
+    char tail_path[512];
+    const char *command;
+    int opt, tail_fd, status;
+
+    while ((opt = getopt(argc, argv, "d:")) != -1) {
+        switch (opt) {
+            case 'd': dir = optarg; break;
+            default: usage(argv[0]); return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    command = argv[optind];
+
+    data_path(tail_path, sizeof(tail_path), "enrollments.dat");
+    tail_fd = open(tail_path, O_RDWR | O_CREAT, 0644);
+    if (tail_fd < 0) {
+        perror(tail_path);
+        return 1;
+    }
+    if (flock(tail_fd, LOCK_EX) < 0) {
+        perror("flock");
+        close(tail_fd);
+        return 1;
+    }
+
+    if (strcmp(command, "seal") == 0) {
+        status = seal(tail_fd);
+    } else if (strcmp(command, "unseal") == 0) {
+        status = unseal(tail_fd);
+    } else if (strcmp(command, "stat") == 0) {
+        status = print_stats(tail_fd);
+    } else {
+        usage(argv[0]);
+        status = -1;
+    }
+
+    flock(tail_fd, LOCK_UN);
+    close(tail_fd);
+    return status < 0 ? 1 : 0;
+}